@@ -0,0 +1,52 @@
+#include "allocation_counter.h"
+
+#ifdef COUNT_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// every operator new of the program, for the allocator calls the connpool benchmark reports
+static std::atomic<uint64_t> g_allocations(0);
+static thread_local uint64_t t_allocations = 0;
+
+void* operator new(size_t size) {
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	++t_allocations;
+	if (void* p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+#endif
+
+namespace allocation_counter {
+#ifdef COUNT_ALLOCATIONS
+	bool Enabled() {
+		return true;
+	}
+
+	uint64_t Process() {
+		return g_allocations.load(std::memory_order_relaxed);
+	}
+
+	uint64_t Thread() {
+		return t_allocations;
+	}
+#else
+	bool Enabled() {
+		return false;
+	}
+
+	uint64_t Process() {
+		return 0;
+	}
+
+	uint64_t Thread() {
+		return 0;
+	}
+#endif
+}
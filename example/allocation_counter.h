@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Counts of operator new calls, for benchmarks that report allocations. They are only counted in the
+ * CameraSDKBench target, which is built with COUNT_ALLOCATIONS; the camera app keeps the CRT allocator, it hands
+ * memory across the CameraSDK/MediaSDK DLL boundary and should not pay for a counter on every allocation.
+ */
+namespace allocation_counter {
+	/**
+	 * \return whether this binary counts allocations, the counts below are 0 otherwise
+	 */
+	bool Enabled();
+
+	/**
+	 * \return operator new calls of the whole process so far
+	 */
+	uint64_t Process();
+
+	/**
+	 * \return operator new calls of the calling thread so far
+	 */
+	uint64_t Thread();
+}
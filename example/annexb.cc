@@ -0,0 +1,183 @@
+#include "annexb.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANNEXB_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using ins_camera::VideoEncodeType;
+
+namespace annexb {
+	const uint8_t* FindStartCodeScalar(const uint8_t* begin, const uint8_t* end) {
+		// compressed data is mostly non-zero, so test the third byte first and skip ahead by three
+		for (const uint8_t* p = begin + 2; p < end; ) {
+			if (*p > 1) {
+				p += 3;
+			}
+			else if (*p == 1 && p[-1] == 0 && p[-2] == 0) {
+				return p - 2;
+			}
+			else {
+				++p;
+			}
+		}
+		return end;
+	}
+
+#ifdef ANNEXB_SSE2
+	namespace {
+		inline int LowestBit(unsigned mask) {
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return static_cast<int>(index);
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+	}
+
+	const uint8_t* FindStartCode(const uint8_t* begin, const uint8_t* end) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi8(1);
+		const uint8_t* p = begin;
+		// 16 candidate positions per step: byte i == 0, byte i+1 == 0 and byte i+2 == 1
+		for (; p + 18 <= end; p += 16) {
+			const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+			const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2));
+			const __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, one));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+			if (mask) {
+				return p + LowestBit(mask);
+			}
+		}
+		return FindStartCodeScalar(p, end);
+	}
+#else
+	const uint8_t* FindStartCode(const uint8_t* begin, const uint8_t* end) {
+		return FindStartCodeScalar(begin, end);
+	}
+#endif
+
+	void ForEachNal(const uint8_t* data, size_t size, const std::function<void(const uint8_t* nal, size_t size)>& f) {
+		const uint8_t* end = data + size;
+		const uint8_t* start = FindStartCode(data, end);
+		while (start != end) {
+			const uint8_t* nal = start + 3;
+			const uint8_t* next = FindStartCode(nal, end);
+			const uint8_t* nal_end = next;
+			// the leading zero of a four byte start code, or cabac_zero_words, are not part of the NAL unit
+			while (nal_end > nal && nal_end[-1] == 0) {
+				--nal_end;
+			}
+			if (nal_end > nal) {
+				f(nal, nal_end - nal);
+			}
+			start = next;
+		}
+	}
+
+	int NalType(VideoEncodeType codec, const uint8_t* nal) {
+		return codec == VideoEncodeType::H264 ? (nal[0] & 0x1f) : ((nal[0] >> 1) & 0x3f);
+	}
+
+	bool IsKeyframe(VideoEncodeType codec, int nal_type) {
+		return codec == VideoEncodeType::H264 ? nal_type == 5 : (nal_type >= 16 && nal_type <= 21);
+	}
+
+	bool IsParameterSet(VideoEncodeType codec, int nal_type) {
+		return codec == VideoEncodeType::H264 ? (nal_type == 7 || nal_type == 8) : (nal_type >= 32 && nal_type <= 34);
+	}
+
+	std::string ToRbsp(const uint8_t* nal, size_t size, size_t max_bytes) {
+		std::string rbsp;
+		int zeros = 0;
+		for (size_t i = 0; i < size && rbsp.size() < max_bytes; ++i) {
+			if (zeros >= 2 && nal[i] == 3) {
+				zeros = 0;
+				continue;
+			}
+			zeros = nal[i] == 0 ? zeros + 1 : 0;
+			rbsp += static_cast<char>(nal[i]);
+		}
+		return rbsp;
+	}
+
+	bool IsSlice(VideoEncodeType codec, int nal_type) {
+		return codec == VideoEncodeType::H264 ? (nal_type >= 1 && nal_type <= 5) : nal_type < 32;
+	}
+
+	NalScanner::NalScanner(VideoEncodeType codec, NalCallback callback)
+		: codec_(codec), callback_(callback), position_(0), tail_size_(0), pending_size_(0), pending_offset_(0), pending_(false) {
+	}
+
+	void NalScanner::Found(uint64_t offset, const uint8_t* header, size_t available) {
+		if (available < kHeaderBytes) {
+			pending_ = true;
+			pending_offset_ = offset;
+			pending_size_ = available;
+			for (size_t i = 0; i < available; ++i) {
+				pending_header_[i] = header[i];
+			}
+			return;
+		}
+		const int type = NalType(codec_, header);
+		// first_mb_in_slice == 0 (H.264) and first_slice_segment_in_pic_flag (H.265) are both the top bit after the header
+		const bool first_slice = IsSlice(codec_, type) && (header[codec_ == VideoEncodeType::H264 ? 1 : 2] & 0x80) != 0;
+		callback_(offset, type, first_slice);
+	}
+
+	void NalScanner::Feed(const uint8_t* data, size_t size) {
+		if (size == 0) {
+			return;
+		}
+		size_t used = 0;
+		if (pending_) {
+			while (pending_size_ < kHeaderBytes && used < size) {
+				pending_header_[pending_size_++] = data[used++];
+			}
+			if (pending_size_ == kHeaderBytes) {
+				pending_ = false;
+				Found(pending_offset_, pending_header_, kHeaderBytes);
+			}
+		}
+
+		// start codes that begin in the last two bytes of the previous pieces
+		uint8_t joined[6];
+		size_t joined_size = 0;
+		for (size_t i = 0; i < tail_size_; ++i) {
+			joined[joined_size++] = tail_[i];
+		}
+		for (size_t i = 0; i < size && joined_size < sizeof(joined); ++i) {
+			joined[joined_size++] = data[i];
+		}
+		for (size_t i = tail_size_ > 2 ? tail_size_ - 2 : 0; i < tail_size_ && i + 3 <= joined_size; ++i) {
+			if (joined[i] == 0 && joined[i + 1] == 0 && joined[i + 2] == 1) {
+				const size_t header = i + 3 - tail_size_;
+				const size_t zero = i > 0 && joined[i - 1] == 0 ? 1 : 0;
+				Found(position_ - tail_size_ + i - zero, data + header, size - header);
+			}
+		}
+
+		const uint8_t* end = data + size;
+		for (const uint8_t* start = FindStartCode(data, end); start != end; start = FindStartCode(start + 3, end)) {
+			const bool zero = start > data ? start[-1] == 0 : tail_size_ > 0 && tail_[tail_size_ - 1] == 0;
+			Found(position_ + (start - data) - (zero ? 1 : 0), start + 3, end - start - 3);
+		}
+
+		// keep the last three bytes seen
+		const size_t keep = std::min<size_t>(size, sizeof(tail_));
+		const size_t old = std::min(tail_size_, sizeof(tail_) - keep);
+		memmove(tail_, tail_ + tail_size_ - old, old);
+		memcpy(tail_ + old, end - keep, keep);
+		tail_size_ = old + keep;
+		position_ += size;
+	}
+}
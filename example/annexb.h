@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <camera/ins_types.h>
+
+/**
+ * Helpers for H.264/H.265 Annex-B elementary streams (NAL units separated by 00 00 01 / 00 00 00 01 start codes),
+ * the format the camera delivers to StreamDelegate::OnVideoData.
+ */
+namespace annexb {
+	/**
+	 * \return the first byte of the first 00 00 01 in [begin, end), end if there is none.
+	 *         Uses SSE2 where the compiler targets it, FindStartCodeScalar otherwise.
+	 */
+	const uint8_t* FindStartCode(const uint8_t* begin, const uint8_t* end);
+	const uint8_t* FindStartCodeScalar(const uint8_t* begin, const uint8_t* end);
+
+	/**
+	 * \brief call f(nal, size) for every NAL unit in the buffer, without start codes and trailing zero bytes
+	 */
+	void ForEachNal(const uint8_t* data, size_t size, const std::function<void(const uint8_t* nal, size_t size)>& f);
+
+	int NalType(ins_camera::VideoEncodeType codec, const uint8_t* nal);
+
+	/**
+	 * \brief IDR for H.264, IRAP (BLA/IDR/CRA) for H.265: decoding can start here
+	 */
+	bool IsKeyframe(ins_camera::VideoEncodeType codec, int nal_type);
+
+	/**
+	 * \brief SPS/PPS, and VPS for H.265
+	 */
+	bool IsParameterSet(ins_camera::VideoEncodeType codec, int nal_type);
+
+	/**
+	 * \brief strip emulation prevention bytes (00 00 03 -> 00 00) from the first max_bytes of a NAL unit
+	 */
+	std::string ToRbsp(const uint8_t* nal, size_t size, size_t max_bytes);
+
+	/**
+	 * \brief VCL (slice) NAL unit
+	 */
+	bool IsSlice(ins_camera::VideoEncodeType codec, int nal_type);
+
+	/**
+	 * \class NalScanner
+	 * \brief Finds NAL units in a stream fed in arbitrary pieces, e.g. a file read block by block;
+	 *        start codes and NAL headers split across Feed() calls are found as well.
+	 */
+	class NalScanner {
+	public:
+		/**
+		 * \param offset position of the start code in the stream, including the leading zero of a four byte start code
+		 * \param first_slice for slices: the first slice of a new picture
+		 */
+		typedef std::function<void(uint64_t offset, int nal_type, bool first_slice)> NalCallback;
+
+		NalScanner(ins_camera::VideoEncodeType codec, NalCallback callback);
+
+		void Feed(const uint8_t* data, size_t size);
+
+		uint64_t Position() const {
+			return position_;
+		}
+
+	private:
+		static const size_t kHeaderBytes = 3; // NAL header and the byte holding the first slice flag
+
+		void Found(uint64_t offset, const uint8_t* header, size_t available);
+
+		ins_camera::VideoEncodeType codec_;
+		NalCallback callback_;
+		uint64_t position_;
+		uint8_t tail_[3];            // last three bytes of the previous pieces
+		size_t tail_size_;
+		uint8_t pending_header_[kHeaderBytes]; // header bytes of a NAL whose start code ended a previous piece
+		size_t pending_size_;
+		uint64_t pending_offset_;
+		bool pending_;
+	};
+}
@@ -0,0 +1,13 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "benchmarks.h"
+
+//CameraSDKBench <name> [args...]: run a benchmark that needs no camera
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <benchmark> [args...]" << std::endl;
+		return RunBenchmark("", std::vector<std::string>());
+	}
+	return RunBenchmark(argv[1], std::vector<std::string>(argv + 2, argv + argc));
+}
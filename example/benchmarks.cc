@@ -0,0 +1,2748 @@
+#include "benchmarks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <camera/device_discovery.h>
+#include "allocation_counter.h"
+#include "annexb.h"
+#include "bulk_downloader.h"
+#include "camera_fleet.h"
+#include "camera_state_cache.h"
+#include "file_catalog.h"
+#include "file_util.h"
+#include "http_client.h"
+#include "latency_histogram.h"
+#include "lens_synchronizer.h"
+#include "local_file_server.h"
+#include "preview_hub.h"
+#include "process_usage.h"
+#include "progressive_stitcher.h"
+#include "range_downloader.h"
+#include "simulated_camera.h"
+#include "stitch_cache.h"
+#include "stitch_pool.h"
+#include "storage_offloader.h"
+#include "stream_index.h"
+#include "stream_recorder.h"
+#include "stream_writer.h"
+#include "telemetry_log.h"
+#include "timelapse_ingest.h"
+#include "video_stitch_queue.h"
+
+using namespace std::chrono;
+
+namespace {
+	/**
+	 * runs a cleanup when the scope is left, by any continue, return or exception
+	 */
+	class ScopeExit {
+	public:
+		explicit ScopeExit(std::function<void()> cleanup) : cleanup_(std::move(cleanup)) {
+		}
+		~ScopeExit() {
+			cleanup_();
+		}
+
+		ScopeExit(const ScopeExit&) = delete;
+		ScopeExit& operator=(const ScopeExit&) = delete;
+
+	private:
+		std::function<void()> cleanup_;
+	};
+
+	double SecondsSince(steady_clock::time_point begin) {
+		return duration_cast<microseconds>(steady_clock::now() - begin).count() / 1e6;
+	}
+
+	/**
+	 * output of a stitch benchmark in dir, never next to the input, which may be one of the tracked samples
+	 */
+	std::string StitchedPath(const std::string& dir, const std::string& input, const std::string& tag) {
+		std::string name = input.substr(input.find_last_of("/\\") + 1);
+		return dir + "bench_" + tag + "_" + name.substr(0, name.find('.')) + ".jpg";
+	}
+
+	int ArgInt(const std::vector<std::string>& args, size_t index, int fallback) {
+		return args.size() > index ? std::stoi(args[index]) : fallback;
+	}
+
+	bool WriteTestFile(const std::string& path, uint64_t size, unsigned seed) {
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		std::mt19937 random(seed);
+		std::vector<uint32_t> block(65536 / sizeof(uint32_t));
+		for (uint64_t written = 0; written < size; ) {
+			for (auto& word : block) {
+				word = random();
+			}
+			const size_t n = static_cast<size_t>(std::min<uint64_t>(size - written, block.size() * sizeof(uint32_t)));
+			fwrite(block.data(), 1, n, file);
+			written += n;
+		}
+		fclose(file);
+		return true;
+	}
+
+	/**
+	 * A disk shared by all writers: limited throughput, and once a second it stalls completely for a while
+	 * like a flushing SD card or a busy laptop drive.
+	 */
+	class SlowDisk {
+	public:
+		SlowDisk(double bytes_per_second, int stall_ms)
+			: bytes_per_second_(bytes_per_second), stall_ms_(stall_ms), next_stall_(steady_clock::now() + seconds(1)) {}
+
+		bool Write(FILE* file, const char* data, size_t size) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			const bool ok = fwrite(data, 1, size, file) == size;
+			std::this_thread::sleep_for(microseconds(static_cast<int64_t>(size * 1e6 / bytes_per_second_)));
+			if (steady_clock::now() >= next_stall_) {
+				std::this_thread::sleep_for(milliseconds(stall_ms_));
+				next_stall_ = steady_clock::now() + seconds(1);
+			}
+			return ok;
+		}
+
+	private:
+		std::mutex mutex_;
+		double bytes_per_second_;
+		int stall_ms_;
+		steady_clock::time_point next_stall_;
+	};
+
+	/**
+	 * What the example delegate used to do: fwrite from the stream callback.
+	 */
+	class DirectStreamWriter : public ins_camera::StreamDelegate {
+	public:
+		DirectStreamWriter(SlowDisk& disk, const std::vector<FILE*>& files) : disk_(disk), files_(files) {}
+
+		void OnAudioData(const uint8_t* data, size_t size, int64_t timestamp) override {}
+		void OnVideoData(const uint8_t* data, size_t size, int64_t timestamp, uint8_t streamType, int stream_index) override {
+			disk_.Write(files_[stream_index], reinterpret_cast<const char*>(data), size);
+		}
+		void OnGyroData(const std::vector<ins_camera::GyroData>& data) override {}
+		void OnExposureData(const ins_camera::ExposureData& data) override {}
+
+	private:
+		SlowDisk& disk_;
+		std::vector<FILE*> files_;
+	};
+
+	struct CallbackLatency {
+		std::vector<double> us; // one per OnVideoData call
+		int late_frames = 0;    // frames delivered after the next one was due
+	};
+
+	/**
+	 * Two lenses at 30 fps, about 100 Mbit/s together, delivered from one thread like the SDK's stream callback.
+	 */
+	CallbackLatency ProduceVideo(ins_camera::StreamDelegate& delegate, int seconds_to_run) {
+		const int fps = 30;
+		const size_t frame_size = 768 * 1024;
+		std::vector<uint8_t> frame(frame_size, 0x5a);
+		CallbackLatency latency;
+		const auto interval = microseconds(1000000 / fps);
+		auto due = steady_clock::now();
+		for (int i = 0; i < seconds_to_run * fps; ++i) {
+			std::this_thread::sleep_until(due);
+			for (int lens = 0; lens < 2; ++lens) {
+				const auto begin = steady_clock::now();
+				// a keyframe every second, four times the size of the others
+				const size_t size = i % fps == 0 ? frame_size : frame_size / 4;
+				delegate.OnVideoData(frame.data(), size, i * 1000 / fps, 0, lens);
+				latency.us.push_back(duration_cast<nanoseconds>(steady_clock::now() - begin).count() / 1e3);
+			}
+			due += interval;
+			if (steady_clock::now() > due) {
+				++latency.late_frames;
+			}
+		}
+		return latency;
+	}
+
+	/**
+	 * An H.264 access unit that parses like the camera's: SPS and PPS in front of every IDR, one slice per picture,
+	 * random slice data with emulation prevention so it contains no start codes of its own.
+	 */
+	/**
+	 * Headless WebSocket viewer of the preview, all viewers share one io_context. A slow viewer waits delay_ms
+	 * after every frame. Counts frames that could not be decoded: the first of a lens or one after a gap
+	 * that is not a keyframe.
+	 */
+	class PreviewViewer {
+	public:
+		PreviewViewer(boost::asio::io_context& io, uint16_t port, const std::string& path, int delay_ms)
+			: socket_(io), timer_(io), port_(port), path_(path), delay_ms_(delay_ms), connected(false), frames(0),
+			bytes(0), undecodable(0) {
+			last_timestamp_[0] = last_timestamp_[1] = -1;
+		}
+
+		void Start() {
+			boost::system::error_code ec;
+			socket_.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), port_), ec);
+			if (ec) {
+				return;
+			}
+			request_ = "GET " + path_ + " HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+				"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+			boost::asio::async_write(socket_, boost::asio::buffer(request_), [this](const boost::system::error_code& ec, size_t) {
+				if (ec) {
+					return;
+				}
+				boost::asio::async_read_until(socket_, buffer_, "\r\n\r\n", [this](const boost::system::error_code& ec, size_t size) {
+					if (ec) {
+						return;
+					}
+					buffer_.consume(size);
+					connected = true;
+					ReadHeader();
+				});
+			});
+		}
+
+		std::atomic<bool> connected;
+		std::atomic<uint64_t> frames;
+		std::atomic<uint64_t> bytes;
+		std::atomic<uint64_t> undecodable;
+
+	private:
+		void Need(size_t size, std::function<void()> then) {
+			if (buffer_.size() >= size) {
+				then();
+				return;
+			}
+			boost::asio::async_read(socket_, buffer_, boost::asio::transfer_at_least(size - buffer_.size()),
+				[then](const boost::system::error_code& ec, size_t) {
+				if (!ec) {
+					then();
+				}
+			});
+		}
+
+		void ReadHeader() {
+			Need(2, [this] {
+				const uint8_t* header = boost::asio::buffer_cast<const uint8_t*>(buffer_.data());
+				const size_t length = header[1] & 0x7f;
+				const size_t extra = length == 126 ? 2 : length == 127 ? 8 : 0;
+				Need(2 + extra, [this, length, extra] {
+					const uint8_t* header = boost::asio::buffer_cast<const uint8_t*>(buffer_.data());
+					uint64_t size = length;
+					if (extra) {
+						size = 0;
+						for (size_t i = 0; i < extra; ++i) {
+							size = size << 8 | header[2 + i];
+						}
+					}
+					buffer_.consume(2 + extra);
+					ReadPayload(static_cast<size_t>(size));
+				});
+			});
+		}
+
+		void ReadPayload(size_t size) {
+			Need(size, [this, size] {
+				const uint8_t* message = boost::asio::buffer_cast<const uint8_t*>(buffer_.data());
+				if (size >= PreviewHub::kHeaderSize) {
+					const size_t lens = message[0] & 1;
+					const bool keyframe = (message[1] & 1) != 0;
+					int64_t timestamp = 0;
+					for (int i = 7; i >= 0; --i) {
+						timestamp = timestamp << 8 | message[4 + i];
+					}
+					// frames are 33 ms apart, anything more means frames were skipped
+					if (!keyframe && (last_timestamp_[lens] < 0 || timestamp - last_timestamp_[lens] > 34)) {
+						++undecodable;
+					}
+					last_timestamp_[lens] = timestamp;
+				}
+				buffer_.consume(size);
+				++frames;
+				bytes += size;
+				if (delay_ms_ > 0) {
+					timer_.expires_after(std::chrono::milliseconds(delay_ms_));
+					timer_.async_wait([this](const boost::system::error_code& ec) {
+						if (!ec) {
+							ReadHeader();
+						}
+					});
+				}
+				else {
+					ReadHeader();
+				}
+			});
+		}
+
+		boost::asio::ip::tcp::socket socket_;
+		boost::asio::steady_timer timer_;
+		boost::asio::streambuf buffer_;
+		uint16_t port_;
+		std::string path_;
+		int delay_ms_;
+		std::string request_;
+		int64_t last_timestamp_[2];
+	};
+
+	std::vector<std::string> Split(const std::string& list, char separator) {
+		std::vector<std::string> items;
+		size_t begin = 0;
+		while (begin <= list.size()) {
+			const size_t end = std::min(list.find(separator, begin), list.size());
+			if (end > begin) {
+				items.push_back(list.substr(begin, end - begin));
+			}
+			begin = end + 1;
+		}
+		return items;
+	}
+
+	/**
+	 * key=value arguments, fallback for keys that are not given
+	 */
+	std::string ArgValue(const std::vector<std::string>& args, const std::string& key, const std::string& fallback) {
+		for (const auto& arg : args) {
+			if (arg.compare(0, key.size() + 1, key + "=") == 0) {
+				return arg.substr(key.size() + 1);
+			}
+		}
+		return fallback;
+	}
+
+	const char* StitchTypeName(STITCH_TYPE type) {
+		switch (type) {
+		case STITCH_TYPE::OPTFLOW:
+			return "optflow";
+		case STITCH_TYPE::DYNAMICSTITCH:
+			return "dynamic";
+		default:
+			return "template";
+		}
+	}
+
+	/**
+	 * compare the stages of the cells both runs have, prints every stage that got slower than threshold percent
+	 * \return number of regressions, -1 if the baseline cannot be read
+	 */
+	int CompareLatency(crow::json::rvalue baseline, crow::json::rvalue current, double threshold) {
+		if (!baseline || !baseline.has("cells")) {
+			return -1;
+		}
+		// rvalue's lo() and keys() are not const, hence the copies
+		std::map<std::string, crow::json::rvalue> before;
+		crow::json::rvalue baseline_cells = baseline["cells"];
+		for (const auto& cell : baseline_cells.lo()) {
+			before[cell["key"].s()] = cell["stages"];
+		}
+		int regressions = 0;
+		size_t compared = 0;
+		crow::json::rvalue current_cells = current["cells"];
+		for (const auto& cell : current_cells.lo()) {
+			const auto it = before.find(cell["key"].s());
+			if (it == before.end()) {
+				continue;
+			}
+			++compared;
+			crow::json::rvalue stages = cell["stages"];
+			for (const auto& stage : stages.keys()) {
+				if (!it->second.has(stage)) {
+					continue;
+				}
+				for (const char* metric : { "p50_us", "p99_us" }) {
+					const double old_us = it->second[stage][metric].d();
+					const double new_us = stages[stage][metric].d();
+					const double change = old_us > 0 ? (new_us - old_us) * 100.0 / old_us : 0;
+					if (change > threshold) {
+						++regressions;
+						std::cout << "REGRESSION " << cell["key"].s() << " " << stage << " " << metric << ": " << old_us / 1e3 << " -> "
+							<< new_us / 1e3 << " ms (+" << change << "%)" << std::endl;
+					}
+				}
+			}
+		}
+		std::cout << compared << " cells compared against the baseline, " << regressions << " regressions over " << threshold << "%" << std::endl;
+		return regressions;
+	}
+
+	/**
+	 * what crow::detail::task_timer was before the timing wheel: every deadline in a std::map with its std::function,
+	 * the whole map walked on every tick
+	 */
+	class MapTaskTimer {
+	public:
+		typedef std::function<void()> Task;
+
+		size_t Schedule(const Task& task, steady_clock::time_point now, seconds timeout) {
+			tasks_.insert({ ++highest_id_, { now + timeout, task } });
+			return highest_id_;
+		}
+
+		void Cancel(size_t id) {
+			tasks_.erase(id);
+		}
+
+		void Process(steady_clock::time_point now) {
+			std::vector<size_t> finished;
+			for (const auto& task : tasks_) {
+				if (task.second.first < now) {
+					task.second.second();
+					finished.push_back(task.first);
+				}
+			}
+			for (const auto id : finished) {
+				tasks_.erase(id);
+			}
+			if (tasks_.empty()) {
+				highest_id_ = 0;
+			}
+		}
+
+		size_t Size() const {
+			return tasks_.size();
+		}
+
+	private:
+		std::map<size_t, std::pair<steady_clock::time_point, Task>> tasks_;
+		size_t highest_id_ = 0;
+	};
+
+	struct ConnectionRate {
+		double per_second = 0;
+		int failed = 0;
+		uint64_t client_allocations = 0; // operator new calls of the client threads
+	};
+
+	/**
+	 * One request on a new connection, the response is read until the server closes it.
+	 * \return bytes of the response, 0 on failure
+	 */
+	uint64_t FetchOnce(boost::asio::ip::tcp::socket& socket, const boost::asio::ip::tcp::endpoint& endpoint, const std::string& request) {
+		char buffer[16384];
+		boost::system::error_code ec;
+		socket.connect(endpoint, ec);
+		if (!ec) {
+			boost::asio::write(socket, boost::asio::buffer(request), ec);
+		}
+		uint64_t received = 0;
+		while (!ec) {
+			received += socket.read_some(boost::asio::buffer(buffer), ec);
+		}
+		const bool complete = ec == boost::asio::error::eof;
+		socket.close(ec);
+		return complete ? received : 0;
+	}
+
+	/**
+	 * Each client opens connections one after another, sends one status request on each and reads the response
+	 * until the server closes the connection.
+	 */
+	ConnectionRate OpenShortConnections(const boost::asio::ip::tcp::endpoint& endpoint, int client_count, int connections_per_client) {
+		static const std::string request = "GET /status HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+		std::atomic<int> failed(0);
+		std::atomic<uint64_t> client_allocations(0);
+		std::vector<std::thread> clients;
+		const auto begin = steady_clock::now();
+		for (int c = 0; c < client_count; ++c) {
+			clients.emplace_back([&]() {
+				const uint64_t own_before = allocation_counter::Thread();
+				boost::asio::io_service io;
+				boost::asio::ip::tcp::socket socket(io);
+				for (int i = 0; i < connections_per_client; ++i) {
+					if (FetchOnce(socket, endpoint, request) == 0) {
+						++failed;
+					}
+				}
+				client_allocations += allocation_counter::Thread() - own_before;
+			});
+		}
+		for (auto& client : clients) {
+			client.join();
+		}
+		ConnectionRate rate;
+		rate.per_second = client_count * connections_per_client / SecondsSince(begin);
+		rate.failed = failed;
+		rate.client_allocations = client_allocations;
+		return rate;
+	}
+
+	void PrintLatency(const std::string& label, CallbackLatency latency) {
+		std::sort(latency.us.begin(), latency.us.end());
+		const auto at = [&](double q) { return latency.us[static_cast<size_t>(q * (latency.us.size() - 1))]; };
+		std::cout << label << ": callback p50 " << at(0.5) << " us, p99 " << at(0.99) << " us, max " << latency.us.back()
+			<< " us, late frames " << latency.late_frames << std::endl;
+	}
+}
+
+int RunBenchmark(const std::string& name, const std::vector<std::string>& args) {
+	if (name == "stitch") {
+		return RunStitchBenchmark(args);
+	}
+	if (name == "download") {
+		return RunDownloadBenchmark(args);
+	}
+	if (name == "range") {
+		return RunRangeDownloadBenchmark(args);
+	}
+	if (name == "stream") {
+		return RunStreamWriterBenchmark(args);
+	}
+	if (name == "nal") {
+		return RunNalIndexBenchmark(args);
+	}
+	if (name == "telemetry") {
+		return RunTelemetryBenchmark(args);
+	}
+	if (name == "preview") {
+		return RunPreviewBenchmark(args);
+	}
+	if (name == "sync") {
+		return RunLensSyncBenchmark(args);
+	}
+	if (name == "state") {
+		return RunCameraStateBenchmark(args);
+	}
+	if (name == "fleet") {
+		return RunFleetBenchmark(args);
+	}
+	if (name == "simulated") {
+		return RunSimulatedFleetBenchmark(args);
+	}
+	if (name == "latency") {
+		return RunStitchLatencyBenchmark(args);
+	}
+	if (name == "stitchcache") {
+		return RunStitchCacheBenchmark(args);
+	}
+	if (name == "progressive") {
+		return RunProgressiveStitchBenchmark(args);
+	}
+	if (name == "timelapse") {
+		return RunTimelapseIngestBenchmark(args);
+	}
+	if (name == "catalog") {
+		return RunFileCatalogBenchmark(args);
+	}
+	if (name == "storage") {
+		return RunStorageOffloadBenchmark(args);
+	}
+	if (name == "videostitch") {
+		return RunVideoStitchQueueBenchmark(args);
+	}
+	if (name == "timers") {
+		return RunTaskTimerBenchmark(args);
+	}
+	if (name == "connpool") {
+		return RunConnectionPoolBenchmark(args);
+	}
+	if (name == "acceptors") {
+		return RunAcceptorScalingBenchmark(args);
+	}
+	if (name == "staticfiles") {
+		return RunStaticFileBenchmark(args);
+	}
+	if (name == "bigbody") {
+		return RunLargeBodyBenchmark(args);
+	}
+	std::cerr << "Unknown benchmark: " << name << std::endl;
+	std::cerr << "Available: stitch, download, range, stream, nal, telemetry, preview, sync, state, fleet, simulated, latency, stitchcache, progressive, timelapse, catalog, storage, videostitch, timers, connpool, acceptors, staticfiles, bigbody" << std::endl;
+	return -1;
+}
+
+int RunStitchBenchmark(const std::vector<std::string>& args) {
+	std::vector<std::string> inputs = args;
+	if (inputs.empty()) {
+		inputs = {
+			"../images/IMG_20230221_134844_00_099.jpg",
+			"../images/IMG_20230221_135004_00_100.jpg",
+			"../images/IMG_20230221_135020_00_101.jpg",
+		};
+	}
+	const int rounds = 3;
+	StitchParams params;
+	const std::string dir = "./bench_stitch/";
+	file_util::MakeDirectories(dir);
+	std::set<std::string> outputs;
+	auto output = [&dir, &outputs](const std::string& input, const std::string& tag) {
+		const std::string path = StitchedPath(dir, input, tag);
+		outputs.insert(path);
+		return path;
+	};
+
+	// cold: what options 8 and 14 used to do, a fresh stitcher configured from scratch for every image
+	auto begin = steady_clock::now();
+	int cold_failures = 0;
+	for (int round = 0; round < rounds; ++round) {
+		for (const auto& input : inputs) {
+			std::vector<std::string> input_paths = { input };
+			auto image_stitcher = CreateImageStitcher(params);
+			image_stitcher->SetInputPath(input_paths);
+			image_stitcher->SetOutputPath(output(input, "cold"));
+			cold_failures += image_stitcher->Stitch() ? 0 : 1;
+		}
+	}
+	const double cold = SecondsSince(begin);
+
+	// warm, single worker: same parallelism as cold, only the per-image setup is gone
+	double warm_single = 0;
+	int warm_failures = 0;
+	{
+		StitchWorkerPool pool(1);
+		pool.Warm(params);
+		begin = steady_clock::now();
+		for (int round = 0; round < rounds; ++round) {
+			for (const auto& input : inputs) {
+				warm_failures += pool.Submit(params, { input }, output(input, "warm")).get() ? 0 : 1;
+			}
+		}
+		warm_single = SecondsSince(begin);
+	}
+
+	// warm, one worker per core
+	double warm_pool = 0;
+	size_t workers = 0;
+	{
+		StitchWorkerPool pool;
+		workers = pool.Workers();
+		pool.Warm(params);
+		begin = steady_clock::now();
+		std::vector<std::future<bool>> results;
+		for (int round = 0; round < rounds; ++round) {
+			for (const auto& input : inputs) {
+				results.push_back(pool.Submit(params, { input }, output(input, "pool" + std::to_string(round))));
+			}
+		}
+		for (auto& result : results) {
+			warm_failures += result.get() ? 0 : 1;
+		}
+		warm_pool = SecondsSince(begin);
+	}
+	for (const auto& path : outputs) {
+		file_util::Remove(path);
+	}
+
+	const double images = static_cast<double>(rounds * inputs.size());
+	std::cout << "images: " << images << " (" << inputs.size() << " inputs x " << rounds << " rounds)" << std::endl;
+	std::cout << "cold per image       : " << cold * 1000 / images << " ms/image, total " << cold << " s" << std::endl;
+	std::cout << "warm pool (1 worker) : " << warm_single * 1000 / images << " ms/image, total " << warm_single << " s" << std::endl;
+	std::cout << "warm pool (" << workers << " workers): " << warm_pool * 1000 / images << " ms/image, total " << warm_pool << " s" << std::endl;
+	if (cold_failures || warm_failures) {
+		std::cout << "failures: cold " << cold_failures << ", warm " << warm_failures << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+int RunDownloadBenchmark(const std::vector<std::string>& args) {
+	const int file_count = ArgInt(args, 0, 24);
+	const int max_mb = ArgInt(args, 1, 32);
+	const int concurrency = ArgInt(args, 2, 4);
+
+	// a fake storage card with a spread of file sizes, served like the camera does
+	const std::string card = "bench_download_card/";
+	const std::string card_dir = card + "DCIM/Camera01/";
+	file_util::MakeDirectories(card_dir);
+	std::vector<std::string> remote_files;
+	for (int i = 0; i < file_count; ++i) {
+		const std::string name = "VID_" + std::to_string(i) + ".insv";
+		const uint64_t size = (static_cast<uint64_t>(max_mb) << 20) * (i + 1) / file_count;
+		if (file_util::FileSize(card_dir + name) != static_cast<int64_t>(size)) {
+			WriteTestFile(card_dir + name, size, i);
+		}
+		remote_files.push_back("/DCIM/Camera01/" + name);
+	}
+
+	LocalFileServer server(card);
+	server.Start();
+
+	auto fresh_run = [&](size_t threads, const std::string& local_dir) {
+		for (const auto& remote : remote_files) {
+			file_util::Remove(local_dir + file_util::Basename(remote));
+			file_util::Remove(local_dir + file_util::Basename(remote) + ".part");
+		}
+		file_util::Remove(local_dir + ".download_manifest");
+		BulkDownloadOptions options;
+		options.concurrency = threads;
+		options.local_dir = local_dir;
+		return options;
+	};
+	auto print = [](const std::string& label, const BulkDownloadReport& report) {
+		std::cout << label << ": " << report.downloaded << " downloaded, " << report.skipped << " skipped, "
+			<< report.failed << " failed, " << (report.bytes >> 20) << " MB in " << report.seconds << " s ("
+			<< (report.seconds > 0 ? (report.bytes >> 20) / report.seconds : 0.0) << " MB/s)" << std::endl;
+	};
+
+	const std::string local_dir = "bench_download_offload/";
+	BulkDownloader sequential(server.BaseUrl(), fresh_run(1, local_dir));
+	print("concurrency 1", sequential.Run(remote_files));
+
+	BulkDownloader parallel(server.BaseUrl(), fresh_run(concurrency, local_dir));
+	print("concurrency " + std::to_string(concurrency), parallel.Run(remote_files));
+
+	// simulate a disconnect half way through, then resume from the manifest and the .part files
+	BulkDownloader interrupted(server.BaseUrl(), fresh_run(concurrency, local_dir));
+	std::atomic<int> finished(0);
+	interrupted.SetFileCallback([&](const std::string&, bool, uint64_t) {
+		if (++finished == file_count / 2) {
+			interrupted.Cancel();
+		}
+	});
+	print("interrupted", interrupted.Run(remote_files));
+	BulkDownloadOptions resume_options;
+	resume_options.concurrency = concurrency;
+	resume_options.local_dir = local_dir;
+	BulkDownloader resumed(server.BaseUrl(), resume_options);
+	const auto report = resumed.Run(remote_files);
+	print("resumed", report);
+
+	int corrupt = 0;
+	for (const auto& remote : remote_files) {
+		const std::string name = file_util::Basename(remote);
+		if (file_util::Sha1File(card_dir + name) != file_util::Sha1File(local_dir + name)) {
+			std::cout << "checksum mismatch: " << name << std::endl;
+			++corrupt;
+		}
+	}
+	server.Stop();
+	return corrupt == 0 && report.failed == 0 ? 0 : -1;
+}
+
+int RunRangeDownloadBenchmark(const std::vector<std::string>& args) {
+	const int file_mb = ArgInt(args, 0, 256);
+	const int stream_mb = ArgInt(args, 1, 40);
+	std::vector<size_t> connections;
+	for (size_t i = 2; i < args.size(); ++i) {
+		connections.push_back(std::stoul(args[i]));
+	}
+	if (connections.empty()) {
+		connections = { 1, 2, 4, 8 };
+	}
+
+	const std::string card = "bench_range_card/";
+	const std::string source = card + "VID_large.insv";
+	const uint64_t size = static_cast<uint64_t>(file_mb) << 20;
+	file_util::MakeDirectories(card);
+	if (file_util::FileSize(source) != static_cast<int64_t>(size)) {
+		WriteTestFile(source, size, 7);
+	}
+	const std::string expected = file_util::Sha1File(source);
+	const std::string local = "bench_range_offload/VID_large.insv";
+	file_util::MakeDirectories("bench_range_offload/");
+
+	int failures = 0;
+	auto run = [&](LocalFileServer& server, size_t threads, const std::string& label) {
+		RangeDownloadOptions options;
+		options.connections = threads;
+		RangeDownloader downloader(options);
+		file_util::Remove(local);
+		const auto result = downloader.Download(file_util::JoinUrl(server.BaseUrl(), "VID_large.insv"), local);
+		const bool intact = result.ok && file_util::Sha1File(local) == expected;
+		std::cout << label << ": " << (result.ranged ? "ranged" : "single stream") << ", " << result.connections
+			<< " connections, " << result.chunks << " chunks, " << (result.bytes >> 20) << " MB in " << result.seconds << " s ("
+			<< result.bytes_per_second / (1 << 20) << " MB/s)" << (intact ? "" : " FAILED " + result.error) << std::endl;
+		failures += intact ? 0 : 1;
+	};
+
+	// loopback has no per connection limit, the stream rate stands in for the camera's wifi
+	LocalFileServer server(card);
+	server.SetStreamRate(static_cast<uint64_t>(stream_mb) << 20);
+	server.Start();
+	for (const auto threads : connections) {
+		run(server, threads, "connections " + std::to_string(threads));
+	}
+	server.Stop();
+
+	LocalFileServer no_ranges(card);
+	no_ranges.EnableRanges(false);
+	no_ranges.SetStreamRate(static_cast<uint64_t>(stream_mb) << 20);
+	no_ranges.Start();
+	run(no_ranges, connections.back(), "no range support");
+	no_ranges.Stop();
+	return failures == 0 ? 0 : -1;
+}
+
+int RunStreamWriterBenchmark(const std::vector<std::string>& args) {
+	const int seconds_to_run = ArgInt(args, 0, 5);
+	const int disk_mb = ArgInt(args, 1, 40);
+	const int stall_ms = ArgInt(args, 2, 300);
+	const int ring_mb = ArgInt(args, 3, 16);
+	const std::string dir = "bench_stream/";
+	file_util::MakeDirectories(dir);
+
+	{
+		SlowDisk disk(disk_mb * 1048576.0, stall_ms);
+		std::vector<FILE*> files = { fopen((dir + "direct_01.h264").c_str(), "wb"), fopen((dir + "direct_02.h264").c_str(), "wb") };
+		DirectStreamWriter direct(disk, files);
+		PrintLatency("direct fwrite        ", ProduceVideo(direct, seconds_to_run));
+		for (auto file : files) {
+			fclose(file);
+		}
+	}
+
+	int failures = 0;
+	const struct {
+		OverflowPolicy policy;
+		size_t ring_bytes;
+		const char* label;
+	} variants[] = {
+		{ OverflowPolicy::Block, static_cast<size_t>(ring_mb) << 20, "ring, block          " },
+		{ OverflowPolicy::Block, 2 << 20, "small ring, block    " },
+		{ OverflowPolicy::DropOldest, 2 << 20, "small ring, drop old " },
+		{ OverflowPolicy::DropNewest, 2 << 20, "small ring, drop new " },
+	};
+	for (const auto& variant : variants) {
+		SlowDisk disk(disk_mb * 1048576.0, stall_ms);
+		std::vector<FILE*> files = { fopen((dir + "ring_01.h264").c_str(), "wb"), fopen((dir + "ring_02.h264").c_str(), "wb") };
+		StreamWriterOptions options;
+		options.overflow = variant.policy;
+		options.ring_bytes = variant.ring_bytes;
+		RingStreamWriter writer(2, false, [&](size_t channel, const char* data, size_t size) {
+			return disk.Write(files[channel], data, size);
+		}, options);
+		PrintLatency(variant.label, ProduceVideo(writer, seconds_to_run));
+		writer.Stop();
+		for (auto file : files) {
+			fclose(file);
+		}
+		for (const auto& stats : writer.Stats()) {
+			std::cout << "    " << stats.name << ": " << stats.frames << " frames, " << stats.dropped_frames << " dropped, "
+				<< stats.writes << " writes of " << (stats.writes ? stats.written_bytes / stats.writes / 1024 : 0) << " KB, ring peak "
+				<< stats.ring_peak / 1024 << " of " << stats.ring_capacity / 1024 << " KB, blocked " << stats.blocked_seconds << " s" << std::endl;
+			if (stats.written_bytes + stats.dropped_bytes != stats.bytes) {
+				std::cout << "    lost bytes: " << stats.bytes - stats.written_bytes - stats.dropped_bytes << std::endl;
+				++failures;
+			}
+		}
+	}
+	return failures == 0 ? 0 : -1;
+}
+
+int RunNalIndexBenchmark(const std::vector<std::string>& args) {
+	const int seconds_of_video = ArgInt(args, 0, 120);
+	const int clip_seconds = ArgInt(args, 1, 5);
+	const int fps = 30;
+	const std::string dir = "bench_nal/";
+	file_util::MakeDirectories(dir);
+	int failures = 0;
+
+	// record two lenses through the ring writer with the recorder attached, like the preview stream in main
+	const std::vector<std::string> paths = { dir + "01.h264", dir + "02.h264" };
+	auto begin = steady_clock::now();
+	{
+		std::mt19937 random(1);
+		RingStreamWriter writer(paths);
+		StreamRecorder recorder(paths, ins_camera::VideoEncodeType::H264, 1440, 720);
+		recorder.Attach(writer);
+		for (int i = 0; i < seconds_of_video * fps; ++i) {
+			for (int lens = 0; lens < 2; ++lens) {
+				const std::string unit = SyntheticAccessUnit(random, i % fps == 0, i % fps == 0 ? 400000 : 60000);
+				writer.OnVideoData(reinterpret_cast<const uint8_t*>(unit.data()), unit.size(), i * 1000 / fps, 0, lens);
+			}
+		}
+		writer.Stop();
+		recorder.Close();
+	}
+	const double record_seconds = SecondsSince(begin);
+	const int64_t stream_size = file_util::FileSize(paths[0]);
+	std::cout << "recorded 2 x " << (stream_size >> 20) << " MB in " << record_seconds << " s, index and mp4: "
+		<< file_util::FileSize(StreamRecorder::IndexPath(paths[0])) << " / " << (file_util::FileSize(StreamRecorder::Mp4Path(paths[0])) >> 20)
+		<< " MB per lens" << std::endl;
+
+	// start code scan over the whole stream
+	std::string stream(static_cast<size_t>(stream_size), '\0');
+	FILE* file = fopen(paths[0].c_str(), "rb");
+	stream.resize(fread(&stream[0], 1, stream.size(), file));
+	fclose(file);
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(stream.data());
+	const uint8_t* end = data + stream.size();
+	size_t counts[2] = { 0, 0 };
+	double scan_seconds[2] = { 0, 0 };
+	for (int simd = 0; simd < 2; ++simd) {
+		begin = steady_clock::now();
+		for (const uint8_t* p = data; ; p += 3) {
+			p = simd ? annexb::FindStartCode(p, end) : annexb::FindStartCodeScalar(p, end);
+			if (p == end) {
+				break;
+			}
+			++counts[simd];
+		}
+		scan_seconds[simd] = SecondsSince(begin);
+	}
+	std::cout << "start codes: scalar " << counts[0] << " in " << scan_seconds[0] * 1000 << " ms (" << (stream.size() >> 20) / scan_seconds[0]
+		<< " MB/s), simd " << counts[1] << " in " << scan_seconds[1] * 1000 << " ms (" << (stream.size() >> 20) / scan_seconds[1] << " MB/s)" << std::endl;
+	failures += counts[0] == counts[1] ? 0 : 1;
+
+	// clip from the middle of the recording: sidecar index versus scanning the stream for keyframes
+	const int64_t clip_begin = seconds_of_video / 2 * 1000 + 400;
+	const int64_t clip_end = clip_begin + clip_seconds * 1000;
+	KeyframeIndex index;
+	begin = steady_clock::now();
+	const bool loaded = index.Load(StreamRecorder::IndexPath(paths[0]));
+	const int64_t indexed_clip = ExtractClip(paths[0], index, clip_begin, clip_end, dir + "clip_indexed.h264");
+	const double indexed_seconds = SecondsSince(begin);
+
+	KeyframeIndex scanned;
+	begin = steady_clock::now();
+	scanned.Scan(paths[0], ins_camera::VideoEncodeType::H264);
+	// without timestamps the scan only knows frame numbers
+	const int64_t scanned_clip = ExtractClip(paths[0], scanned, clip_begin * fps / 1000, clip_end * fps / 1000, dir + "clip_scanned.h264");
+	const double scanned_seconds = SecondsSince(begin);
+
+	std::cout << "clip of " << clip_seconds << " s: index " << indexed_seconds * 1000 << " ms (" << index.Entries().size() << " keyframes), full scan "
+		<< scanned_seconds * 1000 << " ms, " << (indexed_clip >> 10) << " KB" << std::endl;
+	bool same = loaded && index.Entries().size() == scanned.Entries().size() && indexed_clip == scanned_clip && indexed_clip > 0;
+	for (size_t i = 0; same && i < index.Entries().size(); ++i) {
+		same = index.Entries()[i].offset == scanned.Entries()[i].offset;
+	}
+	same = same && file_util::Sha1File(dir + "clip_indexed.h264") == file_util::Sha1File(dir + "clip_scanned.h264");
+	if (!same) {
+		std::cout << "index and scan disagree" << std::endl;
+		++failures;
+	}
+	return failures == 0 ? 0 : -1;
+}
+
+int RunTelemetryBenchmark(const std::vector<std::string>& args) {
+	const int seconds = ArgInt(args, 0, 600);
+	const int rate = ArgInt(args, 1, 1000);
+	const size_t batch = static_cast<size_t>(std::max(rate / 100, 1)); // the SDK delivers gyro in small batches
+	const std::string dir = "bench_telemetry/";
+	file_util::MakeDirectories(dir);
+
+	// a slowly moving camera with sensor noise, timestamps in ms with a little jitter
+	std::mt19937 random(1);
+	std::normal_distribution<double> noise(0.0, 0.01);
+	std::vector<ins_camera::GyroData> samples(static_cast<size_t>(seconds) * rate);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		const double t = static_cast<double>(i) / rate;
+		auto& gyro = samples[i];
+		gyro.timestamp = static_cast<int64_t>(i * 1000 / rate) + (random() % 16 == 0 ? 1 : 0);
+		gyro.ax = 0.1 * sin(t) + noise(random);
+		gyro.ay = -0.98 + noise(random);
+		gyro.az = 0.05 * cos(0.5 * t) + noise(random);
+		gyro.gx = 0.3 * sin(2 * t) + noise(random);
+		gyro.gy = 0.2 * cos(t) + noise(random);
+		gyro.gz = noise(random);
+	}
+	std::cout << samples.size() << " gyro samples (" << seconds << " s at " << rate << " Hz, batches of " << batch << ")" << std::endl;
+
+	// what the commented out logging in the old stream delegate did
+	auto begin = steady_clock::now();
+	FILE* text = fopen((dir + "gyro.txt").c_str(), "w");
+	for (const auto& gyro : samples) {
+		fprintf(text, "timestamp:%lld gyro:[%f %f %f] accel:[%f %f %f]\n", static_cast<long long>(gyro.timestamp),
+			gyro.gx, gyro.gy, gyro.gz, gyro.ax, gyro.ay, gyro.az);
+	}
+	fclose(text);
+	const double text_seconds = SecondsSince(begin);
+	const int64_t text_size = file_util::FileSize(dir + "gyro.txt");
+	std::cout << "text:   " << (text_size >> 10) << " KB (" << static_cast<double>(text_size) / samples.size() << " B/sample), "
+		<< text_seconds * 1000 << " ms on the stream thread" << std::endl;
+
+	int failures = 0;
+	std::vector<TelemetryCompression> modes = { TelemetryCompression::None };
+#ifdef TELEMETRY_ENABLE_DEFLATE
+	modes.push_back(TelemetryCompression::Deflate);
+#endif
+	for (auto mode : modes) {
+		const std::string path = dir + (mode == TelemetryCompression::None ? "gyro_raw.tlm" : "gyro_deflate.tlm");
+		TelemetryLogOptions options;
+		options.compression = mode;
+		std::vector<ins_camera::GyroData> chunk;
+		std::vector<double> calls;
+		calls.reserve(samples.size() / batch + 1);
+		TelemetryLogStats stats;
+		begin = steady_clock::now();
+		{
+			TelemetryWriter writer(path, options);
+			for (size_t i = 0; i < samples.size(); i += batch) {
+				chunk.assign(samples.begin() + i, samples.begin() + std::min(samples.size(), i + batch));
+				const auto call = steady_clock::now();
+				writer.AddGyro(chunk);
+				calls.push_back(SecondsSince(call));
+			}
+			writer.Close();
+			stats = writer.Stats();
+		}
+		const double total_seconds = SecondsSince(begin);
+		double callback_seconds = 0;
+		for (double call : calls) {
+			callback_seconds += call;
+		}
+		std::sort(calls.begin(), calls.end());
+		std::cout << (mode == TelemetryCompression::None ? "binary: " : "deflate:") << " " << (stats.file_bytes >> 10) << " KB ("
+			<< static_cast<double>(stats.file_bytes) / samples.size() << " B/sample, " << stats.blocks << " blocks), "
+			<< callback_seconds * 1000 << " ms on the stream thread (p99 call " << calls[calls.size() * 99 / 100] * 1e6
+			<< " us, worst " << calls.back() * 1e6 << " us), "
+			<< total_seconds * 1000 << " ms until closed" << std::endl;
+
+		// one second windows anywhere in the recording
+		TelemetryReader reader;
+		begin = steady_clock::now();
+		const bool opened = reader.Open(path);
+		const double open_seconds = SecondsSince(begin);
+		const int queries = 1000;
+		std::vector<ins_camera::GyroData> found;
+		size_t returned = 0;
+		begin = steady_clock::now();
+		for (int q = 0; q < queries && opened; ++q) {
+			const int64_t from = static_cast<int64_t>(random() % (static_cast<uint32_t>(seconds) * 1000));
+			found.clear();
+			returned += reader.Gyro(from, from + 1000, found);
+		}
+		const double query_seconds = SecondsSince(begin);
+		std::cout << "         open " << open_seconds * 1000 << " ms, 1 s range query " << query_seconds / queries * 1e6
+			<< " us (" << returned / std::max(queries, 1) << " samples)" << std::endl;
+
+		// everything comes back, as float
+		found.clear();
+		bool same = opened && reader.Gyro(INT64_MIN, INT64_MAX, found) == samples.size();
+		for (size_t i = 0; same && i < samples.size(); ++i) {
+			same = found[i].timestamp == samples[i].timestamp && static_cast<float>(samples[i].gx) == found[i].gx
+				&& static_cast<float>(samples[i].az) == found[i].az;
+		}
+		if (!same) {
+			std::cout << "         read back does not match" << std::endl;
+			++failures;
+		}
+	}
+	return failures == 0 ? 0 : -1;
+}
+
+int RunPreviewBenchmark(const std::vector<std::string>& args) {
+	const int viewer_count = ArgInt(args, 0, 100);
+	const int slow_count = std::min(ArgInt(args, 1, 10), viewer_count);
+	const int seconds = ArgInt(args, 2, 10);
+	const int fps = 30;
+	const int slow_delay_ms = 100;
+
+	// two lenses, a 160 KB keyframe every second and 24 KB frames in between, about 2.3 MB/s per viewer
+	std::mt19937 random(1);
+	std::vector<std::string> gop;
+	for (int i = 0; i < fps; ++i) {
+		gop.push_back(SyntheticAccessUnit(random, i == 0, i == 0 ? 160 * 1024 : 24 * 1024));
+	}
+
+	PreviewHub hub(ins_camera::VideoEncodeType::H264);
+	// what the hub replaces: every viewer gets its own copy of every frame, and nothing is ever dropped
+	std::mutex copy_mutex;
+	std::vector<crow::websocket::connection*> copy_viewers;
+
+	crow::SimpleApp app;
+	app.loglevel(crow::LogLevel::Warning);
+	hub.RegisterRoutes(app);
+	CROW_ROUTE(app, "/copy").websocket()
+		.onopen([&](crow::websocket::connection& viewer) {
+		std::lock_guard<std::mutex> lock(copy_mutex);
+		copy_viewers.push_back(&viewer);
+	})
+		.onclose([&](crow::websocket::connection& viewer, const std::string&) {
+		std::lock_guard<std::mutex> lock(copy_mutex);
+		copy_viewers.erase(std::remove(copy_viewers.begin(), copy_viewers.end(), &viewer), copy_viewers.end());
+	});
+	auto server = app.bindaddr("127.0.0.1").port(0).concurrency(4).signal_clear().run_async();
+	app.wait_for_server_start();
+	while (app.port() == 0) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	const uint16_t port = app.port();
+
+	std::cout << viewer_count << " viewers (" << slow_count << " reading one frame per " << slow_delay_ms << " ms), "
+		<< seconds << " s of two lens preview" << std::endl;
+	int failures = 0;
+	for (int copying = 0; copying < 2; ++copying) {
+		boost::asio::io_context io;
+		std::vector<std::unique_ptr<PreviewViewer>> viewers;
+		for (int i = 0; i < viewer_count; ++i) {
+			viewers.emplace_back(new PreviewViewer(io, port, copying ? "/copy" : "/preview", i < slow_count ? slow_delay_ms : 0));
+			viewers.back()->Start();
+		}
+		std::thread client([&io] {
+			auto work = boost::asio::make_work_guard(io);
+			io.run();
+		});
+		const auto connect_deadline = steady_clock::now() + milliseconds(10000);
+		auto subscribed = [&]() -> size_t {
+			if (copying) {
+				std::lock_guard<std::mutex> lock(copy_mutex);
+				return copy_viewers.size();
+			}
+			return hub.Stats().viewers;
+		};
+		while (subscribed() < static_cast<size_t>(viewer_count) && steady_clock::now() < connect_deadline) {
+			std::this_thread::sleep_for(milliseconds(10));
+		}
+
+		std::vector<double> broadcast_us;
+		size_t peak_queued = 0;
+		auto due = steady_clock::now();
+		for (int i = 0; i < seconds * fps; ++i) {
+			std::this_thread::sleep_until(due);
+			due += microseconds(1000000 / fps);
+			for (int lens = 0; lens < 2; ++lens) {
+				const std::string& unit = gop[i % fps];
+				const int64_t timestamp = i * 1000 / fps;
+				const auto begin = steady_clock::now();
+				if (copying) {
+					std::string message(PreviewHub::kHeaderSize, '\0');
+					message[0] = static_cast<char>(lens);
+					message[1] = i % fps == 0 ? 1 : 0;
+					for (int b = 0; b < 8; ++b) {
+						message[4 + b] = static_cast<char>(static_cast<uint64_t>(timestamp) >> (8 * b));
+					}
+					message += unit;
+					std::lock_guard<std::mutex> lock(copy_mutex);
+					for (auto viewer : copy_viewers) {
+						viewer->send_binary(message);
+					}
+				}
+				else {
+					hub.Broadcast(lens, reinterpret_cast<const uint8_t*>(unit.data()), unit.size(), timestamp);
+				}
+				broadcast_us.push_back(duration_cast<nanoseconds>(steady_clock::now() - begin).count() / 1e3);
+			}
+			if (i % fps == fps - 1) {
+				size_t queued = 0;
+				if (copying) {
+					std::lock_guard<std::mutex> lock(copy_mutex);
+					for (auto viewer : copy_viewers) {
+						queued += viewer->queued_bytes();
+					}
+				}
+				else {
+					queued = hub.Stats().queued_bytes;
+				}
+				peak_queued = std::max(peak_queued, queued);
+			}
+		}
+		// let the fast viewers catch up, then hang up on the server
+		std::this_thread::sleep_for(milliseconds(500));
+		io.stop();
+		client.join();
+		uint64_t fast_frames = 0, slow_frames = 0, undecodable_slow = 0, undecodable_fast = 0;
+		for (int i = 0; i < viewer_count; ++i) {
+			(i < slow_count ? slow_frames : fast_frames) += viewers[i]->frames;
+			(i < slow_count ? undecodable_slow : undecodable_fast) += viewers[i]->undecodable;
+		}
+		viewers.clear();
+		std::this_thread::sleep_for(milliseconds(200));
+
+		std::sort(broadcast_us.begin(), broadcast_us.end());
+		double total_us = 0;
+		for (double us : broadcast_us) {
+			total_us += us;
+		}
+		const size_t sent = broadcast_us.size();
+		const int fast_count = viewer_count - slow_count;
+		std::cout << (copying ? "copy per viewer: " : "shared buffer:   ") << "broadcast mean " << total_us / sent << " us, p99 "
+			<< broadcast_us[sent * 99 / 100] << " us per frame, peak queued " << (peak_queued >> 20) << " MB" << std::endl;
+		std::cout << "                 fast viewers got " << (fast_count ? fast_frames / fast_count : 0) << " of " << sent
+			<< " frames, slow viewers " << (slow_count ? slow_frames / slow_count : 0) << " (undecodable: fast " << undecodable_fast
+			<< ", slow " << undecodable_slow << ")";
+		if (!copying) {
+			const auto stats = hub.Stats();
+			std::cout << ", resyncs " << stats.resyncs << ", skipped " << stats.skipped;
+			failures += undecodable_fast + undecodable_slow == 0 ? 0 : 1;
+		}
+		std::cout << std::endl;
+	}
+	app.stop();
+	server.wait();
+	return failures == 0 ? 0 : -1;
+}
+
+int RunLensSyncBenchmark(const std::vector<std::string>& args) {
+	const int seconds = ArgInt(args, 0, 300);
+	const int jitter_ms = ArgInt(args, 1, 2);
+	const int drop_per_mille = ArgInt(args, 2, 20);
+	const int lag_frames = ArgInt(args, 3, 3);
+	const int fps = 30;
+	const int frames = seconds * fps;
+	// the generator runs this much faster than the camera, lens 1 is delivered late in real time too
+	const auto frame_interval = microseconds(2000);
+
+	// the frame number is the payload, so a pair can be checked; lens 1's clock runs 2 ms ahead
+	std::mt19937 random(7);
+	std::normal_distribution<double> jitter(0.0, jitter_ms);
+	std::uniform_int_distribution<int> per_mille(0, 999);
+	std::vector<int64_t> timestamps[2];
+	std::vector<bool> delivered[2];
+	uint64_t expected_pairs = 0;
+	for (int i = 0; i < frames; ++i) {
+		for (int lens = 0; lens < 2; ++lens) {
+			timestamps[lens].push_back(static_cast<int64_t>(std::llround(i * 1000.0 / fps + 2 * lens + jitter(random))));
+			delivered[lens].push_back(per_mille(random) >= drop_per_mille);
+		}
+	}
+	LensSyncOptions options;
+	options.max_pending = static_cast<size_t>(lag_frames) + 8;
+	// a pair is possible when both frames arrive and the jitter left them within tolerance
+	for (int i = 0; i < frames; ++i) {
+		const int64_t skew = timestamps[0][i] - timestamps[1][i];
+		expected_pairs += delivered[0][i] && delivered[1][i] && skew <= options.tolerance && skew >= -options.tolerance ? 1 : 0;
+	}
+
+	std::vector<steady_clock::time_point> pushed[2];
+	pushed[0].resize(frames);
+	pushed[1].resize(frames);
+	std::vector<double> latency_us;
+	latency_us.reserve(frames);
+	uint64_t wrong_pairs = 0;
+	LensSynchronizer sync([&](const LensSynchronizer::LensFrame& lens0, const LensSynchronizer::LensFrame& lens1) {
+		int32_t a, b;
+		memcpy(&a, lens0.data, sizeof(a));
+		memcpy(&b, lens1.data, sizeof(b));
+		if (a != b) {
+			++wrong_pairs;
+			return;
+		}
+		// from the moment the pair was complete
+		const auto complete = std::max(pushed[0][a], pushed[1][a]);
+		latency_us.push_back(duration_cast<nanoseconds>(steady_clock::now() - complete).count() / 1e3);
+	}, options);
+
+	double push_us[2] = { 0, 0 };
+	const auto start = steady_clock::now() + milliseconds(10);
+	auto produce = [&](int lens) {
+		std::mt19937 delay_random(100 + lens);
+		std::vector<uint8_t> frame(16 * 1024, 0x5a);
+		double total_us = 0;
+		for (int32_t i = 0; i < frames; ++i) {
+			// lens 1 lags a random number of frames behind, but never reorders its own frames
+			auto due = start + frame_interval * i;
+			if (lens == 1 && lag_frames > 0) {
+				due += frame_interval * static_cast<int>(delay_random() % (lag_frames + 1));
+			}
+			std::this_thread::sleep_until(due);
+			if (!delivered[lens][i]) {
+				continue;
+			}
+			memcpy(frame.data(), &i, sizeof(i));
+			pushed[lens][i] = steady_clock::now();
+			const auto begin = steady_clock::now();
+			sync.Push(lens, frame.data(), frame.size(), timestamps[lens][i]);
+			total_us += duration_cast<nanoseconds>(steady_clock::now() - begin).count() / 1e3;
+		}
+		push_us[lens] = total_us;
+	};
+	std::thread lens0(produce, 0);
+	std::thread lens1(produce, 1);
+	lens0.join();
+	lens1.join();
+	sync.Stop();
+
+	const auto stats = sync.Stats();
+	std::sort(latency_us.begin(), latency_us.end());
+	std::cout << frames << " frames per lens, jitter " << jitter_ms << " ms, " << drop_per_mille << "/1000 dropped per lens, lens 1 up to "
+		<< lag_frames << " frames late" << std::endl;
+	std::cout << "pairs " << stats.pairs << " of " << expected_pairs << " possible, wrong " << wrong_pairs << ", orphans " << stats.orphans[0]
+		<< " / " << stats.orphans[1] << ", overflows " << stats.overflows[0] << " / " << stats.overflows[1] << std::endl;
+	std::cout << "skew mean " << stats.mean_skew << " ms, min " << stats.min_skew << ", max " << stats.max_skew << ", |skew| p50 "
+		<< stats.p50_abs_skew << " p99 " << stats.p99_abs_skew << std::endl;
+	if (!latency_us.empty()) {
+		std::cout << "push " << (push_us[0] + push_us[1]) / (2.0 * frames) << " us, pair latency p50 " << latency_us[latency_us.size() / 2]
+			<< " us, p99 " << latency_us[latency_us.size() * 99 / 100] << " us" << std::endl;
+	}
+	return wrong_pairs == 0 && stats.pairs == expected_pairs ? 0 : -1;
+}
+
+int RunCameraStateBenchmark(const std::vector<std::string>& args) {
+	const int readers = ArgInt(args, 0, 16);
+	const int seconds = ArgInt(args, 1, 3);
+	const auto round_trip = milliseconds(4);
+
+	// a camera where every query is one USB round trip
+	std::atomic<uint64_t> camera_queries(0);
+	CameraStateQueries queries;
+	queries.capture = [&](ins_camera::CaptureStatus& status) {
+		std::this_thread::sleep_for(round_trip);
+		++camera_queries;
+		status = ins_camera::CaptureStatus::NOT_CAPTURE;
+		return true;
+	};
+	queries.battery = [&](ins_camera::BatteryStatus& status) {
+		std::this_thread::sleep_for(round_trip);
+		++camera_queries;
+		status.power_type = ins_camera::PowerType::BATTERY;
+		status.battery_level = 87;
+		status.battery_scale = 100;
+		return true;
+	};
+	queries.storage = [&](ins_camera::StorageStatus& status) {
+		std::this_thread::sleep_for(round_trip);
+		++camera_queries;
+		status.free_space = 1ull << 34;
+		status.total_space = 1ull << 36;
+		status.state = ins_camera::CardState::STOR_CS_PASS;
+		return true;
+	};
+	queries.settings = [&](ins_camera::CameraFunctionMode, CameraModeSettings& settings) {
+		std::this_thread::sleep_for(round_trip);
+		++camera_queries;
+		settings = CameraModeSettings();
+		settings.iso = 800;
+		return true;
+	};
+
+	// every reader thread reads the battery as fast as it can, like that many polling clients
+	auto read = [&](const std::function<bool()>& one, std::vector<double>& latency_us) {
+		std::vector<std::vector<double>> per_thread(readers);
+		std::vector<std::thread> threads;
+		const auto end = steady_clock::now() + std::chrono::seconds(seconds);
+		for (int t = 0; t < readers; ++t) {
+			threads.emplace_back([&, t]() {
+				while (steady_clock::now() < end) {
+					const auto begin = steady_clock::now();
+					if (!one()) {
+						return;
+					}
+					per_thread[t].push_back(duration_cast<nanoseconds>(steady_clock::now() - begin).count() / 1e3);
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		for (const auto& samples : per_thread) {
+			latency_us.insert(latency_us.end(), samples.begin(), samples.end());
+		}
+		std::sort(latency_us.begin(), latency_us.end());
+	};
+	auto print = [&](const std::string& label, const std::vector<double>& latency_us, uint64_t queries_made) {
+		if (latency_us.empty()) {
+			std::cout << label << ": no reads" << std::endl;
+			return;
+		}
+		std::cout << label << ": " << latency_us.size() / seconds << " reads/s, p50 " << latency_us[latency_us.size() / 2]
+			<< " us, p99 " << latency_us[latency_us.size() * 99 / 100] << " us, max " << latency_us.back() << " us, "
+			<< queries_made << " camera queries" << std::endl;
+	};
+
+	std::cout << readers << " readers, " << round_trip.count() << " ms per camera query" << std::endl;
+	{
+		CameraCommandExecutor executor;
+		std::vector<double> latency_us;
+		const uint64_t before = camera_queries;
+		read([&]() {
+			ins_camera::BatteryStatus status;
+			return executor.Submit([&]() { return queries.battery(status); }).get();
+		}, latency_us);
+		print("executor per read", latency_us, camera_queries - before);
+	}
+
+	CameraCommandExecutor executor;
+	CameraStateCache cache(queries, executor);
+	while (!cache.Snapshot()->Valid(CameraStateEntry::Settings)) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	std::vector<double> latency_us;
+	const uint64_t before = camera_queries;
+	std::atomic<uint64_t> level(0);
+	read([&]() {
+		const auto state = cache.Snapshot();
+		level += state->Valid(CameraStateEntry::Battery) ? state->battery.battery_level : 0;
+		return true;
+	}, latency_us);
+	print("cached snapshot", latency_us, camera_queries - before);
+
+	// Invalidate is what the settings endpoints call after SetExposureSettings / SetCaptureSettings
+	std::vector<double> refresh_ms;
+	for (int i = 0; i < 20; ++i) {
+		const auto begin = steady_clock::now();
+		cache.Invalidate(CameraStateEntry::Settings);
+		while (true) {
+			const auto state = cache.Snapshot();
+			if (!state->Stale(CameraStateEntry::Settings) && state->updated[static_cast<size_t>(CameraStateEntry::Settings)] > begin) {
+				break;
+			}
+			std::this_thread::sleep_for(microseconds(100));
+		}
+		refresh_ms.push_back(duration_cast<microseconds>(steady_clock::now() - begin).count() / 1e3);
+	}
+	std::sort(refresh_ms.begin(), refresh_ms.end());
+	std::cout << "invalidate to refreshed settings: p50 " << refresh_ms[refresh_ms.size() / 2] << " ms, max " << refresh_ms.back()
+		<< " ms (two queries of " << round_trip.count() << " ms)" << std::endl;
+	cache.Stop();
+	executor.Stop();
+	return level > 0 ? 0 : -1;
+}
+
+int RunFleetBenchmark(const std::vector<std::string>& args) {
+	const int cameras = ArgInt(args, 0, 4);
+	const int rounds = ArgInt(args, 1, 20);
+	const auto busy = milliseconds(20);
+
+	SimulatedCameraOptions options;
+	options.storage_dir = "./bench_fleet/";
+	options.latency_ms = 30;
+	options.latency_jitter_ms = 0;
+	options.photo_latency_ms = 0;
+	options.photo_bytes = 64 << 10;
+	CameraFleet fleet(SimulatedCamera::Fleet(cameras, options), CameraFleet::SerialWriters(options.storage_dir));
+	std::vector<CameraCommandExecutor*> executors;
+	for (size_t i = 0; i < fleet.Size(); ++i) {
+		executors.push_back(fleet.At(i).executor.get());
+	}
+	std::mt19937 random(11);
+	const FleetCommand take_photo = [&](size_t index, std::string& detail) {
+		const auto url = fleet.At(index).camera->TakePhoto();
+		detail = url.Empty() ? std::string() : url.GetSingleOrigin();
+		return !url.Empty();
+	};
+
+	struct Totals {
+		double skew_sum = 0;
+		double skew_max = 0;
+		double total_sum = 0;
+		size_t succeeded = 0;
+		void Add(const FleetCommandReport& report) {
+			skew_sum += report.trigger_skew_ms;
+			skew_max = std::max(skew_max, report.trigger_skew_ms);
+			total_sum += report.total_ms;
+			succeeded += report.Succeeded();
+		}
+	};
+	Totals serial, unsynchronized, barrier;
+	for (int round = 0; round < rounds; ++round) {
+		// one control loop: the command goes out camera by camera
+		{
+			FleetCommandReport report;
+			const auto begin = steady_clock::now();
+			for (int i = 0; i < cameras; ++i) {
+				FleetCommandResult result;
+				result.issued = steady_clock::now();
+				result.ok = take_photo(i, result.detail);
+				result.completed = steady_clock::now();
+				report.results.push_back(result);
+			}
+			report.total_ms = duration_cast<microseconds>(steady_clock::now() - begin).count() / 1e3;
+			report.trigger_skew_ms = duration_cast<microseconds>(report.results.back().issued - report.results.front().issued).count() / 1e3;
+			serial.Add(report);
+		}
+		for (int synchronized = 0; synchronized < 2; ++synchronized) {
+			// a camera in the middle of a status query when the command comes in
+			executors[random() % cameras]->Post([busy]() { std::this_thread::sleep_for(busy); });
+			const auto report = FanOut(executors, take_photo, milliseconds(synchronized ? 2000 : 0));
+			(synchronized ? barrier : unsynchronized).Add(report);
+		}
+	}
+
+	std::cout << cameras << " simulated cameras, " << options.latency_ms << " ms per command, one camera busy for " << busy.count()
+		<< " ms, " << rounds << " rounds" << std::endl;
+	const auto print = [&](const std::string& label, const Totals& totals) {
+		std::cout << label << ": trigger skew mean " << totals.skew_sum / rounds << " ms, max " << totals.skew_max
+			<< " ms, all answered after " << totals.total_sum / rounds << " ms, " << totals.succeeded * 1000.0 / totals.total_sum
+			<< " commands/s" << std::endl;
+	};
+	print("control loop      ", serial);
+	print("fan-out           ", unsynchronized);
+	print("fan-out + barrier ", barrier);
+	const bool ok = barrier.succeeded == static_cast<size_t>(cameras * rounds) && barrier.skew_max < 5.0;
+	return ok ? 0 : -1;
+}
+
+int RunSimulatedFleetBenchmark(const std::vector<std::string>& args) {
+	const int cameras = ArgInt(args, 0, 4);
+	const int stream_seconds = ArgInt(args, 1, 5);
+	const int failures_per_mille = ArgInt(args, 2, 20);
+	const int rounds = 6;
+
+	SimulatedCameraOptions options;
+	options.storage_dir = "./bench_simulated/";
+	options.photo_bytes = 16 << 20;
+	options.http_bytes_per_second = 40 << 20;
+	options.failure_rate = failures_per_mille / 1000.0;
+	const auto devices = SimulatedCamera::Fleet(cameras, options);
+	auto begin = steady_clock::now();
+	CameraFleet fleet(devices, CameraFleet::SerialWriters(options.storage_dir));
+	std::cout << fleet.Size() << " of " << cameras << " simulated cameras opened in " << SecondsSince(begin) << " s, "
+		<< failures_per_mille << "/1000 commands fail" << std::endl;
+
+	// photos, all cameras at once
+	size_t photos = 0;
+	double skew_ms = 0;
+	begin = steady_clock::now();
+	for (int round = 0; round < rounds; ++round) {
+		const auto report = fleet.TakePhoto();
+		photos += report.Succeeded();
+		skew_ms = std::max(skew_ms, report.trigger_skew_ms);
+	}
+	std::cout << "photos: " << photos << " of " << rounds * fleet.Size() << " in " << SecondsSince(begin) << " s, trigger skew max "
+		<< skew_ms << " ms" << std::endl;
+
+	// offload every card over its http server, one BulkDownloader per camera
+	begin = steady_clock::now();
+	std::vector<std::future<BulkDownloadReport>> offloads;
+	for (size_t i = 0; i < fleet.Size(); ++i) {
+		auto camera = fleet.At(i).camera;
+		const std::string local_dir = options.storage_dir + "offload_" + fleet.At(i).serial + "/";
+		offloads.push_back(std::async(std::launch::async, [camera, local_dir]() {
+			file_util::MakeDirectories(local_dir);
+			BulkDownloadOptions download_options;
+			download_options.local_dir = local_dir;
+			file_util::Remove(local_dir + ".download_manifest");
+			std::vector<std::string> files;
+			// the listing is a command as well, it may fail like any other
+			for (int attempt = 0; attempt < 3 && files.empty(); ++attempt) {
+				files = camera->GetCameraFilesList();
+			}
+			return BulkDownloader(camera->GetHttpBaseUrl(), download_options).Run(files);
+		}));
+	}
+	size_t downloaded = 0, download_failed = 0;
+	uint64_t download_bytes = 0;
+	for (auto& offload : offloads) {
+		const auto report = offload.get();
+		downloaded += report.downloaded;
+		download_failed += report.failed;
+		download_bytes += report.bytes;
+	}
+	const double offload_seconds = SecondsSince(begin);
+	std::cout << "offload: " << downloaded << " files, " << download_failed << " failed, " << (download_bytes >> 20) << " MB in "
+		<< offload_seconds << " s, " << download_bytes / offload_seconds / (1 << 20) << " MB/s over " << fleet.Size() << " cameras" << std::endl;
+
+	// live stream of every camera
+	ins_camera::LiveStreamParam param;
+	param.video_resolution = ins_camera::VideoResolution::RES_1440_720P30;
+	param.enable_audio = false;
+	const auto started = fleet.Run([&param](CameraDevice& camera, std::string&) { return camera.StartLiveStreaming(param); });
+	std::this_thread::sleep_for(std::chrono::seconds(stream_seconds));
+	fleet.Run([](CameraDevice& camera, std::string&) { return camera.StopLiveStreaming(); });
+	uint64_t frames = 0, stream_bytes = 0, dropped = 0;
+	for (size_t i = 0; i < fleet.Size(); ++i) {
+		fleet.At(i).stream_writer->Stop();
+		for (const auto& channel : fleet.At(i).stream_writer->Stats()) {
+			frames += channel.frames;
+			stream_bytes += channel.written_bytes;
+			dropped += channel.dropped_frames;
+		}
+	}
+	std::cout << "stream: " << started.Succeeded() << " cameras streamed " << frames << " frames, " << (stream_bytes >> 20) << " MB in "
+		<< stream_seconds << " s, " << frames / std::max(stream_seconds, 1) / std::max<size_t>(started.Succeeded() * 2, 1)
+		<< " fps per lens, " << dropped << " dropped" << std::endl;
+
+	uint64_t commands = 0, failures = 0;
+	for (const auto& device : devices) {
+		commands += static_cast<SimulatedCamera&>(*device).Commands();
+		failures += static_cast<SimulatedCamera&>(*device).InjectedFailures();
+	}
+	std::cout << commands << " commands, " << failures << " failed on purpose" << std::endl;
+	fleet.Close();
+	return downloaded == photos && download_failed == 0 && frames > 0 ? 0 : -1;
+}
+
+int RunStitchLatencyBenchmark(const std::vector<std::string>& args) {
+	const int rounds = std::stoi(ArgValue(args, "rounds", "3"));
+	const std::string out_path = ArgValue(args, "out", "stitch_latency.json");
+	const std::string compare_path = ArgValue(args, "compare", "");
+	const double threshold = std::stod(ArgValue(args, "threshold", "10"));
+	const std::string model = ArgValue(args, "model", "");
+	const std::string camera_kind = ArgValue(args, "camera", "sim");
+	const std::string work_dir = "./bench_latency/";
+	auto inputs = Split(ArgValue(args, "inputs", "../images/IMG_20230221_134844_00_099.jpg,../images/IMG_20230221_135004_00_100.jpg,"
+		"../images/IMG_20230221_135020_00_101.jpg"), ',');
+	file_util::MakeDirectories(work_dir);
+
+	std::shared_ptr<CameraDevice> camera;
+	if (camera_kind == "usb") {
+		ins_camera::DeviceDiscovery discovery;
+		auto list = discovery.GetAvailableDevices();
+		if (list.empty()) {
+			std::cerr << "No device found." << std::endl;
+			return -1;
+		}
+		camera = SdkCamera::FromDescriptors(list)[0];
+		const bool opened = camera->Open();
+		discovery.FreeDeviceDescriptors(list);
+		if (!opened) {
+			std::cerr << "Failed to open camera" << std::endl;
+			return -1;
+		}
+	}
+	else {
+		// photos are the sample images, so the stitch stage works on real input
+		SimulatedCameraOptions options;
+		options.storage_dir = work_dir + "card/";
+		options.photo_templates = inputs;
+		camera = std::make_shared<SimulatedCamera>(options);
+		camera->Open();
+	}
+
+	// the matrix
+	std::vector<StitchParams> cells;
+	for (const auto& type : Split(ArgValue(args, "types", "template,dynamic"), ',')) {
+		for (const auto& size : Split(ArgValue(args, "sizes", "1920x960,3840x1920"), ',')) {
+			for (const auto& flowstate : Split(ArgValue(args, "flowstate", "1"), ',')) {
+				for (const auto& denoise : Split(ArgValue(args, "denoise", "1"), ',')) {
+					for (const auto& colorplus : Split(ArgValue(args, "colorplus", "0"), ',')) {
+						StitchParams params;
+						params.stitch_type = type == "optflow" ? STITCH_TYPE::OPTFLOW : type == "dynamic" ? STITCH_TYPE::DYNAMICSTITCH : STITCH_TYPE::TEMPLATE;
+						params.output_width = std::stoi(size);
+						params.output_height = std::stoi(size.substr(size.find('x') + 1));
+						params.enable_flowstate = flowstate == "1";
+						params.enable_denoise = denoise == "1";
+						params.enable_colorplus = colorplus == "1";
+						params.colorplus_model_path = model;
+						if (params.enable_colorplus && model.empty()) {
+							// like option 14: ColorPlus needs its model
+							std::cout << "skipping colorplus=1, no model=" << std::endl;
+							continue;
+						}
+						cells.push_back(params);
+					}
+				}
+			}
+		}
+	}
+
+	static const char* const stage_names[] = { "capture", "transfer", "setup", "stitch", "total" };
+	std::vector<crow::json::wvalue> cell_results;
+	std::cout << "cell                                                stitch p50    p99   total p50    p99   cpu s  peak RSS MB" << std::endl;
+	for (const auto& params : cells) {
+		char key[128];
+		snprintf(key, sizeof(key), "%s_%dx%d_flowstate%d_denoise%d_colorplus%d", StitchTypeName(params.stitch_type), params.output_width,
+			params.output_height, params.enable_flowstate ? 1 : 0, params.enable_denoise ? 1 : 0, params.enable_colorplus ? 1 : 0);
+		LatencyHistogram stages[5];
+		int failures = 0;
+		ProcessUsage::ResetPeakRss();
+		const auto usage_before = ProcessUsage::Now();
+		const auto cell_begin = steady_clock::now();
+		for (int round = 0; round < rounds; ++round) {
+			for (size_t i = 0; i < inputs.size(); ++i) {
+				steady_clock::time_point at[5];
+				at[0] = steady_clock::now();
+				const auto url = camera->TakePhoto();
+				at[1] = steady_clock::now();
+				if (!url.IsSingleOrigin() || url.Empty()) {
+					++failures;
+					continue;
+				}
+				const std::string remote = url.GetSingleOrigin();
+				const std::string name = remote.substr(remote.rfind('/') + 1);
+				const std::string local = work_dir + name.substr(0, name.find('.')) + ".jpg";
+				// the round's files go whether it succeeds or not
+				ScopeExit cleanup([&camera, &local, &remote]() {
+					file_util::Remove(local);
+					camera->DeleteCameraFile(remote);
+				});
+				if (!camera->DownloadCameraFile(remote, local)) {
+					++failures;
+					continue;
+				}
+				at[2] = steady_clock::now();
+				std::vector<std::string> input_paths = { local };
+				auto stitcher = CreateImageStitcher(params);
+				stitcher->SetInputPath(input_paths);
+				stitcher->SetOutputPath(work_dir + "pano_" + key + ".jpg");
+				at[3] = steady_clock::now();
+				const bool stitched = stitcher->Stitch();
+				at[4] = steady_clock::now();
+				if (!stitched) {
+					++failures;
+					continue;
+				}
+				for (int stage = 0; stage < 4; ++stage) {
+					stages[stage].Record(duration_cast<microseconds>(at[stage + 1] - at[stage]).count());
+				}
+				stages[4].Record(duration_cast<microseconds>(at[4] - at[0]).count());
+			}
+		}
+		const double wall = SecondsSince(cell_begin);
+		const auto usage = ProcessUsage::Now();
+		const double cpu = usage.user_seconds - usage_before.user_seconds + usage.system_seconds - usage_before.system_seconds;
+
+		crow::json::wvalue result;
+		result["key"] = key;
+		result["stitch_type"] = StitchTypeName(params.stitch_type);
+		result["output_width"] = params.output_width;
+		result["output_height"] = params.output_height;
+		result["flowstate"] = params.enable_flowstate;
+		result["denoise"] = params.enable_denoise;
+		result["colorplus"] = params.enable_colorplus;
+		result["runs"] = rounds * static_cast<int>(inputs.size());
+		result["failures"] = failures;
+		for (int stage = 0; stage < 5; ++stage) {
+			result["stages"][stage_names[stage]] = stages[stage].ToJson();
+		}
+		result["wall_s"] = wall;
+		result["cpu_user_s"] = usage.user_seconds - usage_before.user_seconds;
+		result["cpu_system_s"] = usage.system_seconds - usage_before.system_seconds;
+		result["peak_rss_bytes"] = usage.peak_rss_bytes;
+		result["rss_bytes"] = usage.rss_bytes;
+		cell_results.push_back(std::move(result));
+
+		printf("%-50s %9.1f %6.1f %9.1f %6.1f %7.2f %9.1f%s\n", key, stages[3].Percentile(0.5) / 1e3, stages[3].Percentile(0.99) / 1e3,
+			stages[4].Percentile(0.5) / 1e3, stages[4].Percentile(0.99) / 1e3, cpu, usage.peak_rss_bytes / 1048576.0,
+			failures > 0 ? "  (failures)" : "");
+		fflush(stdout);
+	}
+	camera->Close();
+
+	crow::json::wvalue report;
+	report["benchmark"] = "stitch_latency";
+	report["camera"] = camera_kind;
+	report["rounds"] = rounds;
+	report["inputs"] = inputs;
+	report["cells"] = std::move(cell_results);
+	const std::string json = report.dump();
+	FILE* file = fopen(out_path.c_str(), "wb");
+	if (!file || fwrite(json.data(), 1, json.size(), file) != json.size()) {
+		std::cerr << "Failed to write " << out_path << std::endl;
+	}
+	if (file) {
+		fclose(file);
+	}
+	std::cout << "results in " << out_path << std::endl;
+
+	if (compare_path.empty()) {
+		return 0;
+	}
+	FILE* baseline_file = fopen(compare_path.c_str(), "rb");
+	std::string baseline;
+	if (baseline_file) {
+		char buffer[65536];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), baseline_file)) > 0) {
+			baseline.append(buffer, n);
+		}
+		fclose(baseline_file);
+	}
+	const int regressions = CompareLatency(crow::json::load(baseline), crow::json::load(json), threshold);
+	if (regressions < 0) {
+		std::cerr << "Cannot read baseline " << compare_path << std::endl;
+	}
+	return regressions == 0 ? 0 : -1;
+}
+
+int RunStitchCacheBenchmark(const std::vector<std::string>& args) {
+	const std::string input = args.size() > 0 ? args[0] : "../images/IMG_20230221_134844_00_099.jpg";
+	const size_t concurrent = static_cast<size_t>(ArgInt(args, 1, 8));
+	const int repeats = ArgInt(args, 2, 20);
+	const std::string dir = "./bench_stitch_cache/";
+	const std::vector<std::string> input_paths = { input };
+	file_util::MakeDirectories(dir);
+	StitchParams params;
+	params.stitch_type = STITCH_TYPE::OPTFLOW;
+	params.output_width = 3840;
+	params.output_height = 1920;
+
+	StitchWorkerPool pool;
+	pool.Warm(params);
+	std::atomic<int> stitches(0);
+	auto stitch = [&pool, &stitches, &params, &input_paths](const std::string& path) {
+		++stitches;
+		return pool.Submit(params, input_paths, path).get();
+	};
+	int failures = 0;
+
+	// what option 8 did before: every request stitches
+	LatencyHistogram uncached;
+	for (int i = 0; i < std::min(repeats, 5); ++i) {
+		const auto begin = steady_clock::now();
+		failures += pool.Submit(params, input_paths, dir + "uncached.jpg").get() ? 0 : 1;
+		uncached.Record(duration_cast<microseconds>(steady_clock::now() - begin).count());
+	}
+
+	file_util::Remove(dir + "index");
+	StitchCacheOptions options;
+	options.dir = dir;
+	{
+		StitchCache cache(options);
+		cache.Load();
+		if (cache.Stats().entries > 0) {
+			std::cerr << "leftover entries in " << dir << std::endl;
+		}
+
+		// identical requests at once, a client retrying while the first stitch runs
+		auto begin = steady_clock::now();
+		std::vector<std::future<bool>> results;
+		for (size_t i = 0; i < concurrent; ++i) {
+			results.push_back(std::async(std::launch::async, [&cache, &params, &input_paths, &stitch, &dir, i]() {
+				return cache.Stitch(params, input_paths, dir + "out_" + std::to_string(i) + ".jpg", stitch);
+			}));
+		}
+		for (auto& result : results) {
+			failures += result.get() ? 0 : 1;
+		}
+		const double burst = SecondsSince(begin);
+		std::cout << concurrent << " identical requests at once: " << burst * 1000 << " ms, " << stitches << " stitch ran, "
+			<< cache.Stats().coalesced << " requests waited for it" << std::endl;
+
+		LatencyHistogram cached;
+		for (int i = 0; i < repeats; ++i) {
+			begin = steady_clock::now();
+			failures += cache.Stitch(params, input_paths, dir + "repeat.jpg", stitch) ? 0 : 1;
+			cached.Record(duration_cast<microseconds>(steady_clock::now() - begin).count());
+		}
+		std::cout << "uncached stitch p50 " << uncached.Percentile(0.5) / 1e3 << " ms, cached repeat p50 " << cached.Percentile(0.5) / 1e3
+			<< " ms, p99 " << cached.Percentile(0.99) / 1e3 << " ms" << std::endl;
+	}
+
+	// a new process: the index brings the panorama back
+	{
+		StitchCache cache(options);
+		cache.Load();
+		const int before = stitches;
+		const auto begin = steady_clock::now();
+		failures += cache.Stitch(params, input_paths, dir + "reopened.jpg", stitch) ? 0 : 1;
+		std::cout << "reopened cache: " << cache.Stats().entries << " entries, request took " << SecondsSince(begin) * 1000 << " ms, "
+			<< (stitches - before) << " stitches" << std::endl;
+		failures += stitches == before ? 0 : 1;
+	}
+
+	// room for two panoramas, four output sizes requested round robin
+	{
+		options.max_bytes = 2 * static_cast<uint64_t>(std::max<int64_t>(file_util::FileSize(dir + "reopened.jpg"), 1));
+		StitchCache cache(options);
+		cache.Load();
+		const int before = stitches;
+		const int widths[] = { 1920, 2560, 3840, 1920, 1920, 2560 };
+		for (int width : widths) {
+			StitchParams sized = params;
+			sized.output_width = width;
+			sized.output_height = width / 2;
+			failures += cache.Stitch(sized, input_paths, dir + "sized.jpg", [&pool, &stitches, &sized, &input_paths](const std::string& path) {
+				++stitches;
+				return pool.Submit(sized, input_paths, path).get();
+			}) ? 0 : 1;
+		}
+		const auto stats = cache.Stats();
+		std::cout << "bounded to " << options.max_bytes << " bytes: " << (stitches - before) << " stitches for " << 6 << " requests, "
+			<< stats.hits << " hits, " << stats.evictions << " evictions, " << stats.entries << " entries, " << stats.bytes << " bytes" << std::endl;
+	}
+
+	if (failures > 0) {
+		std::cout << "failures: " << failures << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+int RunProgressiveStitchBenchmark(const std::vector<std::string>& args) {
+	const int requests = ArgInt(args, 0, 8);
+	const std::string input = args.size() > 1 ? args[1] : "../images/IMG_20230221_134844_00_099.jpg";
+	const std::string dir = "./bench_progressive/";
+	const std::vector<std::string> input_paths = { input };
+	file_util::MakeDirectories(dir);
+	ProgressiveStitchOptions options;
+	int failures = 0;
+
+	StitchWorkerPool pool;
+	pool.Warm(options.full);
+
+	// direct: the client waits for the full resolution stitch
+	LatencyHistogram direct;
+	{
+		const auto begin = steady_clock::now();
+		std::vector<std::future<bool>> results;
+		for (int i = 0; i < requests; ++i) {
+			results.push_back(pool.Submit(options.full, input_paths, dir + "direct_" + std::to_string(i) + ".jpg"));
+		}
+		for (auto& result : results) {
+			failures += result.get() ? 0 : 1;
+			direct.Record(duration_cast<microseconds>(steady_clock::now() - begin).count());
+		}
+	}
+
+	LatencyHistogram preview, full;
+	{
+		ProgressiveStitcher stitcher(pool, options);
+		std::mutex mutex;
+		std::condition_variable cv;
+		int finished = 0;
+		stitcher.AddListener([&](const PanoramaUpdate& update) {
+			std::lock_guard<std::mutex> lock(mutex);
+			const uint64_t us = static_cast<uint64_t>(update.elapsed_ms * 1000);
+			if (update.stage == PanoramaStage::Preview) {
+				preview.Record(us);
+				// the preview must be in place when it is announced
+				failures += file_util::FileSize(update.output_path) > 0 ? 0 : 1;
+				return;
+			}
+			if (update.stage == PanoramaStage::Full) {
+				full.Record(us);
+			}
+			else {
+				++failures;
+			}
+			++finished;
+			cv.notify_all();
+		});
+		for (int i = 0; i < requests; ++i) {
+			stitcher.Submit(input_paths, dir + "progressive_" + std::to_string(i) + ".jpg");
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&]() { return finished == requests; });
+	}
+
+	// a second request for the same output while the first is still stitching, only the newer one is published
+	int superseded = 0;
+	{
+		ProgressiveStitcher stitcher(pool, options);
+		std::atomic<int> published(0);
+		const std::string output = dir + "replaced.jpg";
+		stitcher.Submit(input_paths, output, [&published](const PanoramaUpdate&) { ++published; });
+		std::promise<void> done;
+		stitcher.Submit(input_paths, output, [&done](const PanoramaUpdate& update) {
+			if (update.stage != PanoramaStage::Preview) {
+				done.set_value();
+			}
+		});
+		done.get_future().wait();
+		PanoramaUpdate current;
+		superseded = stitcher.Current(output, current) && current.generation == 2 ? 1 : 0;
+		std::cout << "replaced request: " << published << " updates of generation 1 published, current generation "
+			<< current.generation << " (" << PanoramaStageName(current.stage) << ")" << std::endl;
+	}
+
+	std::cout << requests << " requests, " << pool.Workers() << " workers" << std::endl;
+	std::cout << "direct full resolution   p50 " << direct.Percentile(0.5) / 1e3 << " ms, max " << direct.Max() / 1e3 << " ms" << std::endl;
+	std::cout << "progressive first image  p50 " << preview.Percentile(0.5) / 1e3 << " ms, max " << preview.Max() / 1e3 << " ms" << std::endl;
+	std::cout << "progressive full result  p50 " << full.Percentile(0.5) / 1e3 << " ms, max " << full.Max() / 1e3 << " ms" << std::endl;
+	if (failures > 0 || !superseded) {
+		std::cout << "failures: " << failures << (superseded ? "" : ", older request overwrote the newer one") << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+int RunTimelapseIngestBenchmark(const std::vector<std::string>& args) {
+	const int frames = ArgInt(args, 0, 20);
+	const int interval_ms = ArgInt(args, 1, 300);
+	const std::string input = args.size() > 2 ? args[2] : "../images/IMG_20230221_134844_00_099.jpg";
+	const std::string dir = "./bench_timelapse/";
+	const auto mode = ins_camera::CameraTimelapseMode::TIMELAPSE_INTERVAL_SHOOTING;
+
+	SimulatedCameraOptions camera_options;
+	camera_options.storage_dir = dir + "card/";
+	camera_options.photo_templates = { input };
+	camera_options.latency_ms = 5;
+	camera_options.latency_jitter_ms = 0;
+	camera_options.http_bytes_per_second = 40 << 20;
+	auto cam = std::make_shared<SimulatedCamera>(camera_options);
+	if (!cam->Open()) {
+		std::cerr << "Failed to open the simulated camera" << std::endl;
+		return -1;
+	}
+	CameraCommandExecutor executor;
+	StitchWorkerPool pool;
+	pool.Warm(StitchParams());
+	ins_camera::TimelapseParam param;
+	param.mode = mode;
+	param.duration = 0;
+	param.lapseTime = static_cast<uint32_t>(interval_ms);
+	param.accelerate_fequency = 1;
+	cam->SetTimeLapseOption(param);
+	const auto shooting = std::chrono::milliseconds(interval_ms * frames + interval_ms / 2);
+	int failures = 0;
+
+	// batch: shoot, then download and stitch everything
+	double batch_tail = 0;
+	size_t batch_frames = 0;
+	{
+		cam->StartTimeLapse(mode);
+		std::this_thread::sleep_for(shooting);
+		const auto url = cam->StopTimeLapse(mode);
+		const auto begin = steady_clock::now();
+		BulkDownloadOptions options;
+		options.local_dir = dir + "batch/";
+		BulkDownloader downloader(cam->GetHttpBaseUrl(), options);
+		downloader.Run(url.OriginUrls());
+		std::vector<std::future<bool>> stitched;
+		for (const auto& remote : url.OriginUrls()) {
+			stitched.push_back(pool.Submit(StitchParams(), { downloader.LocalPath(remote) }, StitchedPath(options.local_dir, downloader.LocalPath(remote), "batch")));
+		}
+		for (auto& result : stitched) {
+			failures += result.get() ? 0 : 1;
+		}
+		batch_tail = SecondsSince(begin);
+		batch_frames = url.OriginUrls().size();
+	}
+
+	// streaming: frames are ingested while the camera shoots
+	TimelapseIngestStats stats;
+	{
+		TimelapseIngestOptions options;
+		options.local_dir = dir + "ingest/";
+		options.output_dir = dir + "stitched/";
+		options.poll_interval = std::chrono::milliseconds(std::max(interval_ms / 2, 50));
+		TimelapseIngest ingest(cam, executor, pool, options);
+		ingest.Start();
+		cam->StartTimeLapse(mode);
+		std::this_thread::sleep_for(shooting);
+		const auto url = cam->StopTimeLapse(mode);
+		stats = ingest.Finish(url);
+		failures += static_cast<int>(stats.download_failed + stats.stitch_failed);
+	}
+	executor.Stop();
+	cam->Close();
+
+	std::cout << frames << " frames every " << interval_ms << " ms, " << pool.Workers() << " stitch workers" << std::endl;
+	std::cout << "batch after stop : " << batch_frames << " frames, " << batch_tail << " s from stop to the last stitched frame" << std::endl;
+	std::cout << "streaming ingest : " << stats.stitched << " of " << stats.discovered << " frames, " << stats.pending_at_finish
+		<< " left at stop, " << stats.finish_seconds << " s from stop to the last stitched frame, " << stats.polls << " polls" << std::endl;
+	if (failures > 0 || stats.stitched != stats.discovered || stats.discovered == 0) {
+		std::cout << "failures: " << failures << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+int RunFileCatalogBenchmark(const std::vector<std::string>& args) {
+	const int files = ArgInt(args, 0, 20000);
+	const int changes = ArgInt(args, 1, 20);
+	const std::string dir = "./bench_catalog/";
+	const std::string path = dir + ".catalog";
+	file_util::MakeDirectories(dir);
+	file_util::Remove(path);
+	int failures = 0;
+
+	std::vector<std::string> listing;
+	for (int i = 0; i < files; ++i) {
+		listing.push_back("/DCIM/Camera01/IMG_20230221_" + std::to_string(100000 + i) + "_00_" + std::to_string(i % 1000) + ".insp");
+	}
+
+	FileCatalog catalog(path);
+	catalog.Load();
+	auto begin = steady_clock::now();
+	const auto first = catalog.Sync(listing);
+	const double first_sync = SecondsSince(begin);
+	failures += first.added.size() == listing.size() ? 0 : 1;
+
+	// a few files shot and a few deleted since the last listing
+	for (int i = 0; i < changes; ++i) {
+		listing[i] = "/DCIM/Camera01/VID_20230222_" + std::to_string(100000 + i) + "_00_" + std::to_string(i) + ".insv";
+	}
+	begin = steady_clock::now();
+	const auto diff = catalog.Sync(listing);
+	const double change_sync = SecondsSince(begin);
+	failures += diff.added.size() == static_cast<size_t>(changes) && diff.removed.size() == static_cast<size_t>(changes) ? 0 : 1;
+
+	begin = steady_clock::now();
+	const auto same = catalog.Sync(listing);
+	const double idle_sync = SecondsSince(begin);
+	failures += same.added.empty() && same.removed.empty() ? 0 : 1;
+
+	// every file downloaded and stitched, one line per transition
+	begin = steady_clock::now();
+	for (const auto& remote : listing) {
+		catalog.Transition(remote, CatalogState::Downloading);
+		catalog.Transition(remote, CatalogState::Downloaded, 4 << 20, "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+		catalog.Transition(remote, CatalogState::Stitched);
+	}
+	const double transition_seconds = SecondsSince(begin);
+	const auto before = catalog.Counts();
+	const int64_t log_bytes = file_util::FileSize(path);
+
+	begin = steady_clock::now();
+	FileCatalog reopened(path);
+	reopened.Load();
+	const double load_seconds = SecondsSince(begin);
+	const auto loaded = reopened.Counts();
+	failures += loaded.files[static_cast<size_t>(CatalogState::Stitched)] == static_cast<size_t>(files) ? 0 : 1;
+
+	begin = steady_clock::now();
+	catalog.Compact();
+	const double compact_seconds = SecondsSince(begin);
+	const auto after = catalog.Counts();
+
+	// a crash in the middle of a record: the whole records before it survive
+	catalog.Transition(listing[0], CatalogState::Downloading);
+	{
+		FILE* log = fopen(path.c_str(), "ab");
+		fputs("stitched 4194304 - 1677000000 /DCIM/Camera01/IMG_torn", log);
+		fclose(log);
+	}
+	FileCatalog recovered(path);
+	recovered.Load();
+	CatalogEntry entry;
+	const bool torn_ignored = !recovered.Lookup("/DCIM/Camera01/IMG_torn", entry);
+	const bool last_kept = recovered.Lookup(listing[0], entry) && entry.state == CatalogState::Downloading;
+	const bool rest_kept = recovered.Lookup(listing[1], entry) && entry.state == CatalogState::Stitched;
+	failures += torn_ignored && last_kept && rest_kept ? 0 : 1;
+
+	std::cout << files << " files, " << changes << " added and removed between listings" << std::endl;
+	std::cout << "first sync   : " << first_sync * 1e3 << " ms" << std::endl;
+	std::cout << "changed sync : " << change_sync * 1e3 << " ms, " << diff.added.size() << " added, " << diff.removed.size() << " removed" << std::endl;
+	std::cout << "same listing : " << idle_sync * 1e3 << " ms, nothing written" << std::endl;
+	std::cout << "transitions  : " << 3 * listing.size() << " in " << transition_seconds * 1e3 << " ms" << std::endl;
+	std::cout << "log          : " << before.records << " records, " << (log_bytes >> 10) << " KB" << std::endl;
+	std::cout << "load         : " << load_seconds * 1e3 << " ms" << std::endl;
+	std::cout << "compact      : " << compact_seconds * 1e3 << " ms, " << after.records << " records, "
+		<< (file_util::FileSize(path) >> 10) << " KB" << std::endl;
+	std::cout << "torn tail    : " << (torn_ignored && last_kept && rest_kept ? "ignored" : "NOT recovered") << std::endl;
+	if (failures > 0) {
+		std::cout << "failures: " << failures << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+int RunStorageOffloadBenchmark(const std::vector<std::string>& args) {
+	const int clips = ArgInt(args, 0, 24);
+	const int clip_ms = ArgInt(args, 1, 500);
+	const uint64_t card_bytes = static_cast<uint64_t>(ArgInt(args, 2, 96)) << 20;
+	const std::string dir = "./bench_storage/";
+	// above the 16 MB/s the clips are written at, or no offloading can keep up
+	const uint64_t recording_rate = 32 << 20;
+
+	struct Run {
+		int lost = 0;
+		double max_used = 0;
+		StorageOffloadStats stats;
+		double seconds = 0;
+	};
+	auto record = [&](bool offload) {
+		Run run;
+		SimulatedCameraOptions camera_options;
+		camera_options.storage_dir = dir + (offload ? "offload/" : "plain/");
+		camera_options.storage_bytes = card_bytes;
+		camera_options.video_bytes_per_second = 16 << 20;
+		camera_options.latency_ms = 2;
+		camera_options.latency_jitter_ms = 0;
+		auto cam = std::make_shared<SimulatedCamera>(camera_options);
+		if (!cam->Open()) {
+			run.lost = clips;
+			return run;
+		}
+		CameraCommandExecutor executor;
+		FileCatalog catalog(dir + (offload ? "offload.catalog" : "plain.catalog"));
+		file_util::Remove(dir + (offload ? "offload.catalog" : "plain.catalog"));
+		catalog.Load();
+		StorageOffloadOptions options;
+		options.local_dir = dir + "local/";
+		options.high_water = 0.6;
+		options.low_water = 0.3;
+		options.poll_interval = std::chrono::milliseconds(clip_ms / 4);
+		options.recording_bytes_per_second = recording_rate;
+		StorageOffloader offloader(cam, executor, catalog, options);
+		if (offload) {
+			offloader.Start();
+		}
+		const auto begin = steady_clock::now();
+		for (int i = 0; i < clips; ++i) {
+			cam->StartRecording();
+			std::this_thread::sleep_for(std::chrono::milliseconds(clip_ms));
+			run.lost += cam->StopRecording().Empty() ? 1 : 0;
+			ins_camera::StorageStatus status;
+			if (cam->GetStorageState(status)) {
+				run.max_used = std::max(run.max_used, 1.0 - static_cast<double>(status.free_space) / status.total_space);
+			}
+		}
+		run.seconds = SecondsSince(begin);
+		offloader.Stop();
+		run.stats = offloader.Stats();
+		executor.Stop();
+		cam->Close();
+		return run;
+	};
+
+	const Run plain = record(false);
+	const Run offloaded = record(true);
+
+	std::cout << clips << " clips of " << clip_ms << " ms, " << (card_bytes >> 20) << " MB card" << std::endl;
+	std::cout << "no offload : " << plain.lost << " clips lost, card up to " << plain.max_used * 100 << "%" << std::endl;
+	std::cout << "offload    : " << offloaded.lost << " clips lost, card up to " << offloaded.max_used * 100 << "%, "
+		<< offloaded.stats.offloaded << " files offloaded, " << (offloaded.stats.freed_bytes >> 20) << " MB freed in "
+		<< offloaded.seconds << " s (" << (offloaded.stats.freed_bytes >> 20) / std::max(offloaded.seconds, 1e-3)
+		<< " MB/s, capped at " << (recording_rate >> 20) << " MB/s while recording), " << offloaded.stats.verify_failed
+		<< " verify failures" << std::endl;
+	if (offloaded.lost > 0 || offloaded.stats.verify_failed > 0 || offloaded.stats.delete_failed > 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int RunVideoStitchQueueBenchmark(const std::vector<std::string>& args) {
+	const int job_count = ArgInt(args, 0, 12);
+	const int largest_mb = ArgInt(args, 1, 16);
+	const double seconds_per_mb = ArgInt(args, 2, 40) / 1000.0;
+	const std::string dir = "./bench_video_stitch/";
+	file_util::MakeDirectories(dir);
+
+	// inputs of 1 to largest_mb MB, every fourth job urgent
+	std::vector<std::string> inputs;
+	for (int i = 0; i < job_count; ++i) {
+		inputs.push_back("VID_" + std::to_string(i) + ".insv");
+		if (!WriteTestFile(dir + inputs.back(), static_cast<uint64_t>(1 + i * 7 % largest_mb) << 20, i)) {
+			std::cerr << "Failed to write " << dir + inputs.back() << std::endl;
+			return -1;
+		}
+	}
+
+	VideoStitchQueue queue(SimulatedVideoStitchFactory(seconds_per_mb));
+	std::mutex mutex;
+	std::map<uint64_t, double> predicted;      // ETA at submission, seconds from the start
+	std::map<uint64_t, double> finished_at;
+	std::map<uint64_t, VideoStitchState> final_state;
+	std::vector<uint64_t> start_order;
+	size_t events = 0;
+	const auto begin = steady_clock::now();
+	queue.AddListener([&](const VideoStitchJob& job) {
+		std::lock_guard<std::mutex> lock(mutex);
+		++events;
+		if (job.state == VideoStitchState::Running && job.progress == 0) {
+			start_order.push_back(job.id);
+		}
+		if (job.eta_seconds < 0) {
+			finished_at[job.id] = SecondsSince(begin);
+			final_state[job.id] = job.state;
+		}
+	});
+
+	crow::SimpleApp app;
+	app.loglevel(crow::LogLevel::Warning);
+	queue.RegisterRoutes(app, dir);
+	auto server = app.bindaddr("127.0.0.1").port(0).concurrency(2).signal_clear().run_async();
+	app.wait_for_server_start();
+	while (app.port() == 0) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	const std::string status_url = "http://127.0.0.1:" + std::to_string(app.port()) + "/video/stitch";
+
+	// one job first, so the ETAs are based on a measured rate rather than the initial guess
+	queue.Submit({ dir + inputs[0] }, dir + "calibration.mp4");
+	queue.WaitIdle();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		start_order.clear();
+		finished_at.clear();
+		final_state.clear();
+	}
+
+	// the first job keeps the worker busy while the rest are queued, so the priorities decide the order after it
+	const auto batch_begin = steady_clock::now();
+	std::vector<uint64_t> ids;
+	std::set<uint64_t> urgent;
+	LatencyHistogram submit_us;
+	for (int i = 0; i < job_count; ++i) {
+		const auto submitted = steady_clock::now();
+		const int priority = i % 4 == 3 ? 10 : 0;
+		const uint64_t id = queue.Submit({ dir + inputs[i] }, dir + "stitched_" + std::to_string(i) + ".mp4", priority);
+		submit_us.Record(duration_cast<microseconds>(steady_clock::now() - submitted).count());
+		if (id == 0) {
+			std::cerr << "Queue refused job " << i << std::endl;
+			return -1;
+		}
+		ids.push_back(id);
+		if (priority > 0) {
+			urgent.insert(id);
+		}
+	}
+	for (const auto id : ids) {
+		VideoStitchJob job;
+		if (queue.Job(id, job)) {
+			predicted[id] = SecondsSince(begin) + job.eta_seconds;
+		}
+	}
+	const double queue_eta = queue.Stats().eta_seconds;
+	// one queued and, once it runs, one running job are cancelled
+	const uint64_t cancelled_queued = ids.back();
+	queue.Cancel(cancelled_queued);
+
+	std::atomic<bool> polling(true);
+	LatencyHistogram poll_us;
+	int poll_failures = 0;
+	std::thread poller([&]() {
+		HttpClient client;
+		while (polling) {
+			const auto requested = steady_clock::now();
+			HttpResponseHead head;
+			std::string body;
+			const bool ok = client.Get(status_url, head, [&body](const char* data, size_t size) {
+				body.append(data, size);
+				return true;
+			});
+			poll_us.Record(duration_cast<microseconds>(steady_clock::now() - requested).count());
+			poll_failures += ok && head.status == 200 ? 0 : 1;
+			std::this_thread::sleep_for(milliseconds(5));
+		}
+	});
+
+	uint64_t cancelled_running = 0;
+	for (const auto id : ids) {
+		VideoStitchJob job;
+		while (queue.Job(id, job) && job.state == VideoStitchState::Queued) {
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		if (job.state == VideoStitchState::Running && urgent.count(id) == 0 && id != ids.front()) {
+			std::this_thread::sleep_for(milliseconds(20));
+			queue.Cancel(id);
+			cancelled_running = id;
+			break;
+		}
+	}
+	queue.WaitIdle();
+	const double total = SecondsSince(batch_begin);
+	polling = false;
+	poller.join();
+	app.stop();
+	server.wait();
+
+	int failures = 0;
+	std::lock_guard<std::mutex> lock(mutex);
+	// after the job that was already running, every urgent job starts before any normal one
+	bool normal_started = false;
+	for (size_t i = 1; i < start_order.size(); ++i) {
+		if (urgent.count(start_order[i]) == 0) {
+			normal_started = true;
+		}
+		else if (normal_started) {
+			std::cerr << "urgent job " << start_order[i] << " started after a normal one" << std::endl;
+			++failures;
+		}
+	}
+	double eta_error = 0;
+	int done = 0;
+	for (const auto id : ids) {
+		if (final_state[id] == VideoStitchState::Done) {
+			eta_error += std::abs(finished_at[id] - predicted[id]);
+			++done;
+		}
+		else if (id != cancelled_queued && id != cancelled_running) {
+			std::cerr << "job " << id << " " << VideoStitchStateName(final_state[id]) << std::endl;
+			++failures;
+		}
+	}
+	failures += final_state[cancelled_queued] == VideoStitchState::Cancelled ? 0 : 1;
+	failures += cancelled_running == 0 || final_state[cancelled_running] == VideoStitchState::Cancelled ? 0 : 1;
+	failures += poll_failures;
+
+	std::cout << job_count << " jobs of 1 to " << largest_mb << " MB at " << seconds_per_mb * 1000 << " ms per MB: " << done << " done, 2 cancelled in "
+		<< total << " s (queue ETA at submission " << queue_eta << " s), mean ETA error " << (done ? eta_error / done : 0) << " s, "
+		<< events << " events" << std::endl;
+	std::cout << "Submit p50 " << submit_us.Percentile(0.5) << " us, p99 " << submit_us.Percentile(0.99) << " us; GET /video/stitch while stitching p50 "
+		<< poll_us.Percentile(0.5) / 1e3 << " ms, p99 " << poll_us.Percentile(0.99) / 1e3 << " ms, max " << poll_us.Max() / 1e3 << " ms over "
+		<< poll_us.Count() << " requests" << std::endl;
+	return failures == 0 ? 0 : -1;
+}
+
+int RunTaskTimerBenchmark(const std::vector<std::string>& args) {
+	const int timer_count = ArgInt(args, 0, 100000);
+	const int restarts = ArgInt(args, 1, 1000000);
+	const int ticks = 100;
+	std::mt19937 random(1);
+	std::vector<size_t> order(timer_count);
+	for (int i = 0; i < timer_count; ++i) {
+		order[i] = i;
+	}
+	std::shuffle(order.begin(), order.end(), random);
+
+	// a connection's deadline: closes its socket, here it only counts
+	struct FakeConnection {
+		crow::detail::task_timer::timer_node deadline;
+		size_t map_id = 0;
+		int* fired = nullptr;
+	};
+	int fired = 0;
+	std::vector<FakeConnection> connections(timer_count);
+	for (auto& connection : connections) {
+		connection.fired = &fired;
+		connection.deadline.context = &connection;
+		connection.deadline.fire = [](void* context) {
+			++*static_cast<FakeConnection*>(context)->fired;
+		};
+	}
+
+	std::cout << timer_count << " live connection deadlines of 5 s, " << restarts << " restarts (one per request)" << std::endl;
+	int failures = 0;
+	{
+		MapTaskTimer timer;
+		auto begin = steady_clock::now();
+		for (auto& connection : connections) {
+			connection.map_id = timer.Schedule([&fired]() { ++fired; }, begin, seconds(5));
+		}
+		const double schedule_s = SecondsSince(begin);
+
+		begin = steady_clock::now();
+		for (int i = 0; i < restarts; ++i) {
+			auto& connection = connections[order[i % timer_count]];
+			timer.Cancel(connection.map_id);
+			connection.map_id = timer.Schedule([&fired]() { ++fired; }, begin, seconds(5));
+		}
+		const double restart_s = SecondsSince(begin);
+
+		begin = steady_clock::now();
+		for (int i = 0; i < ticks; ++i) {
+			timer.Process(begin);
+		}
+		const double tick_s = SecondsSince(begin) / ticks;
+
+		fired = 0;
+		begin = steady_clock::now();
+		timer.Process(begin + seconds(6));
+		const double expire_s = SecondsSince(begin);
+		failures += fired == timer_count ? 0 : 1;
+		std::cout << "std::map + std::function: schedule " << schedule_s * 1e9 / timer_count << " ns, restart " << restart_s * 1e9 / restarts
+			<< " ns, idle tick " << tick_s * 1e6 << " us, expire all " << expire_s * 1e3 << " ms" << std::endl;
+	}
+	{
+		boost::asio::io_service io;
+		crow::detail::task_timer timer(io);
+		auto begin = steady_clock::now();
+		for (auto& connection : connections) {
+			timer.schedule(connection.deadline, seconds(5));
+		}
+		const double schedule_s = SecondsSince(begin);
+
+		begin = steady_clock::now();
+		for (int i = 0; i < restarts; ++i) {
+			timer.schedule(connections[order[i % timer_count]].deadline, seconds(5));
+		}
+		const double restart_s = SecondsSince(begin);
+
+		// one resolution step per tick, none due yet
+		begin = steady_clock::now();
+		const auto resolution = timer.get_resolution();
+		for (int i = 0; i < ticks; ++i) {
+			timer.process(begin + resolution * (i % 10));
+		}
+		const double tick_s = SecondsSince(begin) / ticks;
+
+		fired = 0;
+		begin = steady_clock::now();
+		timer.process(begin + seconds(6));
+		const double expire_s = SecondsSince(begin);
+		failures += fired == timer_count && timer.size() == 0 ? 0 : 1;
+		std::cout << "timing wheel:             schedule " << schedule_s * 1e9 / timer_count << " ns, restart " << restart_s * 1e9 / restarts
+			<< " ns, idle tick " << tick_s * 1e6 << " us, expire all " << expire_s * 1e3 << " ms" << std::endl;
+
+	}
+	{
+		// sub-second deadlines fire within one resolution step, on a running io_service
+		boost::asio::io_service io;
+		crow::detail::task_timer timer(io);
+		const auto resolution = timer.get_resolution();
+		const auto timeouts = { milliseconds(150), milliseconds(250), milliseconds(1200) };
+		std::vector<double> late_ms;
+		std::vector<std::unique_ptr<crow::detail::task_timer::timer_node>> nodes;
+		struct Due {
+			steady_clock::time_point due;
+			std::vector<double>* late_ms;
+		};
+		std::vector<Due> dues(timeouts.size());
+		for (const auto timeout : timeouts) {
+			Due& due = dues[nodes.size()];
+			due = Due{ steady_clock::now() + timeout, &late_ms };
+			nodes.emplace_back(new crow::detail::task_timer::timer_node([](void* context) {
+				auto due = static_cast<Due*>(context);
+				due->late_ms->push_back(duration_cast<microseconds>(steady_clock::now() - due->due).count() / 1e3);
+			}, &due));
+			timer.schedule(*nodes.back(), timeout);
+		}
+		io.run_for(std::chrono::milliseconds(1500));
+		std::cout << "sub-second deadlines fired";
+		for (const double late : late_ms) {
+			std::cout << " " << late << " ms";
+			failures += late >= 0 && late <= resolution.count() + 20 ? 0 : 1;
+		}
+		std::cout << " after they were due (resolution " << resolution.count() << " ms)" << std::endl;
+		failures += late_ms.size() == timeouts.size() ? 0 : 1;
+	}
+	return failures == 0 ? 0 : -1;
+}
+
+int RunConnectionPoolBenchmark(const std::vector<std::string>& args) {
+	const int client_count = ArgInt(args, 0, 8);
+	const int connections_per_client = ArgInt(args, 1, 2000);
+	const int rounds = 3;
+
+	std::cout << client_count << " clients, " << connections_per_client << " connections each, one status request per connection" << std::endl;
+	int failures = 0;
+	for (const size_t pool_size : { size_t(0), size_t(128) }) {
+		crow::SimpleApp app;
+		app.loglevel(crow::LogLevel::Warning);
+		CROW_ROUTE(app, "/status")([] {
+			return "{\"recording\":false,\"battery\":87}";
+		});
+		auto server = app.bindaddr("127.0.0.1").port(0).concurrency(4).connection_pool_size(pool_size).signal_clear().run_async();
+		app.wait_for_server_start();
+		while (app.port() == 0) {
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		const auto endpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), app.port());
+
+		double best_rate = 0;
+		double best_allocations = 0;
+		for (int round = 0; round < rounds; ++round) {
+			const uint64_t allocations_before = allocation_counter::Process();
+			const ConnectionRate rate = OpenShortConnections(endpoint, client_count, connections_per_client);
+			// the server's allocations: everything but what the client threads made
+			const double server_allocations = static_cast<double>(allocation_counter::Process() - allocations_before - rate.client_allocations)
+				/ (client_count * connections_per_client);
+			if (round == 0 || rate.per_second > best_rate) {
+				best_rate = rate.per_second;
+				best_allocations = server_allocations;
+			}
+			failures += rate.failed;
+		}
+		app.stop();
+		server.wait();
+		std::cout << (pool_size == 0 ? "new Connection per accept: " : "pooled connections:        ") << static_cast<int>(best_rate)
+			<< " connections/s, ";
+		if (allocation_counter::Enabled()) {
+			std::cout << best_allocations << " server allocations per connection" << std::endl;
+		}
+		else {
+			std::cout << "allocations not counted (build without COUNT_ALLOCATIONS)" << std::endl;
+		}
+	}
+	return failures == 0 ? 0 : -1;
+}
+
+int RunAcceptorScalingBenchmark(const std::vector<std::string>& args) {
+	const int max_workers = ArgInt(args, 0, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+	const int clients_per_worker = ArgInt(args, 1, 4);
+	const int connections_per_client = ArgInt(args, 2, 500);
+
+	struct Mode {
+		const char* name;
+		std::function<crow::load_balancer()> balancer;
+		bool reuse_port;
+	};
+	const std::vector<Mode> modes = {
+		{ "least connections", crow::load_balancers::least_connections, false },
+		{ "power of two", []() { return crow::load_balancers::power_of_two_choices(1); }, false },
+		{ "least active bytes", crow::load_balancers::least_active_bytes, false },
+		{ "SO_REUSEPORT", crow::load_balancers::least_connections, true },
+	};
+
+	std::cout << clients_per_worker << " clients per worker, " << connections_per_client << " connections each, one status request per connection ("
+		<< std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+	std::cout << "workers";
+	for (const auto& mode : modes) {
+		std::cout << " | " << mode.name << " conn/s (x 1 worker)";
+	}
+	std::cout << std::endl;
+	int failures = 0;
+	std::vector<double> single_worker(modes.size(), 0);
+	for (int workers = 1; workers <= max_workers; workers = workers < max_workers ? std::min(workers * 2, max_workers) : workers + 1) {
+		std::cout << workers;
+		for (size_t m = 0; m < modes.size(); ++m) {
+			crow::SimpleApp app;
+			app.loglevel(crow::LogLevel::Warning);
+			CROW_ROUTE(app, "/status")([] {
+				return "{\"recording\":false,\"battery\":87}";
+			});
+			// crow's concurrency counts the thread that accepts besides the workers
+			auto server = app.bindaddr("127.0.0.1").port(0).concurrency(workers + 1).load_balancer(modes[m].balancer())
+				.reuse_port(modes[m].reuse_port).signal_clear().run_async();
+			app.wait_for_server_start();
+			while (app.port() == 0) {
+				std::this_thread::sleep_for(milliseconds(1));
+			}
+			const auto endpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), app.port());
+			const ConnectionRate rate = OpenShortConnections(endpoint, clients_per_worker * workers, connections_per_client);
+			failures += rate.failed;
+			app.stop();
+			server.wait();
+			if (workers == 1) {
+				single_worker[m] = rate.per_second;
+			}
+			std::cout << " | " << static_cast<int>(rate.per_second) << " (x" << rate.per_second / single_worker[m] << ")";
+		}
+		std::cout << std::endl;
+	}
+	return failures == 0 ? 0 : -1;
+}
+
+int RunStaticFileBenchmark(const std::vector<std::string>& args) {
+	const int downloads = ArgInt(args, 0, 4);
+	const int file_mb = ArgInt(args, 1, 64);
+	const int small_clients = ArgInt(args, 2, 2);
+	const int seconds_per_phase = ArgInt(args, 3, 5);
+	const std::string dir = "./bench_static_files/";
+	file_util::MakeDirectories(dir);
+	for (int i = 0; i < downloads; ++i) {
+		if (file_util::FileSize(dir + "pano_" + std::to_string(i) + ".jpg") != static_cast<int64_t>(file_mb) << 20
+			&& !WriteTestFile(dir + "pano_" + std::to_string(i) + ".jpg", static_cast<uint64_t>(file_mb) << 20, i)) {
+			std::cerr << "Failed to write " << dir << "pano_" << i << ".jpg" << std::endl;
+			return -1;
+		}
+	}
+
+	crow::SimpleApp app;
+	app.loglevel(crow::LogLevel::Warning);
+	CROW_ROUTE(app, "/status")([] {
+		return "{\"recording\":false,\"battery\":87}";
+	});
+	CROW_ROUTE(app, "/files/<string>")([&dir](const crow::request&, crow::response& res, std::string name) {
+		// name is one path segment, it cannot leave dir
+		res.set_static_file_info_unsafe(dir + name);
+		res.end();
+	});
+	auto server = app.bindaddr("127.0.0.1").port(0).concurrency(3).signal_clear().run_async();
+	app.wait_for_server_start();
+	while (app.port() == 0) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	const auto endpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), app.port());
+	const std::string status_request = "GET /status HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+
+	std::cout << small_clients << " clients polling /status on 2 workers, alone and while " << downloads << " clients download "
+		<< file_mb << " MB files over and over, " << seconds_per_phase << " s each" << std::endl;
+	int failures = 0;
+	for (const int streams : { 0, downloads }) {
+		std::atomic<bool> stop(false);
+		std::atomic<uint64_t> streamed(0);
+		std::atomic<int> files(0);
+		std::atomic<int> failed(0);
+		std::vector<std::thread> threads;
+		for (int d = 0; d < streams; ++d) {
+			threads.emplace_back([&, d]() {
+				const std::string request = "GET /files/pano_" + std::to_string(d) + ".jpg HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+				boost::asio::io_service io;
+				boost::asio::ip::tcp::socket socket(io);
+				while (!stop) {
+					const uint64_t bytes = FetchOnce(socket, endpoint, request);
+					if (bytes < static_cast<uint64_t>(file_mb) << 20) {
+						++failed;
+					}
+					streamed += bytes;
+					++files;
+				}
+			});
+		}
+		std::mutex mutex;
+		LatencyHistogram latency;
+		for (int c = 0; c < small_clients; ++c) {
+			threads.emplace_back([&]() {
+				boost::asio::io_service io;
+				boost::asio::ip::tcp::socket socket(io);
+				LatencyHistogram own;
+				while (!stop) {
+					const auto begin = steady_clock::now();
+					if (FetchOnce(socket, endpoint, status_request) == 0) {
+						++failed;
+					}
+					own.Record(duration_cast<microseconds>(steady_clock::now() - begin).count());
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				latency.Merge(own);
+			});
+		}
+		const auto begin = steady_clock::now();
+		std::this_thread::sleep_for(seconds(seconds_per_phase));
+		stop = true;
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		const double elapsed = SecondsSince(begin);
+		failures += failed;
+		std::cout << (streams == 0 ? "alone:           " : "while streaming: ") << "/status p50 " << latency.Percentile(0.5) / 1000.0 << " ms, p99 "
+			<< latency.Percentile(0.99) / 1000.0 << " ms, max " << latency.Max() / 1000.0 << " ms, " << static_cast<int>(latency.Count() / elapsed) << " req/s";
+		if (streams > 0) {
+			std::cout << "; files " << streamed / elapsed / (1 << 20) << " MB/s (" << files << " downloads)";
+		}
+		std::cout << std::endl;
+	}
+	app.stop();
+	server.wait();
+	return failures == 0 ? 0 : -1;
+}
+
+int RunLargeBodyBenchmark(const std::vector<std::string>& args) {
+	const int downloads = ArgInt(args, 0, 3);
+	const int largest_mb = ArgInt(args, 1, 100);
+	const size_t piece = 256 << 10;
+	std::string body(static_cast<size_t>(largest_mb) << 20, 0);
+	std::mt19937 random(25);
+	for (auto& c : body) {
+		c = static_cast<char>(random());
+	}
+
+	crow::SimpleApp app;
+	app.loglevel(crow::LogLevel::Warning);
+	CROW_ROUTE(app, "/status")([] {
+		return "{\"recording\":false,\"battery\":87}";
+	});
+	CROW_ROUTE(app, "/body/<uint>")([&body](const crow::request&, crow::response& res, uint64_t mb) {
+		res.body.assign(body, 0, static_cast<size_t>(mb) << 20);
+		res.end();
+	});
+	CROW_ROUTE(app, "/chunked/<uint>")([&body, piece](const crow::request&, crow::response& res, uint64_t mb) {
+		auto stream = res.stream_chunked();
+		res.end();
+		// a few pieces ahead of the client at most, like a stitch that is slower than the network would be
+		const size_t size = static_cast<size_t>(mb) << 20;
+		std::thread([&body, piece, stream, size]() {
+			for (size_t offset = 0; offset < size && stream->is_open(); offset += piece) {
+				while (stream->pending_bytes() > 4 * piece && stream->is_open()) {
+					std::this_thread::sleep_for(microseconds(200));
+				}
+				stream->write(body.substr(offset, std::min(piece, size - offset)));
+			}
+			stream->close();
+		}).detach();
+	});
+	auto server = app.bindaddr("127.0.0.1").port(0).concurrency(2).signal_clear().run_async();
+	app.wait_for_server_start();
+	while (app.port() == 0) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	const auto endpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), app.port());
+	const std::string status_request = "GET /status HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+
+	std::cout << "MB | body ms | body MB/s | chunked ms | chunked MB/s | worst /status ms (best of " << downloads << ")" << std::endl;
+	std::atomic<int> failures(0);
+	for (const int mb : { 10, 25, 50, 100 }) {
+		if (mb > largest_mb) {
+			break;
+		}
+		std::cout << mb;
+		double worst_status = 0;
+		for (const std::string path : { "/body/", "/chunked/" }) {
+			const std::string request = "GET " + path + std::to_string(mb) + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+			double best = 0;
+			for (int d = 0; d < downloads; ++d) {
+				std::atomic<bool> done(false);
+				std::atomic<int64_t> slowest_us(0);
+				std::thread status([&]() {
+					boost::asio::io_service io;
+					boost::asio::ip::tcp::socket socket(io);
+					while (!done) {
+						const auto begin = steady_clock::now();
+						if (FetchOnce(socket, endpoint, status_request) == 0) {
+							++failures;
+						}
+						const int64_t us = duration_cast<microseconds>(steady_clock::now() - begin).count();
+						if (us > slowest_us) {
+							slowest_us = us;
+						}
+					}
+				});
+				boost::asio::io_service io;
+				boost::asio::ip::tcp::socket socket(io);
+				const auto begin = steady_clock::now();
+				const uint64_t bytes = FetchOnce(socket, endpoint, request);
+				const double elapsed = SecondsSince(begin);
+				done = true;
+				status.join();
+				if (bytes < static_cast<uint64_t>(mb) << 20) {
+					++failures;
+				}
+				best = d == 0 ? elapsed : std::min(best, elapsed);
+				worst_status = std::max(worst_status, slowest_us / 1000.0);
+			}
+			std::cout << " | " << best * 1000 << " | " << mb / best;
+		}
+		std::cout << " | " << worst_status << std::endl;
+	}
+	app.stop();
+	server.wait();
+	return failures == 0 ? 0 : -1;
+}
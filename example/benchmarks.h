@@ -0,0 +1,181 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * \brief Benchmarks that run without a camera attached, selected from the command line:
+ *        CameraSDKBench <name> [args...]
+ * \return process exit code
+ */
+int RunBenchmark(const std::string& name, const std::vector<std::string>& args);
+
+/**
+ * \brief cold (new ImageStitcher per image) versus warm StitchWorkerPool stitching.
+ * \param args input images, defaults to the samples in ../images/
+ */
+int RunStitchBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief BulkDownloader against a LocalFileServer: sequential versus parallel, then resume after a cancel.
+ * \param args [file count] [largest file MB] [concurrency]
+ */
+int RunDownloadBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief RangeDownloader on one large file: single stream versus parallel ranges, and the fallback
+ *        against a server without range support, every response capped at the stream rate.
+ * \param args [file MB] [stream MB/s] [connections...]
+ */
+int RunRangeDownloadBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief stream callback latency of a direct fwrite delegate versus RingStreamWriter, writing two synthetic
+ *        video streams to a disk that is slow and stalls periodically.
+ * \param args [seconds] [disk MB/s] [stall ms every second] [ring MB]
+ */
+int RunStreamWriterBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief start code scan speed (SSE2 versus scalar), live indexing and fMP4 remux through RingStreamWriter, and
+ *        clip extraction from the sidecar index versus a full scan, on a synthetic two lens H.264 recording.
+ * \param args [seconds of video] [clip seconds]
+ */
+int RunNalIndexBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief gyro telemetry at kHz rates: text fprintf log versus the columnar TelemetryWriter (size, time spent on the
+ *        stream thread) and time range queries through the memory mapped TelemetryReader.
+ * \param args [seconds of gyro] [rate Hz]
+ */
+int RunTelemetryBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief live preview fan-out to many headless WebSocket viewers: PreviewHub (one shared buffer per frame, slow
+ *        viewers skip to the next keyframe) versus a send_binary copy per viewer without a drop policy.
+ * \param args [viewers] [slow viewers] [seconds]
+ */
+int RunPreviewBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief LensSynchronizer against a synthetic two lens generator: clock offset and jitter between the lenses,
+ *        frames dropped on either lens, and lens 1 delivered late by a few frames from its own thread.
+ *        Checks that every pair holds the same frame of both lenses.
+ * \param args [seconds of video] [timestamp jitter ms] [drop per mille] [lens 1 lag in frames]
+ */
+int RunLensSyncBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief status reads from many clients against a simulated camera with 4 ms round trips: every read queued on
+ *        the command executor versus CameraStateCache snapshots, and how fast an Invalidate is refreshed.
+ * \param args [reader threads] [seconds per mode]
+ */
+int RunCameraStateBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief fan-out TakePhoto over a CameraFleet of SimulatedCameras with 30 ms round trips, one of them busy with a status query
+ *        when the command comes in: one control loop issuing the command camera by camera, FanOut without
+ *        and with the barrier. Reports trigger skew between the cameras and the time until all have answered.
+ * \param args [cameras] [rounds]
+ */
+int RunFleetBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief the capture workload end to end on a CameraFleet of SimulatedCameras: fan-out photos with injected
+ *        command failures, BulkDownloader offloading every camera's card over http at once, and the live
+ *        stream of all cameras into RingStreamWriters.
+ * \param args [cameras] [seconds of streaming] [failures per mille]
+ */
+int RunSimulatedFleetBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief the option 14 flow, TakePhoto -> DownloadCameraFile -> ImageStitcher::Stitch, over a matrix of stitch
+ *        settings. Every cell records a LatencyHistogram per stage, cpu time and peak RSS, and the results are
+ *        written as JSON; given a baseline JSON, cells whose p50 or p99 grew by more than the threshold are
+ *        reported as regressions and the benchmark fails.
+ * \param args key=value, lists comma separated:
+ *        types=template,dynamic,optflow sizes=1920x960,3840x1920 flowstate=0,1 denoise=0,1 colorplus=0,1
+ *        model=<colorplus model> rounds=3 inputs=<images> camera=sim|usb out=stitch_latency.json
+ *        compare=<baseline json> threshold=<percent>
+ */
+int RunStitchLatencyBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief StitchCache in front of a StitchWorkerPool: identical requests arriving together, repeated requests
+ *        against an uncached stitch, a cache reopened from its index and LRU eviction under a small size limit.
+ * \param args [input image] [concurrent identical requests] [repeats]
+ */
+int RunStitchCacheBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief ProgressiveStitcher against stitching the full resolution panorama directly: time until a client has
+ *        a preview and until the full result replaced it, for a burst of requests submitted together.
+ * \param args [requests] [input image]
+ */
+int RunProgressiveStitchBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief interval shooting on a SimulatedCamera, processed by TimelapseIngest while it runs against downloading
+ *        and stitching the whole batch after StopTimeLapse: the time from stopping until every frame is stitched.
+ * \param args [frames] [interval ms] [input image]
+ */
+int RunTimelapseIngestBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief FileCatalog over a large synthetic card: replaying the log, a Sync() in which few files changed against
+ *        the whole listing, a day of state transitions, compaction and a log whose last line was cut off.
+ * \param args [files] [changed files per sync]
+ */
+int RunFileCatalogBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief a SimulatedCamera with a small card recording clip after clip, without and with a StorageOffloader:
+ *        clips lost to a full card, the highest card usage, files offloaded and the transfer rate while recording.
+ * \param args [clips] [clip ms] [card MB]
+ */
+int RunStorageOffloadBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief VideoStitchQueue with simulated stitches behind a crow app: every fourth job urgent, one queued and one
+ *        running job cancelled, a client polling GET /video/stitch meanwhile. Checks the priority order and reports
+ *        the ETA error, Submit time and the status latency while stitching.
+ * \param args [jobs] [largest input MB] [simulated ms per MB]
+ */
+int RunVideoStitchQueueBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief crow's connection deadlines: the old std::map + std::function task timer versus the timing wheel with
+ *        timers embedded in the connection, with many live timers: schedule, restart (cancel and schedule, once per
+ *        request), an idle tick and expiring them all, then sub-second deadlines on a running io_service.
+ * \param args [live timers] [restarts]
+ */
+int RunTaskTimerBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief short-lived clients against a crow app, one status request per connection: connections per second and
+ *        the server's allocator calls per connection, with a new Connection for every accept and with the
+ *        per-worker pool of recycled ones.
+ * \param args [clients] [connections per client]
+ */
+int RunConnectionPoolBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief short-lived clients against crow apps of 1 to N workers: connections per second with one acceptor thread
+ *        and each load balancer, and with an SO_REUSEPORT acceptor per worker, relative to a single worker.
+ * \param args [max workers] [clients per worker] [connections per client]
+ */
+int RunAcceptorScalingBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief crow's static file responses: latency and rate of small status requests on new connections, alone and
+ *        while other clients download large files over and over, and the download throughput meanwhile.
+ * \param args [downloading clients] [file MB] [status clients] [seconds per phase]
+ */
+int RunStaticFileBenchmark(const std::vector<std::string>& args);
+
+/**
+ * \brief crow's large responses, a body set at once and the same bytes pushed by a producer thread as chunks:
+ *        download time and throughput for bodies of 10 to 100 MB, and the worst status request meanwhile.
+ * \param args [downloads per size] [largest MB]
+ */
+int RunLargeBodyBenchmark(const std::vector<std::string>& args);
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/**
+ * \class BoundedQueue
+ * \brief Fixed capacity lock-free multi-producer/multi-consumer queue (Vyukov's bounded MPMC ring).
+ *        Capacity is rounded up to a power of two. TryPush/TryPop never block; callers choose how
+ *        to wait when the queue is full or empty.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : mask_(RoundUp(capacity) - 1), cells_(new Cell[mask_ + 1]) {
+		for (size_t i = 0; i <= mask_; ++i) {
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueue_pos_.store(0, std::memory_order_relaxed);
+		dequeue_pos_.store(0, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	/**
+	 * \brief value is moved from only when the push succeeds
+	 */
+	bool TryPush(T&& value) {
+		Cell* cell;
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		while (true) {
+			cell = &cells_[pos & mask_];
+			const size_t seq = cell->sequence.load(std::memory_order_acquire);
+			const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		cell->value = std::move(value);
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool TryPop(T& value) {
+		Cell* cell;
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		while (true) {
+			cell = &cells_[pos & mask_];
+			const size_t seq = cell->sequence.load(std::memory_order_acquire);
+			const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		value = std::move(cell->value);
+		cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief approximate number of queued elements, exact when the queue is quiescent
+	 */
+	size_t Size() const {
+		const size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+		const size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+
+	size_t Capacity() const {
+		return mask_ + 1;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	static size_t RoundUp(size_t n) {
+		size_t capacity = 2;
+		while (capacity < n) {
+			capacity <<= 1;
+		}
+		return capacity;
+	}
+
+	const size_t mask_;
+	std::unique_ptr<Cell[]> cells_;
+	// keep producers and consumers off each other's cache line (and off mask_ and cells_, which both read).
+	// padded rather than alignas, stages are heap allocated and C++11 new ignores extended alignment
+	char pad0_[64];
+	std::atomic<size_t> enqueue_pos_;
+	char pad1_[64];
+	std::atomic<size_t> dequeue_pos_;
+	char pad2_[64];
+};
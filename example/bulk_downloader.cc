@@ -0,0 +1,256 @@
+#include "bulk_downloader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <crow/TinySHA1.hpp>
+#include "file_util.h"
+#include "http_client.h"
+#include "token_bucket.h"
+
+DownloadManifest::DownloadManifest(const std::string& path) : path_(path) {
+}
+
+bool DownloadManifest::Load() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.clear();
+	std::ifstream in(path_);
+	if (!in) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		Entry entry;
+		std::string remote;
+		if (!(fields >> entry.sha1 >> entry.size) || entry.sha1.size() != 40) {
+			continue;
+		}
+		std::getline(fields >> std::ws, remote);
+		if (!remote.empty()) {
+			entries_[remote] = entry;
+		}
+	}
+	return true;
+}
+
+bool DownloadManifest::Lookup(const std::string& remote, Entry& entry) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = entries_.find(remote);
+	if (it == entries_.end()) {
+		return false;
+	}
+	entry = it->second;
+	return true;
+}
+
+bool DownloadManifest::Record(const std::string& remote, const Entry& entry) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	FILE* file = fopen(path_.c_str(), "ab");
+	if (!file) {
+		return false;
+	}
+	const std::string line = entry.sha1 + " " + std::to_string(entry.size) + " " + remote + "\n";
+	const bool ok = fwrite(line.data(), 1, line.size(), file) == line.size() && fflush(file) == 0;
+	fclose(file);
+	entries_[remote] = entry;
+	return ok;
+}
+
+BulkDownloader::BulkDownloader(const std::string& base_url, const BulkDownloadOptions& options)
+	: base_url_(base_url), options_(options),
+	manifest_(options.manifest_path.empty() ? options.local_dir + ".download_manifest" : options.manifest_path),
+	cancelled_(false) {
+	if (options_.concurrency == 0) {
+		options_.concurrency = 1;
+	}
+}
+
+void BulkDownloader::SetFileCallback(FileCallback callback) {
+	callback_ = callback;
+}
+
+void BulkDownloader::Cancel() {
+	cancelled_ = true;
+}
+
+std::string BulkDownloader::LocalPath(const std::string& remote) const {
+	return options_.local_dir + file_util::Basename(remote);
+}
+
+void BulkDownloader::ForEach(size_t count, const std::function<void(HttpClient&, size_t)>& work) {
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	const size_t threads = std::min(options_.concurrency, count);
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&]() {
+			HttpClient client;
+			for (size_t i = next++; i < count && !cancelled_; i = next++) {
+				work(client, i);
+			}
+		});
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+BulkDownloadReport BulkDownloader::Run(const std::vector<std::string>& remote_files) {
+	const auto begin = std::chrono::steady_clock::now();
+	BulkDownloadReport report;
+	report.total = remote_files.size();
+	cancelled_ = false;
+	file_util::MakeDirectories(options_.local_dir);
+	manifest_.Load();
+
+	// sizes first, so the largest files can start right away and keep the link busy while small ones trickle in
+	std::vector<Item> items(remote_files.size());
+	ForEach(remote_files.size(), [&](HttpClient& client, size_t i) {
+		HttpResponseHead head;
+		items[i].remote = remote_files[i];
+		items[i].size = client.Head(file_util::JoinUrl(base_url_, remote_files[i]), head) ? head.content_length : -1;
+	});
+
+	std::vector<Item> pending;
+	for (const auto& item : items) {
+		DownloadManifest::Entry entry;
+		const std::string local = LocalPath(item.remote);
+		if (manifest_.Lookup(item.remote, entry)
+			&& (item.size < 0 || entry.size == static_cast<uint64_t>(item.size))
+			&& file_util::FileSize(local) == static_cast<int64_t>(entry.size)
+			&& (!options_.verify_existing || file_util::Sha1File(local) == entry.sha1)) {
+			++report.skipped;
+			continue;
+		}
+		pending.push_back(item);
+	}
+	std::stable_sort(pending.begin(), pending.end(), [](const Item& a, const Item& b) { return a.size > b.size; });
+
+	std::mutex report_mutex;
+	ForEach(pending.size(), [&](HttpClient& client, size_t i) {
+		const Item& item = pending[i];
+		uint64_t bytes = 0;
+		bool ok = false;
+		for (int attempt = 0; attempt <= options_.retries && !ok && !cancelled_; ++attempt) {
+			if (attempt > 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(500 * attempt));
+			}
+			try {
+				ok = Download(client, item, bytes);
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Download " << item.remote << " failed: " << e.what() << std::endl;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(report_mutex);
+			report.bytes += bytes;
+			if (ok) {
+				++report.downloaded;
+			}
+			else if (!cancelled_) {
+				++report.failed;
+				report.failed_files.push_back(item.remote);
+			}
+		}
+		if (callback_ && (ok || !cancelled_)) {
+			callback_(item.remote, ok, bytes);
+		}
+	});
+
+	report.seconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count() / 1e6;
+	return report;
+}
+
+bool BulkDownloader::Download(HttpClient& client, const Item& item, uint64_t& bytes) {
+	const std::string local = LocalPath(item.remote);
+	const std::string part = local + ".part";
+
+	// continue an interrupted transfer, the bytes already on disk go into the checksum first
+	sha1::SHA1 sha;
+	int64_t offset = file_util::FileSize(part);
+	if (offset < 0 || (item.size >= 0 && offset > item.size)) {
+		offset = 0;
+	}
+	if (offset > 0) {
+		FILE* existing = fopen(part.c_str(), "rb");
+		char buf[65536];
+		size_t n;
+		int64_t hashed = 0;
+		while (existing && hashed < offset && (n = fread(buf, 1, sizeof(buf), existing)) > 0) {
+			sha.processBytes(buf, n);
+			hashed += n;
+		}
+		if (existing) {
+			fclose(existing);
+		}
+	}
+
+	FILE* file = fopen(part.c_str(), offset > 0 ? "ab" : "wb");
+	if (!file) {
+		std::cerr << "Can not open " << part << std::endl;
+		return false;
+	}
+
+	uint64_t received = static_cast<uint64_t>(offset);
+	bool ok = true;
+	if (item.size < 0 || offset < item.size) {
+		HttpResponseHead head;
+		bool restarted = false;
+		ok = client.Get(file_util::JoinUrl(base_url_, item.remote), head, [&](const char* data, size_t size) {
+			if (offset > 0 && head.status == 200 && !restarted) {
+				// the server ignored the Range header and sends the whole file again
+				restarted = true;
+				fclose(file);
+				file = fopen(part.c_str(), "wb");
+				sha.reset();
+				received = 0;
+				if (!file) {
+					return false;
+				}
+			}
+			if (fwrite(data, 1, size, file) != size) {
+				return false;
+			}
+			sha.processBytes(data, size);
+			received += size;
+			bytes += size;
+			if (options_.rate_limit) {
+				options_.rate_limit->Acquire(size);
+			}
+			return !cancelled_;
+		}, offset > 0 ? offset : -1);
+		if (!ok) {
+			std::cerr << "Download " << item.remote << " interrupted at " << received << " bytes: " << client.LastError() << std::endl;
+		}
+	}
+	if (file) {
+		ok = fclose(file) == 0 && ok;
+	}
+	else {
+		ok = false;
+	}
+	if (!ok) {
+		return false;
+	}
+	if (item.size >= 0 && received != static_cast<uint64_t>(item.size)) {
+		std::cerr << "Download " << item.remote << " size mismatch: " << received << " of " << item.size << std::endl;
+		file_util::Remove(part);
+		return false;
+	}
+
+	uint8_t digest[20];
+	sha.getDigestBytes(digest);
+	DownloadManifest::Entry entry;
+	entry.size = received;
+	entry.sha1 = file_util::ToHex(digest, sizeof(digest));
+	if (!file_util::Rename(part, local)) {
+		std::cerr << "Can not move " << part << " to " << local << std::endl;
+		return false;
+	}
+	return manifest_.Record(item.remote, entry);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class HttpClient;
+class TokenBucket;
+
+/**
+ * \class DownloadManifest
+ * \brief Append-only record of files that were downloaded completely, one "<sha1> <size> <remote path>" line each.
+ *        A line is only written after the file has been renamed into place, so a crash leaves at worst
+ *        a partial last line, which Load() ignores.
+ */
+class DownloadManifest {
+public:
+	struct Entry {
+		uint64_t size;
+		std::string sha1;
+	};
+
+	explicit DownloadManifest(const std::string& path);
+
+	bool Load();
+	bool Lookup(const std::string& remote, Entry& entry) const;
+	bool Record(const std::string& remote, const Entry& entry);
+
+private:
+	std::string path_;
+	mutable std::mutex mutex_;
+	std::map<std::string, Entry> entries_;
+};
+
+struct BulkDownloadOptions {
+	size_t concurrency = 4;
+	std::string local_dir;     // with trailing slash, files are saved by their base name
+	std::string manifest_path; // empty: <local_dir>.download_manifest
+	int retries = 3;
+	bool verify_existing = false; // re-hash files the manifest lists as complete instead of trusting the size
+	std::shared_ptr<TokenBucket> rate_limit; // shared by all transfers and may be changed while they run, null: no cap
+};
+
+struct BulkDownloadReport {
+	size_t total = 0;
+	size_t downloaded = 0;
+	size_t skipped = 0; // already complete according to the manifest
+	size_t failed = 0;
+	uint64_t bytes = 0;
+	double seconds = 0;
+	std::vector<std::string> failed_files;
+};
+
+/**
+ * \class BulkDownloader
+ * \brief Offloads many files from the camera's http file server (Camera::GetHttpBaseUrl()) with a fixed number
+ *        of parallel transfers, largest files first. Completed files are recorded in a DownloadManifest and
+ *        skipped on the next run; an interrupted file continues from its ".part" file with a Range request.
+ */
+class BulkDownloader {
+public:
+	typedef std::function<void(const std::string& remote, bool ok, uint64_t size)> FileCallback;
+
+	BulkDownloader(const std::string& base_url, const BulkDownloadOptions& options);
+
+	/**
+	 * \brief called from the transfer threads whenever a file finishes or finally fails
+	 */
+	void SetFileCallback(FileCallback callback);
+
+	BulkDownloadReport Run(const std::vector<std::string>& remote_files);
+
+	/**
+	 * \brief stop after the transfers in progress, they keep their ".part" files for the next run
+	 */
+	void Cancel();
+
+	std::string LocalPath(const std::string& remote) const;
+
+private:
+	struct Item {
+		std::string remote;
+		int64_t size; // from HEAD, -1 if unknown
+	};
+
+	bool Download(HttpClient& client, const Item& item, uint64_t& bytes);
+	void ForEach(size_t count, const std::function<void(HttpClient&, size_t)>& work);
+
+	std::string base_url_;
+	BulkDownloadOptions options_;
+	DownloadManifest manifest_;
+	FileCallback callback_;
+	std::atomic<bool> cancelled_;
+};
@@ -0,0 +1,122 @@
+#include "camera_device.h"
+
+SdkCamera::SdkCamera(const ins_camera::DeviceDescriptor& device)
+	: serial_(device.serial_number), camera_(new ins_camera::Camera(device.info)) {
+}
+
+std::vector<std::shared_ptr<CameraDevice>> SdkCamera::FromDescriptors(const std::vector<ins_camera::DeviceDescriptor>& devices) {
+	std::vector<std::shared_ptr<CameraDevice>> cameras;
+	for (const auto& device : devices) {
+		cameras.push_back(std::make_shared<SdkCamera>(device));
+	}
+	return cameras;
+}
+
+bool SdkCamera::Open() const {
+	return camera_->Open();
+}
+
+void SdkCamera::Close() const {
+	camera_->Close();
+}
+
+bool SdkCamera::IsConnected() {
+	return camera_->IsConnected();
+}
+
+std::string SdkCamera::GetSerialNumber() const {
+	// from the descriptor, so it is known before Open and does not cost a round trip
+	return serial_;
+}
+
+ins_camera::CameraType SdkCamera::GetCameraType() const {
+	return camera_->GetCameraType();
+}
+
+ins_camera::VideoEncodeType SdkCamera::GetVideoEncodeType() const {
+	return camera_->GetVideoEncodeType();
+}
+
+ins_camera::CaptureStatus SdkCamera::GetCaptureCurrentStatus() const {
+	return camera_->GetCaptureCurrentStatus();
+}
+
+std::string SdkCamera::GetHttpBaseUrl() const {
+	return camera_->GetHttpBaseUrl();
+}
+
+bool SdkCamera::SyncLocalTimeToCamera(uint64_t time) {
+	return camera_->SyncLocalTimeToCamera(time);
+}
+
+ins_camera::MediaUrl SdkCamera::TakePhoto() const {
+	return camera_->TakePhoto();
+}
+
+bool SdkCamera::SetExposureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::ExposureSettings> settings) {
+	return camera_->SetExposureSettings(mode, settings);
+}
+
+std::shared_ptr<ins_camera::ExposureSettings> SdkCamera::GetExposureSettings(ins_camera::CameraFunctionMode mode) const {
+	return camera_->GetExposureSettings(mode);
+}
+
+bool SdkCamera::SetCaptureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::CaptureSettings> settings) {
+	return camera_->SetCaptureSettings(mode, settings);
+}
+
+std::shared_ptr<ins_camera::CaptureSettings> SdkCamera::GetCaptureSettings(ins_camera::CameraFunctionMode mode) const {
+	return camera_->GetCaptureSettings(mode);
+}
+
+bool SdkCamera::StartRecording() {
+	return camera_->StartRecording();
+}
+
+ins_camera::MediaUrl SdkCamera::StopRecording() {
+	return camera_->StopRecording();
+}
+
+bool SdkCamera::SetTimeLapseOption(ins_camera::TimelapseParam params) {
+	return camera_->SetTimeLapseOption(params);
+}
+
+bool SdkCamera::StartTimeLapse(ins_camera::CameraTimelapseMode mode) {
+	return camera_->StartTimeLapse(mode);
+}
+
+ins_camera::MediaUrl SdkCamera::StopTimeLapse(ins_camera::CameraTimelapseMode mode) {
+	return camera_->StopTimeLapse(mode);
+}
+
+bool SdkCamera::StartLiveStreaming(const ins_camera::LiveStreamParam& param) {
+	return camera_->StartLiveStreaming(param);
+}
+
+bool SdkCamera::StopLiveStreaming() {
+	return camera_->StopLiveStreaming();
+}
+
+void SdkCamera::SetStreamDelegate(std::shared_ptr<ins_camera::StreamDelegate>& delegate) {
+	camera_->SetStreamDelegate(delegate);
+}
+
+std::vector<std::string> SdkCamera::GetCameraFilesList() const {
+	return camera_->GetCameraFilesList();
+}
+
+bool SdkCamera::DeleteCameraFile(const std::string& file_path) const {
+	return camera_->DeleteCameraFile(file_path);
+}
+
+bool SdkCamera::DownloadCameraFile(const std::string& remote_file_path, const std::string& local_file_path) const {
+	return camera_->DownloadCameraFile(remote_file_path, local_file_path);
+}
+
+bool SdkCamera::GetBatteryStatus(ins_camera::BatteryStatus& status) {
+	return camera_->GetBatteryStatus(status);
+}
+
+bool SdkCamera::GetStorageState(ins_camera::StorageStatus& status) {
+	return camera_->GetStorageState(status);
+}
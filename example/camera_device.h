@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <camera/camera.h>
+
+/**
+ * \class CameraDevice
+ * \brief The camera operations the example uses, with the signatures of ins_camera::Camera, so code written
+ *        against a camera runs unchanged on the real SDK (SdkCamera) or without hardware (SimulatedCamera).
+ */
+class CameraDevice {
+public:
+	virtual ~CameraDevice() {}
+
+	virtual bool Open() const = 0;
+	virtual void Close() const = 0;
+	virtual bool IsConnected() = 0;
+	virtual std::string GetSerialNumber() const = 0;
+	virtual ins_camera::CameraType GetCameraType() const = 0;
+	virtual ins_camera::VideoEncodeType GetVideoEncodeType() const = 0;
+	virtual ins_camera::CaptureStatus GetCaptureCurrentStatus() const = 0;
+	virtual std::string GetHttpBaseUrl() const = 0;
+	virtual bool SyncLocalTimeToCamera(uint64_t time) = 0;
+
+	virtual ins_camera::MediaUrl TakePhoto() const = 0;
+	virtual bool SetExposureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::ExposureSettings> settings) = 0;
+	virtual std::shared_ptr<ins_camera::ExposureSettings> GetExposureSettings(ins_camera::CameraFunctionMode mode) const = 0;
+	virtual bool SetCaptureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::CaptureSettings> settings) = 0;
+	virtual std::shared_ptr<ins_camera::CaptureSettings> GetCaptureSettings(ins_camera::CameraFunctionMode mode) const = 0;
+
+	virtual bool StartRecording() = 0;
+	virtual ins_camera::MediaUrl StopRecording() = 0;
+	virtual bool SetTimeLapseOption(ins_camera::TimelapseParam params) = 0;
+	virtual bool StartTimeLapse(ins_camera::CameraTimelapseMode mode) = 0;
+	virtual ins_camera::MediaUrl StopTimeLapse(ins_camera::CameraTimelapseMode mode) = 0;
+
+	virtual bool StartLiveStreaming(const ins_camera::LiveStreamParam& param) = 0;
+	virtual bool StopLiveStreaming() = 0;
+	virtual void SetStreamDelegate(std::shared_ptr<ins_camera::StreamDelegate>& delegate) = 0;
+
+	virtual std::vector<std::string> GetCameraFilesList() const = 0;
+	virtual bool DeleteCameraFile(const std::string& file_path) const = 0;
+	virtual bool DownloadCameraFile(const std::string& remote_file_path, const std::string& local_file_path) const = 0;
+
+	virtual bool GetBatteryStatus(ins_camera::BatteryStatus& status) = 0;
+	virtual bool GetStorageState(ins_camera::StorageStatus& status) = 0;
+};
+
+/**
+ * \class SdkCamera
+ * \brief CameraDevice over a camera found by ins_camera::DeviceDiscovery
+ */
+class SdkCamera : public CameraDevice {
+public:
+	/**
+	 * \param device may be freed with DeviceDiscovery::FreeDeviceDescriptors once the camera is open
+	 */
+	explicit SdkCamera(const ins_camera::DeviceDescriptor& device);
+
+	/**
+	 * \brief one SdkCamera per device in the list
+	 */
+	static std::vector<std::shared_ptr<CameraDevice>> FromDescriptors(const std::vector<ins_camera::DeviceDescriptor>& devices);
+
+	bool Open() const override;
+	void Close() const override;
+	bool IsConnected() override;
+	std::string GetSerialNumber() const override;
+	ins_camera::CameraType GetCameraType() const override;
+	ins_camera::VideoEncodeType GetVideoEncodeType() const override;
+	ins_camera::CaptureStatus GetCaptureCurrentStatus() const override;
+	std::string GetHttpBaseUrl() const override;
+	bool SyncLocalTimeToCamera(uint64_t time) override;
+
+	ins_camera::MediaUrl TakePhoto() const override;
+	bool SetExposureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::ExposureSettings> settings) override;
+	std::shared_ptr<ins_camera::ExposureSettings> GetExposureSettings(ins_camera::CameraFunctionMode mode) const override;
+	bool SetCaptureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::CaptureSettings> settings) override;
+	std::shared_ptr<ins_camera::CaptureSettings> GetCaptureSettings(ins_camera::CameraFunctionMode mode) const override;
+
+	bool StartRecording() override;
+	ins_camera::MediaUrl StopRecording() override;
+	bool SetTimeLapseOption(ins_camera::TimelapseParam params) override;
+	bool StartTimeLapse(ins_camera::CameraTimelapseMode mode) override;
+	ins_camera::MediaUrl StopTimeLapse(ins_camera::CameraTimelapseMode mode) override;
+
+	bool StartLiveStreaming(const ins_camera::LiveStreamParam& param) override;
+	bool StopLiveStreaming() override;
+	void SetStreamDelegate(std::shared_ptr<ins_camera::StreamDelegate>& delegate) override;
+
+	std::vector<std::string> GetCameraFilesList() const override;
+	bool DeleteCameraFile(const std::string& file_path) const override;
+	bool DownloadCameraFile(const std::string& remote_file_path, const std::string& local_file_path) const override;
+
+	bool GetBatteryStatus(ins_camera::BatteryStatus& status) override;
+	bool GetStorageState(ins_camera::StorageStatus& status) override;
+
+private:
+	std::string serial_;
+	std::unique_ptr<ins_camera::Camera> camera_;
+};
@@ -0,0 +1,78 @@
+#include "camera_executor.h"
+
+#include <iostream>
+
+CameraCommandExecutor::CameraCommandExecutor() : stopping_(false) {
+	thread_ = std::thread(&CameraCommandExecutor::Run, this);
+}
+
+CameraCommandExecutor::~CameraCommandExecutor() {
+	Stop();
+}
+
+bool CameraCommandExecutor::Post(std::function<void()> task, std::function<void()> on_cancel) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (stopping_) {
+			return false;
+		}
+		Task queued;
+		queued.run = std::move(task);
+		queued.cancel = std::move(on_cancel);
+		tasks_.push_back(std::move(queued));
+	}
+	cv_.notify_one();
+	return true;
+}
+
+size_t CameraCommandExecutor::Pending() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return tasks_.size();
+}
+
+void CameraCommandExecutor::Stop() {
+	std::deque<Task> dropped;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+		dropped.swap(tasks_);
+	}
+	cv_.notify_all();
+	// outside the lock, a cancel callback may well Post() (and be refused)
+	for (Task& task : dropped) {
+		if (task.cancel) {
+			try {
+				task.cancel();
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Camera command cancel failed: " << e.what() << std::endl;
+			}
+		}
+	}
+	// dropping a packaged_task breaks its promise, so waiting clients get an error instead of hanging
+	dropped.clear();
+	if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+		thread_.join();
+	}
+}
+
+void CameraCommandExecutor::Run() {
+	while (true) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+			if (tasks_.empty()) {
+				return;
+			}
+			task = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+		try {
+			task.run();
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Camera command failed: " << e.what() << std::endl;
+		}
+	}
+}
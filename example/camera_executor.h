@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * \class CameraCommandExecutor
+ * \brief Runs camera commands one at a time on a dedicated thread, so slow USB round trips
+ *        never block the caller (e.g. a Crow io_service worker).
+ */
+class CameraCommandExecutor {
+public:
+	CameraCommandExecutor();
+	~CameraCommandExecutor();
+
+	CameraCommandExecutor(const CameraCommandExecutor&) = delete;
+	CameraCommandExecutor& operator=(const CameraCommandExecutor&) = delete;
+
+	/**
+	 * \brief queue a command, fire and forget.
+	 * \param on_cancel run instead of task if Stop() drops it from the queue, e.g. to answer its client.
+	 * \return false if the executor has been stopped.
+	 */
+	bool Post(std::function<void()> task, std::function<void()> on_cancel = nullptr);
+
+	/**
+	 * \brief queue a command and get its result through a future.
+	 */
+	template <typename F>
+	auto Submit(F f) -> std::future<decltype(f())> {
+		typedef decltype(f()) result_type;
+		auto task = std::make_shared<std::packaged_task<result_type()>>(f);
+		auto result = task->get_future();
+		Post([task]() { (*task)(); });
+		return result;
+	}
+
+	/**
+	 * \brief number of commands waiting to run, not counting the one in progress.
+	 */
+	size_t Pending() const;
+
+	/**
+	 * \brief finish the command in progress, cancel the queued ones and join the thread.
+	 */
+	void Stop();
+
+private:
+	struct Task {
+		std::function<void()> run;
+		std::function<void()> cancel;
+	};
+
+	void Run();
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<Task> tasks_;
+	bool stopping_;
+	std::thread thread_;
+};
@@ -0,0 +1,226 @@
+#include "camera_fleet.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <thread>
+
+using std::chrono::steady_clock;
+
+namespace {
+	double Milliseconds(steady_clock::duration duration) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1e3;
+	}
+}
+
+size_t FleetCommandReport::Succeeded() const {
+	return static_cast<size_t>(std::count_if(results.begin(), results.end(), [](const FleetCommandResult& result) { return result.ok; }));
+}
+
+FleetCommandReport FanOut(const std::vector<CameraCommandExecutor*>& executors, const FleetCommand& command,
+	std::chrono::milliseconds barrier_timeout) {
+	struct Barrier {
+		std::atomic<size_t> expected;
+		std::atomic<size_t> arrived;
+		std::atomic<bool> timed_out;
+		std::vector<FleetCommandResult> results;
+	};
+	auto barrier = std::make_shared<Barrier>();
+	barrier->expected = executors.size();
+	barrier->arrived = 0;
+	barrier->timed_out = false;
+	barrier->results.resize(executors.size());
+
+	const auto begin = steady_clock::now();
+	std::vector<std::future<void>> done;
+	for (size_t i = 0; i < executors.size(); ++i) {
+		barrier->results[i].ok = false;
+		auto task = std::make_shared<std::packaged_task<void()>>([barrier, command, i, barrier_timeout]() {
+			const auto deadline = steady_clock::now() + barrier_timeout;
+			barrier->arrived.fetch_add(1);
+			// spin rather than sleep on a condition variable, the wakeup of every waiter would add to the skew
+			while (barrier->arrived.load() < barrier->expected.load()) {
+				if (steady_clock::now() >= deadline) {
+					barrier->timed_out = true;
+					break;
+				}
+				std::this_thread::yield();
+			}
+			FleetCommandResult& result = barrier->results[i];
+			result.issued = steady_clock::now();
+			try {
+				result.ok = command(i, result.detail);
+			}
+			catch (const std::exception& e) {
+				result.detail = e.what();
+			}
+			result.completed = steady_clock::now();
+		});
+		done.push_back(task->get_future());
+		if (!executors[i]->Post([task]() { (*task)(); })) {
+			barrier->results[i].detail = "executor stopped";
+			barrier->expected.fetch_sub(1);
+		}
+	}
+	std::vector<bool> ran(executors.size(), false);
+	for (size_t i = 0; i < done.size(); ++i) {
+		try {
+			done[i].get();
+			ran[i] = true;
+		}
+		catch (const std::future_error&) {
+			// dropped by an executor that was stopped
+		}
+	}
+
+	FleetCommandReport report;
+	report.results = barrier->results;
+	report.barrier_timed_out = barrier->timed_out;
+	report.total_ms = Milliseconds(steady_clock::now() - begin);
+	report.trigger_skew_ms = 0;
+	report.completion_skew_ms = 0;
+	steady_clock::time_point first_issued = steady_clock::time_point::max(), last_issued = steady_clock::time_point::min();
+	steady_clock::time_point first_completed = first_issued, last_completed = last_issued;
+	for (size_t i = 0; i < report.results.size(); ++i) {
+		if (!ran[i]) {
+			continue;
+		}
+		const auto& result = report.results[i];
+		first_issued = std::min(first_issued, result.issued);
+		last_issued = std::max(last_issued, result.issued);
+		first_completed = std::min(first_completed, result.completed);
+		last_completed = std::max(last_completed, result.completed);
+	}
+	if (first_issued <= last_issued) {
+		report.trigger_skew_ms = Milliseconds(last_issued - first_issued);
+		report.completion_skew_ms = Milliseconds(last_completed - first_completed);
+	}
+	return report;
+}
+
+CameraFleet::WriterFactory CameraFleet::SerialWriters(const std::string& dir) {
+	return [dir](size_t, const std::string& serial) {
+		const std::vector<std::string> paths = { dir + serial + "_01.h264", dir + serial + "_02.h264" };
+		return std::make_shared<RingStreamWriter>(paths);
+	};
+}
+
+CameraFleet::CameraFleet(const std::vector<std::shared_ptr<CameraDevice>>& cameras, WriterFactory writers, const CameraFleetOptions& options)
+	: options_(options), closed_(false) {
+	// opening is a session handshake per camera, do them all at once
+	std::vector<std::future<bool>> opened;
+	for (const auto& camera : cameras) {
+		opened.push_back(std::async(std::launch::async, [camera]() { return camera->Open(); }));
+	}
+	for (size_t i = 0; i < cameras.size(); ++i) {
+		if (!opened[i].get()) {
+			std::cerr << "Failed to open camera " << cameras[i]->GetSerialNumber() << std::endl;
+			failed_.push_back(cameras[i]->GetSerialNumber());
+			continue;
+		}
+		Member member;
+		member.serial = cameras[i]->GetSerialNumber();
+		member.type = cameras[i]->GetCameraType();
+		member.camera = cameras[i];
+		member.stream_writer = writers(members_.size(), member.serial);
+		std::shared_ptr<ins_camera::StreamDelegate> delegate = member.stream_writer;
+		member.camera->SetStreamDelegate(delegate);
+		member.executor.reset(new CameraCommandExecutor());
+		members_.push_back(std::move(member));
+	}
+}
+
+CameraFleet::~CameraFleet() {
+	Close();
+}
+
+size_t CameraFleet::Size() const {
+	return members_.size();
+}
+
+CameraFleet::Member& CameraFleet::At(size_t index) {
+	return members_.at(index);
+}
+
+const std::vector<std::string>& CameraFleet::Failed() const {
+	return failed_;
+}
+
+FleetCommandReport CameraFleet::Run(const std::function<bool(CameraDevice& camera, std::string& detail)>& command) {
+	std::vector<CameraCommandExecutor*> executors;
+	std::vector<std::shared_ptr<CameraDevice>> cameras;
+	for (auto& member : members_) {
+		executors.push_back(member.executor.get());
+		cameras.push_back(member.camera);
+	}
+	auto report = FanOut(executors, [&cameras, &command](size_t index, std::string& detail) {
+		return command(*cameras[index], detail);
+	}, options_.barrier_timeout);
+	for (size_t i = 0; i < members_.size(); ++i) {
+		report.results[i].serial = members_[i].serial;
+	}
+	return report;
+}
+
+FleetCommandReport CameraFleet::TakePhoto() {
+	return Run([](CameraDevice& camera, std::string& detail) {
+		const auto url = camera.TakePhoto();
+		if (!url.IsSingleOrigin() || url.Empty()) {
+			detail = "Failed to take picture";
+			return false;
+		}
+		detail = url.GetSingleOrigin();
+		return true;
+	});
+}
+
+FleetCommandReport CameraFleet::StartRecording() {
+	return Run([](CameraDevice& camera, std::string& detail) {
+		if (!camera.StartRecording()) {
+			detail = "Failed to start recording";
+			return false;
+		}
+		return true;
+	});
+}
+
+FleetCommandReport CameraFleet::StopRecording() {
+	return Run([](CameraDevice& camera, std::string& detail) {
+		const auto url = camera.StopRecording();
+		if (url.Empty()) {
+			detail = "Failed to stop recording";
+			return false;
+		}
+		for (const auto& origin_url : url.OriginUrls()) {
+			detail += (detail.empty() ? "" : " ") + origin_url;
+		}
+		return true;
+	});
+}
+
+void CameraFleet::Close() {
+	if (closed_) {
+		return;
+	}
+	closed_ = true;
+	for (auto& member : members_) {
+		member.executor->Stop();
+	}
+	for (auto& member : members_) {
+		member.camera->Close();
+		member.stream_writer->Stop();
+	}
+}
+
+std::ostream& operator<<(std::ostream& out, const FleetCommandReport& report) {
+	for (const auto& result : report.results) {
+		out << (result.ok ? "  ok     " : "  failed ") << result.serial << " " << result.detail << std::endl;
+	}
+	out << report.Succeeded() << "/" << report.results.size() << " cameras, trigger skew " << report.trigger_skew_ms
+		<< " ms, completion skew " << report.completion_skew_ms << " ms, total " << report.total_ms << " ms";
+	if (report.barrier_timed_out) {
+		out << " (a camera was busy, barrier timed out)";
+	}
+	return out;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <camera/camera.h>
+#include "camera_device.h"
+#include "camera_executor.h"
+#include "stream_writer.h"
+
+/**
+ * \brief what one camera did with a fan-out command
+ */
+struct FleetCommandResult {
+	std::string serial;
+	bool ok;
+	std::string detail;                               // e.g. the url of a photo, or why it failed
+	std::chrono::steady_clock::time_point issued;     // right before the SDK call
+	std::chrono::steady_clock::time_point completed;  // right after it returned
+};
+
+struct FleetCommandReport {
+	std::vector<FleetCommandResult> results; // in fleet order
+	bool barrier_timed_out;                  // a camera was still busy after barrier_timeout, it was issued late
+	double trigger_skew_ms;                  // latest minus earliest issued
+	double completion_skew_ms;               // latest minus earliest completed
+	double total_ms;                         // from the call until the last camera answered
+
+	size_t Succeeded() const;
+};
+
+/**
+ * \brief runs on the executor of camera index, fills detail, returns whether it succeeded
+ */
+typedef std::function<bool(size_t index, std::string& detail)> FleetCommand;
+
+/**
+ * \brief Run command once on every executor, concurrently. Every executor first finishes what it is already doing;
+ *        the commands then wait at a barrier until all executors have reached it and are issued together, so
+ *        the trigger skew is a thread wakeup instead of the command latency times the number of cameras.
+ *        An executor that is still busy after barrier_timeout does not hold the others back any longer.
+ */
+FleetCommandReport FanOut(const std::vector<CameraCommandExecutor*>& executors, const FleetCommand& command,
+	std::chrono::milliseconds barrier_timeout = std::chrono::milliseconds(2000));
+
+struct CameraFleetOptions {
+	std::chrono::milliseconds barrier_timeout = std::chrono::milliseconds(2000);
+};
+
+/**
+ * \class CameraFleet
+ * \brief Opens every camera, in parallel, and gives each its own command executor and
+ *        RingStreamWriter, so the cameras are driven side by side instead of through one control loop.
+ *        Cameras that fail to open are left out and listed in Failed().
+ */
+class CameraFleet {
+public:
+	struct Member {
+		std::string serial;
+		ins_camera::CameraType type;
+		std::shared_ptr<CameraDevice> camera;
+		std::shared_ptr<RingStreamWriter> stream_writer;
+		std::unique_ptr<CameraCommandExecutor> executor;
+	};
+
+	/**
+	 * \brief the stream writer of the index-th opened camera
+	 */
+	typedef std::function<std::shared_ptr<RingStreamWriter>(size_t index, const std::string& serial)> WriterFactory;
+
+	/**
+	 * \brief writes <dir><serial>_01.h264 and <dir><serial>_02.h264
+	 */
+	static WriterFactory SerialWriters(const std::string& dir);
+
+	/**
+	 * \param cameras not opened yet, e.g. SdkCamera::FromDescriptors or SimulatedCamera::Fleet
+	 */
+	CameraFleet(const std::vector<std::shared_ptr<CameraDevice>>& cameras, WriterFactory writers = SerialWriters("./"),
+		const CameraFleetOptions& options = CameraFleetOptions());
+	~CameraFleet();
+
+	CameraFleet(const CameraFleet&) = delete;
+	CameraFleet& operator=(const CameraFleet&) = delete;
+
+	size_t Size() const;
+	Member& At(size_t index);
+
+	/**
+	 * \return serial numbers of the cameras that did not open
+	 */
+	const std::vector<std::string>& Failed() const;
+
+	/**
+	 * \brief run command on every camera at once, see FanOut
+	 */
+	FleetCommandReport Run(const std::function<bool(CameraDevice& camera, std::string& detail)>& command);
+
+	FleetCommandReport TakePhoto();
+	FleetCommandReport StartRecording();
+	FleetCommandReport StopRecording();
+
+	/**
+	 * \brief stop the executors and the stream writers, then close the cameras
+	 */
+	void Close();
+
+private:
+	CameraFleetOptions options_;
+	std::vector<Member> members_;
+	std::vector<std::string> failed_;
+	bool closed_;
+};
+
+std::ostream& operator<<(std::ostream& out, const FleetCommandReport& report);
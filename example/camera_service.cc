@@ -0,0 +1,339 @@
+#include "camera_service.h"
+
+#include <vector>
+
+namespace {
+
+	ins_camera::CameraFunctionMode ModeParam(const crow::json::rvalue& params) {
+		if (params.has("mode") && params["mode"].s() == "video") {
+			return ins_camera::CameraFunctionMode::FUNCTION_MODE_NORMAL_VIDEO;
+		}
+		return ins_camera::CameraFunctionMode::FUNCTION_MODE_NORMAL_IMAGE;
+	}
+
+	void WriteModeSettings(const CameraModeSettings& settings, crow::json::wvalue& body) {
+		body["iso"] = settings.iso;
+		body["shutter_speed"] = settings.shutter_speed;
+		body["exposure_mode"] = settings.exposure_mode;
+		body["ev_bias"] = settings.ev_bias;
+		body["contrast"] = settings.contrast;
+		body["saturation"] = settings.saturation;
+		body["brightness"] = settings.brightness;
+		body["sharpness"] = settings.sharpness;
+		body["white_balance"] = settings.white_balance;
+	}
+
+	/**
+	 * \brief answer from the cached snapshot right on the io thread, 503 until entry has been polled once
+	 */
+	void EndWithState(crow::response& res, const CameraState& state, CameraStateEntry entry,
+		const std::function<void(const CameraState&, crow::json::wvalue&)>& fill) {
+		crow::json::wvalue body;
+		if (!state.Valid(entry)) {
+			body["error"] = "Camera state not polled yet";
+			res.code = 503;
+		}
+		else {
+			fill(state, body);
+			body["age_ms"] = state.AgeMs(entry);
+			body["stale"] = state.Stale(entry);
+		}
+		res.set_header("Content-Type", "application/json");
+		res.end(body.dump());
+	}
+
+}
+
+ins_camera::LiveStreamParam PreviewStreamParam() {
+	ins_camera::LiveStreamParam param;
+	param.video_resolution = ins_camera::VideoResolution::RES_1440_720P30;
+	param.lrv_video_resulution = ins_camera::VideoResolution::RES_1440_720P30;
+	param.video_bitrate = 1024 * 1024 * 2;
+	param.enable_audio = false;
+	param.using_lrv = false;
+	return param;
+}
+
+CameraService::CameraService(std::shared_ptr<CameraDevice> cam, const std::string& download_dir)
+	: cam_(cam), download_dir_(download_dir), state_(CameraStateQueries::FromCamera(cam), executor_) {
+}
+
+void CameraService::Stop() {
+	state_.Stop();
+	executor_.Stop();
+}
+
+void CameraService::Dispatch(const crow::request& req, crow::response& res, Command command) {
+	auto io_service = req.io_service;
+	auto response = &res;
+	const bool queued = executor_.Post([response, io_service, command]() {
+		crow::json::wvalue body;
+		int code = 500;
+		try {
+			code = command(body);
+		}
+		catch (const std::exception& e) {
+			body = crow::json::wvalue();
+			body["error"] = e.what();
+		}
+		const std::string payload = body.dump();
+		// crow::response is only safe to touch from the connection's own io_service
+		io_service->post([response, code, payload]() {
+			response->code = code;
+			response->set_header("Content-Type", "application/json");
+			response->end(payload);
+		});
+	}, [response, io_service]() {
+		// the service stopped before the command ran
+		io_service->post([response]() {
+			response->code = 503;
+			response->set_header("Content-Type", "application/json");
+			crow::json::wvalue body;
+			body["error"] = "Camera service stopped";
+			response->end(body.dump());
+		});
+	});
+	if (!queued) {
+		res.code = 503;
+		res.end();
+	}
+}
+
+void CameraService::RegisterRoutes(crow::SimpleApp& app) {
+	auto cam = cam_;
+	auto state = &state_;
+	const auto download_dir = download_dir_;
+
+	CROW_ROUTE(app, "/camera/photo").methods(crow::HTTPMethod::Post)
+		([this, cam, state](const crow::request& req, crow::response& res) {
+		Dispatch(req, res, [cam, state](crow::json::wvalue& body) {
+			const auto url = cam->TakePhoto();
+			state->Invalidate(CameraStateEntry::Storage);
+			if (!url.IsSingleOrigin() || url.Empty()) {
+				body["error"] = "Failed to take picture";
+				return 502;
+			}
+			body["url"] = url.GetSingleOrigin();
+			return 200;
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/files")
+		([this, cam](const crow::request& req, crow::response& res) {
+		Dispatch(req, res, [cam](crow::json::wvalue& body) {
+			const auto file_list = cam->GetCameraFilesList();
+			std::vector<crow::json::wvalue> files;
+			for (const auto& file : file_list) {
+				files.emplace_back(file);
+			}
+			body["files"] = std::move(files);
+			return 200;
+		});
+	});
+
+	// body: {"remote": "/DCIM/Camera01/IMG_xxx.insp"}, the file is saved under download_dir
+	CROW_ROUTE(app, "/camera/download").methods(crow::HTTPMethod::Post)
+		([this, cam, download_dir](const crow::request& req, crow::response& res) {
+		auto params = crow::json::load(req.body);
+		if (!params || !params.has("remote")) {
+			res.code = 400;
+			res.end("Missing \"remote\" file path");
+			return;
+		}
+		const std::string remote = params["remote"].s();
+		const std::string local = download_dir + remote.substr(remote.rfind('/') + 1);
+		Dispatch(req, res, [cam, remote, local](crow::json::wvalue& body) {
+			if (!cam->DownloadCameraFile(remote, local)) {
+				body["error"] = "Download " + remote + " failed";
+				return 502;
+			}
+			body["local"] = local;
+			return 200;
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/battery")
+		([state](const crow::request&, crow::response& res) {
+		EndWithState(res, *state->Snapshot(), CameraStateEntry::Battery, [](const CameraState& state, crow::json::wvalue& body) {
+			body["power_type"] = static_cast<int32_t>(state.battery.power_type);
+			body["battery_level"] = state.battery.battery_level;
+			body["battery_scale"] = state.battery.battery_scale;
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/storage")
+		([state](const crow::request&, crow::response& res) {
+		EndWithState(res, *state->Snapshot(), CameraStateEntry::Storage, [](const CameraState& state, crow::json::wvalue& body) {
+			body["free_space"] = state.storage.free_space;
+			body["total_space"] = state.storage.total_space;
+			body["state"] = static_cast<int32_t>(state.storage.state);
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/status")
+		([state](const crow::request&, crow::response& res) {
+		EndWithState(res, *state->Snapshot(), CameraStateEntry::Capture, [](const CameraState& state, crow::json::wvalue& body) {
+			body["capture_status"] = static_cast<int32_t>(state.capture);
+			body["capturing"] = state.Capturing();
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/settings")
+		([state](const crow::request&, crow::response& res) {
+		EndWithState(res, *state->Snapshot(), CameraStateEntry::Settings, [](const CameraState& state, crow::json::wvalue& body) {
+			WriteModeSettings(state.image, body["image"]);
+			WriteModeSettings(state.video, body["video"]);
+		});
+	});
+
+	// body: {"mode": "image" | "video", "ev_bias": 0, "iso": 800, "shutter_speed": 0.008, "exposure_mode": 0}
+	CROW_ROUTE(app, "/camera/exposure").methods(crow::HTTPMethod::Post)
+		([this, cam, state](const crow::request& req, crow::response& res) {
+		auto params = crow::json::load(req.body);
+		if (!params) {
+			res.code = 400;
+			res.end("Invalid JSON body");
+			return;
+		}
+		const auto mode = ModeParam(params);
+		auto exposure = std::make_shared<ins_camera::ExposureSettings>();
+		if (params.has("exposure_mode")) {
+			exposure->SetExposureMode(static_cast<ins_camera::PhotographyOptions_ExposureMode>(params["exposure_mode"].i()));
+		}
+		if (params.has("ev_bias")) {
+			exposure->SetEVBias(static_cast<int32_t>(params["ev_bias"].i()));
+		}
+		if (params.has("iso")) {
+			exposure->SetIso(static_cast<int32_t>(params["iso"].i()));
+		}
+		if (params.has("shutter_speed")) {
+			exposure->SetShutterSpeed(params["shutter_speed"].d());
+		}
+		Dispatch(req, res, [cam, state, mode, exposure](crow::json::wvalue& body) {
+			const bool ok = cam->SetExposureSettings(mode, exposure);
+			state->Invalidate(CameraStateEntry::Settings);
+			if (!ok) {
+				body["error"] = "Failed to set exposure";
+				return 502;
+			}
+			body["applied"] = true;
+			return 200;
+		});
+	});
+
+	// body: {"mode": "image" | "video", "contrast": 64, "saturation": 64, "brightness": 0, "sharpness": 3, "white_balance": 0}
+	CROW_ROUTE(app, "/camera/capture_settings").methods(crow::HTTPMethod::Post)
+		([this, cam, state](const crow::request& req, crow::response& res) {
+		auto params = crow::json::load(req.body);
+		if (!params) {
+			res.code = 400;
+			res.end("Invalid JSON body");
+			return;
+		}
+		const auto mode = ModeParam(params);
+		auto settings = std::make_shared<ins_camera::CaptureSettings>();
+		const struct {
+			const char* name;
+			ins_camera::CaptureSettings::SettingsType type;
+		} values[] = {
+			{ "contrast", ins_camera::CaptureSettings::CaptureSettings_Contrast },
+			{ "saturation", ins_camera::CaptureSettings::CaptureSettings_Saturation },
+			{ "brightness", ins_camera::CaptureSettings::CaptureSettings_Brightness },
+			{ "sharpness", ins_camera::CaptureSettings::CaptureSettings_Sharpness },
+		};
+		for (const auto& value : values) {
+			if (params.has(value.name)) {
+				settings->SetValue(value.type, static_cast<int32_t>(params[value.name].i()));
+			}
+		}
+		if (params.has("white_balance")) {
+			settings->SetWhiteBalance(static_cast<ins_camera::PhotographyOptions_WhiteBalance>(params["white_balance"].i()));
+		}
+		Dispatch(req, res, [cam, state, mode, settings](crow::json::wvalue& body) {
+			const bool ok = cam->SetCaptureSettings(mode, settings);
+			state->Invalidate(CameraStateEntry::Settings);
+			if (!ok) {
+				body["error"] = "Failed to set capture settings";
+				return 502;
+			}
+			body["applied"] = true;
+			return 200;
+		});
+	});
+
+	// optional body: {"lapse_time": 3000, "accelerate": 5}
+	CROW_ROUTE(app, "/camera/timelapse/start").methods(crow::HTTPMethod::Post)
+		([this, cam, state](const crow::request& req, crow::response& res) {
+		ins_camera::TimelapseParam param;
+		param.mode = ins_camera::CameraTimelapseMode::MOBILE_TIMELAPSE_VIDEO;
+		param.duration = -1;
+		param.lapseTime = 3000;
+		param.accelerate_fequency = 5;
+		auto params = crow::json::load(req.body);
+		if (params) {
+			if (params.has("lapse_time")) {
+				param.lapseTime = static_cast<uint32_t>(params["lapse_time"].u());
+			}
+			if (params.has("accelerate")) {
+				param.accelerate_fequency = static_cast<uint32_t>(params["accelerate"].u());
+			}
+		}
+		Dispatch(req, res, [cam, state, param](crow::json::wvalue& body) {
+			if (!cam->SetTimeLapseOption(param)) {
+				body["error"] = "Failed to set timelapse option";
+				return 502;
+			}
+			const bool started = cam->StartTimeLapse(param.mode);
+			state->Invalidate(CameraStateEntry::Capture);
+			if (!started) {
+				body["error"] = "Failed to start timelapse";
+				return 502;
+			}
+			body["started"] = true;
+			return 200;
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/timelapse/stop").methods(crow::HTTPMethod::Post)
+		([this, cam, state](const crow::request& req, crow::response& res) {
+		Dispatch(req, res, [cam, state](crow::json::wvalue& body) {
+			const auto url = cam->StopTimeLapse(ins_camera::CameraTimelapseMode::MOBILE_TIMELAPSE_VIDEO);
+			state->Invalidate(CameraStateEntry::Capture);
+			state->Invalidate(CameraStateEntry::Storage);
+			if (url.Empty()) {
+				body["error"] = "Stop timelapse failed";
+				return 502;
+			}
+			std::vector<crow::json::wvalue> urls;
+			for (const auto& origin_url : url.OriginUrls()) {
+				urls.emplace_back(origin_url);
+			}
+			body["urls"] = std::move(urls);
+			return 200;
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/preview/start").methods(crow::HTTPMethod::Post)
+		([this, cam](const crow::request& req, crow::response& res) {
+		Dispatch(req, res, [cam](crow::json::wvalue& body) {
+			if (!cam->StartLiveStreaming(PreviewStreamParam())) {
+				body["error"] = "Failed to start preview stream";
+				return 502;
+			}
+			body["started"] = true;
+			return 200;
+		});
+	});
+
+	CROW_ROUTE(app, "/camera/preview/stop").methods(crow::HTTPMethod::Post)
+		([this, cam](const crow::request& req, crow::response& res) {
+		Dispatch(req, res, [cam](crow::json::wvalue& body) {
+			if (!cam->StopLiveStreaming()) {
+				body["error"] = "Failed to stop preview stream";
+				return 502;
+			}
+			body["stopped"] = true;
+			return 200;
+		});
+	});
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <camera/camera.h>
+#include "crow.h"
+#include "camera_device.h"
+#include "camera_executor.h"
+#include "camera_state_cache.h"
+
+/**
+ * \brief live stream settings of the preview: 1440x720 at 30 fps, 2 Mbit/s, no audio
+ */
+ins_camera::LiveStreamParam PreviewStreamParam();
+
+/**
+ * \class CameraService
+ * \brief Exposes the camera operations of the interactive menu as non-blocking HTTP endpoints.
+ *        Handlers only queue work on the camera command executor and complete the response
+ *        back on the io_service that received the request. Status reads (battery, storage, capture
+ *        state, settings) are answered from the CameraStateCache without touching the camera.
+ */
+class CameraService {
+public:
+	/**
+	 * \param cam an opened camera
+	 * \param download_dir local directory (with trailing slash) that downloaded files are saved into
+	 */
+	CameraService(std::shared_ptr<CameraDevice> cam, const std::string& download_dir);
+
+	/**
+	 * \brief register the /camera/... routes on the app, call before app.run_async()
+	 */
+	void RegisterRoutes(crow::SimpleApp& app);
+
+	/**
+	 * \brief stop accepting commands, pending requests are answered with an error
+	 */
+	void Stop();
+
+private:
+	/**
+	 * A command runs on the executor thread, fills the JSON body and returns the HTTP status code.
+	 */
+	typedef std::function<int(crow::json::wvalue& body)> Command;
+
+	void Dispatch(const crow::request& req, crow::response& res, Command command);
+
+	std::shared_ptr<CameraDevice> cam_;
+	std::string download_dir_;
+	CameraCommandExecutor executor_;
+	CameraStateCache state_;
+};
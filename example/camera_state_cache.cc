@@ -0,0 +1,189 @@
+#include "camera_state_cache.h"
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+using std::chrono::steady_clock;
+
+CameraStateQueries CameraStateQueries::FromCamera(std::shared_ptr<CameraDevice> cam) {
+	CameraStateQueries queries;
+	queries.capture = [cam](ins_camera::CaptureStatus& status) {
+		status = cam->GetCaptureCurrentStatus();
+		return true;
+	};
+	queries.battery = [cam](ins_camera::BatteryStatus& status) {
+		return cam->GetBatteryStatus(status);
+	};
+	queries.storage = [cam](ins_camera::StorageStatus& status) {
+		return cam->GetStorageState(status);
+	};
+	queries.settings = [cam](ins_camera::CameraFunctionMode mode, CameraModeSettings& settings) {
+		const auto exposure = cam->GetExposureSettings(mode);
+		const auto capture = cam->GetCaptureSettings(mode);
+		if (!exposure || !capture) {
+			return false;
+		}
+		settings.iso = exposure->Iso();
+		settings.shutter_speed = exposure->ShutterSpeed();
+		settings.exposure_mode = static_cast<int32_t>(exposure->ExposureMode());
+		settings.ev_bias = exposure->EVBias();
+		settings.contrast = capture->GetIntValue(ins_camera::CaptureSettings::CaptureSettings_Contrast);
+		settings.saturation = capture->GetIntValue(ins_camera::CaptureSettings::CaptureSettings_Saturation);
+		settings.brightness = capture->GetIntValue(ins_camera::CaptureSettings::CaptureSettings_Brightness);
+		settings.sharpness = capture->GetIntValue(ins_camera::CaptureSettings::CaptureSettings_Sharpness);
+		settings.white_balance = static_cast<int32_t>(capture->WhiteBalance());
+		return true;
+	};
+	return queries;
+}
+
+CameraStateCache::CameraStateCache(CameraStateQueries queries, CameraCommandExecutor& executor, const CameraStateCacheOptions& options)
+	: queries_(queries), executor_(executor), options_(options), stopping_(false) {
+	state_ = std::make_shared<CameraState>();
+	for (size_t i = 0; i < CameraState::kEntries; ++i) {
+		invalid_[i] = false;
+		polls_[i] = 0;
+	}
+	thread_ = std::thread(&CameraStateCache::Run, this);
+}
+
+CameraStateCache::~CameraStateCache() {
+	Stop();
+}
+
+std::shared_ptr<const CameraState> CameraStateCache::Snapshot() const {
+	return std::atomic_load(&state_);
+}
+
+void CameraStateCache::Invalidate(CameraStateEntry entry) {
+	const size_t index = static_cast<size_t>(entry);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		invalid_[index] = true;
+	}
+	Publish([index](CameraState& state) {
+		state.stale[index] = true;
+	});
+	cv_.notify_one();
+}
+
+void CameraStateCache::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	cv_.notify_one();
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+uint64_t CameraStateCache::Polls(CameraStateEntry entry) const {
+	return polls_[static_cast<size_t>(entry)];
+}
+
+std::chrono::milliseconds CameraStateCache::Interval(size_t entry, bool capturing) const {
+	const CameraPollInterval* intervals[CameraState::kEntries] = { &options_.capture, &options_.battery, &options_.storage, &options_.settings };
+	return capturing ? intervals[entry]->capturing : intervals[entry]->idle;
+}
+
+void CameraStateCache::Publish(const std::function<void(CameraState&)>& update) {
+	std::lock_guard<std::mutex> lock(publish_mutex_);
+	auto next = std::make_shared<CameraState>(*std::atomic_load(&state_));
+	update(*next);
+	++next->version;
+	std::atomic_store(&state_, std::shared_ptr<const CameraState>(next));
+}
+
+void CameraStateCache::Run() {
+	steady_clock::time_point polled[CameraState::kEntries];
+	bool never[CameraState::kEntries];
+	std::fill(never, never + CameraState::kEntries, true);
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_) {
+		// the intervals follow the capture state of the last poll
+		const bool capturing = Snapshot()->Capturing();
+		const auto now = steady_clock::now();
+		auto next = steady_clock::time_point::max();
+		std::vector<bool> due(CameraState::kEntries, false);
+		bool any = false;
+		for (size_t i = 0; i < CameraState::kEntries; ++i) {
+			const auto at = polled[i] + Interval(i, capturing);
+			due[i] = invalid_[i] || never[i] || at <= now;
+			any = any || due[i];
+			next = due[i] ? next : std::min(next, at);
+			invalid_[i] = false;
+		}
+		if (!any) {
+			cv_.wait_until(lock, next);
+			continue;
+		}
+		lock.unlock();
+
+		// everything that is due in one executor slot
+		auto queries = queries_;
+		std::future<std::shared_ptr<CameraState>> future = executor_.Submit([queries, due]() {
+			auto result = std::make_shared<CameraState>();
+			const size_t capture = static_cast<size_t>(CameraStateEntry::Capture);
+			const size_t battery = static_cast<size_t>(CameraStateEntry::Battery);
+			const size_t storage = static_cast<size_t>(CameraStateEntry::Storage);
+			const size_t settings = static_cast<size_t>(CameraStateEntry::Settings);
+			result->valid[capture] = due[capture] && queries.capture(result->capture);
+			result->valid[battery] = due[battery] && queries.battery(result->battery);
+			result->valid[storage] = due[storage] && queries.storage(result->storage);
+			result->valid[settings] = due[settings] && queries.settings(ins_camera::CameraFunctionMode::FUNCTION_MODE_NORMAL_IMAGE, result->image)
+				&& queries.settings(ins_camera::CameraFunctionMode::FUNCTION_MODE_NORMAL_VIDEO, result->video);
+			return result;
+		});
+		std::shared_ptr<CameraState> result;
+		try {
+			result = future.get();
+		}
+		catch (const std::future_error&) {
+			// the executor was stopped before it got to the queries
+			lock.lock();
+			break;
+		}
+		const auto polled_at = steady_clock::now();
+
+		lock.lock();
+		bool still_invalid[CameraState::kEntries];
+		for (size_t i = 0; i < CameraState::kEntries; ++i) {
+			if (due[i]) {
+				polls_[i].fetch_add(1, std::memory_order_relaxed);
+				polled[i] = polled_at;
+				never[i] = false;
+			}
+			// an Invalidate that came in while the queries ran keeps the entry stale
+			still_invalid[i] = invalid_[i];
+		}
+		lock.unlock();
+		Publish([&](CameraState& state) {
+			for (size_t i = 0; i < CameraState::kEntries; ++i) {
+				if (!due[i] || !result->valid[i]) {
+					continue;
+				}
+				switch (static_cast<CameraStateEntry>(i)) {
+				case CameraStateEntry::Capture:
+					state.capture = result->capture;
+					break;
+				case CameraStateEntry::Battery:
+					state.battery = result->battery;
+					break;
+				case CameraStateEntry::Storage:
+					state.storage = result->storage;
+					break;
+				default:
+					state.image = result->image;
+					state.video = result->video;
+					break;
+				}
+				state.valid[i] = true;
+				state.stale[i] = still_invalid[i];
+				state.updated[i] = polled_at;
+			}
+		});
+		lock.lock();
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <camera/camera.h>
+#include "camera_device.h"
+#include "camera_executor.h"
+
+enum class CameraStateEntry {
+	Capture,
+	Battery,
+	Storage,
+	Settings,
+	Count,
+};
+
+/**
+ * \brief exposure and capture settings of one function mode
+ */
+struct CameraModeSettings {
+	int32_t iso;
+	double shutter_speed;
+	int32_t exposure_mode; // PhotographyOptions_ExposureMode
+	int32_t ev_bias;
+	int32_t contrast;
+	int32_t saturation;
+	int32_t brightness;
+	int32_t sharpness;
+	int32_t white_balance; // PhotographyOptions_WhiteBalance
+};
+
+/**
+ * \brief immutable snapshot of everything the cache knows, readers share it
+ */
+struct CameraState {
+	static const size_t kEntries = static_cast<size_t>(CameraStateEntry::Count);
+
+	ins_camera::CaptureStatus capture;
+	ins_camera::BatteryStatus battery;
+	ins_camera::StorageStatus storage;
+	CameraModeSettings image;  // FUNCTION_MODE_NORMAL_IMAGE
+	CameraModeSettings video;  // FUNCTION_MODE_NORMAL_VIDEO
+
+	bool valid[kEntries];      // polled successfully at least once
+	bool stale[kEntries];      // changed through the SDK since, a refresh is queued
+	std::chrono::steady_clock::time_point updated[kEntries];
+	uint64_t version;
+
+	bool Valid(CameraStateEntry entry) const {
+		return valid[static_cast<size_t>(entry)];
+	}
+	bool Stale(CameraStateEntry entry) const {
+		return stale[static_cast<size_t>(entry)];
+	}
+	int64_t AgeMs(CameraStateEntry entry) const {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - updated[static_cast<size_t>(entry)]).count();
+	}
+	bool Capturing() const {
+		return Valid(CameraStateEntry::Capture) && capture != ins_camera::CaptureStatus::NOT_CAPTURE;
+	}
+};
+
+/**
+ * \brief the camera round trips behind each entry, FromCamera uses the SDK
+ */
+struct CameraStateQueries {
+	std::function<bool(ins_camera::CaptureStatus&)> capture;
+	std::function<bool(ins_camera::BatteryStatus&)> battery;
+	std::function<bool(ins_camera::StorageStatus&)> storage;
+	std::function<bool(ins_camera::CameraFunctionMode mode, CameraModeSettings&)> settings;
+
+	static CameraStateQueries FromCamera(std::shared_ptr<CameraDevice> cam);
+};
+
+struct CameraPollInterval {
+	std::chrono::milliseconds idle;
+	std::chrono::milliseconds capturing;
+};
+
+struct CameraStateCacheOptions {
+	CameraPollInterval capture = { std::chrono::milliseconds(2000), std::chrono::milliseconds(500) };
+	CameraPollInterval battery = { std::chrono::milliseconds(30000), std::chrono::milliseconds(10000) };
+	CameraPollInterval storage = { std::chrono::milliseconds(10000), std::chrono::milliseconds(2000) };
+	CameraPollInterval settings = { std::chrono::milliseconds(60000), std::chrono::milliseconds(60000) };
+};
+
+/**
+ * \class CameraStateCache
+ * \brief Serves camera status without a camera round trip per read. A poller queues the queries on the camera
+ *        command executor, so they take turns with the other commands, each entry at its own interval, faster
+ *        while the camera is capturing. Every refresh publishes a new immutable CameraState with
+ *        std::atomic_store; Snapshot() is a std::atomic_load and never waits for the camera.
+ *        Call Invalidate after changing something through the SDK to have it refreshed right away.
+ */
+class CameraStateCache {
+public:
+	CameraStateCache(CameraStateQueries queries, CameraCommandExecutor& executor,
+		const CameraStateCacheOptions& options = CameraStateCacheOptions());
+	~CameraStateCache();
+
+	/**
+	 * \brief never null, entries that have not been polled yet are not Valid
+	 */
+	std::shared_ptr<const CameraState> Snapshot() const;
+
+	/**
+	 * \brief mark entry stale and refresh it as soon as the executor gets to it
+	 */
+	void Invalidate(CameraStateEntry entry);
+
+	/**
+	 * \brief stop polling, call before the executor is stopped
+	 */
+	void Stop();
+
+	/**
+	 * \return camera queries made so far for entry
+	 */
+	uint64_t Polls(CameraStateEntry entry) const;
+
+private:
+	std::chrono::milliseconds Interval(size_t entry, bool capturing) const;
+	void Publish(const std::function<void(CameraState&)>& update);
+	void Run();
+
+	CameraStateQueries queries_;
+	CameraCommandExecutor& executor_;
+	CameraStateCacheOptions options_;
+	std::shared_ptr<const CameraState> state_; // only through atomic_load/atomic_store
+	std::mutex publish_mutex_;                 // writers take turns, readers do not take it
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool invalid_[CameraState::kEntries];
+	bool stopping_;
+	std::atomic<uint64_t> polls_[CameraState::kEntries];
+	std::thread thread_;
+};
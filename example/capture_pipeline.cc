@@ -0,0 +1,225 @@
+#include "capture_pipeline.h"
+
+#include <iostream>
+#include <thread>
+#include "bounded_queue.h"
+
+class CapturePipeline::Stage {
+public:
+	Stage(const std::string& name, StageFunction function, const StageOptions& options, CapturePipeline* owner)
+		: name_(name), function_(function), options_(options), owner_(owner), queue_(options.queue_capacity),
+		next_(nullptr), busy_(0), processed_(0), failed_(0), dropped_(0), busy_ns_(0) {}
+
+	void SetNext(Stage* next) {
+		next_ = next;
+	}
+
+	void Start() {
+		for (size_t i = 0; i < options_.threads; ++i) {
+			workers_.emplace_back(&Stage::Run, this);
+		}
+	}
+
+	void Join() {
+		for (auto& worker : workers_) {
+			worker.join();
+		}
+		workers_.clear();
+		Shot shot;
+		while (queue_.TryPop(shot)) {
+			++dropped_;
+			owner_->Finish(shot, false);
+		}
+	}
+
+	// moves the shot out only when it was queued
+	bool Push(Shot& shot) {
+		while (!queue_.TryPush(std::move(shot))) {
+			if (options_.policy == BackpressurePolicy::DropNewest || !owner_->running_) {
+				++dropped_;
+				return false;
+			}
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			not_full_.wait(lock, [this]() { return queue_.Size() < queue_.Capacity() || !owner_->running_; });
+		}
+		// the queue stays lock-free, the mutex only orders this against a worker about to sleep
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+		}
+		not_empty_.notify_one();
+		return true;
+	}
+
+	// after running_ was cleared, so waiting workers and producers see it
+	void Wake() {
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+		}
+		not_empty_.notify_all();
+		not_full_.notify_all();
+	}
+
+	StageStats Stats() const {
+		StageStats stats;
+		stats.name = name_;
+		stats.threads = options_.threads;
+		stats.queued = queue_.Size();
+		stats.queue_capacity = queue_.Capacity();
+		stats.busy = busy_;
+		stats.processed = processed_;
+		stats.failed = failed_;
+		stats.dropped = dropped_;
+		stats.busy_seconds = busy_ns_ / 1e9;
+		return stats;
+	}
+
+private:
+	// blocks while the queue is empty, false once the pipeline stops
+	bool Pop(Shot& shot) {
+		while (owner_->running_) {
+			if (queue_.TryPop(shot)) {
+				if (options_.policy == BackpressurePolicy::Block) {
+					{
+						std::lock_guard<std::mutex> lock(wake_mutex_);
+					}
+					not_full_.notify_one();
+				}
+				return true;
+			}
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			not_empty_.wait(lock, [this]() { return queue_.Size() > 0 || !owner_->running_; });
+		}
+		return false;
+	}
+
+	void Run() {
+		Shot shot;
+		while (Pop(shot)) {
+			++busy_;
+			const auto begin = std::chrono::steady_clock::now();
+			bool ok = false;
+			try {
+				ok = function_(shot);
+			}
+			catch (const std::exception& e) {
+				std::cerr << name_ << " stage failed on shot " << shot.id << ": " << e.what() << std::endl;
+			}
+			busy_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+			--busy_;
+
+			if (!ok) {
+				++failed_;
+				owner_->Finish(shot, false);
+				continue;
+			}
+			++processed_;
+			if (!next_) {
+				owner_->Finish(shot, true);
+				continue;
+			}
+			if (!next_->Push(shot)) {
+				owner_->Finish(shot, false);
+			}
+		}
+	}
+
+	const std::string name_;
+	StageFunction function_;
+	const StageOptions options_;
+	CapturePipeline* owner_;
+	BoundedQueue<Shot> queue_;
+	Stage* next_;
+	std::vector<std::thread> workers_;
+	std::mutex wake_mutex_;
+	std::condition_variable not_empty_; // workers sleep on it while the queue is empty
+	std::condition_variable not_full_;  // Block producers sleep on it while it is full
+
+	std::atomic<size_t> busy_;
+	std::atomic<uint64_t> processed_;
+	std::atomic<uint64_t> failed_;
+	std::atomic<uint64_t> dropped_;
+	std::atomic<uint64_t> busy_ns_;
+};
+
+CapturePipeline::CapturePipeline(StageFunction capture, StageFunction transfer, StageFunction stitch, const Options& options)
+	: next_id_(0), running_(false), in_flight_(0) {
+	stages_[0].reset(new Stage("capture", capture, options.capture, this));
+	stages_[1].reset(new Stage("transfer", transfer, options.transfer, this));
+	stages_[2].reset(new Stage("stitch", stitch, options.stitch, this));
+	stages_[0]->SetNext(stages_[1].get());
+	stages_[1]->SetNext(stages_[2].get());
+}
+
+CapturePipeline::~CapturePipeline() {
+	Stop();
+}
+
+void CapturePipeline::SetShotCallback(ShotCallback callback) {
+	callback_ = callback;
+}
+
+void CapturePipeline::Start() {
+	if (running_.exchange(true)) {
+		return;
+	}
+	for (auto& stage : stages_) {
+		stage->Start();
+	}
+}
+
+bool CapturePipeline::Trigger() {
+	if (!running_) {
+		return false;
+	}
+	Shot shot;
+	shot.id = ++next_id_;
+	shot.triggered_at = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(drain_mutex_);
+		++in_flight_;
+	}
+	if (!stages_[0]->Push(shot)) {
+		Finish(shot, false);
+		return false;
+	}
+	return true;
+}
+
+void CapturePipeline::Drain() {
+	std::unique_lock<std::mutex> lock(drain_mutex_);
+	drain_cv_.wait(lock, [this]() { return in_flight_ == 0 || !running_; });
+}
+
+void CapturePipeline::Stop() {
+	if (!running_.exchange(false)) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(drain_mutex_);
+	}
+	drain_cv_.notify_all();
+	for (auto& stage : stages_) {
+		stage->Wake();
+	}
+	for (auto& stage : stages_) {
+		stage->Join();
+	}
+}
+
+std::vector<StageStats> CapturePipeline::Stats() const {
+	std::vector<StageStats> stats;
+	for (const auto& stage : stages_) {
+		stats.push_back(stage->Stats());
+	}
+	return stats;
+}
+
+void CapturePipeline::Finish(const Shot& shot, bool ok) {
+	if (callback_) {
+		callback_(shot, ok);
+	}
+	std::lock_guard<std::mutex> lock(drain_mutex_);
+	if (in_flight_ > 0 && --in_flight_ == 0) {
+		drain_cv_.notify_all();
+	}
+}
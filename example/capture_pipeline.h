@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * \brief One photo travelling through the capture -> transfer -> stitch pipeline.
+ */
+struct Shot {
+	uint64_t id = 0;
+	std::string remote_url;  // filled by the capture stage, e.g. TakePhoto().GetSingleOrigin()
+	std::string local_path;  // filled by the transfer stage
+	std::string output_path; // filled by the stitch stage
+	std::chrono::steady_clock::time_point triggered_at;
+};
+
+/**
+ * \brief What a stage does when the queue in front of the next stage is full.
+ *        Block stalls the upstream worker until there is room, DropNewest discards the shot.
+ */
+enum class BackpressurePolicy {
+	Block,
+	DropNewest,
+};
+
+struct StageOptions {
+	StageOptions(size_t threads = 1, size_t queue_capacity = 4, BackpressurePolicy policy = BackpressurePolicy::Block)
+		: threads(threads), queue_capacity(queue_capacity), policy(policy) {}
+	size_t threads;
+	size_t queue_capacity; // shots waiting in front of this stage
+	BackpressurePolicy policy; // applied when pushing into this stage
+};
+
+struct StageStats {
+	std::string name;
+	size_t threads;
+	size_t queued;
+	size_t queue_capacity;
+	size_t busy;            // workers currently running the stage function
+	uint64_t processed;
+	uint64_t failed;
+	uint64_t dropped;
+	double busy_seconds;    // accumulated worker time, busy_seconds / (threads * wall time) is the utilization
+};
+
+/**
+ * \class CapturePipeline
+ * \brief Runs capture, transfer and stitch as separate stages connected by bounded lock-free queues,
+ *        each with its own worker threads, so shot N+1 captures while shot N downloads and shot N-1 stitches.
+ *        Sustained throughput is limited by the slowest stage instead of the sum of all stages.
+ */
+class CapturePipeline {
+public:
+	/**
+	 * A stage function works on the shot in place and returns false to abandon it.
+	 */
+	typedef std::function<bool(Shot&)> StageFunction;
+	typedef std::function<void(const Shot&, bool ok)> ShotCallback;
+
+	struct Options {
+		StageOptions capture;
+		StageOptions transfer;
+		StageOptions stitch;
+	};
+
+	CapturePipeline(StageFunction capture, StageFunction transfer, StageFunction stitch, const Options& options);
+	~CapturePipeline();
+
+	/**
+	 * \brief called once per shot leaving the pipeline, from the thread of the stage it left
+	 */
+	void SetShotCallback(ShotCallback callback);
+
+	void Start();
+
+	/**
+	 * \brief request one more shot, subject to the capture stage backpressure policy
+	 * \return false if the shot was dropped
+	 */
+	bool Trigger();
+
+	/**
+	 * \brief block until every triggered shot has left the pipeline
+	 */
+	void Drain();
+
+	/**
+	 * \brief stop the workers, shots still queued are abandoned
+	 */
+	void Stop();
+
+	std::vector<StageStats> Stats() const;
+
+private:
+	class Stage;
+
+	void Finish(const Shot& shot, bool ok);
+
+	std::unique_ptr<Stage> stages_[3];
+	ShotCallback callback_;
+	std::atomic<uint64_t> next_id_;
+	std::atomic<bool> running_;
+
+	std::mutex drain_mutex_;
+	std::condition_variable drain_cv_;
+	size_t in_flight_;
+};
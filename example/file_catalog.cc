@@ -0,0 +1,293 @@
+#include "file_catalog.h"
+
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+#include <unordered_set>
+#include "file_util.h"
+
+namespace {
+	const CatalogState kStates[] = { CatalogState::New, CatalogState::Downloading, CatalogState::Downloaded, CatalogState::Stitched,
+		CatalogState::Deleted };
+
+	bool ParseState(const std::string& name, CatalogState& state) {
+		for (CatalogState candidate : kStates) {
+			if (name == CatalogStateName(candidate)) {
+				state = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// the log is compacted once it has this many more lines than files
+	const size_t kCompactSlack = 1024;
+}
+
+const char* CatalogStateName(CatalogState state) {
+	switch (state) {
+	case CatalogState::New:
+		return "new";
+	case CatalogState::Downloading:
+		return "downloading";
+	case CatalogState::Downloaded:
+		return "downloaded";
+	case CatalogState::Stitched:
+		return "stitched";
+	default:
+		return "deleted";
+	}
+}
+
+FileCatalog::FileCatalog(const std::string& path) : path_(path), log_(nullptr), records_(0) {
+}
+
+FileCatalog::~FileCatalog() {
+	if (log_) {
+		fclose(log_);
+	}
+}
+
+std::string FileCatalog::Record(const CatalogEntry& entry) {
+	// "<state> <size> <sha1 or -> <unix time> <remote>", the remote last as it may contain spaces
+	return std::string(CatalogStateName(entry.state)) + " " + std::to_string(entry.size) + " " + (entry.sha1.empty() ? "-" : entry.sha1)
+		+ " " + std::to_string(entry.updated) + " " + entry.remote + "\n";
+}
+
+bool FileCatalog::Apply(const std::string& line) {
+	std::istringstream fields(line);
+	std::string state_name;
+	CatalogEntry entry;
+	if (!(fields >> state_name >> entry.size >> entry.sha1 >> entry.updated) || !ParseState(state_name, entry.state)) {
+		return false;
+	}
+	std::getline(fields >> std::ws, entry.remote);
+	if (entry.remote.empty()) {
+		return false;
+	}
+	if (entry.sha1 == "-") {
+		entry.sha1.clear();
+	}
+	entries_[entry.remote] = entry;
+	return true;
+}
+
+bool FileCatalog::Load() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (log_) {
+		fclose(log_);
+		log_ = nullptr;
+	}
+	entries_.clear();
+	records_ = 0;
+
+	std::string contents;
+	FILE* file = fopen(path_.c_str(), "rb");
+	const bool existed = file != nullptr;
+	if (file) {
+		char buf[65536];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+			contents.append(buf, n);
+		}
+		fclose(file);
+	}
+	// only whole lines count, a line without its newline was cut short by a crash
+	size_t begin = 0;
+	for (size_t end = contents.find('\n'); end != std::string::npos; begin = end + 1, end = contents.find('\n', begin)) {
+		if (Apply(contents.substr(begin, end - begin))) {
+			++records_;
+		}
+	}
+	const bool torn = begin < contents.size();
+
+	// a torn tail would glue itself to the next record, so the log is rewritten without it
+	if (torn || records_ > entries_.size() + kCompactSlack) {
+		CompactLocked();
+	}
+	if (!log_) {
+		log_ = fopen(path_.c_str(), "ab");
+	}
+	return existed;
+}
+
+bool FileCatalog::AppendLocked(const std::vector<const CatalogEntry*>& entries) {
+	if (entries.empty()) {
+		return true;
+	}
+	if (!log_ && !(log_ = fopen(path_.c_str(), "ab"))) {
+		return false;
+	}
+	std::string lines;
+	for (const auto entry : entries) {
+		lines += Record(*entry);
+	}
+	const bool ok = fwrite(lines.data(), 1, lines.size(), log_) == lines.size() && file_util::SyncFile(log_);
+	records_ += entries.size();
+	if (records_ > 2 * entries_.size() + kCompactSlack) {
+		CompactLocked();
+	}
+	return ok;
+}
+
+CatalogDiff FileCatalog::Sync(const std::vector<std::string>& listing) {
+	CatalogDiff diff;
+	std::lock_guard<std::mutex> lock(mutex_);
+	const int64_t now = static_cast<int64_t>(time(NULL));
+	std::vector<const CatalogEntry*> changed;
+	std::unordered_set<std::string> listed(listing.begin(), listing.end());
+	for (const auto& remote : listing) {
+		auto it = entries_.find(remote);
+		if (it != entries_.end() && it->second.state != CatalogState::Deleted) {
+			continue;
+		}
+		// a file that reappears under a deleted name is a new file
+		CatalogEntry& entry = entries_[remote];
+		entry.remote = remote;
+		entry.state = CatalogState::New;
+		entry.size = 0;
+		entry.sha1.clear();
+		entry.updated = now;
+		changed.push_back(&entry);
+		diff.added.push_back(remote);
+	}
+	for (auto& it : entries_) {
+		if (it.second.state != CatalogState::Deleted && listed.count(it.first) == 0) {
+			it.second.state = CatalogState::Deleted;
+			it.second.updated = now;
+			changed.push_back(&it.second);
+			diff.removed.push_back(it.first);
+		}
+	}
+	AppendLocked(changed);
+	return diff;
+}
+
+bool FileCatalog::Transition(const std::string& remote, CatalogState state, uint64_t size, const std::string& sha1) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = entries_.find(remote);
+	if (it == entries_.end()) {
+		CatalogEntry entry;
+		entry.remote = remote;
+		entry.size = 0;
+		it = entries_.insert(std::make_pair(remote, entry)).first;
+	}
+	CatalogEntry& entry = it->second;
+	entry.state = state;
+	entry.size = size > 0 ? size : entry.size;
+	entry.sha1 = sha1.empty() ? entry.sha1 : sha1;
+	entry.updated = static_cast<int64_t>(time(NULL));
+	return AppendLocked(std::vector<const CatalogEntry*>(1, &entry));
+}
+
+bool FileCatalog::Lookup(const std::string& remote, CatalogEntry& entry) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = entries_.find(remote);
+	if (it == entries_.end()) {
+		return false;
+	}
+	entry = it->second;
+	return true;
+}
+
+std::vector<CatalogEntry> FileCatalog::InState(CatalogState state) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<CatalogEntry> entries;
+	for (const auto& it : entries_) {
+		if (it.second.state == state) {
+			entries.push_back(it.second);
+		}
+	}
+	return entries;
+}
+
+CatalogCounts FileCatalog::Counts() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	CatalogCounts counts = {};
+	for (const auto& it : entries_) {
+		const size_t state = static_cast<size_t>(it.second.state);
+		++counts.files[state];
+		counts.bytes[state] += it.second.size;
+	}
+	counts.records = records_;
+	return counts;
+}
+
+bool FileCatalog::Compact() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return CompactLocked();
+}
+
+bool FileCatalog::CompactLocked() {
+	const std::string part = path_ + ".part";
+	FILE* file = fopen(part.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	std::string lines;
+	size_t records = 0;
+	for (auto it = entries_.begin(); it != entries_.end();) {
+		if (it->second.state == CatalogState::Deleted) {
+			it = entries_.erase(it);
+			continue;
+		}
+		lines += Record(it->second);
+		++records;
+		++it;
+	}
+	// on the disk before the rename, or a power loss could leave the log renamed but empty
+	bool ok = fwrite(lines.data(), 1, lines.size(), file) == lines.size() && file_util::SyncFile(file);
+	ok = fclose(file) == 0 && ok;
+	if (log_) {
+		fclose(log_);
+		log_ = nullptr;
+	}
+	// replaced in one step, a crash leaves either the old log or the new one
+	if (!ok || !file_util::Rename(part, path_)) {
+		file_util::Remove(part);
+		log_ = fopen(path_.c_str(), "ab");
+		return false;
+	}
+	file_util::SyncParentDirectory(path_);
+	records_ = records;
+	log_ = fopen(path_.c_str(), "ab");
+	return log_ != nullptr;
+}
+
+void FileCatalog::RegisterRoutes(crow::SimpleApp& app) {
+	CROW_ROUTE(app, "/catalog")
+		([this]() {
+		const auto counts = Counts();
+		crow::json::wvalue body;
+		for (CatalogState state : kStates) {
+			body[CatalogStateName(state)]["files"] = counts.files[static_cast<size_t>(state)];
+			body[CatalogStateName(state)]["bytes"] = counts.bytes[static_cast<size_t>(state)];
+		}
+		body["records"] = counts.records;
+		crow::response res(body.dump());
+		res.set_header("Content-Type", "application/json");
+		return res;
+	});
+
+	CROW_ROUTE(app, "/catalog/<string>")
+		([this](const std::string& state_name) {
+		CatalogState state;
+		if (!ParseState(state_name, state)) {
+			return crow::response(404);
+		}
+		std::vector<crow::json::wvalue> files;
+		for (const auto& entry : InState(state)) {
+			crow::json::wvalue file;
+			file["remote"] = entry.remote;
+			file["size"] = entry.size;
+			file["sha1"] = entry.sha1;
+			file["updated"] = entry.updated;
+			files.push_back(std::move(file));
+		}
+		crow::json::wvalue body;
+		body["files"] = std::move(files);
+		crow::response res(body.dump());
+		res.set_header("Content-Type", "application/json");
+		return res;
+	});
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "crow.h"
+
+enum class CatalogState {
+	New,         // listed on the card, not fetched yet
+	Downloading, // a transfer started; still the state after a crash, the transfer resumes from its .part file
+	Downloaded,
+	Stitched,
+	Deleted,     // gone from the card
+};
+
+const char* CatalogStateName(CatalogState state);
+
+struct CatalogEntry {
+	std::string remote;
+	CatalogState state;
+	uint64_t size;    // 0 until known
+	std::string sha1; // of the local copy, empty until downloaded
+	int64_t updated;  // unix time of the last transition
+};
+
+struct CatalogDiff {
+	std::vector<std::string> added;
+	std::vector<std::string> removed;
+};
+
+struct CatalogCounts {
+	size_t files[5];  // per CatalogState
+	uint64_t bytes[5];
+	size_t records;   // in the log, compacted down to one per file
+};
+
+/**
+ * \class FileCatalog
+ * \brief Local record of every file the camera had: path, size, state and checksum. Every change is one line
+ *        appended to the log file and synced to the disk before the call returns, so a crash or a power loss
+ *        loses at most the line being written, which Load() ignores. Compaction rewrites the log with one line
+ *        per file in a temporary file that is synced and then renamed over it. Sync() diffs a GetCameraFilesList()
+ *        listing against the catalog in memory and only writes the files that changed, so offload, retention and
+ *        dashboards read the catalog instead of asking the camera.
+ */
+class FileCatalog {
+public:
+	/**
+	 * \param path the log, e.g. <offload dir>.catalog
+	 */
+	explicit FileCatalog(const std::string& path);
+	~FileCatalog();
+
+	FileCatalog(const FileCatalog&) = delete;
+	FileCatalog& operator=(const FileCatalog&) = delete;
+
+	/**
+	 * \brief replay the log, false if it cannot be opened (a new catalog starts empty)
+	 */
+	bool Load();
+
+	/**
+	 * \brief new files of the listing become New, files missing from it become Deleted
+	 */
+	CatalogDiff Sync(const std::vector<std::string>& listing);
+
+	/**
+	 * \brief record a state change, size and sha1 are kept from before when 0 / empty
+	 */
+	bool Transition(const std::string& remote, CatalogState state, uint64_t size = 0, const std::string& sha1 = std::string());
+
+	bool Lookup(const std::string& remote, CatalogEntry& entry) const;
+	std::vector<CatalogEntry> InState(CatalogState state) const;
+	CatalogCounts Counts() const;
+
+	/**
+	 * \brief rewrite the log with one line per file, Deleted files are dropped
+	 */
+	bool Compact();
+
+	/**
+	 * \brief register GET /catalog (counts) and GET /catalog/<state> (files), call before app.run_async()
+	 */
+	void RegisterRoutes(crow::SimpleApp& app);
+
+private:
+	bool Apply(const std::string& line);
+	bool AppendLocked(const std::vector<const CatalogEntry*>& entries);
+	bool CompactLocked();
+	static std::string Record(const CatalogEntry& entry);
+
+	std::string path_;
+	mutable std::mutex mutex_;
+	std::unordered_map<std::string, CatalogEntry> entries_;
+	FILE* log_;
+	size_t records_;
+};
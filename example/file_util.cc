@@ -0,0 +1,337 @@
+#include "file_util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+#include <crow/TinySHA1.hpp>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace file_util {
+	int64_t FileSize(const std::string& path) {
+#ifdef _WIN32
+		struct _stat64 st;
+		if (_stat64(path.c_str(), &st) != 0) {
+			return -1;
+		}
+#else
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			return -1;
+		}
+#endif
+		return static_cast<int64_t>(st.st_size);
+	}
+
+	int64_t ModifiedTime(const std::string& path) {
+#ifdef _WIN32
+		struct _stat64 st;
+		if (_stat64(path.c_str(), &st) != 0) {
+			return -1;
+		}
+#else
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			return -1;
+		}
+#endif
+		return static_cast<int64_t>(st.st_mtime);
+	}
+
+	bool MakeDirectories(const std::string& path) {
+		for (size_t pos = path.find_first_of("/\\", 1); ; pos = path.find_first_of("/\\", pos + 1)) {
+			const std::string dir = path.substr(0, pos);
+			if (!dir.empty() && dir.back() != ':') {
+#ifdef _WIN32
+				const int ret = _mkdir(dir.c_str());
+#else
+				const int ret = mkdir(dir.c_str(), 0755);
+#endif
+				if (ret != 0 && errno != EEXIST) {
+					return false;
+				}
+			}
+			if (pos == std::string::npos) {
+				return true;
+			}
+		}
+	}
+
+	bool Rename(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	bool Remove(const std::string& path) {
+		return std::remove(path.c_str()) == 0;
+	}
+
+	bool SyncFile(FILE* file) {
+		if (fflush(file) != 0) {
+			return false;
+		}
+#ifdef _WIN32
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+
+	bool SyncParentDirectory(const std::string& path) {
+#ifdef _WIN32
+		(void)path;
+		return true;
+#else
+		const size_t slash = path.find_last_of('/');
+		const std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+		const int fd = open(dir.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		const bool ok = fsync(fd) == 0;
+		close(fd);
+		return ok;
+#endif
+	}
+
+	bool Copy(const std::string& from, const std::string& to) {
+		FILE* in = fopen(from.c_str(), "rb");
+		if (!in) {
+			return false;
+		}
+		const std::string part = to + ".part";
+		FILE* out = fopen(part.c_str(), "wb");
+		if (!out) {
+			fclose(in);
+			return false;
+		}
+		char buf[65536];
+		size_t n;
+		bool ok = true;
+		while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+			ok = fwrite(buf, 1, n, out) == n;
+		}
+		ok = ok && !ferror(in);
+		fclose(in);
+		ok = fclose(out) == 0 && ok;
+		if (!ok || !Rename(part, to)) {
+			Remove(part);
+			return false;
+		}
+		return true;
+	}
+
+	std::string Basename(const std::string& path) {
+		return path.substr(path.find_last_of("/\\") + 1);
+	}
+
+	std::string JoinUrl(const std::string& base_url, const std::string& uri) {
+		if (!base_url.empty() && base_url.back() == '/' && !uri.empty() && uri.front() == '/') {
+			return base_url + uri.substr(1);
+		}
+		return base_url + uri;
+	}
+
+	std::string ToHex(const uint8_t* data, size_t size) {
+		static const char digits[] = "0123456789abcdef";
+		std::string hex;
+		hex.reserve(size * 2);
+		for (size_t i = 0; i < size; ++i) {
+			hex += digits[data[i] >> 4];
+			hex += digits[data[i] & 0xf];
+		}
+		return hex;
+	}
+
+	std::string Sha1File(const std::string& path) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file) {
+			return std::string();
+		}
+		sha1::SHA1 sha;
+		char buf[65536];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+			sha.processBytes(buf, n);
+		}
+		fclose(file);
+		uint8_t digest[20];
+		sha.getDigestBytes(digest);
+		return ToHex(digest, sizeof(digest));
+	}
+
+#ifdef _WIN32
+	PositionalFile::PositionalFile() : handle_(INVALID_HANDLE_VALUE) {
+	}
+
+	bool PositionalFile::Open(const std::string& path, uint64_t size) {
+		Close();
+		handle_ = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle_ == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER end;
+		end.QuadPart = static_cast<LONGLONG>(size);
+		return size == 0 || (SetFilePointerEx(handle_, end, nullptr, FILE_BEGIN) && SetEndOfFile(handle_));
+	}
+
+	bool PositionalFile::WriteAt(uint64_t offset, const char* data, size_t size) {
+		while (size > 0) {
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD written = 0;
+			const DWORD n = static_cast<DWORD>(std::min<size_t>(size, 1 << 30));
+			if (!WriteFile(handle_, data, n, &written, &overlapped) || written == 0) {
+				return false;
+			}
+			offset += written;
+			data += written;
+			size -= written;
+		}
+		return true;
+	}
+
+	bool PositionalFile::Close() {
+		if (handle_ == INVALID_HANDLE_VALUE) {
+			return true;
+		}
+		const bool ok = CloseHandle(handle_) != 0;
+		handle_ = INVALID_HANDLE_VALUE;
+		return ok;
+	}
+#else
+	PositionalFile::PositionalFile() : fd_(-1) {
+	}
+
+	bool PositionalFile::Open(const std::string& path, uint64_t size) {
+		Close();
+		fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd_ < 0) {
+			return false;
+		}
+		// reserve the blocks up front so the chunks do not fragment the file, a sparse file is the fallback
+		return size == 0 || posix_fallocate(fd_, 0, static_cast<off_t>(size)) == 0
+			|| ftruncate(fd_, static_cast<off_t>(size)) == 0;
+	}
+
+	bool PositionalFile::WriteAt(uint64_t offset, const char* data, size_t size) {
+		while (size > 0) {
+			const ssize_t written = pwrite(fd_, data, size, static_cast<off_t>(offset));
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+			if (written <= 0) {
+				return false;
+			}
+			offset += written;
+			data += written;
+			size -= written;
+		}
+		return true;
+	}
+
+	bool PositionalFile::Close() {
+		if (fd_ < 0) {
+			return true;
+		}
+		const bool ok = close(fd_) == 0;
+		fd_ = -1;
+		return ok;
+	}
+#endif
+
+	PositionalFile::~PositionalFile() {
+		Close();
+	}
+
+#ifdef _WIN32
+	MappedFile::MappedFile() : data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr) {
+	}
+
+	bool MappedFile::Open(const std::string& path) {
+		Close();
+		file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER size;
+		if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) {
+			Close();
+			return false;
+		}
+		size_ = static_cast<size_t>(size.QuadPart);
+		if (size_ == 0) {
+			return true;
+		}
+		mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		data_ = mapping_ ? static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		if (!data_) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close() {
+		if (data_) {
+			UnmapViewOfFile(data_);
+		}
+		if (mapping_) {
+			CloseHandle(mapping_);
+		}
+		if (file_ != INVALID_HANDLE_VALUE) {
+			CloseHandle(file_);
+		}
+		data_ = nullptr;
+		size_ = 0;
+		mapping_ = nullptr;
+		file_ = INVALID_HANDLE_VALUE;
+	}
+#else
+	MappedFile::MappedFile() : data_(nullptr), size_(0) {
+	}
+
+	bool MappedFile::Open(const std::string& path) {
+		Close();
+		const int fd = open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			return false;
+		}
+		size_ = static_cast<size_t>(st.st_size);
+		void* data = size_ > 0 ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+		// the mapping keeps its own reference to the file
+		close(fd);
+		if (data == MAP_FAILED) {
+			size_ = 0;
+			return false;
+		}
+		data_ = static_cast<const uint8_t*>(data);
+		return true;
+	}
+
+	void MappedFile::Close() {
+		if (data_) {
+			munmap(const_cast<uint8_t*>(data_), size_);
+		}
+		data_ = nullptr;
+		size_ = 0;
+	}
+#endif
+
+	MappedFile::~MappedFile() {
+		Close();
+	}
+}
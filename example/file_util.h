@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * Small portable file helpers, the example is built as C++11 so std::filesystem is not available.
+ */
+namespace file_util {
+	/**
+	 * \return size of the file in bytes, -1 if it does not exist
+	 */
+	int64_t FileSize(const std::string& path);
+
+	/**
+	 * \return last modification time in seconds since the epoch, -1 if the file does not exist
+	 */
+	int64_t ModifiedTime(const std::string& path);
+
+	/**
+	 * \brief create the directory and missing parents, succeeds if it already exists
+	 */
+	bool MakeDirectories(const std::string& path);
+
+	/**
+	 * \brief rename, replacing the destination if it exists
+	 */
+	bool Rename(const std::string& from, const std::string& to);
+
+	bool Remove(const std::string& path);
+
+	/**
+	 * \brief flush the stream and have the OS write it to the disk (fsync / _commit), so it survives a power loss
+	 */
+	bool SyncFile(FILE* file);
+
+	/**
+	 * \brief make a rename or a new file in the directory of path durable, a no-op on Windows
+	 */
+	bool SyncParentDirectory(const std::string& path);
+
+	/**
+	 * \brief copy the contents of from into to, through a temporary file so to is never left half written
+	 */
+	bool Copy(const std::string& from, const std::string& to);
+
+	/**
+	 * \brief "/DCIM/Camera01/IMG_1.insp" -> "IMG_1.insp"
+	 */
+	std::string Basename(const std::string& path);
+
+	/**
+	 * \brief join the camera http base url (with trailing slash) and a file uri (with or without leading slash)
+	 */
+	std::string JoinUrl(const std::string& base_url, const std::string& uri);
+
+	std::string ToHex(const uint8_t* data, size_t size);
+
+	/**
+	 * \brief SHA1 of the whole file as lowercase hex, empty if it cannot be read
+	 */
+	std::string Sha1File(const std::string& path);
+
+	/**
+	 * \class PositionalFile
+	 * \brief Output file written at explicit offsets (pwrite / overlapped WriteFile), so several threads
+	 *        can fill different regions of it at once without sharing a file position.
+	 */
+	class PositionalFile {
+	public:
+		PositionalFile();
+		~PositionalFile();
+
+		/**
+		 * \brief create or truncate the file and reserve size bytes for it, 0 to leave it empty
+		 */
+		bool Open(const std::string& path, uint64_t size);
+		bool WriteAt(uint64_t offset, const char* data, size_t size);
+		bool Close();
+
+	private:
+		PositionalFile(const PositionalFile&);
+		PositionalFile& operator=(const PositionalFile&);
+
+#ifdef _WIN32
+		void* handle_;
+#else
+		int fd_;
+#endif
+	};
+
+	/**
+	 * \class MappedFile
+	 * \brief Read-only memory mapping of a whole file, pages are only read when they are touched.
+	 */
+	class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open(const std::string& path);
+		void Close();
+
+		const uint8_t* Data() const {
+			return data_;
+		}
+		size_t Size() const {
+			return size_;
+		}
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		const uint8_t* data_;
+		size_t size_;
+#ifdef _WIN32
+		void* file_;
+		void* mapping_;
+#endif
+	};
+}
@@ -0,0 +1,359 @@
+#include "fmp4_writer.h"
+
+#include "annexb.h"
+
+using ins_camera::VideoEncodeType;
+
+namespace {
+	void U8(std::string& out, uint32_t value) {
+		out += static_cast<char>(value & 0xff);
+	}
+
+	void U16(std::string& out, uint32_t value) {
+		U8(out, value >> 8);
+		U8(out, value);
+	}
+
+	void U32(std::string& out, uint32_t value) {
+		U16(out, value >> 16);
+		U16(out, value);
+	}
+
+	void U64(std::string& out, uint64_t value) {
+		U32(out, static_cast<uint32_t>(value >> 32));
+		U32(out, static_cast<uint32_t>(value));
+	}
+
+	void Zeros(std::string& out, size_t count) {
+		out.append(count, '\0');
+	}
+
+	void PatchU32(std::string& out, size_t pos, uint32_t value) {
+		for (int i = 0; i < 4; ++i) {
+			out[pos + i] = static_cast<char>((value >> (24 - 8 * i)) & 0xff);
+		}
+	}
+
+	size_t Begin(std::string& out, const char* type) {
+		const size_t pos = out.size();
+		U32(out, 0);
+		out.append(type, 4);
+		return pos;
+	}
+
+	size_t BeginFull(std::string& out, const char* type, uint32_t version, uint32_t flags) {
+		const size_t pos = Begin(out, type);
+		U32(out, (version << 24) | flags);
+		return pos;
+	}
+
+	void End(std::string& out, size_t pos) {
+		PatchU32(out, pos, static_cast<uint32_t>(out.size() - pos));
+	}
+
+	void Matrix(std::string& out) {
+		const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+		for (auto value : unity) {
+			U32(out, value);
+		}
+	}
+
+	// trun sample_flags: sample_depends_on and sample_is_non_sync_sample
+	const uint32_t kSyncSample = 0x02000000;
+	const uint32_t kNonSyncSample = 0x01010000;
+}
+
+FragmentedMp4Writer::FragmentedMp4Writer(const std::string& path, VideoEncodeType codec, uint32_t width, uint32_t height,
+	uint32_t timescale)
+	: file_(fopen(path.c_str(), "wb")), codec_(codec), width_(width), height_(height), timescale_(timescale),
+	started_(false), ok_(file_ != nullptr), sequence_(0), decode_time_(0), last_duration_(0) {
+}
+
+FragmentedMp4Writer::~FragmentedMp4Writer() {
+	Close();
+}
+
+bool FragmentedMp4Writer::AddFrame(const uint8_t* data, size_t size, int64_t timestamp) {
+	if (!ok_) {
+		return false;
+	}
+	bool keyframe = false;
+	std::vector<std::string> parameter_sets;
+	std::string sample;
+	annexb::ForEachNal(data, size, [&](const uint8_t* nal, size_t nal_size) {
+		const int type = annexb::NalType(codec_, nal);
+		keyframe = keyframe || annexb::IsKeyframe(codec_, type);
+		if (annexb::IsParameterSet(codec_, type)) {
+			parameter_sets.push_back(std::string(reinterpret_cast<const char*>(nal), nal_size));
+		}
+		U32(sample, static_cast<uint32_t>(nal_size));
+		sample.append(reinterpret_cast<const char*>(nal), nal_size);
+	});
+
+	if (!started_) {
+		// the sample entry needs the parameter sets, so the file starts at the first keyframe that carries them
+		if (!keyframe || !WriteInit(parameter_sets)) {
+			return ok_;
+		}
+		started_ = true;
+	}
+
+	if (!samples_.empty()) {
+		int64_t duration = timestamp - samples_.back().timestamp;
+		if (duration <= 0) {
+			duration = last_duration_ > 0 ? last_duration_ : 1;
+		}
+		samples_.back().duration = static_cast<uint32_t>(duration);
+		last_duration_ = static_cast<uint32_t>(duration);
+	}
+	if (keyframe && !samples_.empty()) {
+		// the previous GOP is complete now that the duration of its last frame is known
+		ok_ = WriteFragment();
+	}
+	const Sample entry = { static_cast<uint32_t>(sample.size()), 0, keyframe, timestamp };
+	samples_.push_back(entry);
+	mdat_.append(sample);
+	return ok_;
+}
+
+bool FragmentedMp4Writer::Close() {
+	if (!file_) {
+		return ok_;
+	}
+	if (!samples_.empty()) {
+		samples_.back().duration = last_duration_ > 0 ? last_duration_ : timescale_ / 30;
+		ok_ = WriteFragment() && ok_;
+	}
+	ok_ = fclose(file_) == 0 && ok_;
+	file_ = nullptr;
+	return ok_;
+}
+
+bool FragmentedMp4Writer::WriteInit(const std::vector<std::string>& parameter_sets) {
+	std::string config;
+	if (codec_ == VideoEncodeType::H264) {
+		const std::string* sps = nullptr;
+		const std::string* pps = nullptr;
+		for (const auto& nal : parameter_sets) {
+			const int type = annexb::NalType(codec_, reinterpret_cast<const uint8_t*>(nal.data()));
+			if (type == 7 && !sps && nal.size() >= 4) {
+				sps = &nal;
+			}
+			if (type == 8 && !pps) {
+				pps = &nal;
+			}
+		}
+		if (!sps || !pps) {
+			return false;
+		}
+		const size_t box = Begin(config, "avcC");
+		U8(config, 1);
+		config.append(sps->substr(1, 3)); // profile, compatibility, level
+		U8(config, 0xff);                 // 4 byte NAL lengths
+		U8(config, 0xe1);
+		U16(config, static_cast<uint32_t>(sps->size()));
+		config.append(*sps);
+		U8(config, 1);
+		U16(config, static_cast<uint32_t>(pps->size()));
+		config.append(*pps);
+		End(config, box);
+	}
+	else {
+		const std::string* sps = nullptr;
+		for (const auto& nal : parameter_sets) {
+			if (annexb::NalType(codec_, reinterpret_cast<const uint8_t*>(nal.data())) == 33 && !sps) {
+				sps = &nal;
+			}
+		}
+		const std::string rbsp = sps ? annexb::ToRbsp(reinterpret_cast<const uint8_t*>(sps->data()), sps->size(), 15) : std::string();
+		if (rbsp.size() < 15) {
+			return false;
+		}
+		// the profile_tier_level right after sps_max_sub_layers_minus1 is byte aligned, copy it as it is.
+		// chroma format and bit depth would need the full SPS, the camera streams 8 bit 4:2:0.
+		const uint8_t layers = static_cast<uint8_t>(rbsp[2]);
+		const size_t box = Begin(config, "hvcC");
+		U8(config, 1);
+		config.append(rbsp.substr(3, 12));
+		U16(config, 0xf000);
+		U8(config, 0xfc);
+		U8(config, 0xfd);
+		U8(config, 0xf8);
+		U8(config, 0xf8);
+		U16(config, 0);
+		U8(config, ((((layers >> 1) & 7) + 1) << 3) | ((layers & 1) << 2) | 3);
+		const int types[] = { 32, 33, 34 };
+		U8(config, 3);
+		for (int type : types) {
+			std::vector<const std::string*> nals;
+			for (const auto& nal : parameter_sets) {
+				if (annexb::NalType(codec_, reinterpret_cast<const uint8_t*>(nal.data())) == type) {
+					nals.push_back(&nal);
+				}
+			}
+			U8(config, type); // array_completeness 0: more may follow in band (hev1)
+			U16(config, static_cast<uint32_t>(nals.size()));
+			for (auto nal : nals) {
+				U16(config, static_cast<uint32_t>(nal->size()));
+				config.append(*nal);
+			}
+		}
+		End(config, box);
+	}
+
+	std::string init;
+	size_t ftyp = Begin(init, "ftyp");
+	init.append("iso5");
+	U32(init, 0x200);
+	init.append("iso5iso6mp41");
+	End(init, ftyp);
+
+	const size_t moov = Begin(init, "moov");
+	size_t box = BeginFull(init, "mvhd", 0, 0);
+	U32(init, 0);
+	U32(init, 0);
+	U32(init, timescale_);
+	U32(init, 0);
+	U32(init, 0x00010000);
+	U16(init, 0x0100);
+	Zeros(init, 10);
+	Matrix(init);
+	Zeros(init, 24);
+	U32(init, 2);
+	End(init, box);
+
+	const size_t trak = Begin(init, "trak");
+	box = BeginFull(init, "tkhd", 0, 3);
+	U32(init, 0);
+	U32(init, 0);
+	U32(init, 1);
+	U32(init, 0);
+	U32(init, 0);
+	Zeros(init, 8);
+	U16(init, 0);
+	U16(init, 0);
+	U16(init, 0);
+	U16(init, 0);
+	Matrix(init);
+	U32(init, width_ << 16);
+	U32(init, height_ << 16);
+	End(init, box);
+
+	const size_t mdia = Begin(init, "mdia");
+	box = BeginFull(init, "mdhd", 0, 0);
+	U32(init, 0);
+	U32(init, 0);
+	U32(init, timescale_);
+	U32(init, 0);
+	U16(init, 0x55c4); // "und"
+	U16(init, 0);
+	End(init, box);
+	box = BeginFull(init, "hdlr", 0, 0);
+	U32(init, 0);
+	init.append("vide");
+	Zeros(init, 12);
+	init.append("VideoHandler", 13);
+	End(init, box);
+
+	const size_t minf = Begin(init, "minf");
+	box = BeginFull(init, "vmhd", 0, 1);
+	Zeros(init, 8);
+	End(init, box);
+	const size_t dinf = Begin(init, "dinf");
+	const size_t dref = BeginFull(init, "dref", 0, 0);
+	U32(init, 1);
+	box = BeginFull(init, "url ", 0, 1);
+	End(init, box);
+	End(init, dref);
+	End(init, dinf);
+
+	const size_t stbl = Begin(init, "stbl");
+	const size_t stsd = BeginFull(init, "stsd", 0, 0);
+	U32(init, 1);
+	const size_t entry = Begin(init, codec_ == VideoEncodeType::H264 ? "avc1" : "hev1");
+	Zeros(init, 6);
+	U16(init, 1);
+	Zeros(init, 16);
+	U16(init, width_);
+	U16(init, height_);
+	U32(init, 0x00480000);
+	U32(init, 0x00480000);
+	U32(init, 0);
+	U16(init, 1);
+	Zeros(init, 32);
+	U16(init, 0x18);
+	U16(init, 0xffff);
+	init.append(config);
+	End(init, entry);
+	End(init, stsd);
+	const char* empty_tables[] = { "stts", "stsc", "stco" };
+	for (const char* table : empty_tables) {
+		box = BeginFull(init, table, 0, 0);
+		U32(init, 0);
+		End(init, box);
+	}
+	box = BeginFull(init, "stsz", 0, 0);
+	U32(init, 0);
+	U32(init, 0);
+	End(init, box);
+	End(init, stbl);
+	End(init, minf);
+	End(init, mdia);
+	End(init, trak);
+
+	const size_t mvex = Begin(init, "mvex");
+	box = BeginFull(init, "trex", 0, 0);
+	U32(init, 1);
+	U32(init, 1);
+	U32(init, 0);
+	U32(init, 0);
+	U32(init, 0);
+	End(init, box);
+	End(init, mvex);
+	End(init, moov);
+
+	ok_ = fwrite(init.data(), 1, init.size(), file_) == init.size();
+	return ok_;
+}
+
+bool FragmentedMp4Writer::WriteFragment() {
+	std::string moof;
+	const size_t moof_box = Begin(moof, "moof");
+	size_t box = BeginFull(moof, "mfhd", 0, 0);
+	U32(moof, ++sequence_);
+	End(moof, box);
+	const size_t traf = Begin(moof, "traf");
+	box = BeginFull(moof, "tfhd", 0, 0x020000); // default-base-is-moof
+	U32(moof, 1);
+	End(moof, box);
+	box = BeginFull(moof, "tfdt", 1, 0);
+	U64(moof, decode_time_);
+	End(moof, box);
+	box = BeginFull(moof, "trun", 0, 0x000701); // data offset, per sample duration, size and flags
+	U32(moof, static_cast<uint32_t>(samples_.size()));
+	const size_t data_offset = moof.size();
+	U32(moof, 0);
+	uint64_t duration = 0;
+	for (const auto& sample : samples_) {
+		U32(moof, sample.duration);
+		U32(moof, sample.size);
+		U32(moof, sample.keyframe ? kSyncSample : kNonSyncSample);
+		duration += sample.duration;
+	}
+	End(moof, box);
+	End(moof, traf);
+	End(moof, moof_box);
+	PatchU32(moof, data_offset, static_cast<uint32_t>(moof.size() + 8));
+
+	std::string mdat_header;
+	U32(mdat_header, static_cast<uint32_t>(mdat_.size() + 8));
+	mdat_header.append("mdat");
+	const bool ok = fwrite(moof.data(), 1, moof.size(), file_) == moof.size()
+		&& fwrite(mdat_header.data(), 1, mdat_header.size(), file_) == mdat_header.size()
+		&& fwrite(mdat_.data(), 1, mdat_.size(), file_) == mdat_.size()
+		&& fflush(file_) == 0;
+	decode_time_ += duration;
+	samples_.clear();
+	mdat_.clear();
+	return ok;
+}
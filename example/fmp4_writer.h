@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <camera/ins_types.h>
+
+/**
+ * \class FragmentedMp4Writer
+ * \brief Remuxes one Annex-B video stream into a fragmented MP4 while it is recorded: the init segment (ftyp/moov)
+ *        is written at the first keyframe, then one moof/mdat fragment per GOP. A recording that is cut off stays
+ *        playable up to the last complete fragment, and nothing is rewritten at the end.
+ *        Frames before the first keyframe are skipped. Parameter sets stay in band (avc1/hev1).
+ */
+class FragmentedMp4Writer {
+public:
+	/**
+	 * \param timescale units per second of the frame timestamps, 1000 for milliseconds
+	 */
+	FragmentedMp4Writer(const std::string& path, ins_camera::VideoEncodeType codec, uint32_t width, uint32_t height,
+		uint32_t timescale = 1000);
+	~FragmentedMp4Writer();
+
+	/**
+	 * \brief one access unit in Annex-B format, as delivered to StreamDelegate::OnVideoData
+	 */
+	bool AddFrame(const uint8_t* data, size_t size, int64_t timestamp);
+
+	/**
+	 * \brief write the last fragment and close the file
+	 */
+	bool Close();
+
+	uint64_t Fragments() const {
+		return sequence_;
+	}
+
+private:
+	struct Sample {
+		uint32_t size;
+		uint32_t duration;
+		bool keyframe;
+		int64_t timestamp;
+	};
+
+	bool WriteInit(const std::vector<std::string>& parameter_sets);
+	bool WriteFragment();
+
+	FILE* file_;
+	ins_camera::VideoEncodeType codec_;
+	uint32_t width_;
+	uint32_t height_;
+	uint32_t timescale_;
+	bool started_;
+	bool ok_;
+	uint32_t sequence_;
+	uint64_t decode_time_;     // of the first sample in samples_
+	uint32_t last_duration_;
+	std::vector<Sample> samples_;
+	std::string mdat_;         // samples_ with 4 byte NAL lengths instead of start codes
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/**
+ * \class FrameRing
+ * \brief Single-producer/single-consumer ring of variable sized frames in one preallocated buffer.
+ *        The producer copies a frame into free space and publishes it, the consumer copies whole frames out
+ *        in batches and then releases their space. A frame never wraps around the end of the buffer.
+ *
+ *        The producer may also discard the oldest queued frame (DropOldest). The consumer notices this
+ *        because releasing its batch fails, and copies again, so a batch that raced with a drop is never used.
+ */
+class FrameRing {
+public:
+	struct Frame {
+		size_t offset;      // payload offset in the batch filled by PopBatch
+		uint32_t size;
+		uint8_t stream_type;
+		int64_t timestamp;
+	};
+
+	/**
+	 * \param capacity bytes, rounded up to a power of two, including a 16 byte header per frame
+	 */
+	explicit FrameRing(size_t capacity) : mask_(RoundUp(capacity) - 1), buffer_(new char[mask_ + 1]) {
+		write_.store(0, std::memory_order_relaxed);
+		read_.store(0, std::memory_order_relaxed);
+	}
+
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+
+	/**
+	 * \brief larger frames are always rejected, half the capacity so one frame can always wrap
+	 */
+	size_t MaxFrameSize() const {
+		return (mask_ + 1) / 2 - sizeof(Header);
+	}
+
+	/**
+	 * \brief producer only. false if there is not enough free space
+	 */
+	bool TryPush(const uint8_t* data, size_t size, int64_t timestamp, uint8_t stream_type) {
+		if (size > MaxFrameSize()) {
+			return false;
+		}
+		const size_t capacity = mask_ + 1;
+		const size_t need = sizeof(Header) + Align(size);
+		uint64_t w = write_.load(std::memory_order_relaxed);
+		const uint64_t r = read_.load(std::memory_order_acquire);
+		size_t pos = static_cast<size_t>(w & mask_);
+		const size_t to_end = capacity - pos;
+		if (w + (need <= to_end ? need : to_end + need) - r > capacity) {
+			return false;
+		}
+		if (need > to_end) {
+			// to_end is a multiple of the header size, there is always room for the marker
+			const Header wrap = { kWrap, 0, 0 };
+			memcpy(&buffer_[pos], &wrap, sizeof(wrap));
+			w += to_end;
+			pos = 0;
+		}
+		const Header header = { static_cast<uint32_t>(size), stream_type, timestamp };
+		memcpy(&buffer_[pos], &header, sizeof(header));
+		memcpy(&buffer_[pos + sizeof(header)], data, size);
+		write_.store(w + need, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief producer only. discard the oldest queued frame to make room
+	 * \return false if the ring is empty
+	 */
+	bool DropOldest(uint32_t& dropped_size) {
+		const uint64_t w = write_.load(std::memory_order_relaxed);
+		uint64_t r = read_.load(std::memory_order_acquire);
+		while (r != w) {
+			// only the producer writes into the buffer, so the header at r is intact even if the consumer moved on
+			Header header;
+			memcpy(&header, &buffer_[r & mask_], sizeof(header));
+			const uint64_t next = header.size == kWrap ? r + (mask_ + 1 - (r & mask_)) : r + sizeof(Header) + Align(header.size);
+			if (read_.compare_exchange_weak(r, next, std::memory_order_acq_rel)) {
+				if (header.size == kWrap) {
+					r = next;
+					continue;
+				}
+				dropped_size = header.size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * \brief consumer only. copy queued frames into payload, at least one and then as many as fit in max_bytes,
+	 *        and release their space
+	 * \return false if the ring is empty
+	 */
+	bool PopBatch(std::vector<char>& payload, std::vector<Frame>& frames, size_t max_bytes) {
+		const size_t capacity = mask_ + 1;
+		while (true) {
+			uint64_t r = read_.load(std::memory_order_acquire);
+			const uint64_t w = write_.load(std::memory_order_acquire);
+			payload.clear();
+			frames.clear();
+			uint64_t p = r;
+			bool torn = false;
+			while (p < w) {
+				const size_t pos = static_cast<size_t>(p & mask_);
+				Header header;
+				memcpy(&header, &buffer_[pos], sizeof(header));
+				if (header.size == kWrap) {
+					p += capacity - pos;
+					continue;
+				}
+				// a drop by the producer can let it overwrite what is being read here, never trust a header blindly
+				if (header.size > MaxFrameSize() || pos + sizeof(Header) + header.size > capacity
+					|| p + sizeof(Header) + Align(header.size) > w) {
+					torn = true;
+					break;
+				}
+				if (!frames.empty() && payload.size() + header.size > max_bytes) {
+					break;
+				}
+				const Frame frame = { payload.size(), header.size, static_cast<uint8_t>(header.stream_type), header.timestamp };
+				frames.push_back(frame);
+				payload.insert(payload.end(), &buffer_[pos + sizeof(Header)], &buffer_[pos + sizeof(Header)] + header.size);
+				p += sizeof(Header) + Align(header.size);
+			}
+			if (p > w) {
+				torn = true;
+			}
+			if (!torn && p == r) {
+				return false;
+			}
+			if (!torn && read_.compare_exchange_strong(r, p, std::memory_order_acq_rel)) {
+				return !frames.empty();
+			}
+		}
+	}
+
+	/**
+	 * \brief bytes in use including headers and padding, approximate while the other side is active
+	 */
+	size_t Used() const {
+		const uint64_t w = write_.load(std::memory_order_acquire);
+		const uint64_t r = read_.load(std::memory_order_acquire);
+		return w > r ? static_cast<size_t>(w - r) : 0;
+	}
+
+	size_t Capacity() const {
+		return mask_ + 1;
+	}
+
+private:
+	struct Header {
+		uint32_t size;
+		uint32_t stream_type;
+		int64_t timestamp;
+	};
+	static const uint32_t kWrap = 0xffffffff;
+
+	static size_t Align(size_t n) {
+		return (n + sizeof(Header) - 1) & ~(sizeof(Header) - 1);
+	}
+
+	static size_t RoundUp(size_t n) {
+		size_t capacity = 4096;
+		while (capacity < n) {
+			capacity <<= 1;
+		}
+		return capacity;
+	}
+
+	const size_t mask_;
+	std::unique_ptr<char[]> buffer_;
+	// positions only ever grow, so a stale value can never be mistaken for a current one.
+	// padded rather than alignas, the ring is heap allocated and C++11 new ignores extended alignment
+	std::atomic<uint64_t> write_;
+	char pad_[64];
+	std::atomic<uint64_t> read_;
+};
@@ -0,0 +1,305 @@
+#include "http_client.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using boost::asio::ip::tcp;
+
+namespace {
+	struct ParsedUrl {
+		std::string host;
+		std::string port;
+		std::string target;
+	};
+
+	bool ParseUrl(const std::string& url, ParsedUrl& parsed) {
+		const std::string scheme = "http://";
+		if (url.compare(0, scheme.size(), scheme) != 0) {
+			return false;
+		}
+		const size_t host_begin = scheme.size();
+		const size_t target_begin = url.find('/', host_begin);
+		const std::string authority = url.substr(host_begin, target_begin - host_begin);
+		const size_t colon = authority.rfind(':');
+		if (colon == std::string::npos) {
+			parsed.host = authority;
+			parsed.port = "80";
+		}
+		else {
+			parsed.host = authority.substr(0, colon);
+			parsed.port = authority.substr(colon + 1);
+		}
+		parsed.target = target_begin == std::string::npos ? "/" : url.substr(target_begin);
+		return !parsed.host.empty();
+	}
+
+	std::string Lower(std::string s) {
+		std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+		return s;
+	}
+
+	std::string Trim(const std::string& s) {
+		const size_t begin = s.find_first_not_of(" \t\r\n");
+		if (begin == std::string::npos) {
+			return std::string();
+		}
+		return s.substr(begin, s.find_last_not_of(" \t\r\n") - begin + 1);
+	}
+
+	/**
+	 * \brief parse a number the server sent, without throwing on garbage.
+	 * \param end_chars characters that may follow the digits, e.g. ';' before chunk extensions
+	 */
+	bool ParseUnsigned(const std::string& text, int base, uint64_t& value, const char* end_chars = "") {
+		// strtoull would skip leading blanks and wrap a minus sign around
+		if (text.empty() || !std::isxdigit(static_cast<unsigned char>(text[0]))) {
+			return false;
+		}
+		errno = 0;
+		char* end = nullptr;
+		const unsigned long long parsed = std::strtoull(text.c_str(), &end, base);
+		if (errno != 0 || end == text.c_str()) {
+			return false;
+		}
+		if (*end != '\0' && std::strchr(end_chars, *end) == nullptr) {
+			return false;
+		}
+		value = parsed;
+		return true;
+	}
+}
+
+std::string HttpResponseHead::Header(const std::string& name) const {
+	auto it = headers.find(Lower(name));
+	return it == headers.end() ? std::string() : it->second;
+}
+
+HttpClient::HttpClient(std::chrono::milliseconds timeout) : timeout_(timeout) {
+}
+
+bool HttpClient::Head(const std::string& url, HttpResponseHead& head) {
+	return Request("HEAD", url, -1, -1, head, nullptr);
+}
+
+bool HttpClient::Get(const std::string& url, HttpResponseHead& head, const BodySink& sink, int64_t range_first, int64_t range_last) {
+	return Request("GET", url, range_first, range_last, head, &sink);
+}
+
+bool HttpClient::Fail(const std::string& error) {
+	error_ = error;
+	return false;
+}
+
+bool HttpClient::Wait(tcp::socket& socket, bool& done) {
+	io_.restart();
+	io_.run_for(timeout_);
+	if (!done) {
+		// cancel the pending operation and let its handler run before the stack frame goes away
+		boost::system::error_code ignored;
+		socket.close(ignored);
+		io_.restart();
+		io_.run();
+		return Fail("timed out");
+	}
+	return true;
+}
+
+bool HttpClient::ReadMore(tcp::socket& socket, boost::asio::streambuf& buffer) {
+	bool done = false;
+	boost::system::error_code ec;
+	socket.async_read_some(buffer.prepare(65536), [&](const boost::system::error_code& e, size_t n) {
+		ec = e;
+		buffer.commit(n);
+		done = true;
+	});
+	if (!Wait(socket, done)) {
+		return false;
+	}
+	if (ec) {
+		return Fail(ec.message());
+	}
+	return true;
+}
+
+bool HttpClient::ReadLine(tcp::socket& socket, boost::asio::streambuf& buffer, std::string& line) {
+	while (true) {
+		const char* data = boost::asio::buffer_cast<const char*>(buffer.data());
+		const char* end = data + buffer.size();
+		const char* eol = std::search(data, end, "\r\n", "\r\n" + 2);
+		if (eol != end) {
+			line.assign(data, eol);
+			buffer.consume(eol - data + 2);
+			return true;
+		}
+		if (buffer.size() > 65536) {
+			return Fail("header line too long");
+		}
+		if (!ReadMore(socket, buffer)) {
+			return false;
+		}
+	}
+}
+
+bool HttpClient::Request(const std::string& method, const std::string& url, int64_t range_first, int64_t range_last,
+	HttpResponseHead& head, const BodySink* sink) {
+	head = HttpResponseHead();
+	ParsedUrl parsed;
+	if (!ParseUrl(url, parsed)) {
+		return Fail("unsupported url: " + url);
+	}
+
+	tcp::socket socket(io_);
+	tcp::resolver resolver(io_);
+	boost::system::error_code ec;
+	auto endpoints = resolver.resolve(parsed.host, parsed.port, ec);
+	if (ec) {
+		return Fail(ec.message());
+	}
+
+	bool done = false;
+	boost::asio::async_connect(socket, endpoints, [&](const boost::system::error_code& e, const tcp::endpoint&) {
+		ec = e;
+		done = true;
+	});
+	if (!Wait(socket, done)) {
+		return false;
+	}
+	if (ec) {
+		return Fail(ec.message());
+	}
+
+	std::ostringstream request;
+	request << method << ' ' << parsed.target << " HTTP/1.1\r\n"
+		<< "Host: " << parsed.host << ':' << parsed.port << "\r\n"
+		<< "Connection: close\r\n";
+	if (range_first >= 0) {
+		request << "Range: bytes=" << range_first << '-';
+		if (range_last >= 0) {
+			request << range_last;
+		}
+		request << "\r\n";
+	}
+	request << "\r\n";
+	const std::string request_str = request.str();
+
+	done = false;
+	boost::asio::async_write(socket, boost::asio::buffer(request_str), [&](const boost::system::error_code& e, size_t) {
+		ec = e;
+		done = true;
+	});
+	if (!Wait(socket, done)) {
+		return false;
+	}
+	if (ec) {
+		return Fail(ec.message());
+	}
+
+	boost::asio::streambuf buffer;
+	std::string line;
+	if (!ReadLine(socket, buffer, line)) {
+		return false;
+	}
+	std::istringstream status_line(line);
+	std::string version;
+	status_line >> version >> head.status;
+	if (version.compare(0, 5, "HTTP/") != 0) {
+		return Fail("malformed status line: " + line);
+	}
+	while (true) {
+		if (!ReadLine(socket, buffer, line)) {
+			return false;
+		}
+		if (line.empty()) {
+			break;
+		}
+		const size_t colon = line.find(':');
+		if (colon != std::string::npos) {
+			head.headers[Lower(Trim(line.substr(0, colon)))] = Trim(line.substr(colon + 1));
+		}
+	}
+	const std::string length = head.Header("content-length");
+	if (!length.empty()) {
+		uint64_t content_length = 0;
+		if (!ParseUnsigned(length, 10, content_length) || content_length > static_cast<uint64_t>(INT64_MAX)) {
+			return Fail("malformed content-length: " + length);
+		}
+		head.content_length = static_cast<int64_t>(content_length);
+	}
+
+	if (head.status < 200 || head.status >= 300) {
+		return Fail("http status " + std::to_string(head.status));
+	}
+	if (!sink || method == "HEAD") {
+		return true;
+	}
+	return ReadBody(socket, buffer, head, *sink);
+}
+
+bool HttpClient::ReadBody(tcp::socket& socket, boost::asio::streambuf& buffer, const HttpResponseHead& head, const BodySink& sink) {
+	if (Lower(head.Header("transfer-encoding")).find("chunked") != std::string::npos) {
+		std::string line;
+		while (true) {
+			if (!ReadLine(socket, buffer, line)) {
+				return false;
+			}
+			uint64_t chunk = 0;
+			if (!ParseUnsigned(line, 16, chunk, "; \t")) {
+				return Fail("malformed chunk size: " + line);
+			}
+			if (chunk == 0) {
+				return true;
+			}
+			uint64_t remaining = chunk;
+			while (remaining > 0) {
+				if (buffer.size() == 0 && !ReadMore(socket, buffer)) {
+					return false;
+				}
+				const size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+				if (!sink(boost::asio::buffer_cast<const char*>(buffer.data()), n)) {
+					return Fail("aborted");
+				}
+				buffer.consume(n);
+				remaining -= n;
+			}
+			if (!ReadLine(socket, buffer, line)) {
+				return false;
+			}
+		}
+	}
+
+	uint64_t received = 0;
+	while (head.content_length < 0 || received < static_cast<uint64_t>(head.content_length)) {
+		if (buffer.size() == 0) {
+			bool done = false;
+			boost::system::error_code ec;
+			socket.async_read_some(buffer.prepare(262144), [&](const boost::system::error_code& e, size_t n) {
+				ec = e;
+				buffer.commit(n);
+				done = true;
+			});
+			if (!Wait(socket, done)) {
+				return false;
+			}
+			if (ec == boost::asio::error::eof && head.content_length < 0) {
+				return true;
+			}
+			if (ec) {
+				return Fail(ec.message());
+			}
+		}
+		size_t n = buffer.size();
+		if (head.content_length >= 0) {
+			n = static_cast<size_t>(std::min<uint64_t>(n, head.content_length - received));
+		}
+		if (!sink(boost::asio::buffer_cast<const char*>(buffer.data()), n)) {
+			return Fail("aborted");
+		}
+		buffer.consume(n);
+		received += n;
+	}
+	return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <boost/asio.hpp>
+
+struct HttpResponseHead {
+	int status = 0;
+	std::map<std::string, std::string> headers; // lower case names
+	int64_t content_length = -1;                // -1 when the server did not send one
+
+	std::string Header(const std::string& name) const;
+};
+
+/**
+ * \class HttpClient
+ * \brief Minimal blocking HTTP/1.1 client for the camera's GetHttpBaseUrl() file server,
+ *        every operation is bounded by the timeout. One instance per thread.
+ */
+class HttpClient {
+public:
+	/**
+	 * \brief receives the body in pieces, return false to abort the transfer
+	 */
+	typedef std::function<bool(const char* data, size_t size)> BodySink;
+
+	explicit HttpClient(std::chrono::milliseconds timeout = std::chrono::milliseconds(10000));
+
+	bool Head(const std::string& url, HttpResponseHead& head);
+
+	/**
+	 * \param range_first first byte to fetch, -1 for the whole file (no Range header)
+	 * \param range_last last byte to fetch (inclusive), -1 for up to the end
+	 * \return true if a 2xx response was fully received. Check head.status for 206 vs 200,
+	 *         a server without range support answers 200 with the whole file.
+	 */
+	bool Get(const std::string& url, HttpResponseHead& head, const BodySink& sink, int64_t range_first = -1, int64_t range_last = -1);
+
+	const std::string& LastError() const {
+		return error_;
+	}
+
+private:
+	bool Request(const std::string& method, const std::string& url, int64_t range_first, int64_t range_last,
+		HttpResponseHead& head, const BodySink* sink);
+	bool ReadBody(boost::asio::ip::tcp::socket& socket, boost::asio::streambuf& buffer, const HttpResponseHead& head, const BodySink& sink);
+	bool ReadMore(boost::asio::ip::tcp::socket& socket, boost::asio::streambuf& buffer);
+	bool ReadLine(boost::asio::ip::tcp::socket& socket, boost::asio::streambuf& buffer, std::string& line);
+	bool Wait(boost::asio::ip::tcp::socket& socket, bool& done);
+	bool Fail(const std::string& error);
+
+	boost::asio::io_context io_;
+	std::chrono::milliseconds timeout_;
+	std::string error_;
+};
@@ -0,0 +1,105 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+	const int kSubBucketBits = 7;                         // values below 128 have a bucket each
+	const uint64_t kHalf = 1ull << (kSubBucketBits - 1);  // linear buckets per power of two above that
+	const int kMaxBit = 42;                               // about 50 days in us, larger values are clamped
+
+	int HighestBit(uint64_t value) {
+		int bit = 0;
+		while (value >>= 1) {
+			++bit;
+		}
+		return bit;
+	}
+}
+
+LatencyHistogram::LatencyHistogram()
+	: buckets_(BucketOf((1ull << (kMaxBit + 1)) - 1) + 1, 0), count_(0), min_(std::numeric_limits<uint64_t>::max()), max_(0), sum_(0) {
+}
+
+size_t LatencyHistogram::BucketOf(uint64_t us) {
+	us = std::min<uint64_t>(us, (1ull << (kMaxBit + 1)) - 1);
+	const int bit = HighestBit(us);
+	if (bit < kSubBucketBits) {
+		return static_cast<size_t>(us);
+	}
+	// the top kSubBucketBits bits select the bucket, (us >> shift) is in [kHalf, 2 * kHalf)
+	const int shift = bit - kSubBucketBits + 1;
+	return static_cast<size_t>(shift * kHalf + (us >> shift));
+}
+
+uint64_t LatencyHistogram::HighestOf(size_t bucket) {
+	if (bucket < 2 * kHalf) {
+		return bucket;
+	}
+	const int shift = static_cast<int>(bucket / kHalf) - 1;
+	const uint64_t mantissa = bucket % kHalf + kHalf;
+	return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t us) {
+	++buckets_[BucketOf(us)];
+	++count_;
+	min_ = std::min(min_, us);
+	max_ = std::max(max_, us);
+	sum_ += static_cast<double>(us);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+	for (size_t i = 0; i < buckets_.size(); ++i) {
+		buckets_[i] += other.buckets_[i];
+	}
+	count_ += other.count_;
+	min_ = std::min(min_, other.min_);
+	max_ = std::max(max_, other.max_);
+	sum_ += other.sum_;
+}
+
+uint64_t LatencyHistogram::Count() const {
+	return count_;
+}
+
+uint64_t LatencyHistogram::Min() const {
+	return count_ == 0 ? 0 : min_;
+}
+
+uint64_t LatencyHistogram::Max() const {
+	return max_;
+}
+
+double LatencyHistogram::Mean() const {
+	return count_ == 0 ? 0 : sum_ / count_;
+}
+
+uint64_t LatencyHistogram::Percentile(double q) const {
+	if (count_ == 0) {
+		return 0;
+	}
+	const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(q * count_ + 0.5), 1);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < buckets_.size(); ++i) {
+		seen += buckets_[i];
+		if (seen >= rank) {
+			// never beyond what was actually recorded
+			return std::min(HighestOf(i), max_);
+		}
+	}
+	return max_;
+}
+
+crow::json::wvalue LatencyHistogram::ToJson() const {
+	crow::json::wvalue json;
+	json["count"] = count_;
+	json["min_us"] = Min();
+	json["mean_us"] = Mean();
+	json["p50_us"] = Percentile(0.5);
+	json["p90_us"] = Percentile(0.9);
+	json["p99_us"] = Percentile(0.99);
+	json["p999_us"] = Percentile(0.999);
+	json["max_us"] = max_;
+	return json;
+}
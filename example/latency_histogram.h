@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "crow.h"
+
+/**
+ * \class LatencyHistogram
+ * \brief HDR style histogram of latencies in microseconds: exact below 128 us, above that 64 linear buckets per
+ *        power of two, so every recorded value is kept within 1.6% whatever its magnitude, in a fixed few KB.
+ *        Recording is a shift and an increment; percentiles are read from the bucket counts.
+ */
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void Record(uint64_t us);
+	void Merge(const LatencyHistogram& other);
+
+	uint64_t Count() const;
+	uint64_t Min() const;
+	uint64_t Max() const;
+	double Mean() const;
+
+	/**
+	 * \param q in [0, 1]
+	 * \return the highest value that is equivalent to the q-th recorded value, 0 if empty
+	 */
+	uint64_t Percentile(double q) const;
+
+	/**
+	 * \brief count, min, mean, p50, p90, p99, p999 and max, in us
+	 */
+	crow::json::wvalue ToJson() const;
+
+private:
+	static size_t BucketOf(uint64_t us);
+	static uint64_t HighestOf(size_t bucket);
+
+	std::vector<uint64_t> buckets_;
+	uint64_t count_;
+	uint64_t min_;
+	uint64_t max_;
+	double sum_;
+};
@@ -0,0 +1,164 @@
+#include "lens_synchronizer.h"
+
+#include <algorithm>
+#include <limits>
+
+LensSynchronizer::LensSynchronizer(PairCallback callback, const LensSyncOptions& options)
+	: callback_(callback), options_(options), stopping_(false), sleeping_(false), pairs_(0), skew_sum_(0),
+	min_skew_(std::numeric_limits<int64_t>::max()), max_skew_(std::numeric_limits<int64_t>::min()),
+	abs_skew_(static_cast<size_t>(std::max<int64_t>(options.tolerance, 0)) + 1) {
+	for (int lens = 0; lens < 2; ++lens) {
+		rings_[lens].reset(new FrameRing(options_.ring_bytes));
+		overflows_[lens] = 0;
+		orphans_[lens] = 0;
+	}
+	options_.max_pending = std::max<size_t>(options_.max_pending, 1);
+	thread_ = std::thread(&LensSynchronizer::Run, this);
+}
+
+LensSynchronizer::~LensSynchronizer() {
+	Stop();
+}
+
+bool LensSynchronizer::Push(int lens, const uint8_t* data, size_t size, int64_t timestamp) {
+	if (lens < 0 || lens > 1 || stopping_.load(std::memory_order_relaxed)) {
+		return false;
+	}
+	if (!rings_[lens]->TryPush(data, size, timestamp, static_cast<uint8_t>(lens))) {
+		overflows_[lens].fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	// pairs with the fence in Sleep: either this sees sleeping_, or the pairing thread sees the frame
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping_.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		sleeping_.store(false, std::memory_order_relaxed);
+		wake_.notify_one();
+	}
+	return true;
+}
+
+void LensSynchronizer::Stop() {
+	if (stopping_.exchange(true)) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+	}
+	wake_.notify_one();
+	thread_.join();
+}
+
+void LensSynchronizer::Sleep() {
+	std::unique_lock<std::mutex> lock(wake_mutex_);
+	sleeping_.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (rings_[0]->Used() == 0 && rings_[1]->Used() == 0) {
+		wake_.wait(lock, [this]() { return !sleeping_.load(std::memory_order_relaxed) || stopping_; });
+	}
+	sleeping_.store(false, std::memory_order_relaxed);
+}
+
+bool LensSynchronizer::Drain() {
+	bool any = false;
+	for (int lens = 0; lens < 2; ++lens) {
+		while (rings_[lens]->PopBatch(batch_, frames_, rings_[lens]->MaxFrameSize())) {
+			for (const auto& frame : frames_) {
+				Pending pending;
+				pending.data.assign(batch_.data() + frame.offset, frame.size);
+				pending.timestamp = frame.timestamp;
+				pending_[lens].push_back(std::move(pending));
+			}
+			any = true;
+		}
+	}
+	return any;
+}
+
+void LensSynchronizer::Orphan(int lens) {
+	pending_[lens].pop_front();
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	++orphans_[lens];
+}
+
+void LensSynchronizer::Match(bool flush) {
+	while (!pending_[0].empty() && !pending_[1].empty()) {
+		const Pending& a = pending_[0].front();
+		const Pending& b = pending_[1].front();
+		const int64_t skew = a.timestamp - b.timestamp;
+		if (skew > options_.tolerance) {
+			Orphan(1);
+			continue;
+		}
+		if (skew < -options_.tolerance) {
+			Orphan(0);
+			continue;
+		}
+		const LensFrame lens0 = { reinterpret_cast<const uint8_t*>(a.data.data()), a.data.size(), a.timestamp };
+		const LensFrame lens1 = { reinterpret_cast<const uint8_t*>(b.data.data()), b.data.size(), b.timestamp };
+		callback_(lens0, lens1);
+		{
+			std::lock_guard<std::mutex> lock(stats_mutex_);
+			++pairs_;
+			skew_sum_ += skew;
+			min_skew_ = std::min(min_skew_, skew);
+			max_skew_ = std::max(max_skew_, skew);
+			++abs_skew_[static_cast<size_t>(skew < 0 ? -skew : skew)];
+		}
+		pending_[0].pop_front();
+		pending_[1].pop_front();
+	}
+	// one lens is running ahead while the other delivers nothing, e.g. its frames were dropped upstream
+	for (int lens = 0; lens < 2; ++lens) {
+		while (pending_[lens].size() > (flush ? 0 : options_.max_pending)) {
+			Orphan(lens);
+		}
+	}
+}
+
+void LensSynchronizer::Run() {
+	while (true) {
+		const bool stopping = stopping_;
+		if (Drain()) {
+			Match(false);
+		}
+		else if (stopping) {
+			break;
+		}
+		else {
+			Sleep();
+		}
+	}
+	Drain();
+	Match(true);
+}
+
+LensSyncStats LensSynchronizer::Stats() const {
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	LensSyncStats stats = {};
+	stats.pairs = pairs_;
+	for (int lens = 0; lens < 2; ++lens) {
+		stats.orphans[lens] = orphans_[lens];
+		stats.overflows[lens] = overflows_[lens];
+	}
+	if (pairs_ == 0) {
+		return stats;
+	}
+	stats.mean_skew = static_cast<double>(skew_sum_) / pairs_;
+	stats.min_skew = min_skew_;
+	stats.max_skew = max_skew_;
+	uint64_t seen = 0;
+	bool have_p50 = false;
+	for (size_t i = 0; i < abs_skew_.size(); ++i) {
+		seen += abs_skew_[i];
+		if (!have_p50 && seen * 2 >= pairs_) {
+			stats.p50_abs_skew = static_cast<int64_t>(i);
+			have_p50 = true;
+		}
+		if (seen * 100 >= pairs_ * 99) {
+			stats.p99_abs_skew = static_cast<int64_t>(i);
+			break;
+		}
+	}
+	return stats;
+}
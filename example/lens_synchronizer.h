@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_ring.h"
+
+struct LensSyncOptions {
+	int64_t tolerance = 8;        // largest timestamp difference within a pair, in timestamp units (ms)
+	size_t max_pending = 16;      // frames of one lens waiting for the other lens, the oldest beyond this are orphans
+	size_t ring_bytes = 16 << 20; // input ring per lens
+};
+
+struct LensSyncStats {
+	uint64_t pairs;
+	uint64_t orphans[2];   // frames dropped without a partner within tolerance
+	uint64_t overflows[2]; // frames dropped because the input ring was full
+	double mean_skew;      // lens 0 minus lens 1 over the pairs
+	int64_t min_skew;
+	int64_t max_skew;
+	int64_t p50_abs_skew;
+	int64_t p99_abs_skew;
+};
+
+/**
+ * \class LensSynchronizer
+ * \brief Pairs the frames of stream_index 0 and 1, which the SDK delivers as independent callbacks with their own
+ *        timestamps. Push only copies the frame into the lens' SPSC FrameRing, so it never blocks the stream thread
+ *        and each lens may be delivered from its own thread. A pairing thread drains the rings into per-lens queues
+ *        and matches the heads: two heads within tolerance are a pair; otherwise the older head can no longer find
+ *        a partner, because timestamps only grow, and is dropped as an orphan. With both rings empty the pairing
+ *        thread sleeps until a Push wakes it.
+ */
+class LensSynchronizer {
+public:
+	struct LensFrame {
+		const uint8_t* data;
+		size_t size;
+		int64_t timestamp;
+	};
+
+	/**
+	 * \brief called on the pairing thread, the frames are valid for the duration of the call
+	 */
+	typedef std::function<void(const LensFrame& lens0, const LensFrame& lens1)> PairCallback;
+
+	LensSynchronizer(PairCallback callback, const LensSyncOptions& options = LensSyncOptions());
+	~LensSynchronizer();
+
+	/**
+	 * \brief lock-free while frames flow, one thread per lens at most; only a Push onto an idle synchronizer takes
+	 *        a mutex to wake the pairing thread. false if the frame was dropped because the ring was full
+	 */
+	bool Push(int lens, const uint8_t* data, size_t size, int64_t timestamp);
+
+	/**
+	 * \brief pair what has been pushed, then stop the pairing thread. Frames still unpaired are orphans.
+	 */
+	void Stop();
+
+	LensSyncStats Stats() const;
+
+private:
+	struct Pending {
+		std::string data;
+		int64_t timestamp;
+	};
+
+	bool Drain();
+	void Match(bool flush);
+	void Orphan(int lens);
+	void Sleep();
+	void Run();
+
+	PairCallback callback_;
+	LensSyncOptions options_;
+	std::unique_ptr<FrameRing> rings_[2];
+	std::atomic<uint64_t> overflows_[2];
+	std::atomic<bool> stopping_;
+	std::atomic<bool> sleeping_; // the pairing thread is about to wait, or waits, for a Push
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+
+	// pairing thread only
+	std::deque<Pending> pending_[2];
+	std::vector<char> batch_;
+	std::vector<FrameRing::Frame> frames_;
+
+	mutable std::mutex stats_mutex_;
+	uint64_t pairs_;
+	uint64_t orphans_[2];
+	int64_t skew_sum_;
+	int64_t min_skew_;
+	int64_t max_skew_;
+	std::vector<uint64_t> abs_skew_; // histogram, one bucket per timestamp unit up to tolerance
+	std::thread thread_;
+};
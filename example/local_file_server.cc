@@ -0,0 +1,134 @@
+#include "local_file_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "file_util.h"
+
+LocalFileServer::LocalFileServer(const std::string& root_dir, uint16_t port)
+	: root_dir_(root_dir), port_(port), ranges_(true), stream_rate_(0) {
+	app_.loglevel(crow::LogLevel::Warning);
+	CROW_ROUTE(app_, "/<path>")
+		([this](const crow::request& req, crow::response& res, std::string uri) {
+		Serve(req, res, uri);
+	});
+}
+
+LocalFileServer::~LocalFileServer() {
+	Stop();
+}
+
+void LocalFileServer::EnableRanges(bool enable) {
+	ranges_ = enable;
+}
+
+void LocalFileServer::SetStreamRate(uint64_t bytes_per_second) {
+	stream_rate_ = bytes_per_second;
+}
+
+void LocalFileServer::Throttle(uint64_t bytes) const {
+	const uint64_t rate = stream_rate_;
+	if (rate > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds(bytes * 1000000 / rate));
+	}
+}
+
+void LocalFileServer::Start() {
+	// throttled responses hold their handler thread, leave room for parallel ranges from several clients
+	server_ = app_.bindaddr("127.0.0.1").port(port_).concurrency(16).signal_clear().run_async();
+	app_.wait_for_server_start();
+	// the actual port is only known once the acceptor is running
+	while (app_.port() == 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	port_ = app_.port();
+}
+
+void LocalFileServer::Stop() {
+	if (server_.valid()) {
+		app_.stop();
+		server_.wait();
+		server_ = std::future<void>();
+	}
+}
+
+std::string LocalFileServer::BaseUrl() const {
+	return "http://127.0.0.1:" + std::to_string(port_) + "/";
+}
+
+void LocalFileServer::Serve(const crow::request& req, crow::response& res, const std::string& uri) {
+	if (uri.find("..") != std::string::npos) {
+		res.code = 403;
+		res.end();
+		return;
+	}
+	const std::string path = file_util::JoinUrl(root_dir_ + "/", uri);
+	const int64_t size = file_util::FileSize(path);
+	if (size < 0) {
+		res.code = 404;
+		res.end();
+		return;
+	}
+
+	if (ranges_) {
+		res.set_header("Accept-Ranges", "bytes");
+	}
+	if (req.method == crow::HTTPMethod::Head) {
+		// crow would report the length of the empty body
+		res.skip_body = false;
+		res.manual_length_header = true;
+		res.set_header("Content-Length", std::to_string(size));
+		res.end();
+		return;
+	}
+
+	const std::string range = req.get_header_value("Range");
+	if (!ranges_ || range.compare(0, 6, "bytes=") != 0) {
+		Throttle(static_cast<uint64_t>(size));
+		res.set_static_file_info_unsafe(path);
+		res.end();
+		return;
+	}
+
+	// single range only: bytes=first-[last]
+	int64_t first = -1;
+	int64_t last = size - 1;
+	const size_t dash = range.find('-', 6);
+	try {
+		first = std::stoll(range.substr(6, dash - 6));
+		if (dash != std::string::npos && dash + 1 < range.size()) {
+			last = std::min<int64_t>(std::stoll(range.substr(dash + 1)), size - 1);
+		}
+	}
+	catch (const std::exception&) {
+		first = -1;
+	}
+	if (first < 0 || first > last) {
+		res.code = 416;
+		res.set_header("Content-Range", "bytes */" + std::to_string(size));
+		res.end();
+		return;
+	}
+
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		res.code = 500;
+		res.end();
+		return;
+	}
+	std::string body(static_cast<size_t>(last - first + 1), '\0');
+#ifdef _WIN32
+	_fseeki64(file, first, SEEK_SET);
+#else
+	fseeko(file, first, SEEK_SET);
+#endif
+	body.resize(fread(&body[0], 1, body.size(), file));
+	fclose(file);
+
+	Throttle(body.size());
+	res.code = 206;
+	res.set_header("Content-Type", "application/octet-stream");
+	res.set_header("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(first + body.size() - 1) + "/" + std::to_string(size));
+	res.end(body);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <string>
+#include "crow.h"
+
+/**
+ * \class LocalFileServer
+ * \brief Serves a local directory over HTTP the way the camera's GetHttpBaseUrl() endpoint serves its
+ *        storage card: GET/HEAD of <base url><file uri>, with single byte-range support.
+ *        Stand-in for the camera when testing and benchmarking downloads without hardware.
+ */
+class LocalFileServer {
+public:
+	/**
+	 * \param root_dir directory the file uris are resolved against
+	 * \param port 0 picks a free port
+	 */
+	explicit LocalFileServer(const std::string& root_dir, uint16_t port = 0);
+	~LocalFileServer();
+
+	/**
+	 * \brief answer Range requests with 206 (default) or ignore them and send the whole file like a simple server would
+	 */
+	void EnableRanges(bool enable);
+
+	/**
+	 * \brief cap every response at bytes_per_second, like a single stream over the camera's wifi. 0: no cap
+	 */
+	void SetStreamRate(uint64_t bytes_per_second);
+
+	/**
+	 * \brief start serving, returns once the port is bound
+	 */
+	void Start();
+	void Stop();
+
+	/**
+	 * \brief "http://127.0.0.1:<port>/", with trailing slash like Camera::GetHttpBaseUrl()
+	 */
+	std::string BaseUrl() const;
+
+private:
+	void Serve(const crow::request& req, crow::response& res, const std::string& uri);
+	void Throttle(uint64_t bytes) const;
+
+	crow::SimpleApp app_;
+	std::string root_dir_;
+	uint16_t port_;
+	std::atomic<bool> ranges_;
+	std::atomic<uint64_t> stream_rate_;
+	std::future<void> server_;
+};
@@ -4,9 +4,29 @@
 #include <camera/photography_settings.h>
 #include <camera/device_discovery.h>
 #include <regex>
+#include <sstream>
 #include <vector>
 #include <string>
 #include "crow.h"
+#include "camera_device.h"
+#include "camera_fleet.h"
+#include "camera_service.h"
+#include "capture_pipeline.h"
+#include "stitch_pool.h"
+#include "storage_offloader.h"
+#include "stream_writer.h"
+#include "preview_hub.h"
+#include "progressive_stitcher.h"
+#include "stream_recorder.h"
+#include "telemetry_log.h"
+#include "timelapse_ingest.h"
+#include "video_stitch_queue.h"
+#include "bulk_downloader.h"
+#include "file_catalog.h"
+#include "file_util.h"
+#include "range_downloader.h"
+#include "simulated_camera.h"
+#include "stitch_cache.h"
 
 
 //*** Image stiching ***
@@ -16,93 +36,121 @@
 #include <condition_variable>
 #include <mutex>
 #include <chrono>
+#include <atomic>
+#include <future>
 using namespace std::chrono;
 
-class TestStreamDelegate : public ins_camera::StreamDelegate {
-public:
-	TestStreamDelegate() {
-		file1_ = fopen("./01.h264", "wb");
-		file2_ = fopen("./02.h264", "wb");
-	}
-	~TestStreamDelegate() {
-		fclose(file1_);
-		fclose(file2_);
-	}
+int main(int argc, char* argv[]) {
 
-	void OnAudioData(const uint8_t* data, size_t size, int64_t timestamp) override {
-		std::cout << "on audio data:" << std::endl;
-	}
-	void OnVideoData(const uint8_t* data, size_t size, int64_t timestamp, uint8_t streamType, int stream_index = 0) override {
-		//std::cout << "on video frame:" << size << ";" << timestamp << std::endl;
-		if (stream_index == 0) {
-			fwrite(data, sizeof(uint8_t), size, file1_);
-		}
-		if (stream_index == 1) {
-			fwrite(data, sizeof(uint8_t), size, file2_);
+	//--service: serve the camera over HTTP instead of the interactive menu
+	//--simulate <n>: n simulated cameras instead of the connected ones, to try everything without hardware
+	bool service_mode = false;
+	int simulated = 0;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		service_mode = service_mode || arg == "--service";
+		if (arg == "--simulate" && i + 1 < argc) {
+			simulated = std::stoi(argv[++i]);
 		}
 	}
-	void OnGyroData(const std::vector<ins_camera::GyroData>& data) override {
-		//for (auto& gyro : data) {
-		//	if (gyro.timestamp - last_timestamp > 2) {
-		//		fprintf(file1_, "timestamp:%lld package_size = %d  offtimestamp = %lld gyro:[%f %f %f] accel:[%f %f %f]\n", gyro.timestamp, data.size(), gyro.timestamp - last_timestamp, gyro.gx, gyro.gy, gyro.gz, gyro.ax, gyro.ay, gyro.az);
-		//	}
-		//	last_timestamp = gyro.timestamp;
-		//}
-	}
-	void OnExposureData(const ins_camera::ExposureData& data) override {
-		//fprintf(file2_, "timestamp:%lld shutter_speed_s:%f\n", data.timestamp, data.exposure_time);
-	}
-
-private:
-	FILE* file1_;
-	FILE* file2_;
-	int64_t last_timestamp = 0;
-};
-
-int main(int argc, char* argv[]) {
-
-	crow::SimpleApp app; //define your crow application
-
-	//define your endpoint at the root directory
-	CROW_ROUTE(app, "/")([]() {
-		return "Hello world";
-		});
-
-	//set the port, set the app to run on multiple threads, and run the app
-	app.port(18080).multithreaded().run();
-
-
 
 	std::cout << "Begin open camera..." << std::endl;
 	ins_camera::DeviceDiscovery discovery;
-	auto list = discovery.GetAvailableDevices();
-	for (int i = 0; i < list.size(); ++i) {
-		auto desc = list[i];
-		std::cout << "\nSerial:" << desc.serial_number << "\t"
-			<< "Camera type:" << int(desc.camera_type) << "\t"
-			<< "Lens type:" << int(desc.lens_type) << "\n" << std::endl;
+	std::vector<ins_camera::DeviceDescriptor> list;
+	std::vector<std::shared_ptr<CameraDevice>> cameras;
+	if (simulated > 0) {
+		cameras = SimulatedCamera::Fleet(simulated);
+	}
+	else {
+		list = discovery.GetAvailableDevices();
+		for (int i = 0; i < list.size(); ++i) {
+			auto desc = list[i];
+			std::cout << "\nSerial:" << desc.serial_number << "\t"
+				<< "Camera type:" << int(desc.camera_type) << "\t"
+				<< "Lens type:" << int(desc.lens_type) << "\n" << std::endl;
+		}
+		cameras = SdkCamera::FromDescriptors(list);
 	}
 
-	if (list.size() <= 0) {
+	if (cameras.size() <= 0) {
 		std::cerr << "No device found." << std::endl;
 		return -1;
 	}
 
-	std::shared_ptr<ins_camera::Camera> cam = std::make_shared<ins_camera::Camera>(list[0].info);
-	//ins_camera::Camera cam(list[0].info);
-	if (!cam->Open()) {
+	//preview stream goes through per-lens ring buffers, so a slow disk never stalls the camera's delivery thread
+	std::vector<std::string> stream_paths = { "./01.h264", "./02.h264" };
+	auto stream_writer = std::make_shared<RingStreamWriter>(stream_paths);
+
+	//every camera on the host is opened with its own command thread and stream writer,
+	//the first one drives the menu and the service, the others stream to <serial>_01.h264 / _02.h264
+	const auto serial_writers = CameraFleet::SerialWriters("./");
+	CameraFleet fleet(cameras, [stream_writer, serial_writers](size_t index, const std::string& serial) {
+		return index == 0 ? stream_writer : serial_writers(index, serial);
+	});
+	if (fleet.Size() == 0) {
 		std::cerr << "Failed to open camera" << std::endl;
 		return -1;
 	}
+	std::shared_ptr<CameraDevice> cam = fleet.At(0).camera;
+	//ins_camera::Camera cam(list[0].info);
 
 	std::cout << "\nhttp base url:" << cam->GetHttpBaseUrl() << std::endl;
 
-	std::shared_ptr<ins_camera::StreamDelegate> delegate = std::make_shared<TestStreamDelegate>();
-	cam->SetStreamDelegate(delegate);
+	//the writer thread also indexes the keyframes (01.h264.idx) and remuxes each lens to 01.mp4 / 02.mp4
+	StreamRecorder stream_recorder(stream_paths, cam->GetVideoEncodeType(), 1440, 720);
+	stream_recorder.Attach(*stream_writer);
+
+	//gyro and exposure data of the stream go to a compact binary log, see TelemetryReader for reading it back
+	auto telemetry = std::make_shared<TelemetryWriter>("./telemetry.tlm");
+	stream_writer->SetTelemetryWriter(telemetry);
+
+	//in service mode browsers can watch the preview on ws://host:18080/preview
+	PreviewHub preview_hub(cam->GetVideoEncodeType());
+	preview_hub.Attach(*stream_writer);
 
 	discovery.FreeDeviceDescriptors(list);
 
-	std::cout << "Succeed to open camera!\n" << std::endl;
+	std::cout << "Succeed to open " << fleet.Size() << " camera(s)!\n" << std::endl;
+
+	//what is on the card and how far each file got, offload and the /catalog routes read it instead of the camera
+	FileCatalog file_catalog("C:/Users/Desktop/MasterThesis/offload/.catalog");
+	file_catalog.Load();
+
+	if (service_mode) {
+		crow::SimpleApp app; //define your crow application
+
+		//define your endpoint at the root directory
+		CROW_ROUTE(app, "/")([]() {
+			return "Hello world";
+			});
+
+		CameraService service(cam, "C:/Users/Desktop/MasterThesis/images/");
+		service.RegisterRoutes(app);
+		preview_hub.RegisterRoutes(app);
+		//POST /panorama answers with a preview, the full resolution result is announced on ws://host:18080/panorama/events
+		StitchWorkerPool stitch_pool;
+		ProgressiveStitcher progressive_stitcher(stitch_pool);
+		progressive_stitcher.RegisterRoutes(app, "C:/Users/Desktop/MasterThesis/images/");
+		file_catalog.Sync(cam->GetCameraFilesList());
+		file_catalog.RegisterRoutes(app);
+		//POST /video/stitch only queues the .insv stitch, progress and ETA are pushed on ws://host:18080/video/stitch/events
+		VideoStitchQueue video_stitch_queue(simulated > 0 ? SimulatedVideoStitchFactory(0.05) : SdkVideoStitchFactory());
+		video_stitch_queue.RegisterRoutes(app, "C:/Users/Desktop/MasterThesis/videos/");
+
+		//set the port, set the app to run on multiple threads, and run the app without blocking the camera session
+		auto server = app.port(18080).multithreaded().run_async();
+		server.wait();
+
+		service.Stop();
+		video_stitch_queue.Stop();
+		progressive_stitcher.Stop();
+		stream_writer->Stop();
+		preview_hub.Detach();
+		stream_recorder.Close();
+		telemetry->Close();
+		fleet.Close();
+		return 0;
+	}
 
 	std::cout << "Usage:\n" << std::endl;
 	std::cout << "1: Take photo" << std::endl;
@@ -121,6 +169,18 @@ int main(int argc, char* argv[]) {
 
 	//Testing
 	std::cout << "14: Take photo, stitch and download image" << std::endl;
+	std::cout << "15: Pipelined burst: take, download and stitch photos concurrently" << std::endl;
+	std::cout << "16: Download all files (parallel, resumable)" << std::endl;
+	std::cout << "17: Download large file (parallel ranges, with progress)" << std::endl;
+	std::cout << "18: Start preview stream recording" << std::endl;
+	std::cout << "19: Stop preview stream recording" << std::endl;
+	std::cout << "20: Take photo on all cameras" << std::endl;
+	std::cout << "21: Start recording on all cameras" << std::endl;
+	std::cout << "22: Stop recording on all cameras" << std::endl;
+	std::cout << "23: Start interval shooting, stitching frames while it runs" << std::endl;
+	std::cout << "24: Stop interval shooting" << std::endl;
+	std::cout << "25: Start/stop keeping the card below 85% by offloading the oldest files" << std::endl;
+	std::cout << "26: Queue a video stitch (.insv), progress is shown while the menu stays usable" << std::endl;
 
 	std::cout << "0: Exit\n" << std::endl;
 
@@ -129,6 +189,35 @@ int main(int argc, char* argv[]) {
 	auto start = time(NULL);
 	cam->SyncLocalTimeToCamera(start);
 
+	//Stitchers stay configured between photos instead of being created for every image
+	StitchWorkerPool stitch_pool;
+	//Stitching the same image with the same settings again copies the earlier panorama
+	StitchCache stitch_cache;
+	stitch_cache.Load();
+	//option 14 shows a quick preview first and replaces it with the full resolution panorama when that is done
+	ProgressiveStitcher progressive_stitcher(stitch_pool);
+	progressive_stitcher.AddListener([](const PanoramaUpdate& update) {
+		if (update.stage == PanoramaStage::Full) {
+			std::cout << "\nFull resolution panorama ready in " << update.elapsed_ms << " ms: " << update.output_path << std::endl;
+		}
+	});
+	//options 23 and 24, frames of the interval shooting in progress are downloaded and stitched as they appear
+	std::unique_ptr<TimelapseIngest> timelapse_ingest;
+	const auto interval_mode = ins_camera::CameraTimelapseMode::TIMELAPSE_INTERVAL_SHOOTING; //or TIMELAPSE_STARLAPSE_SHOOTING
+	//option 25, long unattended recordings keep going because the oldest files are moved off the card in time
+	std::unique_ptr<StorageOffloader> storage_offloader;
+	//option 26, video stitches run one after the other in the background
+	VideoStitchQueue video_stitch_queue(simulated > 0 ? SimulatedVideoStitchFactory(0.05) : SdkVideoStitchFactory());
+	video_stitch_queue.AddListener([](const VideoStitchJob& job) {
+		if (job.state == VideoStitchState::Running && job.progress % 10 == 0) {
+			std::cout << "\nVideo stitch " << job.id << ": " << job.progress << "%, " << job.eta_seconds << " s left" << std::endl;
+		}
+		else if (job.state != VideoStitchState::Queued && job.state != VideoStitchState::Running) {
+			std::cout << "\nVideo stitch " << job.id << " " << VideoStitchStateName(job.state) << ": " << job.output_path
+				<< (job.error_info.empty() ? "" : " (" + job.error_info + ")") << std::endl;
+		}
+	});
+
 	int option;
 	while (true) {
 		std::cout << "Please enter index: ";
@@ -259,6 +348,7 @@ int main(int argc, char* argv[]) {
 
 			const auto ret = cam->DownloadCameraFile(download_url, save_path);
 			if (ret) {
+				file_catalog.Transition(download_url, CatalogState::Downloaded, static_cast<uint64_t>(std::max<int64_t>(file_util::FileSize(save_path), 0)));
 				std::cout << "Download " << image_jpg << " succeed!!!" << std::endl;
 			}
 			else {
@@ -324,22 +414,25 @@ int main(int argc, char* argv[]) {
 			}
 
 
+			StitchParams stitch_params;
+			stitch_params.stitch_type = stitch_type;
+			stitch_params.hdr_type = hdr_type;
+			stitch_params.output_width = output_width;
+			stitch_params.output_height = output_height;
+			stitch_params.enable_flowstate = enable_flowstate;
+			stitch_params.enable_denoise = enable_denoise;
+			stitch_params.enable_cuda = enable_cuda;
+			stitch_params.enable_colorplus = enable_colorplus;
+			stitch_params.colorplus_model_path = colorpuls_model_path;
+
 			int count = 1;
 			while (count--) {
 				std::string suffix = input_paths[0].substr(input_paths[0].find_last_of(".") + 1);
 				std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
 				if (suffix == "insp" || suffix == "jpg") {
-					auto image_stitcher = std::make_shared<ins_media::ImageStitcher>();
-					image_stitcher->SetInputPath(input_paths);
-					image_stitcher->SetStitchType(stitch_type);
-					image_stitcher->SetHDRType(hdr_type);
-					image_stitcher->SetOutputPath(output_path);
-					image_stitcher->SetOutputSize(output_width, output_height);
-					image_stitcher->EnableFlowState(enable_flowstate);
-					image_stitcher->EnableDenoise(enable_denoise);
-					image_stitcher->EnableCuda(enable_cuda);
-					image_stitcher->EnableColorPlus(enable_colorplus, colorpuls_model_path);
-					image_stitcher->Stitch();
+					stitch_cache.Stitch(stitch_params, input_paths, output_path, [&](const std::string& stitched_path) {
+						return stitch_pool.Submit(stitch_params, input_paths, stitched_path).get();
+					});
 				}
 				std::cout << "Stitching succeded! \n";
 			}
@@ -438,66 +531,267 @@ int main(int argc, char* argv[]) {
 
 			const auto ret = cam->DownloadCameraFile(download_url, save_path);
 			if (ret) {
+				file_catalog.Transition(download_url, CatalogState::Downloaded, static_cast<uint64_t>(std::max<int64_t>(file_util::FileSize(save_path), 0)));
 				std::string output_image;
 				std::cout << "Type name of image: ";
 				std::cin >> output_image;
 				std::string output_path = "C:/Users/Desktop/MasterThesis/stitched_images/" + output_image + ".jpg";
 
-				// Stichtypes: 
-				//TEMPLATE (fast-not good), OPTFLOW (slow-best), DYNAMICSTICH (fast-relative good)
-				STITCH_TYPE stitch_type = STITCH_TYPE::TEMPLATE;
-				HDR_TYPE hdr_type = HDR_TYPE::ImageHdr_NONE;
-
-				int output_width = 1920;
-				int output_height = 960;
-
-				bool enable_flowstate = true;
-				bool enable_cuda = false;
-				bool enalbe_stitchfusion = true;
-				bool enable_colorplus = true;
-				bool enable_directionlock = true;
-				bool enable_denoise = true;
-				std::string colorpuls_model_path;
-
-				if (input_paths.empty()) {
-					std::cout << "Can not find input_file" << std::endl;
-					return -1;
+				//a TEMPLATE preview is at output_path right away, the DYNAMICSTITCH panorama replaces it in the background
+				std::promise<PanoramaUpdate> preview;
+				auto answered = std::make_shared<std::atomic<bool>>(false);
+				progressive_stitcher.Submit(input_paths, output_path, [&preview, answered, &file_catalog, download_url](const PanoramaUpdate& update) {
+					// the preview is only a stand-in, the file counts as stitched once the full panorama replaced it
+					if (update.stage == PanoramaStage::Full) {
+						file_catalog.Transition(download_url, CatalogState::Stitched);
+					}
+					if (!answered->exchange(true)) {
+						preview.set_value(update);
+					}
+				});
+				const auto update = preview.get_future().get();
+				if (update.stage == PanoramaStage::Failed) {
+					std::cout << "Stitching failed" << std::endl;
 				}
-
-				if (output_path.empty()) {
-					std::cout << "Can not find output_file" << std::endl;
-					return -1;
+				else {
+					std::cout << "Preview ready in " << update.elapsed_ms << " ms, full resolution follows: " << output_path << std::endl;
 				}
+			}
+			else {
+				std::cout << "Something went wrong..." << std::endl;
+			}
+		}
 
-				if (colorpuls_model_path.empty()) {
-					enable_colorplus = false;
+		//Pipelined burst: shot N+1 captures while shot N downloads and shot N-1 stitches
+		if (option == 15) {
+			int shots;
+			std::cout << "Number of photos: ";
+			std::cin >> shots;
+
+			auto capture = [cam](Shot& shot) {
+				const auto url = cam->TakePhoto();
+				if (!url.IsSingleOrigin() || url.Empty()) {
+					return false;
 				}
+				shot.remote_url = url.GetSingleOrigin();
+				return true;
+			};
+			auto transfer = [cam](Shot& shot) {
+				std::string image_insp = shot.remote_url.substr(shot.remote_url.rfind("/") + 1);
+				shot.local_path = "C:/Users/Desktop/MasterThesis/images/" + image_insp;
+				return cam->DownloadCameraFile(shot.remote_url, shot.local_path);
+			};
+			StitchParams stitch_params;
+			auto stitch = [&stitch_pool, stitch_params](Shot& shot) {
+				std::string image_insp = shot.local_path.substr(shot.local_path.rfind("/") + 1);
+				shot.output_path = "C:/Users/Desktop/MasterThesis/stitched_images/" + image_insp.substr(0, image_insp.find('.')) + ".jpg";
+				return stitch_pool.Submit(stitch_params, { shot.local_path }, shot.output_path).get();
+			};
+			stitch_pool.Warm(stitch_params);
+
+			CapturePipeline::Options options;
+			options.capture = StageOptions(1, 2);
+			options.transfer = StageOptions(1, 4);
+			options.stitch = StageOptions(stitch_pool.Workers(), 8);
+
+			CapturePipeline pipeline(capture, transfer, stitch, options);
+			pipeline.SetShotCallback([](const Shot& shot, bool ok) {
+				auto ms = duration_cast<milliseconds>(steady_clock::now() - shot.triggered_at).count();
+				std::cout << "Shot " << shot.id << (ok ? " done: " + shot.output_path : " failed") << " (" << ms << " ms)" << std::endl;
+			});
+
+			auto begin = steady_clock::now();
+			pipeline.Start();
+			for (int i = 0; i < shots; ++i) {
+				pipeline.Trigger();
+			}
+			pipeline.Drain();
+			pipeline.Stop();
+			double seconds = duration_cast<milliseconds>(steady_clock::now() - begin).count() / 1000.0;
+
+			std::cout << "Shots per minute: " << (seconds > 0 ? shots * 60.0 / seconds : 0.0) << std::endl;
+			for (const auto& stage : pipeline.Stats()) {
+				std::cout << stage.name << ": processed " << stage.processed << ", failed " << stage.failed
+					<< ", dropped " << stage.dropped << ", utilization "
+					<< (seconds > 0 ? 100.0 * stage.busy_seconds / (stage.threads * seconds) : 0.0) << "%" << std::endl;
+			}
+		}
 
-				int count = 1;
-				while (count--) {
-					std::string suffix = input_paths[0].substr(input_paths[0].find_last_of(".") + 1);
-					std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
-					if (suffix == "insp" || suffix == "jpg") {
-						auto image_stitcher = std::make_shared<ins_media::ImageStitcher>();
-						image_stitcher->SetInputPath(input_paths);
-						image_stitcher->SetStitchType(stitch_type);
-						image_stitcher->SetHDRType(hdr_type);
-						image_stitcher->SetOutputPath(output_path);
-						image_stitcher->SetOutputSize(output_width, output_height);
-						image_stitcher->EnableFlowState(enable_flowstate);
-						image_stitcher->EnableDenoise(enable_denoise);
-						image_stitcher->EnableCuda(enable_cuda);
-						image_stitcher->EnableColorPlus(enable_colorplus, colorpuls_model_path);
-						image_stitcher->Stitch();
-						std::cout << "Stitching success!!\n";
-					}
+		//Offload the whole card over the camera's http server, files already in the manifest are skipped
+		if (option == 16) {
+			BulkDownloadOptions options;
+			options.concurrency = 4;
+			options.local_dir = "C:/Users/Desktop/MasterThesis/offload/";
+			//only the changes since the last listing are written to the catalog
+			const auto diff = file_catalog.Sync(cam->GetCameraFilesList());
+			std::cout << diff.added.size() << " new files, " << diff.removed.size() << " gone from the card" << std::endl;
+			//new files and the ones a crash interrupted, the downloader resumes those from their .part files
+			std::vector<std::string> pending;
+			for (auto state : { CatalogState::New, CatalogState::Downloading }) {
+				for (const auto& entry : file_catalog.InState(state)) {
+					pending.push_back(entry.remote);
+					file_catalog.Transition(entry.remote, CatalogState::Downloading);
+				}
+			}
+			BulkDownloader downloader(cam->GetHttpBaseUrl(), options);
+			downloader.SetFileCallback([](const std::string& file, bool ok, uint64_t /*bytes*/) {
+				std::cout << "Download " << file << (ok ? " succeed!!!" : " failed!!!") << std::endl;
+			});
+			const auto report = downloader.Run(pending);
+			DownloadManifest manifest(options.local_dir + ".download_manifest");
+			manifest.Load();
+			for (const auto& remote : pending) {
+				DownloadManifest::Entry entry;
+				if (manifest.Lookup(remote, entry) && file_util::FileSize(downloader.LocalPath(remote)) == static_cast<int64_t>(entry.size)) {
+					file_catalog.Transition(remote, CatalogState::Downloaded, entry.size, entry.sha1);
 				}
+				else {
+					file_catalog.Transition(remote, CatalogState::New);
+				}
+			}
+			std::cout << report.downloaded << " downloaded, " << report.skipped << " already done, "
+				<< report.failed << " failed, " << (report.bytes >> 20) << " MB in " << report.seconds << " s" << std::endl;
+		}
 
+		//Download one large video with several Range requests in parallel instead of DownloadCameraFile
+		if (option == 17) {
+			std::string file_to_download;
+			std::cout << "Please input full file path to download: ";
+			std::cin >> file_to_download;
+			const std::string path_to_save = "C:/Users/Desktop/MasterThesis/offload/" + file_util::Basename(file_to_download);
+
+			RangeDownloader downloader;
+			downloader.SetProgressCallback([](const RangeDownloadProgress& progress) {
+				std::cout << "\r" << (progress.received >> 20) << " / " << (progress.total >> 20) << " MB, "
+					<< progress.bytes_per_second / (1 << 20) << " MB/s   " << std::flush;
+			});
+			const auto result = downloader.Download(file_util::JoinUrl(cam->GetHttpBaseUrl(), file_to_download), path_to_save);
+			std::cout << std::endl;
+			if (result.ok) {
+				std::cout << "Download " << file_to_download << " succeed!!! " << result.bytes_per_second / (1 << 20) << " MB/s over "
+					<< result.connections << (result.ranged ? " connections" : " connection (no range support)") << std::endl;
+			}
+			else {
+				std::cout << "Download " << file_to_download << " failed!!! " << result.error << std::endl;
+			}
+		}
 
+		if (option == 18) {
+			if (cam->StartLiveStreaming(PreviewStreamParam())) {
+				std::cout << "Preview stream started, recording to " << stream_paths[0] << " and " << stream_paths[1] << std::endl;
 			}
 			else {
-				std::cout << "Something went wrong..." << std::endl;
+				std::cout << "Failed to start preview stream" << std::endl;
+			}
+		}
+
+		if (option == 19) {
+			if (cam->StopLiveStreaming()) {
+				std::cout << "Preview stream stopped" << std::endl;
+			}
+			else {
+				std::cout << "Failed to stop preview stream" << std::endl;
+			}
+		}
+
+		//fan-out commands, every camera's command thread issues it at the same moment
+		if (option == 20) {
+			std::cout << fleet.TakePhoto() << std::endl;
+		}
+
+		if (option == 21) {
+			std::cout << fleet.StartRecording() << std::endl;
+		}
+
+		if (option == 22) {
+			std::cout << fleet.StopRecording() << std::endl;
+		}
+
+		if (option == 23) {
+			if (timelapse_ingest) {
+				std::cout << "Interval shooting is already running" << std::endl;
+				continue;
+			}
+			ins_camera::TimelapseParam param;
+			param.mode = interval_mode;
+			param.duration = -1;
+			param.lapseTime = 3000;
+			param.accelerate_fequency = 5;
+			if (!cam->SetTimeLapseOption(param)) {
+				std::cerr << "Failed to set capture settings." << std::endl;
+				continue;
+			}
+			TimelapseIngestOptions options;
+			options.local_dir = "C:/Users/Desktop/MasterThesis/timelapse/";
+			options.output_dir = "C:/Users/Desktop/MasterThesis/stitched_images/timelapse/";
+			timelapse_ingest.reset(new TimelapseIngest(cam, *fleet.At(0).executor, stitch_pool, options));
+			timelapse_ingest->SetFrameCallback([](const std::string& remote, const std::string& output_path, bool ok) {
+				std::cout << "\nFrame " << remote << (ok ? " stitched to " + output_path : " failed") << std::endl;
+			});
+			if (!timelapse_ingest->Start() || !cam->StartTimeLapse(param.mode)) {
+				std::cerr << "Failed to start interval shooting" << std::endl;
+				timelapse_ingest.reset();
+				continue;
 			}
+			std::cout << "Interval shooting started, frames go to " << options.output_dir << std::endl;
+		}
+
+		if (option == 24) {
+			if (!timelapse_ingest) {
+				std::cout << "No interval shooting running" << std::endl;
+				continue;
+			}
+			auto url = cam->StopTimeLapse(interval_mode);
+			if (url.Empty()) {
+				std::cerr << "Stop timelapse failed" << std::endl;
+			}
+			//only the frames the camera took since the last poll are left
+			const auto stats = timelapse_ingest->Finish(url);
+			timelapse_ingest.reset();
+			std::cout << stats.stitched << " of " << stats.discovered << " frames stitched, " << stats.pending_at_finish
+				<< " were left when stopping and took " << stats.finish_seconds << " s" << std::endl;
+		}
+
+		if (option == 25) {
+			if (storage_offloader) {
+				storage_offloader->Stop();
+				const auto stats = storage_offloader->Stats();
+				storage_offloader.reset();
+				std::cout << "Offloading stopped, " << stats.offloaded << " files moved off the card, " << (stats.freed_bytes >> 20)
+					<< " MB freed" << std::endl;
+				continue;
+			}
+			StorageOffloadOptions options;
+			options.local_dir = "C:/Users/Desktop/MasterThesis/offload/";
+			options.bytes_per_second = 0;
+			options.recording_bytes_per_second = 4 << 20;
+			storage_offloader.reset(new StorageOffloader(cam, *fleet.At(0).executor, file_catalog, options));
+			storage_offloader->Start();
+			std::cout << "Keeping the card below " << options.high_water * 100 << "%, files go to " << options.local_dir << std::endl;
+		}
+
+		if (option == 26) {
+			const std::string video_path = "C:/Users/Desktop/MasterThesis/videos/";
+			std::string input_video;
+			std::string output_video;
+			//5.7k recordings come as two files, _00_ and _10_, both are needed
+			std::cout << "Please input the .insv file(s) to stitch, separated by spaces: ";
+			std::cin >> std::ws;
+			std::string line;
+			std::getline(std::cin, line);
+			std::vector<std::string> input_paths;
+			std::istringstream names(line);
+			while (names >> input_video) {
+				input_paths.push_back(video_path + input_video);
+			}
+			std::cout << "Please input name for stitched video: ";
+			std::cin >> output_video;
+			const uint64_t id = video_stitch_queue.Submit(input_paths, video_path + output_video + ".mp4");
+			if (id == 0) {
+				std::cerr << "Video stitch queue is full" << std::endl;
+				continue;
+			}
+			std::cout << "Video stitch " << id << " queued, " << video_stitch_queue.Stats().eta_seconds << " s until the queue is done" << std::endl;
 		}
 
 		/*if (option == 30) {
@@ -525,8 +819,15 @@ int main(int argc, char* argv[]) {
 	}*/
 	}
 
-
-	cam->Close();
+	timelapse_ingest.reset();
+	storage_offloader.reset();
+	video_stitch_queue.Stop();
+	//flush the rings before the mp4 fragments are finished
+	stream_writer->Stop();
+	preview_hub.Detach();
+	stream_recorder.Close();
+	telemetry->Close();
+	fleet.Close();
 	return 0;
 
 }
\ No newline at end of file
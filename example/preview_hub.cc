@@ -0,0 +1,171 @@
+#include "preview_hub.h"
+
+#include <algorithm>
+#include "annexb.h"
+#include "stream_writer.h"
+
+PreviewHub::PreviewHub(ins_camera::VideoEncodeType codec, const PreviewHubOptions& options)
+	: codec_(codec), options_(options), stats_(), writer_(nullptr), tap_(0), pending_(false), stopping_(false) {
+}
+
+PreviewHub::~PreviewHub() {
+	Detach();
+}
+
+void PreviewHub::Attach(RingStreamWriter& writer) {
+	Detach();
+	if (rings_.empty()) {
+		for (size_t i = 0; i < options_.lenses; ++i) {
+			rings_.emplace_back(new FrameRing(options_.ring_bytes));
+		}
+	}
+	stopping_ = false;
+	thread_ = std::thread(&PreviewHub::Run, this);
+	writer_ = &writer;
+	tap_ = writer.AddLiveTap([this](size_t lens, const uint8_t* data, size_t size, int64_t timestamp) {
+		Enqueue(lens, data, size, timestamp);
+	});
+}
+
+void PreviewHub::Detach() {
+	if (!writer_) {
+		return;
+	}
+	writer_->RemoveLiveTap(tap_);
+	writer_ = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_one();
+	thread_.join();
+}
+
+void PreviewHub::Enqueue(size_t lens, const uint8_t* data, size_t size, int64_t timestamp) {
+	if (lens >= rings_.size()) {
+		return;
+	}
+	// a live preview wants the newest frames, the oldest make room
+	FrameRing& ring = *rings_[lens];
+	uint32_t dropped = 0;
+	uint64_t overflowed = 0;
+	while (!ring.TryPush(data, size, timestamp, 0)) {
+		++overflowed;
+		if (size > ring.MaxFrameSize() || !ring.DropOldest(dropped)) {
+			break;
+		}
+	}
+	if (overflowed > 0) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		stats_.overflowed += overflowed;
+	}
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		pending_ = true;
+	}
+	wake_.notify_one();
+}
+
+void PreviewHub::Run() {
+	std::vector<char> batch;
+	std::vector<FrameRing::Frame> frames;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			wake_.wait(lock, [this]() { return pending_ || stopping_; });
+			if (stopping_) {
+				return;
+			}
+			pending_ = false;
+		}
+		for (size_t lens = 0; lens < rings_.size(); ++lens) {
+			while (rings_[lens]->PopBatch(batch, frames, 1 << 20)) {
+				for (const auto& frame : frames) {
+					Broadcast(lens, reinterpret_cast<const uint8_t*>(batch.data() + frame.offset), frame.size, frame.timestamp);
+				}
+			}
+		}
+	}
+}
+
+void PreviewHub::RegisterRoutes(crow::SimpleApp& app) {
+	CROW_ROUTE(app, "/preview").websocket()
+		.onopen([this](crow::websocket::connection& viewer) {
+		Add(viewer);
+	})
+		.onclose([this](crow::websocket::connection& viewer, const std::string&) {
+		Remove(viewer);
+	});
+}
+
+void PreviewHub::Add(crow::websocket::connection& viewer) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	Viewer v = { &viewer, ~0ull };
+	viewers_.push_back(v);
+}
+
+void PreviewHub::Remove(crow::websocket::connection& viewer) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	viewers_.erase(std::remove_if(viewers_.begin(), viewers_.end(), [&viewer](const Viewer& v) {
+		return v.connection == &viewer;
+	}), viewers_.end());
+}
+
+void PreviewHub::Broadcast(size_t lens, const uint8_t* data, size_t size, int64_t timestamp) {
+	bool keyframe = false;
+	annexb::ForEachNal(data, size, [&](const uint8_t* nal, size_t) {
+		keyframe = keyframe || annexb::IsKeyframe(codec_, annexb::NalType(codec_, nal));
+	});
+	const uint64_t bit = 1ull << std::min<size_t>(lens, 63);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++stats_.frames;
+	stats_.bytes += size;
+	if (viewers_.empty()) {
+		return;
+	}
+
+	auto message = std::make_shared<std::string>();
+	message->reserve(kHeaderSize + size);
+	message->push_back(static_cast<char>(lens));
+	message->push_back(keyframe ? 1 : 0);
+	message->push_back(codec_ == ins_camera::VideoEncodeType::H264 ? 0 : 1);
+	message->push_back(0);
+	for (int i = 0; i < 8; ++i) {
+		message->push_back(static_cast<char>(static_cast<uint64_t>(timestamp) >> (8 * i)));
+	}
+	message->append(reinterpret_cast<const char*>(data), size);
+	std::shared_ptr<const std::string> shared = message;
+
+	for (auto& viewer : viewers_) {
+		if (viewer.connection->queued_bytes() > options_.max_queued_bytes) {
+			// frames after a gap cannot be decoded anyway, wait for the next keyframe of this lens
+			if ((viewer.waiting & bit) == 0) {
+				++stats_.resyncs;
+			}
+			viewer.waiting |= bit;
+			++stats_.skipped;
+			continue;
+		}
+		if (viewer.waiting & bit) {
+			if (!keyframe) {
+				++stats_.skipped;
+				continue;
+			}
+			viewer.waiting &= ~bit;
+		}
+		viewer.connection->send_binary_shared(shared);
+		++stats_.sends;
+	}
+}
+
+PreviewHubStats PreviewHub::Stats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	PreviewHubStats stats = stats_;
+	stats.viewers = viewers_.size();
+	stats.queued_bytes = 0;
+	for (const auto& viewer : viewers_) {
+		stats.queued_bytes += viewer.connection->queued_bytes();
+	}
+	return stats;
+}
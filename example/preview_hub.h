@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <camera/camera.h>
+#include "crow.h"
+#include "frame_ring.h"
+
+class RingStreamWriter;
+
+struct PreviewHubOptions {
+	size_t max_queued_bytes = 4 << 20; // per viewer, a viewer with more unsent data skips ahead to the next keyframe
+	size_t lenses = 2;                 // video streams taken from the writer, the others are ignored
+	size_t ring_bytes = 4 << 20;       // per lens, frames waiting for the broadcast thread
+};
+
+struct PreviewHubStats {
+	size_t viewers;
+	uint64_t frames;     // broadcast, each encoded once
+	uint64_t bytes;      // of the encoded frames
+	uint64_t sends;      // frames queued on a viewer
+	uint64_t skipped;    // frames a viewer did not get because it was waiting for a keyframe
+	uint64_t resyncs;    // times a viewer fell behind and was moved to the next keyframe
+	size_t queued_bytes; // not yet written to the viewers' sockets, all viewers together
+	uint64_t overflowed; // oldest frames dropped because the broadcast thread fell behind the camera
+};
+
+/**
+ * \class PreviewHub
+ * \brief Fans the live preview out to any number of WebSocket viewers. Every frame is encoded once into a
+ *        reference counted message that all viewers share, so the cost per viewer is a frame header and a queue
+ *        entry. Viewers start at a keyframe; one whose socket falls more than max_queued_bytes behind drops
+ *        frames until the next keyframe of that lens instead of buffering without bound.
+ *
+ *        Attached to a RingStreamWriter, frames are copied into a ring per lens right on the stream callback and
+ *        broadcast from a thread of the hub's own, so the preview neither waits for the disk writer nor holds it up.
+ *
+ *        A message is a 12 byte header followed by the Annex-B access unit:
+ *        lens (u8), flags (u8, bit 0 keyframe), codec (u8, 0 H.264, 1 H.265), reserved (u8), timestamp (i64 LE).
+ */
+class PreviewHub {
+public:
+	static const size_t kHeaderSize = 12;
+
+	explicit PreviewHub(ins_camera::VideoEncodeType codec, const PreviewHubOptions& options = PreviewHubOptions());
+	~PreviewHub();
+
+	/**
+	 * \brief broadcast the video frames of writer as the camera delivers them, until Detach
+	 */
+	void Attach(RingStreamWriter& writer);
+	void Detach();
+
+	/**
+	 * \brief register the /preview WebSocket route on the app, call before app.run_async()
+	 */
+	void RegisterRoutes(crow::SimpleApp& app);
+
+	void Add(crow::websocket::connection& viewer);
+
+	/**
+	 * \brief no frame is sent to viewer once this returns, call it from the close handler
+	 */
+	void Remove(crow::websocket::connection& viewer);
+
+	/**
+	 * \brief one access unit of one lens, as delivered to StreamDelegate::OnVideoData
+	 */
+	void Broadcast(size_t lens, const uint8_t* data, size_t size, int64_t timestamp);
+
+	PreviewHubStats Stats() const;
+
+private:
+	struct Viewer {
+		crow::websocket::connection* connection;
+		uint64_t waiting; // lenses that wait for a keyframe, one bit each
+	};
+
+	void Enqueue(size_t lens, const uint8_t* data, size_t size, int64_t timestamp);
+	void Run();
+
+	ins_camera::VideoEncodeType codec_;
+	PreviewHubOptions options_;
+	mutable std::mutex mutex_;
+	std::vector<Viewer> viewers_;
+	PreviewHubStats stats_;
+	RingStreamWriter* writer_;
+	size_t tap_;
+
+	std::vector<std::unique_ptr<FrameRing>> rings_; // by lens, filled on the stream callback
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	bool pending_;  // frames were queued since the thread last looked
+	bool stopping_;
+	std::thread thread_;
+};
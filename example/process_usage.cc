@@ -0,0 +1,90 @@
+#include "process_usage.h"
+
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+#ifdef _WIN32
+	double Seconds(const FILETIME& time) {
+		ULARGE_INTEGER value;
+		value.LowPart = time.dwLowDateTime;
+		value.HighPart = time.dwHighDateTime;
+		return value.QuadPart / 1e7;
+	}
+#else
+	/**
+	 * "VmRSS:    1234 kB" from /proc/self/status, 0 where there is no procfs
+	 */
+	uint64_t StatusKilobytes(const char* field) {
+		FILE* file = fopen("/proc/self/status", "r");
+		if (!file) {
+			return 0;
+		}
+		char line[256];
+		unsigned long long kb = 0;
+		const size_t length = strlen(field);
+		while (fgets(line, sizeof(line), file)) {
+			if (strncmp(line, field, length) == 0 && line[length] == ':') {
+				sscanf(line + length + 1, "%llu", &kb);
+				break;
+			}
+		}
+		fclose(file);
+		return kb * 1024;
+	}
+#endif
+}
+
+ProcessUsage ProcessUsage::Now() {
+	ProcessUsage usage = {};
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS memory;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) {
+		usage.rss_bytes = memory.WorkingSetSize;
+		usage.peak_rss_bytes = memory.PeakWorkingSetSize;
+	}
+	FILETIME created, exited, kernel, user;
+	if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+		usage.user_seconds = Seconds(user);
+		usage.system_seconds = Seconds(kernel);
+	}
+#else
+	struct rusage self;
+	if (getrusage(RUSAGE_SELF, &self) == 0) {
+		usage.user_seconds = self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6;
+		usage.system_seconds = self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+		usage.peak_rss_bytes = static_cast<uint64_t>(self.ru_maxrss);
+#else
+		usage.peak_rss_bytes = static_cast<uint64_t>(self.ru_maxrss) * 1024;
+#endif
+	}
+	usage.rss_bytes = StatusKilobytes("VmRSS");
+	// unlike ru_maxrss, VmHWM follows ResetPeakRss
+	const uint64_t hwm = StatusKilobytes("VmHWM");
+	usage.peak_rss_bytes = hwm > 0 ? hwm : usage.peak_rss_bytes;
+#endif
+	return usage;
+}
+
+bool ProcessUsage::ResetPeakRss() {
+#if defined(_WIN32) || defined(__APPLE__)
+	return false;
+#else
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if (!file) {
+		return false;
+	}
+	const bool ok = fputs("5", file) >= 0;
+	return fclose(file) == 0 && ok;
+#endif
+}
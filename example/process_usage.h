@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * \brief memory and cpu time of this process so far
+ */
+struct ProcessUsage {
+	uint64_t rss_bytes;      // resident now
+	uint64_t peak_rss_bytes; // high water mark since start or the last ResetPeakRss
+	double user_seconds;
+	double system_seconds;
+
+	static ProcessUsage Now();
+
+	/**
+	 * \brief start a new peak_rss_bytes high water mark where the OS allows it (Linux), false otherwise
+	 */
+	static bool ResetPeakRss();
+};
@@ -0,0 +1,243 @@
+#include "progressive_stitcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "file_util.h"
+
+using std::chrono::steady_clock;
+
+namespace {
+	/**
+	 * "C:/out/pano.jpg", ".preview3" -> "C:/out/pano.preview3.jpg", the stitcher picks the format by extension
+	 */
+	std::string WithSuffix(const std::string& path, const std::string& suffix) {
+		const size_t dot = path.find_last_of('.');
+		const size_t slash = path.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return path + suffix;
+		}
+		return path.substr(0, dot) + suffix + path.substr(dot);
+	}
+
+	double MillisecondsSince(steady_clock::time_point begin) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - begin).count() / 1e3;
+	}
+
+	crow::json::wvalue ToJson(const PanoramaUpdate& update) {
+		crow::json::wvalue json;
+		json["path"] = update.output_path;
+		json["stage"] = PanoramaStageName(update.stage);
+		json["generation"] = update.generation;
+		json["elapsed_ms"] = update.elapsed_ms;
+		return json;
+	}
+}
+
+ProgressiveStitchOptions::ProgressiveStitchOptions() {
+	preview.stitch_type = STITCH_TYPE::TEMPLATE;
+	preview.output_width = 1024;
+	preview.output_height = 512;
+	preview.enable_flowstate = false;
+	preview.enable_denoise = false;
+	full.stitch_type = STITCH_TYPE::DYNAMICSTITCH;
+	full.output_width = 3840;
+	full.output_height = 1920;
+}
+
+const char* PanoramaStageName(PanoramaStage stage) {
+	switch (stage) {
+	case PanoramaStage::Preview:
+		return "preview";
+	case PanoramaStage::Full:
+		return "full";
+	default:
+		return "failed";
+	}
+}
+
+ProgressiveStitcher::ProgressiveStitcher(StitchWorkerPool& full_pool, const ProgressiveStitchOptions& options)
+	: options_(options), preview_pool_(1, 1), full_pool_(full_pool), next_listener_(0), stopped_(false), pending_(0) {
+	preview_pool_.Warm(options_.preview);
+}
+
+ProgressiveStitcher::~ProgressiveStitcher() {
+	Stop();
+}
+
+size_t ProgressiveStitcher::AddListener(Listener listener) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	listeners_[next_listener_] = listener;
+	return next_listener_++;
+}
+
+void ProgressiveStitcher::RemoveListener(size_t id) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	listeners_.erase(id);
+}
+
+uint64_t ProgressiveStitcher::Submit(const std::vector<std::string>& input_paths, const std::string& output_path, Listener on_update) {
+	const auto begin = steady_clock::now();
+	uint64_t generation = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!stopped_) {
+			generation = ++generations_[output_path];
+			++pending_;
+		}
+	}
+	if (generation == 0) {
+		PanoramaUpdate update = { output_path, PanoramaStage::Failed, 0, 0 };
+		if (on_update) {
+			on_update(update);
+		}
+		return 0;
+	}
+
+	const std::string preview_path = WithSuffix(output_path, ".preview" + std::to_string(generation));
+	preview_pool_.Submit(options_.preview, input_paths, preview_path, [this, input_paths, output_path, preview_path, generation, begin, on_update](bool ok) {
+		PanoramaUpdate update = { output_path, ok ? PanoramaStage::Preview : PanoramaStage::Failed, generation, MillisecondsSince(begin) };
+		if (!Publish(update, ok ? preview_path : std::string(), on_update) || !ok) {
+			Done();
+			return;
+		}
+		const std::string full_path = WithSuffix(output_path, ".full" + std::to_string(generation));
+		full_pool_.Submit(options_.full, input_paths, full_path, [this, output_path, full_path, generation, begin, on_update](bool ok) {
+			PanoramaUpdate update = { output_path, ok ? PanoramaStage::Full : PanoramaStage::Failed, generation, MillisecondsSince(begin) };
+			Publish(update, ok ? full_path : std::string(), on_update);
+			Done();
+		});
+	});
+	return generation;
+}
+
+bool ProgressiveStitcher::Publish(PanoramaUpdate update, const std::string& stitched_path, const Listener& on_update) {
+	std::vector<Listener> listeners;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		// a newer request for the same output owns it now, and nothing is published once stopped
+		if (stopped_ || generations_[update.output_path] != update.generation) {
+			if (!stitched_path.empty()) {
+				file_util::Remove(stitched_path);
+			}
+			return false;
+		}
+		if (!stitched_path.empty() && !file_util::Rename(stitched_path, update.output_path)) {
+			std::cerr << "Failed to publish " << update.output_path << std::endl;
+			file_util::Remove(stitched_path);
+			update.stage = PanoramaStage::Failed;
+		}
+		auto current = published_.find(update.output_path);
+		const bool keeps_preview = update.stage == PanoramaStage::Failed && current != published_.end()
+			&& current->second.generation == update.generation;
+		if (!keeps_preview) {
+			published_[update.output_path] = update;
+		}
+		for (const auto& listener : listeners_) {
+			listeners.push_back(listener.second);
+		}
+	}
+	if (on_update) {
+		on_update(update);
+	}
+	for (const auto& listener : listeners) {
+		listener(update);
+	}
+	return update.stage != PanoramaStage::Failed;
+}
+
+void ProgressiveStitcher::Done() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (--pending_ == 0) {
+		idle_cv_.notify_all();
+	}
+}
+
+bool ProgressiveStitcher::Current(const std::string& output_path, PanoramaUpdate& update) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = published_.find(output_path);
+	if (it == published_.end()) {
+		return false;
+	}
+	update = it->second;
+	return true;
+}
+
+void ProgressiveStitcher::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopped_ = true;
+	}
+	preview_pool_.Stop();
+	// the full stitches call back into this object, wait for them rather than leave them dangling
+	std::unique_lock<std::mutex> lock(mutex_);
+	idle_cv_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void ProgressiveStitcher::RegisterRoutes(crow::SimpleApp& app, const std::string& image_dir) {
+	AddListener([this](const PanoramaUpdate& update) {
+		const std::string message = ToJson(update).dump();
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto watcher : watchers_) {
+			watcher->send_text(message);
+		}
+	});
+
+	CROW_ROUTE(app, "/panorama/events").websocket()
+		.onopen([this](crow::websocket::connection& watcher) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		watchers_.push_back(&watcher);
+	})
+		.onclose([this](crow::websocket::connection& watcher, const std::string&) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		watchers_.erase(std::remove(watchers_.begin(), watchers_.end(), &watcher), watchers_.end());
+	});
+
+	// body: {"inputs": ["IMG_xxx.insp"], "name": "pano"}, answered once the preview is published
+	CROW_ROUTE(app, "/panorama").methods(crow::HTTPMethod::Post)
+		([this, image_dir](const crow::request& req, crow::response& res) {
+		auto params = crow::json::load(req.body);
+		if (!params || !params.has("inputs") || !params.has("name") || params["inputs"].size() == 0) {
+			res.code = 400;
+			res.end("Missing \"inputs\" or \"name\"");
+			return;
+		}
+		// only files in image_dir, whatever path the client sends
+		std::vector<std::string> input_paths;
+		for (const auto& input : params["inputs"]) {
+			input_paths.push_back(image_dir + file_util::Basename(input.s()));
+		}
+		const std::string output_path = image_dir + file_util::Basename(params["name"].s()) + ".jpg";
+
+		auto io_service = req.io_service;
+		auto response = &res;
+		auto answered = std::make_shared<std::atomic<bool>>(false);
+		Submit(input_paths, output_path, [io_service, response, answered](const PanoramaUpdate& update) {
+			if (answered->exchange(true)) {
+				return;
+			}
+			auto body = ToJson(update);
+			body["events"] = "/panorama/events";
+			const std::string payload = body.dump();
+			const int code = update.stage == PanoramaStage::Failed ? 500 : 200;
+			// crow::response is only safe to touch from the connection's own io_service
+			io_service->post([response, code, payload]() {
+				response->code = code;
+				response->set_header("Content-Type", "application/json");
+				response->end(payload);
+			});
+		});
+	});
+
+	CROW_ROUTE(app, "/panorama/<string>")
+		([this, image_dir](const std::string& name) {
+		PanoramaUpdate update;
+		if (!Current(image_dir + file_util::Basename(name) + ".jpg", update)) {
+			return crow::response(404);
+		}
+		crow::response res(ToJson(update).dump());
+		res.set_header("Content-Type", "application/json");
+		return res;
+	});
+}
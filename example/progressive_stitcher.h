@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "crow.h"
+#include "stitch_pool.h"
+
+struct ProgressiveStitchOptions {
+	ProgressiveStitchOptions();
+
+	StitchParams preview; // TEMPLATE at 1024x512 without FlowState or denoise, ready in a fraction of a second
+	StitchParams full;    // DYNAMICSTITCH at 3840x1920, OPTFLOW for the best quality
+};
+
+enum class PanoramaStage {
+	Preview,
+	Full,
+	Failed, // the preview failed, or the full stitch failed and the preview stays
+};
+
+const char* PanoramaStageName(PanoramaStage stage);
+
+struct PanoramaUpdate {
+	std::string output_path;
+	PanoramaStage stage;
+	uint64_t generation; // of the request for output_path, an update of an older request is never published
+	double elapsed_ms;   // since Submit
+};
+
+/**
+ * \class ProgressiveStitcher
+ * \brief Publishes a panorama twice: a low resolution TEMPLATE preview from a worker of its own, so it never
+ *        waits behind full resolution jobs, then the full resolution stitch from the shared StitchWorkerPool.
+ *        Both are written next to output_path and renamed over it, so readers always see a whole file and the
+ *        full result replaces the preview in one step. Listeners are told about every published stage.
+ */
+class ProgressiveStitcher {
+public:
+	typedef std::function<void(const PanoramaUpdate& update)> Listener;
+
+	/**
+	 * \param full_pool runs the full resolution stitches
+	 */
+	explicit ProgressiveStitcher(StitchWorkerPool& full_pool, const ProgressiveStitchOptions& options = ProgressiveStitchOptions());
+	~ProgressiveStitcher();
+
+	ProgressiveStitcher(const ProgressiveStitcher&) = delete;
+	ProgressiveStitcher& operator=(const ProgressiveStitcher&) = delete;
+
+	/**
+	 * \brief called for every update of every panorama, from a stitch worker thread
+	 */
+	size_t AddListener(Listener listener);
+	void RemoveListener(size_t id);
+
+	/**
+	 * \brief stitch the preview into output_path, then the full resolution panorama over it
+	 * \param on_update called for the updates of this request only, before the listeners
+	 * \return generation of the request
+	 */
+	uint64_t Submit(const std::vector<std::string>& input_paths, const std::string& output_path, Listener on_update = nullptr);
+
+	/**
+	 * \brief latest published update of output_path, false if there is none
+	 */
+	bool Current(const std::string& output_path, PanoramaUpdate& update) const;
+
+	/**
+	 * \brief register POST /panorama, GET /panorama/<name> and the /panorama/events WebSocket,
+	 *        call before app.run_async()
+	 * \param image_dir where the inputs are looked up and the panoramas are written, with trailing slash
+	 */
+	void RegisterRoutes(crow::SimpleApp& app, const std::string& image_dir);
+
+	/**
+	 * \brief stop publishing, queued previews are dropped and full stitches already queued in the shared pool
+	 *        are waited for and thrown away
+	 */
+	void Stop();
+
+private:
+	/**
+	 * \return whether the update was published, i.e. stitched_path replaced output_path
+	 */
+	bool Publish(PanoramaUpdate update, const std::string& stitched_path, const Listener& on_update);
+	void Done();
+
+	ProgressiveStitchOptions options_;
+	StitchWorkerPool preview_pool_;
+	StitchWorkerPool& full_pool_;
+	mutable std::mutex mutex_;
+	std::map<std::string, PanoramaUpdate> published_;
+	std::map<std::string, uint64_t> generations_;
+	std::map<size_t, Listener> listeners_;
+	size_t next_listener_;
+	bool stopped_;
+	size_t pending_; // requests with a callback still to come
+	std::condition_variable idle_cv_;
+	std::vector<crow::websocket::connection*> watchers_;
+};
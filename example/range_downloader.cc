@@ -0,0 +1,219 @@
+#include "range_downloader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "file_util.h"
+#include "http_client.h"
+
+RangeDownloader::RangeDownloader(const RangeDownloadOptions& options)
+	: options_(options), cancelled_(false), received_(0) {
+	if (options_.connections == 0) {
+		options_.connections = 1;
+	}
+	if (options_.chunk_size == 0) {
+		options_.chunk_size = 8 << 20;
+	}
+}
+
+void RangeDownloader::SetProgressCallback(ProgressCallback callback) {
+	callback_ = callback;
+}
+
+void RangeDownloader::Cancel() {
+	cancelled_ = true;
+}
+
+void RangeDownloader::Report(int64_t total) {
+	if (!callback_) {
+		return;
+	}
+	RangeDownloadProgress progress;
+	progress.received = received_;
+	progress.total = total;
+	progress.seconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin_).count() / 1e6;
+	progress.bytes_per_second = progress.seconds > 0 ? progress.received / progress.seconds : 0;
+	callback_(progress);
+}
+
+RangeDownloadResult RangeDownloader::Download(const std::string& url, const std::string& local_path) {
+	RangeDownloadResult result;
+	begin_ = std::chrono::steady_clock::now();
+	received_ = 0;
+	cancelled_ = false;
+	const std::string part = local_path + ".ranged";
+
+	HttpClient client;
+	HttpResponseHead head;
+	const int64_t size = client.Head(url, head) ? head.content_length : -1;
+	bool done = false;
+	if (size >= 0 && static_cast<uint64_t>(size) >= options_.min_ranged_size && options_.connections > 1
+		&& head.Header("accept-ranges") == "bytes") {
+		result.ranged = true;
+		done = DownloadRanged(url, part, static_cast<uint64_t>(size), result);
+		if (!done && !result.ranged && !cancelled_) {
+			// advertised ranges but answered 200 with the whole file, start over with one stream
+			received_ = 0;
+		}
+	}
+	if (!result.ranged && !cancelled_) {
+		result.connections = 1;
+		result.chunks = 1;
+		done = DownloadSingle(url, part, size, result);
+	}
+	Report(size);
+
+	result.bytes = received_;
+	result.seconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin_).count() / 1e6;
+	result.bytes_per_second = result.seconds > 0 ? result.bytes / result.seconds : 0;
+	if (cancelled_ && result.error.empty()) {
+		result.error = "cancelled";
+	}
+	if (done && !cancelled_ && file_util::Rename(part, local_path)) {
+		result.ok = true;
+		return result;
+	}
+	if (done && result.error.empty()) {
+		result.error = "can not move " + part + " to " + local_path;
+	}
+	file_util::Remove(part);
+	return result;
+}
+
+bool RangeDownloader::DownloadRanged(const std::string& url, const std::string& path, uint64_t size, RangeDownloadResult& result) {
+	file_util::PositionalFile file;
+	if (!file.Open(path, size)) {
+		result.error = "can not open " + path;
+		return false;
+	}
+	const size_t chunks = static_cast<size_t>((size + options_.chunk_size - 1) / options_.chunk_size);
+	const size_t threads = std::min(options_.connections, chunks);
+	result.chunks = chunks;
+	result.connections = threads;
+
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+	std::atomic<bool> unsupported(false);
+	std::mutex mutex;
+	std::condition_variable finished;
+	size_t running = threads;
+	std::string error;
+
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&]() {
+			HttpClient client;
+			for (size_t i = next++; i < chunks && !failed && !cancelled_; i = next++) {
+				uint64_t offset = i * options_.chunk_size;
+				const uint64_t last = std::min<uint64_t>(offset + options_.chunk_size, size) - 1;
+				bool write_failed = false;
+				for (int attempt = 0; offset <= last && !failed && !cancelled_; ++attempt) {
+					if (attempt > options_.retries) {
+						std::lock_guard<std::mutex> lock(mutex);
+						error = "chunk " + std::to_string(i) + ": " + client.LastError();
+						failed = true;
+						break;
+					}
+					if (attempt > 0) {
+						std::this_thread::sleep_for(std::chrono::milliseconds(200 * attempt));
+					}
+					HttpResponseHead head;
+					client.Get(url, head, [&](const char* data, size_t n) {
+						if (head.status != 206) {
+							unsupported = true;
+							failed = true;
+							return false;
+						}
+						n = static_cast<size_t>(std::min<uint64_t>(n, last + 1 - offset));
+						if (!file.WriteAt(offset, data, n)) {
+							write_failed = true;
+							failed = true;
+							return false;
+						}
+						offset += n;
+						received_ += n;
+						return !failed && !cancelled_;
+					}, offset, last);
+					if (write_failed) {
+						std::lock_guard<std::mutex> lock(mutex);
+						error = "write failed at " + std::to_string(offset);
+					}
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0) {
+				finished.notify_all();
+			}
+		});
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (running > 0) {
+			finished.wait_for(lock, std::chrono::milliseconds(options_.progress_interval_ms));
+			if (running > 0) {
+				lock.unlock();
+				Report(static_cast<int64_t>(size));
+				lock.lock();
+			}
+		}
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	const bool closed = file.Close();
+	if (unsupported) {
+		result.ranged = false;
+		return false;
+	}
+	if (failed) {
+		result.error = error;
+		return false;
+	}
+	if (!closed) {
+		result.error = "can not write " + path;
+		return false;
+	}
+	return !cancelled_;
+}
+
+bool RangeDownloader::DownloadSingle(const std::string& url, const std::string& path, int64_t size, RangeDownloadResult& result) {
+	file_util::PositionalFile file;
+	if (!file.Open(path, size > 0 ? static_cast<uint64_t>(size) : 0)) {
+		result.error = "can not open " + path;
+		return false;
+	}
+	HttpClient client;
+	HttpResponseHead head;
+	uint64_t offset = 0;
+	auto last_report = std::chrono::steady_clock::now();
+	const bool ok = client.Get(url, head, [&](const char* data, size_t n) {
+		if (!file.WriteAt(offset, data, n)) {
+			return false;
+		}
+		offset += n;
+		received_ += n;
+		const auto now = std::chrono::steady_clock::now();
+		if (now - last_report >= std::chrono::milliseconds(options_.progress_interval_ms)) {
+			last_report = now;
+			Report(size);
+		}
+		return !cancelled_;
+	});
+	const bool closed = file.Close();
+	if (!ok) {
+		result.error = client.LastError();
+		return false;
+	}
+	if (!closed) {
+		result.error = "can not write " + path;
+		return false;
+	}
+	if (size >= 0 && offset != static_cast<uint64_t>(size)) {
+		result.error = "size mismatch: " + std::to_string(offset) + " of " + std::to_string(size);
+		return false;
+	}
+	return true;
+}
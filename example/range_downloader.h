@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct RangeDownloadOptions {
+	size_t connections = 4;
+	uint64_t chunk_size = 8 << 20;
+	uint64_t min_ranged_size = 16 << 20; // smaller files are not worth the extra connections
+	int retries = 3;                     // per chunk, a retry continues where the chunk stopped
+	int progress_interval_ms = 250;
+};
+
+struct RangeDownloadProgress {
+	uint64_t received = 0;
+	int64_t total = -1; // -1 if the server did not report a size
+	double seconds = 0;
+	double bytes_per_second = 0;
+};
+
+struct RangeDownloadResult {
+	bool ok = false;
+	bool ranged = false; // false: fetched with a single stream
+	size_t connections = 0;
+	size_t chunks = 0;
+	uint64_t bytes = 0;
+	double seconds = 0;
+	double bytes_per_second = 0;
+	std::string error;
+};
+
+/**
+ * \class RangeDownloader
+ * \brief Fetches one large file (e.g. a multi-gigabyte .insv) from the camera's http file server
+ *        (Camera::GetHttpBaseUrl() + file uri) with several parallel Range requests. The chunks are written
+ *        with positional writes into a preallocated "<local>.ranged" file which is renamed into place at the end.
+ *        Servers that do not advertise "Accept-Ranges: bytes", or answer a range with 200, and small files
+ *        are fetched with a single stream.
+ */
+class RangeDownloader {
+public:
+	typedef std::function<void(const RangeDownloadProgress& progress)> ProgressCallback;
+
+	explicit RangeDownloader(const RangeDownloadOptions& options = RangeDownloadOptions());
+
+	/**
+	 * \brief called from the thread running Download() every progress_interval_ms, and once at the end
+	 */
+	void SetProgressCallback(ProgressCallback callback);
+
+	RangeDownloadResult Download(const std::string& url, const std::string& local_path);
+
+	/**
+	 * \brief abort the running Download(), the partial file is removed
+	 */
+	void Cancel();
+
+private:
+	bool DownloadRanged(const std::string& url, const std::string& path, uint64_t size, RangeDownloadResult& result);
+	bool DownloadSingle(const std::string& url, const std::string& path, int64_t size, RangeDownloadResult& result);
+	void Report(int64_t total);
+
+	RangeDownloadOptions options_;
+	ProgressCallback callback_;
+	std::atomic<bool> cancelled_;
+	std::atomic<uint64_t> received_;
+	std::chrono::steady_clock::time_point begin_;
+};
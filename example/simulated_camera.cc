@@ -0,0 +1,564 @@
+#include "simulated_camera.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include "file_util.h"
+
+using std::chrono::steady_clock;
+
+std::string SyntheticAccessUnit(std::mt19937& random, bool keyframe, size_t size) {
+	static const uint8_t sps[] = { 0, 0, 0, 1, 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50, 0x05, 0xbb, 0x01, 0x10 };
+	static const uint8_t pps[] = { 0, 0, 0, 1, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0 };
+	std::string unit;
+	if (keyframe) {
+		unit.append(reinterpret_cast<const char*>(sps), sizeof(sps));
+		unit.append(reinterpret_cast<const char*>(pps), sizeof(pps));
+	}
+	unit.append("\0\0\0\1", 4);
+	unit += static_cast<char>(keyframe ? 0x65 : 0x41);
+	unit += static_cast<char>(0x88); // first_mb_in_slice = 0
+	int zeros = 0;
+	while (unit.size() < size) {
+		// zero bytes about as often as in real slice data
+		uint8_t byte = static_cast<uint8_t>(random());
+		byte = (byte & 0x0f) == 0 ? 0 : byte;
+		if (zeros >= 2 && byte <= 3) {
+			unit += '\3';
+			zeros = 0;
+		}
+		zeros = byte == 0 ? zeros + 1 : 0;
+		unit += static_cast<char>(byte);
+	}
+	unit += static_cast<char>(0x80); // rbsp stop bit
+	return unit;
+}
+
+namespace {
+	const char* kCardDir = "DCIM/Camera01/";
+
+	/**
+	 * a file of size bytes without writing them, the card is only ever read back over http
+	 */
+	bool WriteSparse(const std::string& path, uint64_t size) {
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		bool ok = true;
+		if (size > 0) {
+#ifdef _WIN32
+			ok = _fseeki64(file, static_cast<int64_t>(size - 1), SEEK_SET) == 0;
+#else
+			ok = fseeko(file, static_cast<off_t>(size - 1), SEEK_SET) == 0;
+#endif
+			ok = ok && fputc(0, file) != EOF;
+		}
+		return fclose(file) == 0 && ok;
+	}
+
+	bool CopyFile(const std::string& from, const std::string& to) {
+		FILE* in = fopen(from.c_str(), "rb");
+		if (!in) {
+			return false;
+		}
+		FILE* out = fopen(to.c_str(), "wb");
+		if (!out) {
+			fclose(in);
+			return false;
+		}
+		std::vector<char> buffer(1 << 20);
+		bool ok = true;
+		size_t n;
+		while (ok && (n = fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+			ok = fwrite(buffer.data(), 1, n, out) == n;
+		}
+		fclose(in);
+		return fclose(out) == 0 && ok;
+	}
+}
+
+SimulatedCamera::SimulatedCamera(const SimulatedCameraOptions& options)
+	: options_(options), random_(options.seed), open_(false), used_bytes_(0), card_full_(false), next_file_(1),
+	capture_(ins_camera::CaptureStatus::NOT_CAPTURE), interval_running_(false), commands_(0), failures_(0), streaming_(false) {
+}
+
+SimulatedCamera::~SimulatedCamera() {
+	StopIntervalShooting();
+	Close();
+}
+
+std::vector<std::shared_ptr<CameraDevice>> SimulatedCamera::Fleet(size_t count, const SimulatedCameraOptions& options) {
+	std::vector<std::shared_ptr<CameraDevice>> cameras;
+	for (size_t i = 0; i < count; ++i) {
+		SimulatedCameraOptions camera_options = options;
+		const std::string number = std::to_string(i + 1);
+		camera_options.serial = "SIM" + std::string(7 - std::min<size_t>(number.size(), 7), '0') + number;
+		camera_options.storage_dir = options.storage_dir + camera_options.serial + "/";
+		camera_options.seed = options.seed + static_cast<unsigned>(i);
+		cameras.push_back(std::make_shared<SimulatedCamera>(camera_options));
+	}
+	return cameras;
+}
+
+bool SimulatedCamera::Command(int extra_ms) const {
+	int delay_ms;
+	bool fail;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		delay_ms = options_.latency_ms + extra_ms
+			+ (options_.latency_jitter_ms > 0 ? static_cast<int>(random_() % (options_.latency_jitter_ms + 1)) : 0);
+		fail = options_.failure_rate > 0 && std::uniform_real_distribution<double>(0, 1)(random_) < options_.failure_rate;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+	++commands_;
+	if (fail) {
+		++failures_;
+	}
+	return !fail;
+}
+
+std::string SimulatedCamera::AddFile(const std::string& prefix, const std::string& extension, uint64_t size, const std::string& copy_of) const {
+	// IMG_20230221_134844_00_099.insp, like the camera names them
+	std::string uri;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const time_t now = time(NULL);
+		char stamp[32];
+		strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+		char number[8];
+		snprintf(number, sizeof(number), "%03u", next_file_++ % 1000);
+		uri = std::string("/") + kCardDir + prefix + "_" + stamp + "_00_" + number + extension;
+	}
+	const std::string path = options_.storage_dir + uri.substr(1);
+	const uint64_t needed = copy_of.empty() ? size : static_cast<uint64_t>(std::max<int64_t>(file_util::FileSize(copy_of), 0));
+	{
+		// like the camera, a recording that does not fit on the card is lost. the space is reserved right away,
+		// so concurrent recorders cannot all pass the check and overfill the card
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (used_bytes_ + needed > options_.storage_bytes) {
+			card_full_ = true;
+			return std::string();
+		}
+		used_bytes_ += needed;
+	}
+	const bool ok = copy_of.empty() ? WriteSparse(path, size) : CopyFile(copy_of, path);
+	const uint64_t written = ok ? static_cast<uint64_t>(std::max<int64_t>(file_util::FileSize(path), 0)) : 0;
+	std::lock_guard<std::mutex> lock(mutex_);
+	// the reservation is replaced with what was actually written
+	used_bytes_ = used_bytes_ - std::min(used_bytes_, needed) + written;
+	if (!ok) {
+		return std::string();
+	}
+	files_.push_back(uri);
+	return uri;
+}
+
+bool SimulatedCamera::Open() const {
+	if (!Command() || !file_util::MakeDirectories(options_.storage_dir + kCardDir)) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!open_) {
+		server_.reset(new LocalFileServer(options_.storage_dir));
+		server_->SetStreamRate(options_.http_bytes_per_second);
+		server_->Start();
+		opened_at_ = steady_clock::now();
+		open_ = true;
+	}
+	return true;
+}
+
+void SimulatedCamera::Close() const {
+	StopStream();
+	std::unique_ptr<LocalFileServer> server;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		open_ = false;
+		server.swap(server_);
+	}
+	if (server) {
+		server->Stop();
+	}
+}
+
+bool SimulatedCamera::IsConnected() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return open_;
+}
+
+std::string SimulatedCamera::GetSerialNumber() const {
+	return options_.serial;
+}
+
+ins_camera::CameraType SimulatedCamera::GetCameraType() const {
+	return options_.camera_type;
+}
+
+ins_camera::VideoEncodeType SimulatedCamera::GetVideoEncodeType() const {
+	return ins_camera::VideoEncodeType::H264;
+}
+
+ins_camera::CaptureStatus SimulatedCamera::GetCaptureCurrentStatus() const {
+	Command();
+	std::lock_guard<std::mutex> lock(mutex_);
+	return capture_;
+}
+
+std::string SimulatedCamera::GetHttpBaseUrl() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return server_ ? server_->BaseUrl() : std::string();
+}
+
+bool SimulatedCamera::SyncLocalTimeToCamera(uint64_t) {
+	return Command();
+}
+
+std::string SimulatedCamera::AddPhoto() const {
+	std::string photo_template;
+	if (!options_.photo_templates.empty()) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		photo_template = options_.photo_templates[(next_file_ - 1) % options_.photo_templates.size()];
+	}
+	return AddFile("IMG", ".insp", options_.photo_bytes, photo_template);
+}
+
+ins_camera::MediaUrl SimulatedCamera::TakePhoto() const {
+	if (!Command(options_.photo_latency_ms)) {
+		return ins_camera::MediaUrl(std::vector<std::string>());
+	}
+	const std::string uri = AddPhoto();
+	return ins_camera::MediaUrl(uri.empty() ? std::vector<std::string>() : std::vector<std::string>(1, uri));
+}
+
+bool SimulatedCamera::SetExposureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::ExposureSettings> settings) {
+	if (!Command() || !settings) {
+		return false;
+	}
+	auto copy = std::make_shared<ins_camera::ExposureSettings>();
+	copy->SetExposureMode(settings->ExposureMode());
+	copy->SetEVBias(settings->EVBias());
+	copy->SetIso(settings->Iso());
+	copy->SetShutterSpeed(settings->ShutterSpeed());
+	std::lock_guard<std::mutex> lock(mutex_);
+	exposure_[mode] = copy;
+	return true;
+}
+
+std::shared_ptr<ins_camera::ExposureSettings> SimulatedCamera::GetExposureSettings(ins_camera::CameraFunctionMode mode) const {
+	if (!Command()) {
+		return nullptr;
+	}
+	auto settings = std::make_shared<ins_camera::ExposureSettings>();
+	std::lock_guard<std::mutex> lock(mutex_);
+	const auto it = exposure_.find(mode);
+	if (it == exposure_.end()) {
+		settings->SetExposureMode(ins_camera::PhotographyOptions_ExposureMode::PhotographyOptions_ExposureOptions_Program_AUTO);
+		settings->SetEVBias(0);
+		settings->SetIso(100);
+		settings->SetShutterSpeed(1.0 / 120.0);
+		return settings;
+	}
+	settings->SetExposureMode(it->second->ExposureMode());
+	settings->SetEVBias(it->second->EVBias());
+	settings->SetIso(it->second->Iso());
+	settings->SetShutterSpeed(it->second->ShutterSpeed());
+	return settings;
+}
+
+bool SimulatedCamera::SetCaptureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::CaptureSettings> settings) {
+	if (!Command() || !settings) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	capture_settings_[mode] = std::make_shared<ins_camera::CaptureSettings>(*settings);
+	return true;
+}
+
+std::shared_ptr<ins_camera::CaptureSettings> SimulatedCamera::GetCaptureSettings(ins_camera::CameraFunctionMode mode) const {
+	if (!Command()) {
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	const auto it = capture_settings_.find(mode);
+	return std::make_shared<ins_camera::CaptureSettings>(it == capture_settings_.end() ? ins_camera::CaptureSettings() : *it->second);
+}
+
+bool SimulatedCamera::StartCapture(ins_camera::CaptureStatus status) {
+	if (!Command()) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (capture_ != ins_camera::CaptureStatus::NOT_CAPTURE) {
+		return false;
+	}
+	capture_ = status;
+	capture_started_ = steady_clock::now();
+	return true;
+}
+
+ins_camera::MediaUrl SimulatedCamera::StopCapture(ins_camera::CaptureStatus status, const std::string& prefix) {
+	if (!Command()) {
+		return ins_camera::MediaUrl(std::vector<std::string>());
+	}
+	double seconds;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (capture_ != status) {
+			return ins_camera::MediaUrl(std::vector<std::string>());
+		}
+		capture_ = ins_camera::CaptureStatus::NOT_CAPTURE;
+		seconds = std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - capture_started_).count() / 1e3;
+	}
+	const uint64_t size = std::min<uint64_t>(static_cast<uint64_t>(seconds * options_.video_bytes_per_second), 256 << 20);
+	const std::string uri = AddFile(prefix, ".insv", size, std::string());
+	return ins_camera::MediaUrl(uri.empty() ? std::vector<std::string>() : std::vector<std::string>(1, uri));
+}
+
+bool SimulatedCamera::StartRecording() {
+	return StartCapture(ins_camera::CaptureStatus::NORMAL_CAPTURE);
+}
+
+ins_camera::MediaUrl SimulatedCamera::StopRecording() {
+	return StopCapture(ins_camera::CaptureStatus::NORMAL_CAPTURE, "VID");
+}
+
+bool SimulatedCamera::SetTimeLapseOption(ins_camera::TimelapseParam params) {
+	if (!Command()) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	timelapse_[params.mode] = params;
+	return true;
+}
+
+bool SimulatedCamera::StartTimeLapse(ins_camera::CameraTimelapseMode mode) {
+	if (mode != ins_camera::CameraTimelapseMode::TIMELAPSE_INTERVAL_SHOOTING && mode != ins_camera::CameraTimelapseMode::TIMELAPSE_STARLAPSE_SHOOTING) {
+		return StartCapture(ins_camera::CaptureStatus::TIMELAPSE_CAPTURE);
+	}
+	const auto status = mode == ins_camera::CameraTimelapseMode::TIMELAPSE_STARLAPSE_SHOOTING
+		? ins_camera::CaptureStatus::STARLAPSE_SHOOTING : ins_camera::CaptureStatus::INTERVAL_SHOOTING_CAPTURE;
+	if (!StartCapture(status)) {
+		return false;
+	}
+	uint32_t lapse_ms = 3000;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto it = timelapse_.find(mode);
+		if (it != timelapse_.end() && it->second.lapseTime > 0) {
+			lapse_ms = it->second.lapseTime;
+		}
+		interval_frames_.clear();
+		interval_running_ = true;
+	}
+	interval_thread_ = std::thread(&SimulatedCamera::IntervalShooting, this, std::chrono::milliseconds(lapse_ms));
+	return true;
+}
+
+ins_camera::MediaUrl SimulatedCamera::StopTimeLapse(ins_camera::CameraTimelapseMode mode) {
+	if (mode != ins_camera::CameraTimelapseMode::TIMELAPSE_INTERVAL_SHOOTING && mode != ins_camera::CameraTimelapseMode::TIMELAPSE_STARLAPSE_SHOOTING) {
+		return StopCapture(ins_camera::CaptureStatus::TIMELAPSE_CAPTURE, "LPS");
+	}
+	if (!Command()) {
+		return ins_camera::MediaUrl(std::vector<std::string>());
+	}
+	StopIntervalShooting();
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (capture_ != ins_camera::CaptureStatus::INTERVAL_SHOOTING_CAPTURE && capture_ != ins_camera::CaptureStatus::STARLAPSE_SHOOTING) {
+		return ins_camera::MediaUrl(std::vector<std::string>());
+	}
+	capture_ = ins_camera::CaptureStatus::NOT_CAPTURE;
+	// every frame of the run, like the photo urls of TakePhoto
+	return ins_camera::MediaUrl(interval_frames_);
+}
+
+void SimulatedCamera::StopIntervalShooting() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		interval_running_ = false;
+	}
+	interval_cv_.notify_all();
+	if (interval_thread_.joinable()) {
+		interval_thread_.join();
+	}
+}
+
+void SimulatedCamera::IntervalShooting(std::chrono::milliseconds interval) {
+	auto next = steady_clock::now() + interval;
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (interval_running_) {
+		if (interval_cv_.wait_until(lock, next) != std::cv_status::timeout) {
+			continue;
+		}
+		lock.unlock();
+		const std::string uri = AddPhoto();
+		lock.lock();
+		if (!uri.empty()) {
+			interval_frames_.push_back(uri);
+		}
+		next += interval;
+	}
+}
+
+bool SimulatedCamera::StartLiveStreaming(const ins_camera::LiveStreamParam& param) {
+	if (!Command() || streaming_.exchange(true)) {
+		return false;
+	}
+	stream_thread_ = std::thread(&SimulatedCamera::Stream, this, param);
+	return true;
+}
+
+bool SimulatedCamera::StopLiveStreaming() {
+	if (!Command()) {
+		return false;
+	}
+	StopStream();
+	return true;
+}
+
+void SimulatedCamera::StopStream() const {
+	streaming_ = false;
+	if (stream_thread_.joinable()) {
+		stream_thread_.join();
+	}
+}
+
+void SimulatedCamera::SetStreamDelegate(std::shared_ptr<ins_camera::StreamDelegate>& delegate) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	delegate_ = delegate;
+}
+
+void SimulatedCamera::Stream(ins_camera::LiveStreamParam param) {
+	std::shared_ptr<ins_camera::StreamDelegate> delegate;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		delegate = delegate_;
+	}
+	if (!delegate) {
+		// nobody to deliver to, like the SDK without a delegate
+		while (streaming_) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return;
+	}
+	std::mt19937 random(options_.seed * 7919u);
+	std::normal_distribution<double> noise(0.0, 0.01);
+	const int fps = std::max(options_.fps, 1);
+	const int gop = std::max(options_.gop, 1);
+	// the bitrate is per lens; a keyframe is about five times a P frame
+	const size_t bytes_per_frame = std::max<size_t>(param.video_bitrate / 8 / fps, 256);
+	const size_t p_frame = bytes_per_frame * gop / (gop + 4);
+	const size_t keyframe = p_frame * 5;
+	const auto frame_interval = std::chrono::microseconds(1000000 / fps);
+	const auto gyro_interval = std::chrono::microseconds(1000000 / std::max(options_.gyro_batches_per_second, 1));
+	const int gyro_per_batch = std::max(options_.gyro_hz / std::max(options_.gyro_batches_per_second, 1), 1);
+	const std::vector<uint8_t> audio_frame(param.audio_bitrate / 8 * 1024 / std::max<uint32_t>(param.audio_samplerate, 1), 0x21);
+	const auto audio_interval = std::chrono::microseconds(1024 * 1000000ll / std::max<uint32_t>(param.audio_samplerate, 1));
+
+	const auto start = steady_clock::now();
+	auto next_frame = start, next_gyro = start, next_audio = start;
+	int64_t frame = 0;
+	int64_t gyro_sample = 0;
+	std::vector<ins_camera::GyroData> gyro(gyro_per_batch);
+	while (streaming_) {
+		const auto now = steady_clock::now();
+		const int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+		if (now >= next_frame) {
+			if (param.enable_video) {
+				const bool is_keyframe = frame % gop == 0;
+				for (int lens = 0; lens < 2; ++lens) {
+					const std::string unit = SyntheticAccessUnit(random, is_keyframe, is_keyframe ? keyframe : p_frame);
+					delegate->OnVideoData(reinterpret_cast<const uint8_t*>(unit.data()), unit.size(), timestamp, 0, lens);
+				}
+			}
+			ins_camera::ExposureData exposure;
+			exposure.timestamp = static_cast<double>(timestamp);
+			exposure.exposure_time = 1.0 / 120.0;
+			delegate->OnExposureData(exposure);
+			++frame;
+			next_frame += frame_interval;
+		}
+		if (now >= next_gyro) {
+			for (auto& sample : gyro) {
+				sample.timestamp = gyro_sample++ * 1000 / std::max(options_.gyro_hz, 1);
+				sample.ax = noise(random);
+				sample.ay = noise(random);
+				sample.az = 1.0 + noise(random);
+				sample.gx = noise(random);
+				sample.gy = noise(random);
+				sample.gz = noise(random);
+			}
+			delegate->OnGyroData(gyro);
+			next_gyro += gyro_interval;
+		}
+		if (param.enable_audio && now >= next_audio) {
+			delegate->OnAudioData(audio_frame.data(), audio_frame.size(), timestamp);
+			next_audio += audio_interval;
+		}
+		std::this_thread::sleep_until(std::min(std::min(next_frame, next_gyro), param.enable_audio ? next_audio : next_gyro));
+	}
+}
+
+std::vector<std::string> SimulatedCamera::GetCameraFilesList() const {
+	if (!Command()) {
+		return std::vector<std::string>();
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	return files_;
+}
+
+bool SimulatedCamera::DeleteCameraFile(const std::string& file_path) const {
+	if (!Command()) {
+		return false;
+	}
+	const std::string path = options_.storage_dir + file_path.substr(file_path.find_first_not_of('/'));
+	const int64_t size = file_util::FileSize(path);
+	std::lock_guard<std::mutex> lock(mutex_);
+	const auto it = std::find(files_.begin(), files_.end(), file_path);
+	if (it == files_.end() || !file_util::Remove(path)) {
+		return false;
+	}
+	files_.erase(it);
+	used_bytes_ -= std::min<uint64_t>(used_bytes_, static_cast<uint64_t>(std::max<int64_t>(size, 0)));
+	card_full_ = false;
+	return true;
+}
+
+bool SimulatedCamera::DownloadCameraFile(const std::string& remote_file_path, const std::string& local_file_path) const {
+	if (!Command()) {
+		return false;
+	}
+	return CopyFile(options_.storage_dir + remote_file_path.substr(remote_file_path.find_first_not_of('/')), local_file_path);
+}
+
+bool SimulatedCamera::GetBatteryStatus(ins_camera::BatteryStatus& status) {
+	if (!Command()) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	// one percent every three minutes
+	const auto minutes = std::chrono::duration_cast<std::chrono::minutes>(steady_clock::now() - opened_at_).count();
+	status.power_type = ins_camera::PowerType::BATTERY;
+	status.battery_level = static_cast<uint32_t>(std::max<int64_t>(100 - minutes / 3, 0));
+	status.battery_scale = 100;
+	return true;
+}
+
+bool SimulatedCamera::GetStorageState(ins_camera::StorageStatus& status) {
+	if (!Command()) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	status.free_space = options_.storage_bytes - std::min(used_bytes_, options_.storage_bytes);
+	status.total_space = options_.storage_bytes;
+	status.state = card_full_ ? ins_camera::CardState::STOR_CS_NOSPACE : ins_camera::CardState::STOR_CS_PASS;
+	return true;
+}
+
+uint64_t SimulatedCamera::Commands() const {
+	return commands_;
+}
+
+uint64_t SimulatedCamera::InjectedFailures() const {
+	return failures_;
+}
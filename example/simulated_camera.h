@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "camera_device.h"
+#include "local_file_server.h"
+
+/**
+ * \brief an H.264 Annex-B access unit of about size bytes: SPS, PPS and an IDR slice for a keyframe, one P slice
+ *        otherwise, with slice data that has zero bytes and emulation prevention like the real thing
+ */
+std::string SyntheticAccessUnit(std::mt19937& random, bool keyframe, size_t size);
+
+struct SimulatedCameraOptions {
+	std::string serial = "SIM0000001";
+	ins_camera::CameraType camera_type = ins_camera::CameraType::Insta360X3;
+	std::string storage_dir = "./simulated/"; // the storage card, served over http; with trailing slash
+	std::vector<std::string> photo_templates;  // copied in turn for every photo, e.g. real .insp files to stitch; none: photo_bytes
+	uint64_t photo_bytes = 8 << 20;
+	uint64_t video_bytes_per_second = 12 << 20; // size of recorded files, capped at 256 MB
+	uint64_t storage_bytes = 64ull << 30;      // a file that does not fit is not written, the card reports STOR_CS_NOSPACE
+	uint64_t http_bytes_per_second = 0;         // per response of the file server, 0: no cap
+
+	int latency_ms = 30;        // every command, a USB round trip
+	int latency_jitter_ms = 10; // added uniformly
+	int photo_latency_ms = 600; // TakePhoto on top of latency_ms
+	double failure_rate = 0;    // share of commands that fail, drawn per command
+
+	int fps = 30;
+	int gop = 30;                      // frames per keyframe
+	int gyro_hz = 1000;                // samples
+	int gyro_batches_per_second = 100; // OnGyroData calls
+	unsigned seed = 1;
+};
+
+/**
+ * \class SimulatedCamera
+ * \brief CameraDevice without hardware, for load tests on any machine. Commands cost latency_ms plus jitter on
+ *        the calling thread and fail at failure_rate. Photos and recordings become files under storage_dir,
+ *        which a LocalFileServer serves at GetHttpBaseUrl() like the camera's file server; interval shooting and
+ *        starlapse timelapses add a photo every lapseTime ms while they run. The live stream
+ *        delivers synthetic H.264 for both lenses at fps and the bitrate of the LiveStreamParam, gyro batches
+ *        and one exposure sample per frame from a single thread, like the SDK's stream callback.
+ */
+class SimulatedCamera : public CameraDevice {
+public:
+	explicit SimulatedCamera(const SimulatedCameraOptions& options = SimulatedCameraOptions());
+	~SimulatedCamera();
+
+	/**
+	 * \brief count simulated cameras SIM0000001.., each with its own storage_dir/<serial>/ and seed
+	 */
+	static std::vector<std::shared_ptr<CameraDevice>> Fleet(size_t count, const SimulatedCameraOptions& options = SimulatedCameraOptions());
+
+	bool Open() const override;
+	void Close() const override;
+	bool IsConnected() override;
+	std::string GetSerialNumber() const override;
+	ins_camera::CameraType GetCameraType() const override;
+	ins_camera::VideoEncodeType GetVideoEncodeType() const override;
+	ins_camera::CaptureStatus GetCaptureCurrentStatus() const override;
+	std::string GetHttpBaseUrl() const override;
+	bool SyncLocalTimeToCamera(uint64_t time) override;
+
+	ins_camera::MediaUrl TakePhoto() const override;
+	bool SetExposureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::ExposureSettings> settings) override;
+	std::shared_ptr<ins_camera::ExposureSettings> GetExposureSettings(ins_camera::CameraFunctionMode mode) const override;
+	bool SetCaptureSettings(ins_camera::CameraFunctionMode mode, std::shared_ptr<ins_camera::CaptureSettings> settings) override;
+	std::shared_ptr<ins_camera::CaptureSettings> GetCaptureSettings(ins_camera::CameraFunctionMode mode) const override;
+
+	bool StartRecording() override;
+	ins_camera::MediaUrl StopRecording() override;
+	bool SetTimeLapseOption(ins_camera::TimelapseParam params) override;
+	bool StartTimeLapse(ins_camera::CameraTimelapseMode mode) override;
+	ins_camera::MediaUrl StopTimeLapse(ins_camera::CameraTimelapseMode mode) override;
+
+	bool StartLiveStreaming(const ins_camera::LiveStreamParam& param) override;
+	bool StopLiveStreaming() override;
+	void SetStreamDelegate(std::shared_ptr<ins_camera::StreamDelegate>& delegate) override;
+
+	std::vector<std::string> GetCameraFilesList() const override;
+	bool DeleteCameraFile(const std::string& file_path) const override;
+	bool DownloadCameraFile(const std::string& remote_file_path, const std::string& local_file_path) const override;
+
+	bool GetBatteryStatus(ins_camera::BatteryStatus& status) override;
+	bool GetStorageState(ins_camera::StorageStatus& status) override;
+
+	/**
+	 * \brief commands made so far, and how many of them failed on purpose
+	 */
+	uint64_t Commands() const;
+	uint64_t InjectedFailures() const;
+
+private:
+	/**
+	 * \brief wait out the latency of one command, false if this command is to fail
+	 */
+	bool Command(int extra_ms = 0) const;
+
+	/**
+	 * \brief a new file of size bytes on the card, returns its uri
+	 */
+	std::string AddFile(const std::string& prefix, const std::string& extension, uint64_t size, const std::string& copy_of) const;
+	std::string AddPhoto() const;
+
+	void StopIntervalShooting();
+	void IntervalShooting(std::chrono::milliseconds interval);
+
+	void StopStream() const;
+	bool StartCapture(ins_camera::CaptureStatus status);
+	ins_camera::MediaUrl StopCapture(ins_camera::CaptureStatus status, const std::string& prefix);
+	void Stream(ins_camera::LiveStreamParam param);
+
+	SimulatedCameraOptions options_;
+	mutable std::unique_ptr<LocalFileServer> server_;
+
+	mutable std::mutex mutex_;
+	mutable std::mt19937 random_;
+	mutable bool open_;
+	mutable std::vector<std::string> files_;
+	mutable uint64_t used_bytes_;
+	mutable bool card_full_; // a file did not fit, until one is deleted
+	mutable uint32_t next_file_;
+	mutable std::chrono::steady_clock::time_point opened_at_;
+	ins_camera::CaptureStatus capture_;
+	std::chrono::steady_clock::time_point capture_started_;
+	std::map<int, std::shared_ptr<ins_camera::ExposureSettings>> exposure_;
+	std::map<int, std::shared_ptr<ins_camera::CaptureSettings>> capture_settings_;
+	std::shared_ptr<ins_camera::StreamDelegate> delegate_;
+	std::map<int, ins_camera::TimelapseParam> timelapse_;
+	std::vector<std::string> interval_frames_; // of the interval shooting in progress
+	bool interval_running_;
+	std::condition_variable interval_cv_;
+	std::thread interval_thread_;
+
+	mutable std::atomic<uint64_t> commands_;
+	mutable std::atomic<uint64_t> failures_;
+	mutable std::atomic<bool> streaming_;
+	mutable std::thread stream_thread_;
+};
@@ -0,0 +1,258 @@
+#include "stitch_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <crow/TinySHA1.hpp>
+#include "file_util.h"
+
+namespace {
+	// bump when the key layout changes, old entries then simply stop matching
+	const char kKeyVersion[] = "stitch-cache-1";
+
+	/**
+	 * ".jpg" for "C:/out/pano.JPG", empty without an extension
+	 */
+	std::string ExtensionOf(const std::string& path) {
+		const size_t dot = path.find_last_of('.');
+		const size_t slash = path.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return std::string();
+		}
+		std::string extension = path.substr(dot);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension;
+	}
+}
+
+StitchCache::StitchCache(const StitchCacheOptions& options)
+	: options_(options), bytes_(0), next_temp_(0), dirty_(false) {
+	file_util::MakeDirectories(options_.dir);
+}
+
+StitchCache::~StitchCache() {
+	Save();
+}
+
+std::string StitchCache::PathOf(const std::string& key, const std::string& extension) const {
+	return options_.dir + key + extension;
+}
+
+bool StitchCache::Load() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	lru_.clear();
+	entries_.clear();
+	bytes_ = 0;
+	std::ifstream in(options_.dir + "index");
+	if (!in) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		Entry entry;
+		if (!(fields >> entry.key >> entry.size) || entry.key.size() != 40 || entries_.count(entry.key)) {
+			continue;
+		}
+		fields >> entry.extension;
+		entry.pins = 0;
+		if (file_util::FileSize(PathOf(entry.key, entry.extension)) != static_cast<int64_t>(entry.size)) {
+			dirty_ = true;
+			continue;
+		}
+		lru_.push_back(entry);
+		entries_[entry.key] = std::prev(lru_.end());
+		bytes_ += entry.size;
+	}
+	EvictLocked();
+	return true;
+}
+
+bool StitchCache::Save() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return !dirty_ || SaveLocked();
+}
+
+bool StitchCache::SaveLocked() {
+	const std::string path = options_.dir + "index";
+	const std::string part = path + ".part";
+	FILE* file = fopen(part.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = true;
+	for (const auto& entry : lru_) {
+		const std::string line = entry.key + " " + std::to_string(entry.size) + " " + entry.extension + "\n";
+		ok = ok && fwrite(line.data(), 1, line.size(), file) == line.size();
+	}
+	ok = fclose(file) == 0 && ok;
+	// replaced in one step, a crash leaves the previous index
+	if (!ok || !file_util::Rename(part, path)) {
+		file_util::Remove(part);
+		return false;
+	}
+	dirty_ = false;
+	return true;
+}
+
+std::string StitchCache::ContentSha1(const std::string& path) {
+	const int64_t size = file_util::FileSize(path);
+	const int64_t modified = file_util::ModifiedTime(path);
+	if (size < 0) {
+		return std::string();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = hashes_.find(path);
+		if (it != hashes_.end() && it->second.size == size && it->second.modified == modified) {
+			return it->second.sha1;
+		}
+	}
+	ContentHash hash;
+	hash.size = size;
+	hash.modified = modified;
+	hash.sha1 = file_util::Sha1File(path);
+	if (!hash.sha1.empty()) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		hashes_[path] = hash;
+	}
+	return hash.sha1;
+}
+
+std::string StitchCache::KeyOf(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& extension) {
+	std::string description = std::string(kKeyVersion) + "\n" + params.Key() + "\n" + extension + "\n";
+	for (const auto& input : input_paths) {
+		const std::string sha1 = ContentSha1(input);
+		if (sha1.empty()) {
+			return std::string();
+		}
+		description += sha1 + "\n";
+	}
+	sha1::SHA1 sha;
+	sha.processBytes(description.data(), description.size());
+	uint8_t digest[20];
+	sha.getDigestBytes(digest);
+	return file_util::ToHex(digest, sizeof(digest));
+}
+
+bool StitchCache::Stitch(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& output_path,
+	const StitchFunction& stitch) {
+	const std::string extension = ExtensionOf(output_path);
+	const std::string key = KeyOf(params, input_paths, extension);
+	if (key.empty()) {
+		std::cerr << "Stitch cache: cannot read the inputs of " << output_path << std::endl;
+		return false;
+	}
+
+	std::shared_ptr<std::promise<bool>> leader;
+	std::shared_future<bool> running;
+	std::string stitched_path;
+	auto hit = lru_.end();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = entries_.find(key);
+		if (it != entries_.end()) {
+			++stats_.hits;
+			lru_.splice(lru_.begin(), lru_, it->second);
+			++it->second->pins;
+			dirty_ = true;
+			hit = it->second;
+		}
+		else if (in_flight_.count(key) == 0) {
+			++stats_.misses;
+			leader = std::make_shared<std::promise<bool>>();
+			in_flight_[key] = leader->get_future().share();
+			stitched_path = options_.dir + key + ".tmp" + std::to_string(next_temp_++) + extension;
+		}
+		else {
+			++stats_.coalesced;
+			running = in_flight_[key];
+		}
+	}
+
+	if (hit != lru_.end()) {
+		// copied without the lock, the pin keeps the panorama from being evicted meanwhile
+		return CopyOut(hit, output_path);
+	}
+	if (running.valid()) {
+		// the stitch we waited for is in the cache now, unless it failed or was evicted right away
+		return running.get() && Stitch(params, input_paths, output_path, stitch);
+	}
+
+	bool ok = false;
+	try {
+		ok = stitch(stitched_path) && file_util::FileSize(stitched_path) > 0;
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Stitch " << output_path << " failed: " << e.what() << std::endl;
+	}
+	catch (...) {
+		// whatever it throws, the callers coalesced on this key must still be woken up
+		std::cerr << "Stitch " << output_path << " failed with an unknown exception" << std::endl;
+	}
+	auto entry = lru_.end();
+	if (ok) {
+		entry = Insert(key, extension, stitched_path);
+	}
+	else {
+		file_util::Remove(stitched_path);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		in_flight_.erase(key);
+	}
+	leader->set_value(entry != lru_.end());
+	return entry != lru_.end() && CopyOut(entry, output_path);
+}
+
+std::list<StitchCache::Entry>::iterator StitchCache::Insert(const std::string& key, const std::string& extension, const std::string& stitched_path) {
+	const std::string path = PathOf(key, extension);
+	if (!file_util::Rename(stitched_path, path)) {
+		file_util::Remove(stitched_path);
+		return lru_.end();
+	}
+	Entry entry;
+	entry.key = key;
+	entry.extension = extension;
+	entry.size = static_cast<uint64_t>(file_util::FileSize(path));
+	entry.pins = 1; // by the caller, until its copy is made
+	std::lock_guard<std::mutex> lock(mutex_);
+	lru_.push_front(entry);
+	entries_[key] = lru_.begin();
+	bytes_ += entry.size;
+	EvictLocked();
+	SaveLocked();
+	return lru_.begin();
+}
+
+bool StitchCache::CopyOut(std::list<Entry>::iterator entry, const std::string& output_path) {
+	const bool ok = file_util::Copy(PathOf(entry->key, entry->extension), output_path);
+	std::lock_guard<std::mutex> lock(mutex_);
+	--entry->pins;
+	return ok;
+}
+
+void StitchCache::EvictLocked() {
+	auto it = lru_.end();
+	while (bytes_ > options_.max_bytes && it != lru_.begin()) {
+		--it;
+		if (it->pins > 0) {
+			continue;
+		}
+		file_util::Remove(PathOf(it->key, it->extension));
+		bytes_ -= it->size;
+		entries_.erase(it->key);
+		++stats_.evictions;
+		dirty_ = true;
+		it = lru_.erase(it);
+	}
+	stats_.entries = lru_.size();
+	stats_.bytes = bytes_;
+}
+
+StitchCacheStats StitchCache::Stats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
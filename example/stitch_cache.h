@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "stitch_pool.h"
+
+struct StitchCacheOptions {
+	std::string dir = "./stitch_cache/"; // with trailing slash, holds the panoramas and the index
+	uint64_t max_bytes = 2ull << 30;     // least recently used panoramas are evicted above this
+};
+
+struct StitchCacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;      // requests that ran the stitch
+	uint64_t coalesced = 0;   // requests that waited for an identical stitch already running
+	uint64_t evictions = 0;
+	uint64_t entries = 0;
+	uint64_t bytes = 0;
+};
+
+/**
+ * \class StitchCache
+ * \brief Panoramas stored by a hash of the input file contents, the StitchParams and the output format, so
+ *        stitching the same image with the same settings again is a copy of the earlier result.
+ *        Identical requests that arrive while the stitch runs wait for it instead of stitching too.
+ *        The cache is bounded by size with least recently used eviction, and its index is saved in
+ *        <dir>index so the results survive restarts.
+ */
+class StitchCache {
+public:
+	/**
+	 * stitch the request into the given path, e.g. through StitchWorkerPool::Submit
+	 */
+	typedef std::function<bool(const std::string& output_path)> StitchFunction;
+
+	explicit StitchCache(const StitchCacheOptions& options = StitchCacheOptions());
+	~StitchCache();
+
+	StitchCache(const StitchCache&) = delete;
+	StitchCache& operator=(const StitchCache&) = delete;
+
+	/**
+	 * \brief read the index, entries whose panorama is gone are dropped
+	 */
+	bool Load();
+
+	/**
+	 * \brief put the panorama for input_paths and params at output_path, from the cache when there is one,
+	 *        otherwise by running stitch once however many callers ask for it at the same time
+	 * \return false if the inputs cannot be read or the stitch failed
+	 */
+	bool Stitch(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& output_path,
+		const StitchFunction& stitch);
+
+	/**
+	 * \brief hex key of the request, empty if an input cannot be read
+	 */
+	std::string KeyOf(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& extension);
+
+	StitchCacheStats Stats() const;
+
+	/**
+	 * \brief write the index with the current recency order, Load() of the next run continues from it
+	 */
+	bool Save();
+
+private:
+	struct Entry {
+		std::string key;
+		std::string extension;
+		uint64_t size;
+		int pins; // callers copying the panorama out, it is not evicted meanwhile
+	};
+	struct ContentHash {
+		int64_t size;
+		int64_t modified;
+		std::string sha1;
+	};
+
+	std::string PathOf(const std::string& key, const std::string& extension) const;
+	std::string ContentSha1(const std::string& path);
+	bool CopyOut(std::list<Entry>::iterator entry, const std::string& output_path);
+	std::list<Entry>::iterator Insert(const std::string& key, const std::string& extension, const std::string& stitched_path);
+	void EvictLocked();
+	bool SaveLocked();
+
+	StitchCacheOptions options_;
+	mutable std::mutex mutex_;
+	std::list<Entry> lru_; // most recently used first
+	std::map<std::string, std::list<Entry>::iterator> entries_;
+	std::map<std::string, std::shared_future<bool>> in_flight_;
+	std::map<std::string, ContentHash> hashes_; // inputs hashed before by path, reused while size and mtime match
+	uint64_t bytes_;
+	uint64_t next_temp_;
+	bool dirty_;
+	StitchCacheStats stats_;
+};
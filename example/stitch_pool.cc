@@ -0,0 +1,245 @@
+#include "stitch_pool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+namespace {
+	// how far down the queue a worker looks for a job matching one of its warm stitchers
+	const size_t kAffinityWindow = 16;
+}
+
+std::string StitchParams::Key() const {
+	std::ostringstream key;
+	key << static_cast<int>(stitch_type) << '|' << static_cast<int>(hdr_type) << '|'
+		<< output_width << 'x' << output_height << '|'
+		<< enable_flowstate << enable_denoise << enable_cuda << enable_colorplus << '|'
+		<< colorplus_model_path;
+	return key.str();
+}
+
+std::shared_ptr<ins_media::ImageStitcher> CreateImageStitcher(const StitchParams& params) {
+	auto image_stitcher = std::make_shared<ins_media::ImageStitcher>();
+	image_stitcher->SetStitchType(params.stitch_type);
+	image_stitcher->SetHDRType(params.hdr_type);
+	image_stitcher->SetOutputSize(params.output_width, params.output_height);
+	image_stitcher->EnableFlowState(params.enable_flowstate);
+	image_stitcher->EnableDenoise(params.enable_denoise);
+	image_stitcher->EnableCuda(params.enable_cuda);
+	image_stitcher->EnableColorPlus(params.enable_colorplus && !params.colorplus_model_path.empty(), params.colorplus_model_path);
+	return image_stitcher;
+}
+
+struct StitchWorkerPool::Job {
+	StitchParams params;
+	std::string key;
+	std::vector<std::string> input_paths;
+	std::string output_path;
+	Worker* pinned = nullptr; // only this worker may take the job
+	bool warm_only = false;
+	std::promise<bool> result;
+	std::function<void(bool ok)> done;
+
+	void Finish(bool ok) {
+		result.set_value(ok);
+		if (done) {
+			done(ok);
+		}
+	}
+};
+
+struct StitchWorkerPool::Worker {
+	std::thread thread;
+	// most recently used first, only touched by the worker thread
+	std::vector<std::pair<std::string, std::shared_ptr<ins_media::ImageStitcher>>> stitchers;
+
+	bool Has(const std::string& key) const {
+		for (const auto& entry : stitchers) {
+			if (entry.first == key) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::shared_ptr<ins_media::ImageStitcher> Acquire(const Job& job, size_t capacity) {
+		for (size_t i = 0; i < stitchers.size(); ++i) {
+			if (stitchers[i].first == job.key) {
+				auto entry = stitchers[i];
+				stitchers.erase(stitchers.begin() + i);
+				stitchers.insert(stitchers.begin(), entry);
+				return entry.second;
+			}
+		}
+		auto stitcher = CreateImageStitcher(job.params);
+		stitchers.insert(stitchers.begin(), std::make_pair(job.key, stitcher));
+		if (stitchers.size() > capacity) {
+			stitchers.pop_back();
+		}
+		return stitcher;
+	}
+};
+
+StitchWorkerPool::StitchWorkerPool(size_t workers, size_t stitchers_per_worker)
+	: stopping_(false), stitchers_per_worker_(std::max<size_t>(1, stitchers_per_worker)) {
+	if (workers == 0) {
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (size_t i = 0; i < workers; ++i) {
+		workers_.emplace_back(new Worker());
+	}
+	for (auto& worker : workers_) {
+		worker->thread = std::thread(&StitchWorkerPool::Run, this, worker.get());
+	}
+}
+
+StitchWorkerPool::~StitchWorkerPool() {
+	Stop();
+}
+
+void StitchWorkerPool::Warm(const StitchParams& params) {
+	std::vector<std::future<bool>> warmed;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (stopping_) {
+			return;
+		}
+		for (auto& worker : workers_) {
+			auto job = std::make_shared<Job>();
+			job->params = params;
+			job->key = params.Key();
+			job->pinned = worker.get();
+			job->warm_only = true;
+			warmed.push_back(job->result.get_future());
+			jobs_.push_front(job);
+		}
+	}
+	cv_.notify_all();
+	for (auto& done : warmed) {
+		done.wait();
+	}
+}
+
+void StitchWorkerPool::Enqueue(const std::shared_ptr<Job>& job) {
+	job->key = job->params.Key();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!stopping_) {
+			jobs_.push_back(job);
+			cv_.notify_one();
+			return;
+		}
+	}
+	job->Finish(false);
+}
+
+std::future<bool> StitchWorkerPool::Submit(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& output_path) {
+	auto job = std::make_shared<Job>();
+	job->params = params;
+	job->input_paths = input_paths;
+	job->output_path = output_path;
+	auto result = job->result.get_future();
+	Enqueue(job);
+	return result;
+}
+
+void StitchWorkerPool::Submit(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& output_path,
+	std::function<void(bool ok)> done) {
+	auto job = std::make_shared<Job>();
+	job->params = params;
+	job->input_paths = input_paths;
+	job->output_path = output_path;
+	job->done = done;
+	Enqueue(job);
+}
+
+size_t StitchWorkerPool::Workers() const {
+	return workers_.size();
+}
+
+size_t StitchWorkerPool::Pending() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return jobs_.size();
+}
+
+void StitchWorkerPool::Stop() {
+	std::deque<std::shared_ptr<Job>> abandoned;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (stopping_) {
+			return;
+		}
+		stopping_ = true;
+		abandoned.swap(jobs_);
+	}
+	cv_.notify_all();
+	for (auto& job : abandoned) {
+		job->Finish(false);
+	}
+	for (auto& worker : workers_) {
+		worker->thread.join();
+	}
+}
+
+void StitchWorkerPool::Run(Worker* worker) {
+	while (true) {
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!job) {
+				if (stopping_) {
+					return;
+				}
+				// pinned jobs first, then a job we are already warm for, then the oldest one anyone may take
+				auto chosen = jobs_.end();
+				auto first = jobs_.end();
+				size_t scanned = 0;
+				for (auto it = jobs_.begin(); it != jobs_.end() && scanned < kAffinityWindow; ++it) {
+					const Job& candidate = **it;
+					if (candidate.pinned && candidate.pinned != worker) {
+						continue;
+					}
+					++scanned;
+					if (candidate.pinned || worker->Has(candidate.key)) {
+						chosen = it;
+						break;
+					}
+					if (first == jobs_.end()) {
+						first = it;
+					}
+				}
+				if (chosen == jobs_.end()) {
+					chosen = first;
+				}
+				if (chosen != jobs_.end()) {
+					job = *chosen;
+					jobs_.erase(chosen);
+				}
+				else {
+					cv_.wait(lock);
+				}
+			}
+		}
+
+		bool ok = false;
+		try {
+			auto stitcher = worker->Acquire(*job, stitchers_per_worker_);
+			if (job->warm_only) {
+				ok = true;
+			}
+			else {
+				stitcher->SetInputPath(job->input_paths);
+				stitcher->SetOutputPath(job->output_path);
+				ok = stitcher->Stitch();
+			}
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Stitch " << job->output_path << " failed: " << e.what() << std::endl;
+		}
+		catch (...) {
+			// anything else would end the worker thread and with it the process
+			std::cerr << "Stitch " << job->output_path << " failed with an unknown exception" << std::endl;
+		}
+		job->Finish(ok);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stitcher/stitcher.h>
+#include <stitcher/common.h>
+
+/**
+ * \brief Everything ImageStitcher is configured with besides the input and output paths.
+ *        Jobs with equal keys can share a warm stitcher.
+ */
+struct StitchParams {
+	STITCH_TYPE stitch_type = STITCH_TYPE::TEMPLATE;
+	HDR_TYPE hdr_type = HDR_TYPE::ImageHdr_NONE;
+	int output_width = 1920;
+	int output_height = 960;
+	bool enable_flowstate = true;
+	bool enable_denoise = true;
+	bool enable_cuda = false;
+	bool enable_colorplus = false;
+	std::string colorplus_model_path;
+
+	std::string Key() const;
+};
+
+/**
+ * \brief create a stitcher and apply every setting in params, this is the expensive part
+ */
+std::shared_ptr<ins_media::ImageStitcher> CreateImageStitcher(const StitchParams& params);
+
+/**
+ * \class StitchWorkerPool
+ * \brief Keeps pre-configured ImageStitcher instances warm on a fixed set of worker threads, one per core
+ *        by default. Each worker caches a few stitchers by parameter key and prefers queued jobs whose key
+ *        it already has, so model loading and pipeline init are paid once per worker instead of per image.
+ */
+class StitchWorkerPool {
+public:
+	/**
+	 * \param workers number of worker threads, 0 means one per core
+	 * \param stitchers_per_worker how many differently configured stitchers each worker keeps
+	 */
+	explicit StitchWorkerPool(size_t workers = 0, size_t stitchers_per_worker = 4);
+	~StitchWorkerPool();
+
+	StitchWorkerPool(const StitchWorkerPool&) = delete;
+	StitchWorkerPool& operator=(const StitchWorkerPool&) = delete;
+
+	/**
+	 * \brief create a stitcher for params on every worker ahead of the first job, blocks until done
+	 */
+	void Warm(const StitchParams& params);
+
+	/**
+	 * \brief queue a stitch of input_paths into output_path
+	 * \return future holding the result of ImageStitcher::Stitch()
+	 */
+	std::future<bool> Submit(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& output_path);
+
+	/**
+	 * \brief queue a stitch and call done with the result of ImageStitcher::Stitch() from the worker thread,
+	 *        or with false from Stop() if the job never ran
+	 */
+	void Submit(const StitchParams& params, const std::vector<std::string>& input_paths, const std::string& output_path,
+		std::function<void(bool ok)> done);
+
+	size_t Workers() const;
+	size_t Pending() const;
+
+	/**
+	 * \brief finish running jobs and join the workers, queued jobs fail
+	 */
+	void Stop();
+
+private:
+	struct Job;
+	struct Worker;
+
+	void Enqueue(const std::shared_ptr<Job>& job);
+
+	void Run(Worker* worker);
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<std::shared_ptr<Job>> jobs_;
+	bool stopping_;
+	size_t stitchers_per_worker_;
+	std::vector<std::unique_ptr<Worker>> workers_;
+};
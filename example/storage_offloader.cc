@@ -0,0 +1,297 @@
+#include "storage_offloader.h"
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_set>
+#include "file_util.h"
+
+namespace {
+	/**
+	 * IMG_20230221_134844_00_099.insp -> 20230221_134844_00_099.insp, photos and videos ordered by capture time
+	 */
+	std::string CaptureOrder(const std::string& remote) {
+		const std::string name = file_util::Basename(remote);
+		const size_t underscore = name.find('_');
+		return underscore == std::string::npos ? name : name.substr(underscore + 1);
+	}
+
+	const size_t kMaxFruitlessBatches = 3;
+
+	/**
+	 * run a command on the camera's executor, false if the executor was stopped before it ran
+	 */
+	template <typename T, typename F>
+	bool RunOn(CameraCommandExecutor& executor, F command, T& result) {
+		auto future = executor.Submit(command);
+		try {
+			result = future.get();
+			return true;
+		}
+		catch (const std::future_error&) {
+			return false;
+		}
+	}
+}
+
+StorageOffloader::StorageOffloader(std::shared_ptr<CameraDevice> cam, CameraCommandExecutor& executor, FileCatalog& catalog,
+	const StorageOffloadOptions& options)
+	: cam_(cam), executor_(executor), catalog_(catalog), options_(options), rate_limit_(std::make_shared<TokenBucket>(options.bytes_per_second)),
+	running_(false), stopped_(false) {
+	BulkDownloadOptions download_options;
+	download_options.concurrency = options_.concurrency;
+	download_options.local_dir = options_.local_dir;
+	download_options.rate_limit = rate_limit_;
+	downloader_.reset(new BulkDownloader(cam_->GetHttpBaseUrl(), download_options));
+}
+
+StorageOffloader::~StorageOffloader() {
+	Stop();
+}
+
+void StorageOffloader::Start() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (running_) {
+		return;
+	}
+	running_ = true;
+	stopped_ = false;
+	thread_ = std::thread(&StorageOffloader::Run, this);
+}
+
+void StorageOffloader::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		running_ = false;
+		stopped_ = true;
+	}
+	cv_.notify_all();
+	downloader_->Cancel();
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+void StorageOffloader::Run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (running_) {
+		lock.unlock();
+		Check();
+		lock.lock();
+		cv_.wait_for(lock, options_.poll_interval, [this]() { return !running_; });
+	}
+}
+
+bool StorageOffloader::ReadStorage(ins_camera::StorageStatus& status) {
+	auto cam = cam_;
+	std::pair<bool, ins_camera::StorageStatus> result;
+	if (!RunOn(executor_, [cam]() {
+		std::pair<bool, ins_camera::StorageStatus> state;
+		state.first = cam->GetStorageState(state.second);
+		return state;
+	}, result) || !result.first) {
+		return false;
+	}
+	status = result.second;
+	return true;
+}
+
+bool StorageOffloader::Capturing() {
+	auto cam = cam_;
+	ins_camera::CaptureStatus status = ins_camera::CaptureStatus::NOT_CAPTURE;
+	RunOn(executor_, [cam]() { return cam->GetCaptureCurrentStatus(); }, status);
+	return status != ins_camera::CaptureStatus::NOT_CAPTURE;
+}
+
+bool StorageOffloader::UpdateRate() {
+	const bool capturing = Capturing();
+	rate_limit_->SetRate(capturing ? options_.recording_bytes_per_second : options_.bytes_per_second);
+	return capturing;
+}
+
+std::vector<std::string> StorageOffloader::Oldest(uint64_t bytes, bool capturing) {
+	auto cam = cam_;
+	std::vector<std::string> listing;
+	if (!RunOn(executor_, [cam]() { return cam->GetCameraFilesList(); }, listing) || listing.empty()) {
+		return std::vector<std::string>();
+	}
+	catalog_.Sync(listing);
+	std::sort(listing.begin(), listing.end(), [](const std::string& a, const std::string& b) { return CaptureOrder(a) < CaptureOrder(b); });
+	// the newest file may still be being written while the camera captures
+	if (capturing) {
+		listing.pop_back();
+	}
+
+	// files that failed recently are stepped over, a bad one must not hold back the newer ones
+	const auto now = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!backoff_.empty()) {
+		const std::unordered_set<std::string> listed(listing.begin(), listing.end());
+		for (auto it = backoff_.begin(); it != backoff_.end();) {
+			it = listed.count(it->first) ? std::next(it) : backoff_.erase(it);
+		}
+	}
+	stats_.backed_off = 0;
+
+	// sizes are known for files the catalog saw downloaded, the others count as one file each
+	std::vector<std::string> batch;
+	uint64_t known = 0;
+	for (const auto& remote : listing) {
+		if (batch.size() >= options_.batch_files || (known >= bytes && !batch.empty())) {
+			break;
+		}
+		auto backoff = backoff_.find(remote);
+		if (backoff != backoff_.end() && backoff->second.retry_at > now) {
+			++stats_.backed_off;
+			continue;
+		}
+		CatalogEntry entry;
+		if (catalog_.Lookup(remote, entry)) {
+			known += entry.size;
+		}
+		batch.push_back(remote);
+	}
+	return batch;
+}
+
+void StorageOffloader::Failed(const std::string& remote) {
+	// called with mutex_ held
+	Backoff& backoff = backoff_.insert(std::make_pair(remote, Backoff{ 0, std::chrono::steady_clock::time_point() })).first->second;
+	auto delay = options_.failure_backoff;
+	for (unsigned i = 0; i < backoff.failures && delay < options_.max_failure_backoff; ++i) {
+		delay *= 2;
+	}
+	delay = std::min(delay, options_.max_failure_backoff);
+	++backoff.failures;
+	backoff.retry_at = std::chrono::steady_clock::now() + delay;
+}
+
+uint64_t StorageOffloader::Offload(const std::vector<std::string>& batch) {
+	for (const auto& remote : batch) {
+		CatalogEntry entry;
+		if (!catalog_.Lookup(remote, entry) || entry.state == CatalogState::New) {
+			catalog_.Transition(remote, CatalogState::Downloading);
+		}
+	}
+	// a recording can start while the batch transfers, the cap follows the capture state until it is done
+	std::mutex watch_mutex;
+	std::condition_variable watch_cv;
+	bool transferring = true;
+	std::thread watcher([this, &watch_mutex, &watch_cv, &transferring]() {
+		std::unique_lock<std::mutex> lock(watch_mutex);
+		while (!watch_cv.wait_for(lock, options_.capture_poll_interval, [&transferring]() { return !transferring; })) {
+			lock.unlock();
+			UpdateRate();
+			lock.lock();
+		}
+	});
+	downloader_->Run(batch);
+	{
+		std::lock_guard<std::mutex> lock(watch_mutex);
+		transferring = false;
+	}
+	watch_cv.notify_all();
+	watcher.join();
+
+	DownloadManifest manifest(options_.local_dir + ".download_manifest");
+	manifest.Load();
+	uint64_t freed = 0;
+	for (const auto& remote : batch) {
+		if (!Running()) {
+			break;
+		}
+		const std::string local = downloader_->LocalPath(remote);
+		DownloadManifest::Entry downloaded;
+		if (!manifest.Lookup(remote, downloaded) || file_util::FileSize(local) != static_cast<int64_t>(downloaded.size)) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			++stats_.download_failed;
+			Failed(remote);
+			continue;
+		}
+		// what is on disk now, not what went through the socket, is what the card's copy is replaced with
+		if (options_.verify && file_util::Sha1File(local) != downloaded.sha1) {
+			std::cerr << "Offloaded " << local << " does not match its checksum, keeping " << remote << " on the card" << std::endl;
+			file_util::Remove(local);
+			catalog_.Transition(remote, CatalogState::New);
+			std::lock_guard<std::mutex> lock(mutex_);
+			++stats_.verify_failed;
+			Failed(remote);
+			continue;
+		}
+		CatalogEntry entry;
+		if (!catalog_.Lookup(remote, entry) || entry.state != CatalogState::Stitched) {
+			catalog_.Transition(remote, CatalogState::Downloaded, downloaded.size, downloaded.sha1);
+		}
+
+		auto cam = cam_;
+		bool deleted = false;
+		RunOn(executor_, [cam, remote]() { return cam->DeleteCameraFile(remote); }, deleted);
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!deleted) {
+			++stats_.delete_failed;
+			Failed(remote);
+			continue;
+		}
+		backoff_.erase(remote);
+		catalog_.Transition(remote, CatalogState::Deleted, downloaded.size);
+		++stats_.offloaded;
+		stats_.freed_bytes += downloaded.size;
+		freed += downloaded.size;
+	}
+	return freed;
+}
+
+uint64_t StorageOffloader::Check() {
+	std::lock_guard<std::mutex> check_lock(check_mutex_);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++stats_.checks;
+	}
+	uint64_t freed = 0;
+	bool offloading = false;
+	size_t fruitless = 0;
+	while (Running()) {
+		ins_camera::StorageStatus status;
+		if (!ReadStorage(status) || status.total_space == 0) {
+			break;
+		}
+		const double used = 1.0 - static_cast<double>(std::min(status.free_space, status.total_space)) / status.total_space;
+		const bool full = status.state == ins_camera::CardState::STOR_CS_NOSPACE;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stats_.used = used;
+			stats_.max_used = std::max(stats_.max_used, used);
+			stats_.card_full += full && !offloading ? 1 : 0;
+		}
+		// start above the high-water mark, then go on down to the low-water mark
+		if (!full && (offloading ? used <= options_.low_water : used < options_.high_water)) {
+			break;
+		}
+		offloading = true;
+
+		const bool capturing = UpdateRate();
+		const uint64_t excess = static_cast<uint64_t>(std::max(used - options_.low_water, 0.0) * status.total_space);
+		const auto batch = Oldest(std::max<uint64_t>(excess, 1), capturing);
+		if (batch.empty()) {
+			break;
+		}
+		const uint64_t batch_freed = Offload(batch);
+		freed += batch_freed;
+		// the files of a batch that freed nothing are backed off, the next one moves on to newer files. after a
+		// few of those in a row the camera or the link is more likely at fault than the files, the next poll tries again
+		fruitless = batch_freed == 0 ? fruitless + 1 : 0;
+		if (fruitless >= kMaxFruitlessBatches) {
+			break;
+		}
+	}
+	return freed;
+}
+
+bool StorageOffloader::Running() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return !stopped_;
+}
+
+StorageOffloadStats StorageOffloader::Stats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "bulk_downloader.h"
+#include "camera_device.h"
+#include "camera_executor.h"
+#include "file_catalog.h"
+#include "token_bucket.h"
+
+struct StorageOffloadOptions {
+	std::string local_dir;                         // offloaded files, with trailing slash
+	double high_water = 0.85;                      // share of the card in use that starts offloading
+	double low_water = 0.70;                       // offloading goes on until usage is down to it
+	std::chrono::milliseconds poll_interval = std::chrono::milliseconds(30000);
+	uint64_t bytes_per_second = 0;                 // while the camera is idle, 0: no cap
+	uint64_t recording_bytes_per_second = 4 << 20; // while it captures, the card is busy writing the recording
+	std::chrono::milliseconds capture_poll_interval = std::chrono::milliseconds(1000); // during a batch, to follow it
+	size_t batch_files = 4;                        // downloaded together before any of them is deleted
+	size_t concurrency = 2;
+	bool verify = true;                            // re-read the local copy and compare it with the transfer's sha1
+	// a file that failed to download, verify or delete is skipped for this long, doubled on every further failure
+	std::chrono::milliseconds failure_backoff = std::chrono::milliseconds(60000);
+	std::chrono::milliseconds max_failure_backoff = std::chrono::milliseconds(3600000);
+};
+
+struct StorageOffloadStats {
+	uint64_t checks = 0;
+	uint64_t offloaded = 0;      // downloaded, verified and deleted from the card
+	uint64_t freed_bytes = 0;
+	uint64_t download_failed = 0;
+	uint64_t verify_failed = 0;  // kept on the card
+	uint64_t delete_failed = 0;
+	uint64_t backed_off = 0;     // files skipped at the last check after failing before
+	uint64_t card_full = 0;      // checks that found STOR_CS_NOSPACE
+	double used = 0;             // share of the card at the last check
+	double max_used = 0;
+};
+
+/**
+ * \class StorageOffloader
+ * \brief Keeps the camera's card below a high-water mark so long unattended captures do not stop when it fills.
+ *        Every poll_interval it reads GetStorageState() on the camera's command executor; above high_water, or
+ *        when the card reports STOR_CS_NOSPACE, it downloads the oldest files in small batches, checks each
+ *        local copy against the checksum taken during the transfer and only then calls DeleteCameraFile(),
+ *        until usage is back at low_water. A file that fails is skipped with an exponential backoff, so the
+ *        newer ones behind it still get offloaded. Transfers share a TokenBucket that is slowed to
+ *        recording_bytes_per_second while the camera captures, polled every capture_poll_interval during a batch
+ *        so a recording that starts mid-batch is throttled right away. Every step is recorded in the FileCatalog.
+ */
+class StorageOffloader {
+public:
+	StorageOffloader(std::shared_ptr<CameraDevice> cam, CameraCommandExecutor& executor, FileCatalog& catalog,
+		const StorageOffloadOptions& options);
+	~StorageOffloader();
+
+	StorageOffloader(const StorageOffloader&) = delete;
+	StorageOffloader& operator=(const StorageOffloader&) = delete;
+
+	void Start();
+
+	/**
+	 * \brief stop after the transfers in progress, they keep their ".part" files for the next run
+	 */
+	void Stop();
+
+	/**
+	 * \brief one check from the calling thread, offloading if the card is over the high-water mark
+	 * \return bytes freed on the card
+	 */
+	uint64_t Check();
+
+	StorageOffloadStats Stats() const;
+
+private:
+	bool ReadStorage(ins_camera::StorageStatus& status);
+	bool Capturing();
+	bool UpdateRate();
+	std::vector<std::string> Oldest(uint64_t bytes, bool capturing);
+	uint64_t Offload(const std::vector<std::string>& batch);
+	void Failed(const std::string& remote);
+	bool Running() const;
+	void Run();
+
+	std::shared_ptr<CameraDevice> cam_;
+	CameraCommandExecutor& executor_;
+	FileCatalog& catalog_;
+	StorageOffloadOptions options_;
+	std::shared_ptr<TokenBucket> rate_limit_;
+	std::unique_ptr<BulkDownloader> downloader_;
+
+	std::mutex check_mutex_; // one Check() at a time
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	bool running_; // the polling thread
+	bool stopped_;
+	StorageOffloadStats stats_;
+	struct Backoff {
+		unsigned failures;
+		std::chrono::steady_clock::time_point retry_at;
+	};
+	std::unordered_map<std::string, Backoff> backoff_; // by remote path
+	std::thread thread_;
+};
@@ -0,0 +1,179 @@
+#include "stream_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include "annexb.h"
+#include "file_util.h"
+
+using ins_camera::VideoEncodeType;
+
+namespace {
+	const char kMagic[8] = { 'N', 'A', 'L', 'I', 'D', 'X', '0', '1' };
+	const size_t kHeaderSize = 16;
+	const size_t kEntrySize = 24;
+
+	void PutLE(uint8_t* out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out[i] = static_cast<uint8_t>(value >> (8 * i));
+		}
+	}
+
+	uint64_t GetLE(const uint8_t* in, size_t bytes) {
+		uint64_t value = 0;
+		for (size_t i = 0; i < bytes; ++i) {
+			value |= static_cast<uint64_t>(in[i]) << (8 * i);
+		}
+		return value;
+	}
+
+	bool Seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+		return _fseeki64(file, static_cast<int64_t>(offset), SEEK_SET) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+}
+
+KeyframeIndexWriter::KeyframeIndexWriter(const std::string& index_path, VideoEncodeType codec)
+	: file_(fopen(index_path.c_str(), "wb")), codec_(codec), frames_(0), keyframes_(0) {
+	if (file_) {
+		uint8_t header[kHeaderSize] = {};
+		memcpy(header, kMagic, sizeof(kMagic));
+		PutLE(header + 8, static_cast<uint32_t>(codec), 4);
+		fwrite(header, 1, sizeof(header), file_);
+		fflush(file_);
+	}
+}
+
+KeyframeIndexWriter::~KeyframeIndexWriter() {
+	if (file_) {
+		fclose(file_);
+	}
+}
+
+bool KeyframeIndexWriter::AddFrame(const uint8_t* data, size_t size, int64_t timestamp, uint64_t offset) {
+	bool keyframe = false;
+	annexb::ForEachNal(data, size, [&](const uint8_t* nal, size_t) {
+		keyframe = keyframe || annexb::IsKeyframe(codec_, annexb::NalType(codec_, nal));
+	});
+	if (keyframe && file_) {
+		uint8_t entry[kEntrySize];
+		PutLE(entry, offset, 8);
+		PutLE(entry + 8, static_cast<uint64_t>(timestamp), 8);
+		PutLE(entry + 16, frames_, 8);
+		fwrite(entry, 1, sizeof(entry), file_);
+		// one entry per GOP, cheap enough to keep the index as current as the stream
+		fflush(file_);
+		++keyframes_;
+	}
+	++frames_;
+	return keyframe;
+}
+
+bool KeyframeIndex::Load(const std::string& index_path) {
+	entries_.clear();
+	FILE* file = fopen(index_path.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+	uint8_t header[kHeaderSize];
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+		fclose(file);
+		return false;
+	}
+	codec_ = static_cast<VideoEncodeType>(GetLE(header + 8, 4));
+	uint8_t entry[kEntrySize];
+	// a partial last entry is what a recording that was cut off leaves behind, ignore it
+	while (fread(entry, 1, sizeof(entry), file) == sizeof(entry)) {
+		KeyframeEntry e;
+		e.offset = GetLE(entry, 8);
+		e.timestamp = static_cast<int64_t>(GetLE(entry + 8, 8));
+		e.frame_number = GetLE(entry + 16, 8);
+		entries_.push_back(e);
+	}
+	fclose(file);
+	return true;
+}
+
+bool KeyframeIndex::Scan(const std::string& stream_path, VideoEncodeType codec) {
+	entries_.clear();
+	codec_ = codec;
+	FILE* file = fopen(stream_path.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+	// an access unit starts at its first non-slice NAL (AUD, parameter sets, SEI) or at the first slice of the picture
+	bool after_slice = true;
+	uint64_t unit_start = 0;
+	uint64_t frames = 0;
+	annexb::NalScanner scanner(codec, [&](uint64_t offset, int type, bool first_slice) {
+		if (!annexb::IsSlice(codec, type)) {
+			if (after_slice) {
+				unit_start = offset;
+				after_slice = false;
+			}
+			return;
+		}
+		if (first_slice) {
+			if (after_slice) {
+				unit_start = offset;
+			}
+			if (annexb::IsKeyframe(codec, type)) {
+				KeyframeEntry entry = { unit_start, static_cast<int64_t>(frames), frames };
+				entries_.push_back(entry);
+			}
+			++frames;
+		}
+		after_slice = true;
+	});
+	std::vector<uint8_t> buffer(1 << 20);
+	size_t n;
+	while ((n = fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+		scanner.Feed(buffer.data(), n);
+	}
+	fclose(file);
+	return true;
+}
+
+size_t KeyframeIndex::Find(int64_t timestamp) const {
+	auto it = std::upper_bound(entries_.begin(), entries_.end(), timestamp, [](int64_t t, const KeyframeEntry& entry) {
+		return t < entry.timestamp;
+	});
+	return it == entries_.begin() ? 0 : static_cast<size_t>(it - entries_.begin() - 1);
+}
+
+int64_t ExtractClip(const std::string& stream_path, const KeyframeIndex& index, int64_t begin_timestamp, int64_t end_timestamp,
+	const std::string& clip_path) {
+	const auto& entries = index.Entries();
+	const int64_t stream_size = file_util::FileSize(stream_path);
+	if (entries.empty() || stream_size < 0) {
+		return -1;
+	}
+	const uint64_t begin = entries[index.Find(begin_timestamp)].offset;
+	auto next = std::upper_bound(entries.begin(), entries.end(), end_timestamp, [](int64_t t, const KeyframeEntry& entry) {
+		return t < entry.timestamp;
+	});
+	const uint64_t end = next == entries.end() ? static_cast<uint64_t>(stream_size) : next->offset;
+	if (end <= begin) {
+		return -1;
+	}
+
+	FILE* in = fopen(stream_path.c_str(), "rb");
+	FILE* out = fopen(clip_path.c_str(), "wb");
+	bool ok = in && out && Seek(in, begin);
+	std::vector<char> buffer(1 << 20);
+	for (uint64_t copied = 0; ok && copied < end - begin; ) {
+		const size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), end - begin - copied));
+		const size_t n = fread(buffer.data(), 1, want, in);
+		ok = n == want && fwrite(buffer.data(), 1, n, out) == n;
+		copied += n;
+	}
+	if (in) {
+		fclose(in);
+	}
+	if (out) {
+		ok = fclose(out) == 0 && ok;
+	}
+	return ok ? static_cast<int64_t>(end - begin) : -1;
+}
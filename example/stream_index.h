@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <camera/ins_types.h>
+
+/**
+ * \brief One random access point of a raw .h264/.h265 recording: the frame starts at offset with its parameter sets.
+ */
+struct KeyframeEntry {
+	uint64_t offset;
+	int64_t timestamp;     // as passed to StreamDelegate::OnVideoData
+	uint64_t frame_number; // frames before this one in the stream
+};
+
+/**
+ * \class KeyframeIndexWriter
+ * \brief Builds the sidecar index "<stream>.idx" while the stream is being written. The file is a 16 byte header
+ *        ("NALIDX01", codec, 0) and one 24 byte little-endian KeyframeEntry per keyframe; entries are appended as they
+ *        are found, so the index of a recording that was cut off is still usable.
+ */
+class KeyframeIndexWriter {
+public:
+	KeyframeIndexWriter(const std::string& index_path, ins_camera::VideoEncodeType codec);
+	~KeyframeIndexWriter();
+
+	/**
+	 * \brief feed every frame in stream order with the offset it was written at
+	 * \return true if the frame is a keyframe
+	 */
+	bool AddFrame(const uint8_t* data, size_t size, int64_t timestamp, uint64_t offset);
+
+	uint64_t Keyframes() const {
+		return keyframes_;
+	}
+
+private:
+	FILE* file_;
+	ins_camera::VideoEncodeType codec_;
+	uint64_t frames_;
+	uint64_t keyframes_;
+};
+
+/**
+ * \class KeyframeIndex
+ * \brief Reads a sidecar index, lookups are a binary search over the keyframes.
+ */
+class KeyframeIndex {
+public:
+	bool Load(const std::string& index_path);
+
+	/**
+	 * \brief rebuild the index of a recording that has none by scanning the whole stream,
+	 *        timestamps are unknown and set to the frame number
+	 */
+	bool Scan(const std::string& stream_path, ins_camera::VideoEncodeType codec);
+
+	/**
+	 * \return position of the last keyframe at or before timestamp, the first keyframe if there is none before
+	 */
+	size_t Find(int64_t timestamp) const;
+
+	const std::vector<KeyframeEntry>& Entries() const {
+		return entries_;
+	}
+
+	ins_camera::VideoEncodeType Codec() const {
+		return codec_;
+	}
+
+private:
+	std::vector<KeyframeEntry> entries_;
+	ins_camera::VideoEncodeType codec_ = ins_camera::VideoEncodeType::H264;
+};
+
+/**
+ * \brief copy the frames from the keyframe at or before begin_timestamp up to the first keyframe after end_timestamp
+ *        into a new stream that starts with a keyframe. Reads only the index and the clip itself.
+ * \return bytes written, -1 on error
+ */
+int64_t ExtractClip(const std::string& stream_path, const KeyframeIndex& index, int64_t begin_timestamp, int64_t end_timestamp,
+	const std::string& clip_path);
@@ -0,0 +1,53 @@
+#include "stream_recorder.h"
+
+#include "stream_writer.h"
+
+StreamRecorder::StreamRecorder(const std::vector<std::string>& stream_paths, ins_camera::VideoEncodeType codec,
+	uint32_t width, uint32_t height) : writer_(nullptr), observer_(0) {
+	for (const auto& path : stream_paths) {
+		Lens lens;
+		lens.index.reset(new KeyframeIndexWriter(IndexPath(path), codec));
+		lens.mp4.reset(new FragmentedMp4Writer(Mp4Path(path), codec, width, height));
+		lenses_.push_back(std::move(lens));
+	}
+}
+
+StreamRecorder::~StreamRecorder() {
+	Close();
+}
+
+void StreamRecorder::Attach(RingStreamWriter& writer) {
+	writer_ = &writer;
+	observer_ = writer.AddFrameObserver([this](size_t channel, const FrameRing::Frame& frame, const char* payload, uint64_t offset) {
+		OnFrame(channel, reinterpret_cast<const uint8_t*>(payload), frame.size, frame.timestamp, offset);
+	});
+}
+
+void StreamRecorder::OnFrame(size_t channel, const uint8_t* data, size_t size, int64_t timestamp, uint64_t offset) {
+	if (channel < lenses_.size()) {
+		lenses_[channel].index->AddFrame(data, size, timestamp, offset);
+		lenses_[channel].mp4->AddFrame(data, size, timestamp);
+	}
+}
+
+void StreamRecorder::Close() {
+	if (writer_) {
+		// returns only once the writer thread is out of OnFrame
+		writer_->RemoveFrameObserver(observer_);
+		writer_ = nullptr;
+	}
+	for (auto& lens : lenses_) {
+		lens.mp4->Close();
+	}
+}
+
+std::string StreamRecorder::IndexPath(const std::string& stream_path) {
+	return stream_path + ".idx";
+}
+
+std::string StreamRecorder::Mp4Path(const std::string& stream_path) {
+	const size_t dot = stream_path.find_last_of('.');
+	const size_t slash = stream_path.find_last_of("/\\");
+	const bool has_extension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+	return (has_extension ? stream_path.substr(0, dot) : stream_path) + ".mp4";
+}
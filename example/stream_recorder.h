@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <camera/ins_types.h>
+#include "fmp4_writer.h"
+#include "stream_index.h"
+
+class RingStreamWriter;
+
+/**
+ * \class StreamRecorder
+ * \brief Makes the raw lens streams of a live recording seekable while they are written: for every stream it keeps
+ *        the keyframe index "<stream>.idx" up to date and remuxes the frames into "<stream without extension>.mp4".
+ *        Runs on RingStreamWriter's writer thread, never on the camera's callback thread.
+ */
+class StreamRecorder {
+public:
+	StreamRecorder(const std::vector<std::string>& stream_paths, ins_camera::VideoEncodeType codec, uint32_t width, uint32_t height);
+	~StreamRecorder();
+
+	/**
+	 * \brief receive the frames of writer, channel i is stream_paths[i]. The writer has to outlive the recorder.
+	 */
+	void Attach(RingStreamWriter& writer);
+
+	void OnFrame(size_t channel, const uint8_t* data, size_t size, int64_t timestamp, uint64_t offset);
+
+	/**
+	 * \brief detach from the writer and finish the mp4 files. Stop the writer first to record what it still has queued.
+	 */
+	void Close();
+
+	static std::string IndexPath(const std::string& stream_path);
+	static std::string Mp4Path(const std::string& stream_path);
+
+private:
+	struct Lens {
+		std::unique_ptr<KeyframeIndexWriter> index;
+		std::unique_ptr<FragmentedMp4Writer> mp4;
+	};
+
+	std::vector<Lens> lenses_;
+	RingStreamWriter* writer_;
+	size_t observer_;
+};
@@ -0,0 +1,241 @@
+#include "stream_writer.h"
+
+#include <algorithm>
+#include <chrono>
+
+struct RingStreamWriter::Channel {
+	Channel(const std::string& name, size_t ring_bytes)
+		: name(name), ring(ring_bytes), frames(0), bytes(0), dropped_frames(0), dropped_bytes(0),
+		written_bytes(0), writes(0), ring_peak(0), blocked_ns(0) {}
+
+	std::string name;
+	FrameRing ring;
+	// producer side
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> dropped_frames;
+	std::atomic<uint64_t> dropped_bytes;
+	// writer side
+	std::atomic<uint64_t> written_bytes;
+	std::atomic<uint64_t> writes;
+	std::atomic<size_t> ring_peak;
+	std::atomic<int64_t> blocked_ns;
+	std::chrono::steady_clock::time_point last_write;
+};
+
+RingStreamWriter::RingStreamWriter(const std::vector<std::string>& video_paths, const std::string& audio_path,
+	const StreamWriterOptions& options)
+	: options_(options), next_observer_(0), next_tap_(0), video_streams_(video_paths.size()), audio_(!audio_path.empty()), stopping_(false) {
+	for (const auto& path : video_paths) {
+		files_.push_back(fopen(path.c_str(), "wb"));
+	}
+	if (audio_) {
+		files_.push_back(fopen(audio_path.c_str(), "wb"));
+	}
+	write_ = [this](size_t channel, const char* data, size_t size) {
+		return files_[channel] && fwrite(data, 1, size, files_[channel]) == size;
+	};
+	Init(files_.size());
+}
+
+RingStreamWriter::RingStreamWriter(size_t video_streams, bool audio, WriteFunction write, const StreamWriterOptions& options)
+	: options_(options), write_(write), next_observer_(0), next_tap_(0), video_streams_(video_streams), audio_(audio), stopping_(false) {
+	Init(video_streams + (audio ? 1 : 0));
+}
+
+RingStreamWriter::~RingStreamWriter() {
+	Stop();
+}
+
+void RingStreamWriter::Init(size_t channels) {
+	for (size_t i = 0; i < channels; ++i) {
+		const std::string name = i < video_streams_ ? "video " + std::to_string(i) : "audio";
+		channels_.emplace_back(new Channel(name, options_.ring_bytes));
+		channels_.back()->last_write = std::chrono::steady_clock::now();
+	}
+	thread_ = std::thread(&RingStreamWriter::Run, this);
+}
+
+void RingStreamWriter::OnAudioData(const uint8_t* data, size_t size, int64_t timestamp) {
+	if (audio_) {
+		Push(*channels_[video_streams_], data, size, timestamp, 0);
+	}
+}
+
+void RingStreamWriter::OnVideoData(const uint8_t* data, size_t size, int64_t timestamp, uint8_t streamType, int stream_index) {
+	if (stream_index >= 0 && static_cast<size_t>(stream_index) < video_streams_) {
+		{
+			// ahead of Push, which may wait for the disk
+			std::lock_guard<std::mutex> lock(tap_mutex_);
+			for (const auto& tap : taps_) {
+				tap.second(static_cast<size_t>(stream_index), data, size, timestamp);
+			}
+		}
+		Push(*channels_[stream_index], data, size, timestamp, streamType);
+	}
+}
+
+void RingStreamWriter::OnGyroData(const std::vector<ins_camera::GyroData>& data) {
+	std::lock_guard<std::mutex> lock(telemetry_mutex_);
+	if (telemetry_ && !stopping_.load(std::memory_order_relaxed)) {
+		telemetry_->AddGyro(data);
+	}
+}
+
+void RingStreamWriter::OnExposureData(const ins_camera::ExposureData& data) {
+	std::lock_guard<std::mutex> lock(telemetry_mutex_);
+	if (telemetry_ && !stopping_.load(std::memory_order_relaxed)) {
+		telemetry_->AddExposure(data);
+	}
+}
+
+void RingStreamWriter::SetTelemetryWriter(std::shared_ptr<TelemetryWriter> telemetry) {
+	std::lock_guard<std::mutex> lock(telemetry_mutex_);
+	telemetry_ = telemetry;
+}
+
+size_t RingStreamWriter::AddFrameObserver(FrameObserver observer) {
+	std::lock_guard<std::mutex> lock(observer_mutex_);
+	observers_.emplace_back(++next_observer_, observer);
+	return next_observer_;
+}
+
+void RingStreamWriter::RemoveFrameObserver(size_t id) {
+	std::lock_guard<std::mutex> lock(observer_mutex_);
+	observers_.erase(std::remove_if(observers_.begin(), observers_.end(), [id](const std::pair<size_t, FrameObserver>& observer) {
+		return observer.first == id;
+	}), observers_.end());
+}
+
+size_t RingStreamWriter::AddLiveTap(LiveTap tap) {
+	std::lock_guard<std::mutex> lock(tap_mutex_);
+	taps_.emplace_back(++next_tap_, tap);
+	return next_tap_;
+}
+
+void RingStreamWriter::RemoveLiveTap(size_t id) {
+	std::lock_guard<std::mutex> lock(tap_mutex_);
+	taps_.erase(std::remove_if(taps_.begin(), taps_.end(), [id](const std::pair<size_t, LiveTap>& tap) {
+		return tap.first == id;
+	}), taps_.end());
+}
+
+void RingStreamWriter::Push(Channel& channel, const uint8_t* data, size_t size, int64_t timestamp, uint8_t stream_type) {
+	channel.frames.fetch_add(1, std::memory_order_relaxed);
+	channel.bytes.fetch_add(size, std::memory_order_relaxed);
+	std::chrono::steady_clock::time_point blocked_since;
+	for (int attempt = 0; !channel.ring.TryPush(data, size, timestamp, stream_type); ++attempt) {
+		uint32_t dropped = 0;
+		if (options_.overflow == OverflowPolicy::DropOldest && channel.ring.DropOldest(dropped)) {
+			channel.dropped_frames.fetch_add(1, std::memory_order_relaxed);
+			channel.dropped_bytes.fetch_add(dropped, std::memory_order_relaxed);
+			continue;
+		}
+		if (options_.overflow != OverflowPolicy::Block || size > channel.ring.MaxFrameSize() || stopping_) {
+			channel.dropped_frames.fetch_add(1, std::memory_order_relaxed);
+			channel.dropped_bytes.fetch_add(size, std::memory_order_relaxed);
+			break;
+		}
+		if (attempt == 0) {
+			blocked_since = std::chrono::steady_clock::now();
+		}
+		if (attempt < 64) {
+			std::this_thread::yield();
+		}
+		else {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+	if (blocked_since != std::chrono::steady_clock::time_point()) {
+		channel.blocked_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - blocked_since).count(), std::memory_order_relaxed);
+	}
+}
+
+void RingStreamWriter::Run() {
+	std::vector<char> batch;
+	std::vector<FrameRing::Frame> frames;
+	size_t reserve = 0;
+	for (const auto& channel : channels_) {
+		reserve = std::max(reserve, channel->ring.MaxFrameSize());
+	}
+	batch.reserve(options_.batch_bytes + reserve);
+	// a ring smaller than a batch could never fill one
+	const size_t batch_threshold = std::min(options_.batch_bytes, reserve);
+
+	while (true) {
+		// read the flag before draining, so the last pass sees everything pushed before Stop()
+		const bool stopping = stopping_;
+		bool wrote = false;
+		for (size_t i = 0; i < channels_.size(); ++i) {
+			Channel& channel = *channels_[i];
+			const size_t used = channel.ring.Used();
+			if (used > channel.ring_peak.load(std::memory_order_relaxed)) {
+				channel.ring_peak.store(used, std::memory_order_relaxed);
+			}
+			// hold small amounts back until they are worth a write
+			const auto now = std::chrono::steady_clock::now();
+			if (!stopping && used < batch_threshold
+				&& now - channel.last_write < std::chrono::milliseconds(options_.flush_interval_ms)) {
+				continue;
+			}
+			channel.last_write = now;
+			while (channel.ring.PopBatch(batch, frames, options_.batch_bytes)) {
+				const uint64_t offset = channel.written_bytes.load(std::memory_order_relaxed);
+				write_(i, batch.data(), batch.size());
+				{
+					std::lock_guard<std::mutex> lock(observer_mutex_);
+					for (const auto& observer : observers_) {
+						for (const auto& frame : frames) {
+							observer.second(i, frame, batch.data() + frame.offset, offset + frame.offset);
+						}
+					}
+				}
+				channel.written_bytes.fetch_add(batch.size(), std::memory_order_relaxed);
+				channel.writes.fetch_add(1, std::memory_order_relaxed);
+				wrote = true;
+				if (!stopping && batch.size() < options_.batch_bytes) {
+					break;
+				}
+			}
+		}
+		if (stopping) {
+			break;
+		}
+		if (!wrote) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+void RingStreamWriter::Stop() {
+	if (stopping_.exchange(true)) {
+		return;
+	}
+	thread_.join();
+	for (auto& file : files_) {
+		if (file) {
+			fclose(file);
+			file = nullptr;
+		}
+	}
+}
+
+std::vector<StreamChannelStats> RingStreamWriter::Stats() const {
+	std::vector<StreamChannelStats> stats;
+	for (const auto& channel : channels_) {
+		StreamChannelStats s;
+		s.name = channel->name;
+		s.frames = channel->frames;
+		s.bytes = channel->bytes;
+		s.dropped_frames = channel->dropped_frames;
+		s.dropped_bytes = channel->dropped_bytes;
+		s.written_bytes = channel->written_bytes;
+		s.writes = channel->writes;
+		s.ring_capacity = channel->ring.Capacity();
+		s.ring_peak = channel->ring_peak;
+		s.blocked_seconds = channel->blocked_ns / 1e9;
+		stats.push_back(s);
+	}
+	return stats;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <camera/camera.h>
+#include "frame_ring.h"
+#include "telemetry_log.h"
+
+/**
+ * \brief What the stream callback does when a ring is full.
+ *        Block waits for the writer, DropOldest discards queued frames to make room, DropNewest discards the new frame.
+ */
+enum class OverflowPolicy {
+	Block,
+	DropOldest,
+	DropNewest,
+};
+
+struct StreamWriterOptions {
+	size_t ring_bytes = 16 << 20;  // per stream, how much of a disk stall is absorbed
+	size_t batch_bytes = 1 << 20;  // largest single write
+	int flush_interval_ms = 50;    // a stream with less than batch_bytes queued is written at least this often
+	OverflowPolicy overflow = OverflowPolicy::Block;
+};
+
+struct StreamChannelStats {
+	std::string name;
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t dropped_frames;
+	uint64_t dropped_bytes;
+	uint64_t written_bytes;
+	uint64_t writes;
+	size_t ring_capacity;
+	size_t ring_peak;       // most bytes queued at once, sampled by the writer
+	double blocked_seconds; // time the stream callback waited for room (Block only)
+};
+
+/**
+ * \class RingStreamWriter
+ * \brief StreamDelegate that keeps disk i/o off the SDK's stream callback thread. Every video stream_index,
+ *        and optionally the audio, has its own preallocated FrameRing; the callback only copies the payload in,
+ *        and one writer thread empties the rings with large coalesced writes.
+ */
+class RingStreamWriter : public ins_camera::StreamDelegate {
+public:
+	/**
+	 * \brief called on the writer thread with a batch of whole frames of one channel,
+	 *        channels are the video stream indices followed by audio
+	 */
+	typedef std::function<bool(size_t channel, const char* data, size_t size)> WriteFunction;
+
+	/**
+	 * \brief called on the writer thread for every frame once it has been written, with the payload and
+	 *        the offset of the frame in its channel's output
+	 */
+	typedef std::function<void(size_t channel, const FrameRing::Frame& frame, const char* payload, uint64_t offset)> FrameObserver;
+
+	/**
+	 * \brief called on the stream callback thread with every video frame before it is queued for the disk, so
+	 *        live consumers do not wait for the writer. It must only copy the frame and return
+	 */
+	typedef std::function<void(size_t lens, const uint8_t* data, size_t size, int64_t timestamp)> LiveTap;
+
+	/**
+	 * \brief write video stream i to video_paths[i], audio to audio_path unless it is empty
+	 */
+	RingStreamWriter(const std::vector<std::string>& video_paths, const std::string& audio_path = std::string(),
+		const StreamWriterOptions& options = StreamWriterOptions());
+	RingStreamWriter(size_t video_streams, bool audio, WriteFunction write, const StreamWriterOptions& options = StreamWriterOptions());
+	~RingStreamWriter();
+
+	void OnAudioData(const uint8_t* data, size_t size, int64_t timestamp) override;
+	void OnVideoData(const uint8_t* data, size_t size, int64_t timestamp, uint8_t streamType, int stream_index = 0) override;
+	void OnGyroData(const std::vector<ins_camera::GyroData>& data) override;
+	void OnExposureData(const ins_camera::ExposureData& data) override;
+
+	/**
+	 * \return id for RemoveFrameObserver
+	 */
+	size_t AddFrameObserver(FrameObserver observer);
+
+	/**
+	 * \brief returns once the writer thread is no longer inside the observer
+	 */
+	void RemoveFrameObserver(size_t id);
+
+	/**
+	 * \return id for RemoveLiveTap
+	 */
+	size_t AddLiveTap(LiveTap tap);
+
+	/**
+	 * \brief returns once the stream callback is no longer inside the tap
+	 */
+	void RemoveLiveTap(size_t id);
+
+	/**
+	 * \brief log gyro and exposure data to telemetry, nullptr to stop
+	 */
+	void SetTelemetryWriter(std::shared_ptr<TelemetryWriter> telemetry);
+
+	/**
+	 * \brief write out what is queued and close the files, later stream data is dropped
+	 */
+	void Stop();
+
+	std::vector<StreamChannelStats> Stats() const;
+
+private:
+	struct Channel;
+
+	void Init(size_t channels);
+	void Push(Channel& channel, const uint8_t* data, size_t size, int64_t timestamp, uint8_t stream_type);
+	void Run();
+
+	StreamWriterOptions options_;
+	WriteFunction write_;
+	std::mutex observer_mutex_;
+	std::vector<std::pair<size_t, FrameObserver>> observers_;
+	size_t next_observer_;
+	std::mutex tap_mutex_;
+	std::vector<std::pair<size_t, LiveTap>> taps_;
+	size_t next_tap_;
+	std::mutex telemetry_mutex_;
+	std::shared_ptr<TelemetryWriter> telemetry_;
+	std::vector<std::unique_ptr<Channel>> channels_;
+	std::vector<FILE*> files_;
+	size_t video_streams_;
+	bool audio_;
+	std::atomic<bool> stopping_;
+	std::thread thread_;
+};
@@ -0,0 +1,386 @@
+#include "telemetry_log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#ifdef TELEMETRY_ENABLE_DEFLATE
+#include <zlib.h>
+#endif
+
+namespace {
+	const char kMagic[8] = { 'T', 'L', 'M', 'L', 'O', 'G', '0', '1' };
+	const char kBlockMagic[4] = { 'T', 'B', 'L', 'K' };
+	const size_t kHeaderSize = 16;
+	// magic, stream, compression, axes, reserved, count, first/last timestamp, raw/stored size, reserved
+	const size_t kBlockHeaderSize = 40;
+	const size_t kGyroAxes = 6;
+	// exposure timestamps are doubles, they are stored to 1/1000 of their unit
+	const double kExposureScale = 1000.0;
+
+	void PutLE(uint8_t* out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out[i] = static_cast<uint8_t>(value >> (8 * i));
+		}
+	}
+
+	uint64_t GetLE(const uint8_t* in, size_t bytes) {
+		uint64_t value = 0;
+		for (size_t i = 0; i < bytes; ++i) {
+			value |= static_cast<uint64_t>(in[i]) << (8 * i);
+		}
+		return value;
+	}
+
+	void PutVarint(std::string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out += static_cast<char>((value & 0x7f) | 0x80);
+			value >>= 7;
+		}
+		out += static_cast<char>(value);
+	}
+
+	bool GetVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+		value = 0;
+		for (int shift = 0; in < end && shift < 64; shift += 7) {
+			const uint8_t byte = *in++;
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint64_t ZigZag(int64_t value) {
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	int64_t UnZigZag(uint64_t value) {
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	size_t Axes(TelemetryStream stream) {
+		return stream == TelemetryStream::Gyro ? kGyroAxes : 1;
+	}
+}
+
+TelemetryWriter::TelemetryWriter(const std::string& path, const TelemetryLogOptions& options)
+	: options_(options), file_(fopen(path.c_str(), "wb")), closing_(false), ok_(file_ != nullptr), stats_() {
+	options_.block_samples = std::max<size_t>(options_.block_samples, 1);
+#ifndef TELEMETRY_ENABLE_DEFLATE
+	options_.compression = TelemetryCompression::None;
+#endif
+	gyro_ = NewBlock(TelemetryStream::Gyro);
+	exposure_ = NewBlock(TelemetryStream::Exposure);
+	if (file_) {
+		uint8_t header[kHeaderSize] = {};
+		memcpy(header, kMagic, sizeof(kMagic));
+		ok_ = fwrite(header, 1, sizeof(header), file_) == sizeof(header);
+		stats_.file_bytes = sizeof(header);
+	}
+	thread_ = std::thread(&TelemetryWriter::Run, this);
+}
+
+TelemetryWriter::~TelemetryWriter() {
+	Close();
+}
+
+TelemetryWriter::Block TelemetryWriter::NewBlock(TelemetryStream stream) {
+	Block block;
+	// written blocks keep their capacity, so the stream thread does not allocate in the steady state
+	auto& spare = stream == TelemetryStream::Gyro ? spare_gyro_ : spare_exposure_;
+	if (!spare.empty()) {
+		block = std::move(spare.back());
+		spare.pop_back();
+		return block;
+	}
+	block.stream = stream;
+	block.timestamps.reserve(options_.block_samples);
+	block.columns.resize(Axes(stream));
+	for (auto& column : block.columns) {
+		column.reserve(options_.block_samples);
+	}
+	return block;
+}
+
+void TelemetryWriter::Queue(Block& block) {
+	full_.push_back(std::move(block));
+	block = NewBlock(full_.back().stream);
+	cv_.notify_one();
+}
+
+void TelemetryWriter::AddGyro(const std::vector<ins_camera::GyroData>& data) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (closing_) {
+		return;
+	}
+	for (const auto& gyro : data) {
+		gyro_.timestamps.push_back(gyro.timestamp);
+		gyro_.columns[0].push_back(static_cast<float>(gyro.ax));
+		gyro_.columns[1].push_back(static_cast<float>(gyro.ay));
+		gyro_.columns[2].push_back(static_cast<float>(gyro.az));
+		gyro_.columns[3].push_back(static_cast<float>(gyro.gx));
+		gyro_.columns[4].push_back(static_cast<float>(gyro.gy));
+		gyro_.columns[5].push_back(static_cast<float>(gyro.gz));
+		if (gyro_.timestamps.size() >= options_.block_samples) {
+			Queue(gyro_);
+		}
+	}
+	stats_.gyro_samples += data.size();
+}
+
+void TelemetryWriter::AddExposure(const ins_camera::ExposureData& data) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (closing_) {
+		return;
+	}
+	exposure_.timestamps.push_back(static_cast<int64_t>(std::llround(data.timestamp * kExposureScale)));
+	exposure_.columns[0].push_back(static_cast<float>(data.exposure_time));
+	if (exposure_.timestamps.size() >= options_.block_samples) {
+		Queue(exposure_);
+	}
+	++stats_.exposure_samples;
+}
+
+bool TelemetryWriter::Close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!closing_) {
+			closing_ = true;
+			cv_.notify_one();
+		}
+	}
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+	if (file_) {
+		ok_ = fclose(file_) == 0 && ok_;
+		file_ = nullptr;
+	}
+	return ok_;
+}
+
+TelemetryLogStats TelemetryWriter::Stats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+void TelemetryWriter::Run() {
+	const auto interval = std::chrono::milliseconds(options_.flush_interval_ms);
+	auto last_flush = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		cv_.wait_for(lock, interval, [this] { return !full_.empty() || closing_; });
+		// full blocks of one stream do not hold back the partial block of the other, exposure is much slower than gyro
+		if (closing_ || std::chrono::steady_clock::now() - last_flush >= interval) {
+			if (!gyro_.timestamps.empty()) {
+				Queue(gyro_);
+			}
+			if (!exposure_.timestamps.empty()) {
+				Queue(exposure_);
+			}
+			last_flush = std::chrono::steady_clock::now();
+		}
+		if (full_.empty() && closing_) {
+			return;
+		}
+		while (!full_.empty()) {
+			Block block = std::move(full_.front());
+			full_.pop_front();
+			lock.unlock();
+			const bool ok = WriteBlock(block);
+			block.timestamps.clear();
+			for (auto& column : block.columns) {
+				column.clear();
+			}
+			lock.lock();
+			ok_ = ok && ok_;
+			(block.stream == TelemetryStream::Gyro ? spare_gyro_ : spare_exposure_).push_back(std::move(block));
+		}
+	}
+}
+
+bool TelemetryWriter::WriteBlock(const Block& block) {
+	const size_t count = block.timestamps.size();
+	const size_t axes = block.columns.size();
+	std::string raw;
+	raw.reserve(count * (2 + 4 * axes));
+	for (size_t i = 1; i < count; ++i) {
+		PutVarint(raw, ZigZag(block.timestamps[i] - block.timestamps[i - 1]));
+	}
+	// each column as four byte planes, lowest byte first: sign, exponent and high mantissa bytes of a sensor
+	// column barely change, which is what makes the block compressible
+	for (const auto& column : block.columns) {
+		const size_t plane = raw.size();
+		raw.resize(plane + 4 * count);
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t bits;
+			memcpy(&bits, &column[i], sizeof(bits));
+			for (size_t b = 0; b < 4; ++b) {
+				raw[plane + b * count + i] = static_cast<char>(bits >> (8 * b));
+			}
+		}
+	}
+
+	TelemetryCompression compression = TelemetryCompression::None;
+	const std::string* payload = &raw;
+#ifdef TELEMETRY_ENABLE_DEFLATE
+	std::string deflated;
+	if (options_.compression == TelemetryCompression::Deflate) {
+		uLongf size = compressBound(static_cast<uLong>(raw.size()));
+		deflated.resize(size);
+		if (compress2(reinterpret_cast<Bytef*>(&deflated[0]), &size, reinterpret_cast<const Bytef*>(raw.data()),
+			static_cast<uLong>(raw.size()), Z_DEFAULT_COMPRESSION) == Z_OK && size < raw.size()) {
+			deflated.resize(size);
+			payload = &deflated;
+			compression = TelemetryCompression::Deflate;
+		}
+	}
+#endif
+
+	uint8_t header[kBlockHeaderSize] = {};
+	memcpy(header, kBlockMagic, sizeof(kBlockMagic));
+	header[4] = static_cast<uint8_t>(block.stream);
+	header[5] = static_cast<uint8_t>(compression);
+	header[6] = static_cast<uint8_t>(axes);
+	PutLE(header + 8, count, 4);
+	PutLE(header + 12, static_cast<uint64_t>(block.timestamps.front()), 8);
+	PutLE(header + 20, static_cast<uint64_t>(block.timestamps.back()), 8);
+	PutLE(header + 28, raw.size(), 4);
+	PutLE(header + 32, payload->size(), 4);
+	const bool ok = file_ && fwrite(header, 1, sizeof(header), file_) == sizeof(header)
+		&& fwrite(payload->data(), 1, payload->size(), file_) == payload->size() && fflush(file_) == 0;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++stats_.blocks;
+	stats_.raw_bytes += raw.size();
+	stats_.file_bytes += sizeof(header) + payload->size();
+	return ok;
+}
+
+bool TelemetryReader::Open(const std::string& path) {
+	gyro_.clear();
+	exposure_.clear();
+	if (!file_.Open(path) || file_.Size() < kHeaderSize || memcmp(file_.Data(), kMagic, sizeof(kMagic)) != 0) {
+		file_.Close();
+		return false;
+	}
+	const uint8_t* data = file_.Data();
+	size_t offset = kHeaderSize;
+	// stop at the first incomplete block, that is where a log that was cut off ends
+	while (offset + kBlockHeaderSize <= file_.Size() && memcmp(data + offset, kBlockMagic, sizeof(kBlockMagic)) == 0) {
+		const uint8_t* header = data + offset;
+		BlockInfo block;
+		block.stream = static_cast<TelemetryStream>(header[4]);
+		block.compression = header[5];
+		block.count = static_cast<uint32_t>(GetLE(header + 8, 4));
+		block.first_timestamp = static_cast<int64_t>(GetLE(header + 12, 8));
+		block.last_timestamp = static_cast<int64_t>(GetLE(header + 20, 8));
+		block.raw_size = static_cast<uint32_t>(GetLE(header + 28, 4));
+		block.stored_size = static_cast<uint32_t>(GetLE(header + 32, 4));
+		block.offset = offset + kBlockHeaderSize;
+		if (block.offset + block.stored_size > file_.Size() || header[6] != Axes(block.stream)) {
+			break;
+		}
+		if (block.stream == TelemetryStream::Gyro) {
+			gyro_.push_back(block);
+		}
+		else if (block.stream == TelemetryStream::Exposure) {
+			exposure_.push_back(block);
+		}
+		offset = block.offset + block.stored_size;
+	}
+	return true;
+}
+
+bool TelemetryReader::Decode(const BlockInfo& block, std::vector<int64_t>& timestamps, std::vector<float>& values) const {
+	const uint8_t* in = file_.Data() + block.offset;
+	std::vector<uint8_t> inflated;
+	if (block.compression == static_cast<uint8_t>(TelemetryCompression::Deflate)) {
+#ifdef TELEMETRY_ENABLE_DEFLATE
+		inflated.resize(block.raw_size);
+		uLongf size = block.raw_size;
+		if (uncompress(inflated.data(), &size, in, block.stored_size) != Z_OK || size != block.raw_size) {
+			return false;
+		}
+		in = inflated.data();
+#else
+		return false;
+#endif
+	}
+	else if (block.compression != static_cast<uint8_t>(TelemetryCompression::None)) {
+		return false;
+	}
+	const uint8_t* end = in + block.raw_size;
+
+	const size_t axes = Axes(block.stream);
+	timestamps.resize(block.count);
+	values.resize(block.count * axes);
+	int64_t timestamp = block.first_timestamp;
+	for (size_t i = 0; i < block.count; ++i) {
+		uint64_t delta = 0;
+		if (i > 0 && !GetVarint(in, end, delta)) {
+			return false;
+		}
+		timestamp += UnZigZag(delta);
+		timestamps[i] = timestamp;
+	}
+	if (static_cast<size_t>(end - in) != values.size() * 4) {
+		return false;
+	}
+	for (size_t axis = 0; axis < axes; ++axis, in += 4 * block.count) {
+		for (size_t i = 0; i < block.count; ++i) {
+			const uint32_t bits = in[i] | (in[block.count + i] << 8) | (in[2 * block.count + i] << 16)
+				| (static_cast<uint32_t>(in[3 * block.count + i]) << 24);
+			memcpy(&values[axis * block.count + i], &bits, sizeof(bits));
+		}
+	}
+	return true;
+}
+
+template <typename F>
+size_t TelemetryReader::Query(const std::vector<BlockInfo>& blocks, int64_t begin, int64_t end, F append) const {
+	// blocks are written in time order, skip the ones that end before the range
+	auto it = std::lower_bound(blocks.begin(), blocks.end(), begin, [](const BlockInfo& block, int64_t t) {
+		return block.last_timestamp < t;
+	});
+	std::vector<int64_t> timestamps;
+	std::vector<float> values;
+	size_t appended = 0;
+	for (; it != blocks.end() && it->first_timestamp < end; ++it) {
+		if (!Decode(*it, timestamps, values)) {
+			continue;
+		}
+		const size_t first = std::lower_bound(timestamps.begin(), timestamps.end(), begin) - timestamps.begin();
+		for (size_t i = first; i < timestamps.size() && timestamps[i] < end; ++i, ++appended) {
+			append(timestamps[i], values.data() + i, timestamps.size());
+		}
+	}
+	return appended;
+}
+
+size_t TelemetryReader::Gyro(int64_t begin, int64_t end, std::vector<ins_camera::GyroData>& out) const {
+	return Query(gyro_, begin, end, [&out](int64_t timestamp, const float* value, size_t stride) {
+		ins_camera::GyroData gyro;
+		gyro.timestamp = timestamp;
+		gyro.ax = value[0];
+		gyro.ay = value[stride];
+		gyro.az = value[2 * stride];
+		gyro.gx = value[3 * stride];
+		gyro.gy = value[4 * stride];
+		gyro.gz = value[5 * stride];
+		out.push_back(gyro);
+	});
+}
+
+size_t TelemetryReader::Exposure(double begin, double end, std::vector<ins_camera::ExposureData>& out) const {
+	const int64_t scaled_begin = static_cast<int64_t>(std::ceil(begin * kExposureScale));
+	const int64_t scaled_end = static_cast<int64_t>(std::ceil(end * kExposureScale));
+	return Query(exposure_, scaled_begin, scaled_end, [&out](int64_t timestamp, const float* value, size_t) {
+		ins_camera::ExposureData exposure;
+		exposure.timestamp = timestamp / kExposureScale;
+		exposure.exposure_time = value[0];
+		out.push_back(exposure);
+	});
+}
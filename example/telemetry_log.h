@@ -0,0 +1,139 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <camera/camera.h>
+#include "file_util.h"
+
+/**
+ * Deflate is opt-in: it needs zlib, configure with -DTELEMETRY_DEFLATE=ON, which defines TELEMETRY_ENABLE_DEFLATE
+ * and links it (the same dependency as CROW_ENABLE_COMPRESSION). Without it blocks are stored uncompressed,
+ * Deflate is not the default and compressed blocks cannot be read.
+ */
+enum class TelemetryCompression {
+	None,
+	Deflate,
+};
+
+enum class TelemetryStream : uint8_t {
+	Gyro = 1,     // timestamp, ax ay az gx gy gz
+	Exposure = 2, // timestamp, exposure_time
+};
+
+struct TelemetryLogOptions {
+	size_t block_samples = 8192;  // samples per block, a query decodes whole blocks
+	int flush_interval_ms = 1000; // a partial block is written at least this often
+#ifdef TELEMETRY_ENABLE_DEFLATE
+	TelemetryCompression compression = TelemetryCompression::Deflate;
+#else
+	TelemetryCompression compression = TelemetryCompression::None;
+#endif
+};
+
+struct TelemetryLogStats {
+	uint64_t gyro_samples;
+	uint64_t exposure_samples;
+	uint64_t blocks;
+	uint64_t raw_bytes;    // encoded columns before compression
+	uint64_t file_bytes;
+};
+
+/**
+ * \class TelemetryWriter
+ * \brief Binary log of the gyro and exposure data of a stream. Samples are buffered per stream and written as
+ *        columnar blocks by a background thread: zigzag varint deltas of the timestamps, then each axis as
+ *        float32, optionally deflated. Every block header carries its time range, so a reader can find blocks
+ *        without decoding them, and a log that was cut off is readable up to its last complete block.
+ *        AddGyro/AddExposure only append to memory and are safe to call from the SDK's stream thread.
+ */
+class TelemetryWriter {
+public:
+	explicit TelemetryWriter(const std::string& path, const TelemetryLogOptions& options = TelemetryLogOptions());
+	~TelemetryWriter();
+
+	void AddGyro(const std::vector<ins_camera::GyroData>& data);
+	void AddExposure(const ins_camera::ExposureData& data);
+
+	/**
+	 * \brief write what is buffered and close the file, later samples are dropped
+	 */
+	bool Close();
+
+	TelemetryLogStats Stats() const;
+
+private:
+	struct Block {
+		TelemetryStream stream;
+		std::vector<int64_t> timestamps;
+		std::vector<std::vector<float>> columns;
+	};
+
+	Block NewBlock(TelemetryStream stream);
+	void Queue(Block& block);
+	void Run();
+	bool WriteBlock(const Block& block);
+
+	TelemetryLogOptions options_;
+	FILE* file_;
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	Block gyro_;
+	Block exposure_;
+	std::deque<Block> full_;
+	std::vector<Block> spare_gyro_;
+	std::vector<Block> spare_exposure_;
+	bool closing_;
+	bool ok_;
+	TelemetryLogStats stats_;
+	std::thread thread_;
+};
+
+/**
+ * \class TelemetryReader
+ * \brief Memory maps a telemetry log. Open walks the block headers only, queries binary search them by time and
+ *        decode just the blocks that overlap the range.
+ */
+class TelemetryReader {
+public:
+	struct BlockInfo {
+		TelemetryStream stream;
+		uint8_t compression;
+		uint32_t count;
+		int64_t first_timestamp;
+		int64_t last_timestamp;
+		size_t offset;       // of the payload in the file
+		uint32_t raw_size;
+		uint32_t stored_size;
+	};
+
+	bool Open(const std::string& path);
+
+	/**
+	 * \brief append the gyro samples with begin <= timestamp < end to out
+	 * \return number of samples appended
+	 */
+	size_t Gyro(int64_t begin, int64_t end, std::vector<ins_camera::GyroData>& out) const;
+	size_t Exposure(double begin, double end, std::vector<ins_camera::ExposureData>& out) const;
+
+	const std::vector<BlockInfo>& Blocks(TelemetryStream stream) const {
+		return stream == TelemetryStream::Gyro ? gyro_ : exposure_;
+	}
+
+private:
+	/**
+	 * \brief decode all samples of a block, values holds the columns one after the other
+	 */
+	bool Decode(const BlockInfo& block, std::vector<int64_t>& timestamps, std::vector<float>& values) const;
+	template <typename F>
+	size_t Query(const std::vector<BlockInfo>& blocks, int64_t begin, int64_t end, F append) const;
+
+	file_util::MappedFile file_;
+	std::vector<BlockInfo> gyro_;
+	std::vector<BlockInfo> exposure_;
+};
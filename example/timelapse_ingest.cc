@@ -0,0 +1,233 @@
+#include "timelapse_ingest.h"
+
+#include <algorithm>
+#include <iostream>
+#include "file_util.h"
+
+namespace {
+	/**
+	 * frames are named IMG_<date>_<time>_00_<number>, so the base name orders them by capture time
+	 */
+	bool CapturedBefore(const std::string& a, const std::string& b) {
+		return file_util::Basename(a) < file_util::Basename(b);
+	}
+}
+
+TimelapseIngest::TimelapseIngest(std::shared_ptr<CameraDevice> cam, CameraCommandExecutor& executor, StitchWorkerPool& pool,
+	const TimelapseIngestOptions& options)
+	: cam_(cam), executor_(executor), pool_(pool), options_(options), polling_(false), finishing_(false) {
+}
+
+TimelapseIngest::~TimelapseIngest() {
+	if (poll_thread_.joinable() || download_thread_.joinable()) {
+		Finish(ins_camera::MediaUrl(std::vector<std::string>()));
+	}
+}
+
+void TimelapseIngest::SetFrameCallback(FrameCallback callback) {
+	callback_ = callback;
+}
+
+bool TimelapseIngest::IsFrame(const std::string& remote) const {
+	const size_t dot = remote.find_last_of('.');
+	if (dot == std::string::npos) {
+		return false;
+	}
+	std::string extension = remote.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return std::find(options_.extensions.begin(), options_.extensions.end(), extension) != options_.extensions.end();
+}
+
+std::vector<std::string> TimelapseIngest::ListFiles() {
+	auto cam = cam_;
+	auto files = executor_.Submit([cam]() { return cam->GetCameraFilesList(); });
+	std::vector<std::string> list;
+	try {
+		list = files.get();
+	}
+	catch (const std::future_error&) {
+		// the executor was stopped
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	++stats_.polls;
+	return list;
+}
+
+bool TimelapseIngest::Start() {
+	if (poll_thread_.joinable()) {
+		return false;
+	}
+	// frames are the files that were not there before
+	const auto existing = ListFiles();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		seen_.insert(existing.begin(), existing.end());
+		polling_ = true;
+		finishing_ = false;
+	}
+
+	BulkDownloadOptions download_options;
+	download_options.concurrency = options_.download_concurrency;
+	download_options.local_dir = options_.local_dir;
+	downloader_.reset(new BulkDownloader(cam_->GetHttpBaseUrl(), download_options));
+	file_util::MakeDirectories(options_.output_dir);
+
+	poll_thread_ = std::thread(&TimelapseIngest::Poll, this);
+	download_thread_ = std::thread(&TimelapseIngest::Download, this);
+	return true;
+}
+
+void TimelapseIngest::Add(std::vector<std::string> files, bool final) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<std::string> frames;
+	for (const auto& file : files) {
+		if (IsFrame(file) && seen_.insert(file).second) {
+			frames.push_back(file);
+		}
+	}
+	stats_.discovered += frames.size();
+	stats_.pending += frames.size();
+	if (!held_.empty()) {
+		frames.push_back(held_);
+		held_.clear();
+	}
+	std::sort(frames.begin(), frames.end(), CapturedBefore);
+	// the newest frame may still be being written, it goes once a later one is listed
+	if (!final && !frames.empty()) {
+		held_ = frames.back();
+		frames.pop_back();
+	}
+	to_download_.insert(to_download_.end(), frames.begin(), frames.end());
+	cv_.notify_all();
+}
+
+void TimelapseIngest::Poll() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (polling_) {
+		cv_.wait_for(lock, options_.poll_interval, [this]() { return !polling_; });
+		if (!polling_) {
+			break;
+		}
+		lock.unlock();
+		Add(ListFiles(), false);
+		lock.lock();
+	}
+}
+
+void TimelapseIngest::Download() {
+	while (true) {
+		std::vector<std::string> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this]() { return !to_download_.empty() || finishing_; });
+			if (to_download_.empty()) {
+				return;
+			}
+			batch.assign(to_download_.begin(), to_download_.end());
+			to_download_.clear();
+		}
+
+		std::mutex reported_mutex;
+		std::set<std::string> reported;
+		downloader_->SetFileCallback([this, &reported_mutex, &reported](const std::string& remote, bool ok, uint64_t bytes) {
+			{
+				std::lock_guard<std::mutex> lock(reported_mutex);
+				reported.insert(remote);
+			}
+			if (!ok) {
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					++stats_.download_failed;
+					--stats_.pending;
+				}
+				cv_.notify_all();
+				if (callback_) {
+					callback_(remote, std::string(), false);
+				}
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				++stats_.downloaded;
+				stats_.bytes += bytes;
+			}
+			if (options_.delete_after_download) {
+				auto cam = cam_;
+				executor_.Post([cam, remote]() { cam->DeleteCameraFile(remote); });
+			}
+			Stitch(remote);
+		});
+		downloader_->Run(batch);
+
+		// the manifest already had these, e.g. from an earlier run into the same local_dir
+		for (const auto& remote : batch) {
+			if (reported.count(remote) == 0) {
+				Stitch(remote);
+			}
+		}
+	}
+}
+
+void TimelapseIngest::Stitch(const std::string& remote) {
+	const std::string name = file_util::Basename(remote);
+	const std::string output_path = options_.output_dir + name.substr(0, name.find('.')) + ".jpg";
+	pool_.Submit(options_.params, { downloader_->LocalPath(remote) }, output_path, [this, remote, output_path](bool ok) {
+		Stitched(remote, output_path, ok);
+	});
+}
+
+void TimelapseIngest::Stitched(const std::string& remote, const std::string& output_path, bool ok) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (ok) {
+			++stats_.stitched;
+		}
+		else {
+			++stats_.stitch_failed;
+		}
+		--stats_.pending;
+	}
+	cv_.notify_all();
+	if (callback_) {
+		callback_(remote, output_path, ok);
+	}
+}
+
+TimelapseIngestStats TimelapseIngest::Finish(const ins_camera::MediaUrl& final_urls) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		polling_ = false;
+	}
+	cv_.notify_all();
+	if (poll_thread_.joinable()) {
+		poll_thread_.join();
+	}
+
+	const auto begin = std::chrono::steady_clock::now();
+	if (download_thread_.joinable()) {
+		auto files = ListFiles();
+		for (const auto& url : final_urls.OriginUrls()) {
+			files.push_back(url);
+		}
+		Add(files, true);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stats_.pending_at_finish = stats_.pending;
+		finishing_ = true;
+	}
+	cv_.notify_all();
+	if (download_thread_.joinable()) {
+		download_thread_.join();
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [this]() { return stats_.pending == 0; });
+	stats_.finish_seconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count() / 1e6;
+	return stats_;
+}
+
+TimelapseIngestStats TimelapseIngest::Stats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
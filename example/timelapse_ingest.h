@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bulk_downloader.h"
+#include "camera_device.h"
+#include "camera_executor.h"
+#include "stitch_pool.h"
+
+struct TimelapseIngestOptions {
+	std::string local_dir;                             // frames are downloaded into it, with trailing slash
+	std::string output_dir;                            // stitched frames, <frame name>.jpg, with trailing slash
+	std::chrono::milliseconds poll_interval = std::chrono::milliseconds(1000);
+	size_t download_concurrency = 2;
+	bool delete_after_download = false;                // free the card as the run goes on
+	std::vector<std::string> extensions = { ".insp", ".jpg" };
+	StitchParams params;
+};
+
+struct TimelapseIngestStats {
+	uint64_t discovered = 0;
+	uint64_t downloaded = 0;
+	uint64_t download_failed = 0;
+	uint64_t stitched = 0;
+	uint64_t stitch_failed = 0;
+	uint64_t bytes = 0;
+	uint64_t polls = 0;
+	size_t pending = 0;          // discovered but not stitched yet
+	double finish_seconds = 0;   // from Finish() until the last frame was stitched
+	size_t pending_at_finish = 0;
+};
+
+/**
+ * \class TimelapseIngest
+ * \brief Processes an interval shooting or starlapse run while it is still capturing. It polls
+ *        GetCameraFilesList() on the camera's command executor for frames that were not on the card when
+ *        Start() was called, downloads them over the camera's http server with a BulkDownloader and stitches
+ *        each on the StitchWorkerPool as soon as it is local. The newest frame is held back until a later one
+ *        appears, it may still be being written. After StopTimeLapse only the last few frames are left to do.
+ */
+class TimelapseIngest {
+public:
+	/**
+	 * remote frame, local stitched panorama, whether it got that far
+	 */
+	typedef std::function<void(const std::string& remote, const std::string& output_path, bool ok)> FrameCallback;
+
+	TimelapseIngest(std::shared_ptr<CameraDevice> cam, CameraCommandExecutor& executor, StitchWorkerPool& pool,
+		const TimelapseIngestOptions& options);
+	~TimelapseIngest();
+
+	TimelapseIngest(const TimelapseIngest&) = delete;
+	TimelapseIngest& operator=(const TimelapseIngest&) = delete;
+
+	/**
+	 * \brief called from the stitch workers for every frame that was stitched or given up on
+	 */
+	void SetFrameCallback(FrameCallback callback);
+
+	/**
+	 * \brief note the files already on the card and start polling, call right before StartTimeLapse
+	 * \return false if the file list cannot be read
+	 */
+	bool Start();
+
+	/**
+	 * \brief after StopTimeLapse: one last poll, the frames of final_urls are added too, then block until every
+	 *        frame is stitched
+	 */
+	TimelapseIngestStats Finish(const ins_camera::MediaUrl& final_urls);
+
+	TimelapseIngestStats Stats() const;
+
+private:
+	bool IsFrame(const std::string& remote) const;
+	std::vector<std::string> ListFiles();
+	void Add(std::vector<std::string> files, bool final);
+	void Poll();
+	void Download();
+	void Stitch(const std::string& remote);
+	void Stitched(const std::string& remote, const std::string& output_path, bool ok);
+
+	std::shared_ptr<CameraDevice> cam_;
+	CameraCommandExecutor& executor_;
+	StitchWorkerPool& pool_;
+	TimelapseIngestOptions options_;
+	std::unique_ptr<BulkDownloader> downloader_;
+	FrameCallback callback_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::set<std::string> seen_;
+	std::string held_;                 // newest frame, queued once a later one shows up
+	std::deque<std::string> to_download_;
+	bool polling_;
+	bool finishing_;
+	TimelapseIngestStats stats_;
+	std::thread poll_thread_;
+	std::thread download_thread_;
+};
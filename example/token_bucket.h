@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/**
+ * \class TokenBucket
+ * \brief Byte rate limit shared by any number of threads. Acquire() takes the bytes right away and, once the
+ *        bucket is in debt, sleeps until the rate has paid it back, so chunks larger than the burst still work and
+ *        concurrent transfers together stay at the rate. The rate can be changed while transfers run.
+ */
+class TokenBucket {
+public:
+	/**
+	 * \param bytes_per_second 0: no limit
+	 * \param burst_bytes what may go through at once after an idle period
+	 */
+	explicit TokenBucket(uint64_t bytes_per_second = 0, uint64_t burst_bytes = 256 << 10)
+		: rate_(static_cast<double>(bytes_per_second)), burst_(static_cast<double>(burst_bytes)), tokens_(burst_),
+		last_(std::chrono::steady_clock::now()) {
+	}
+
+	TokenBucket(const TokenBucket&) = delete;
+	TokenBucket& operator=(const TokenBucket&) = delete;
+
+	void SetRate(uint64_t bytes_per_second) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		Refill();
+		rate_ = static_cast<double>(bytes_per_second);
+		if (rate_ == 0) {
+			tokens_ = burst_;
+		}
+	}
+
+	uint64_t Rate() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return static_cast<uint64_t>(rate_);
+	}
+
+	void Acquire(uint64_t bytes) {
+		std::chrono::microseconds wait(0);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (rate_ == 0) {
+				return;
+			}
+			Refill();
+			tokens_ -= static_cast<double>(bytes);
+			if (tokens_ < 0) {
+				wait = std::chrono::microseconds(static_cast<int64_t>(-tokens_ / rate_ * 1e6));
+			}
+		}
+		if (wait.count() > 0) {
+			std::this_thread::sleep_for(wait);
+		}
+	}
+
+private:
+	void Refill() {
+		const auto now = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration_cast<std::chrono::microseconds>(now - last_).count() / 1e6;
+		last_ = now;
+		tokens_ = std::min(burst_, tokens_ + seconds * rate_);
+	}
+
+	mutable std::mutex mutex_;
+	double rate_;
+	double burst_;
+	double tokens_;
+	std::chrono::steady_clock::time_point last_;
+};
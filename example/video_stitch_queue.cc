@@ -0,0 +1,659 @@
+#include "video_stitch_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <stitcher/stitcher.h>
+#include "file_util.h"
+
+using std::chrono::steady_clock;
+
+namespace {
+	/**
+	 * "C:/out/clip.mp4", ".part" -> "C:/out/clip.part.mp4", the stitcher picks the container by extension
+	 */
+	std::string WithSuffix(const std::string& path, const std::string& suffix) {
+		const size_t dot = path.find_last_of('.');
+		const size_t slash = path.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return path + suffix;
+		}
+		return path.substr(0, dot) + suffix + path.substr(dot);
+	}
+
+	double SecondsBetween(steady_clock::time_point begin, steady_clock::time_point end) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1e6;
+	}
+
+	double Megabytes(uint64_t bytes) {
+		return bytes / static_cast<double>(1 << 20);
+	}
+
+	bool Finished(VideoStitchState state) {
+		return state == VideoStitchState::Done || state == VideoStitchState::Failed || state == VideoStitchState::Cancelled;
+	}
+
+	crow::json::wvalue ToJson(const VideoStitchJob& job) {
+		crow::json::wvalue json;
+		json["id"] = job.id;
+		std::vector<crow::json::wvalue> inputs;
+		for (const auto& input : job.input_paths) {
+			inputs.emplace_back(file_util::Basename(input));
+		}
+		json["inputs"] = std::move(inputs);
+		json["output"] = file_util::Basename(job.output_path);
+		json["priority"] = job.priority;
+		json["input_bytes"] = job.input_bytes;
+		json["state"] = VideoStitchStateName(job.state);
+		json["progress"] = job.progress;
+		if (job.state == VideoStitchState::Failed) {
+			json["error"] = job.error;
+			json["error_info"] = job.error_info;
+		}
+		json["position"] = job.position;
+		json["queued_seconds"] = job.queued_seconds;
+		json["run_seconds"] = job.run_seconds;
+		json["eta_seconds"] = job.eta_seconds;
+		return json;
+	}
+
+	crow::json::wvalue ToJson(const VideoStitchQueueStats& stats) {
+		crow::json::wvalue json;
+		json["queued"] = stats.queued;
+		json["running"] = stats.running;
+		json["done"] = stats.done;
+		json["failed"] = stats.failed;
+		json["cancelled"] = stats.cancelled;
+		json["eta_seconds"] = stats.eta_seconds;
+		json["seconds_per_mb"] = stats.seconds_per_mb;
+		return json;
+	}
+
+	class SdkVideoStitch : public VideoStitchRun {
+	public:
+		SdkVideoStitch() : cancelled_(std::make_shared<std::atomic<bool>>(false)) {
+		}
+
+		void Start(const std::vector<std::string>& input_paths, const std::string& output_path, const VideoStitchParams& params,
+			ProgressCallback on_progress, ErrorCallback on_error) override {
+			std::vector<std::string> inputs = input_paths;
+			stitcher_ = std::make_shared<ins_media::VideoStitcher>();
+			stitcher_->SetInputPath(inputs);
+			stitcher_->SetOutputPath(output_path);
+			stitcher_->SetStitchType(params.stitch_type);
+			stitcher_->EnableCuda(params.enable_cuda);
+			stitcher_->EnableFlowState(params.enable_flowstate);
+			// direction lock depends on FlowState
+			stitcher_->EnableDirectionLock(params.enable_flowstate && params.enable_direction_lock);
+			stitcher_->EnableDenoise(params.enable_denoise);
+			stitcher_->EnableColorPlus(params.enable_colorplus, params.colorplus_model_path);
+			if (params.output_width > 0 && params.output_height > 0) {
+				stitcher_->SetOutputSize(params.output_width, params.output_height);
+			}
+			if (params.output_bitrate > 0) {
+				stitcher_->SetOutputBitRate(params.output_bitrate);
+			}
+			auto cancelled = cancelled_;
+			stitcher_->SetStitchProgressCallback([cancelled, on_progress, on_error](int process, int error) {
+				if (cancelled->load()) {
+					return;
+				}
+				if (error != 0) {
+					on_error(error, "Stitch error " + std::to_string(error));
+					return;
+				}
+				on_progress(process);
+			});
+			stitcher_->SetStitchStateCallback([cancelled, on_error](int error, const char* info) {
+				if (!cancelled->load()) {
+					on_error(error, info ? info : "");
+				}
+			});
+			stitcher_->StartStitch();
+		}
+
+		bool Cancel() override {
+			cancelled_->store(true);
+			return stitcher_ && stitcher_->CancelStitch();
+		}
+
+	private:
+		std::shared_ptr<ins_media::VideoStitcher> stitcher_;
+		std::shared_ptr<std::atomic<bool>> cancelled_;
+	};
+
+	class SimulatedVideoStitch : public VideoStitchRun {
+	public:
+		explicit SimulatedVideoStitch(std::function<double(uint64_t input_bytes)> duration) : duration_(duration), cancelled_(false) {
+		}
+
+		~SimulatedVideoStitch() {
+			Cancel();
+		}
+
+		void Start(const std::vector<std::string>& input_paths, const std::string& output_path, const VideoStitchParams&,
+			ProgressCallback on_progress, ErrorCallback on_error) override {
+			uint64_t input_bytes = 0;
+			for (const auto& input : input_paths) {
+				const int64_t size = file_util::FileSize(input);
+				if (size < 0) {
+					on_error(static_cast<int>(STITCH_ERR::NoMetaData), "Cannot open " + input);
+					return;
+				}
+				input_bytes += size;
+			}
+			const auto step = std::chrono::microseconds(static_cast<int64_t>(duration_(input_bytes) * 1e4));
+			thread_ = std::thread([this, output_path, on_progress, on_error, step]() {
+				std::unique_lock<std::mutex> lock(mutex_);
+				for (int progress = 1; progress <= 100; ++progress) {
+					if (cv_.wait_for(lock, step, [this]() { return cancelled_; })) {
+						return;
+					}
+					lock.unlock();
+					if (progress == 100 && !std::ofstream(output_path, std::ios::binary)) {
+						on_error(static_cast<int>(STITCH_ERR::InitPipelineFailed), "Cannot write " + output_path);
+						return;
+					}
+					on_progress(progress);
+					lock.lock();
+				}
+			});
+		}
+
+		bool Cancel() override {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				cancelled_ = true;
+			}
+			cv_.notify_all();
+			if (thread_.joinable()) {
+				thread_.join();
+			}
+			return true;
+		}
+
+	private:
+		std::function<double(uint64_t)> duration_;
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		bool cancelled_;
+		std::thread thread_;
+	};
+}
+
+VideoStitchFactory SdkVideoStitchFactory() {
+	return []() {
+		return std::unique_ptr<VideoStitchRun>(new SdkVideoStitch());
+	};
+}
+
+VideoStitchFactory SimulatedVideoStitchFactory(double seconds_per_mb, double jitter) {
+	struct Random {
+		std::mutex mutex;
+		std::mt19937 engine{ 1 };
+	};
+	auto random = std::make_shared<Random>();
+	auto duration = [random, seconds_per_mb, jitter](uint64_t input_bytes) {
+		std::lock_guard<std::mutex> lock(random->mutex);
+		return Megabytes(input_bytes) * seconds_per_mb * std::uniform_real_distribution<double>(1 - jitter, 1 + jitter)(random->engine);
+	};
+	return [duration]() {
+		return std::unique_ptr<VideoStitchRun>(new SimulatedVideoStitch(duration));
+	};
+}
+
+const char* VideoStitchStateName(VideoStitchState state) {
+	switch (state) {
+	case VideoStitchState::Queued:
+		return "queued";
+	case VideoStitchState::Running:
+		return "running";
+	case VideoStitchState::Done:
+		return "done";
+	case VideoStitchState::Failed:
+		return "failed";
+	default:
+		return "cancelled";
+	}
+}
+
+struct VideoStitchQueue::Entry {
+	VideoStitchJob job;
+	std::string part_path;
+	steady_clock::time_point submitted;
+	steady_clock::time_point started;
+	steady_clock::time_point finished;
+	bool cancel_requested = false;
+	bool completed = false; // the stitcher reported progress 100 or an error
+};
+
+VideoStitchQueue::VideoStitchQueue(VideoStitchFactory factory, const VideoStitchParams& params, const VideoStitchQueueOptions& options)
+	: factory_(factory), params_(params), options_(options), next_id_(1), stopping_(false), seconds_per_mb_(options.initial_seconds_per_mb),
+	next_listener_(0) {
+	for (size_t i = 0; i < std::max<size_t>(options_.workers, 1); ++i) {
+		workers_.emplace_back(&VideoStitchQueue::Run, this);
+	}
+}
+
+VideoStitchQueue::~VideoStitchQueue() {
+	Stop();
+}
+
+size_t VideoStitchQueue::AddListener(Listener listener) {
+	std::lock_guard<std::mutex> lock(listener_mutex_);
+	listeners_[next_listener_] = listener;
+	return next_listener_++;
+}
+
+void VideoStitchQueue::RemoveListener(size_t id) {
+	std::lock_guard<std::mutex> lock(listener_mutex_);
+	listeners_.erase(id);
+}
+
+uint64_t VideoStitchQueue::Submit(const std::vector<std::string>& input_paths, const std::string& output_path, int priority) {
+	auto entry = std::make_shared<Entry>();
+	entry->job.input_paths = input_paths;
+	entry->job.output_path = output_path;
+	entry->job.priority = priority;
+	for (const auto& input : input_paths) {
+		entry->job.input_bytes += static_cast<uint64_t>(std::max<int64_t>(file_util::FileSize(input), 0));
+	}
+	entry->part_path = WithSuffix(output_path, options_.part_suffix);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (stopping_ || queue_.size() >= options_.max_queued) {
+			return 0;
+		}
+		entry->job.id = next_id_++;
+		entry->submitted = steady_clock::now();
+		jobs_[entry->job.id] = entry;
+		queue_[std::make_pair(-priority, entry->job.id)] = entry;
+	}
+	cv_.notify_all();
+	Notify(entry);
+	return entry->job.id;
+}
+
+bool VideoStitchQueue::Cancel(uint64_t id) {
+	std::shared_ptr<Entry> entry;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = jobs_.find(id);
+		if (it == jobs_.end() || Finished(it->second->job.state)) {
+			return false;
+		}
+		entry = it->second;
+		if (entry->job.state == VideoStitchState::Running) {
+			// CancelStitch may take a while, the worker calls it rather than the caller's (HTTP) thread
+			entry->cancel_requested = true;
+			cv_.notify_all();
+			return true;
+		}
+		queue_.erase(std::make_pair(-entry->job.priority, id));
+		entry->job.state = VideoStitchState::Cancelled;
+	}
+	Finish(entry, VideoStitchState::Cancelled);
+	return true;
+}
+
+void VideoStitchQueue::Run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+		if (stopping_) {
+			return;
+		}
+		auto entry = queue_.begin()->second;
+		queue_.erase(queue_.begin());
+		entry->job.state = VideoStitchState::Running;
+		entry->started = steady_clock::now();
+		running_.push_back(entry);
+		lock.unlock();
+		Notify(entry);
+		Execute(entry);
+		lock.lock();
+	}
+}
+
+void VideoStitchQueue::Execute(const std::shared_ptr<Entry>& entry) {
+	file_util::Remove(entry->part_path);
+	auto run = factory_();
+	run->Start(entry->job.input_paths, entry->part_path, params_,
+		[this, entry](int progress) {
+		progress = std::min(progress, 100);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (entry->completed || entry->job.state != VideoStitchState::Running || progress <= entry->job.progress) {
+				return;
+			}
+			entry->job.progress = progress;
+			if (progress == 100) {
+				entry->completed = true;
+				cv_.notify_all();
+				return;
+			}
+		}
+		// the last step is announced by Finish once the output is in place
+		Notify(entry);
+	},
+		[this, entry](int error, const std::string& info) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (entry->completed || entry->job.state != VideoStitchState::Running) {
+			return;
+		}
+		entry->completed = true;
+		entry->job.error = error;
+		entry->job.error_info = info;
+		cv_.notify_all();
+	});
+
+	bool cancel = false;
+	bool failed = false;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [this, &entry]() { return entry->completed || entry->cancel_requested || stopping_; });
+		cancel = !entry->completed;
+		failed = entry->completed && entry->job.progress < 100;
+	}
+	if (cancel) {
+		run->Cancel();
+	}
+	run.reset();
+
+	if (cancel || failed) {
+		file_util::Remove(entry->part_path);
+		Finish(entry, cancel ? VideoStitchState::Cancelled : VideoStitchState::Failed);
+		return;
+	}
+	if (!file_util::Rename(entry->part_path, entry->job.output_path)) {
+		file_util::Remove(entry->part_path);
+		std::lock_guard<std::mutex> lock(mutex_);
+		entry->job.error_info = "Failed to move the output to " + entry->job.output_path;
+		failed = true;
+	}
+	Finish(entry, failed ? VideoStitchState::Failed : VideoStitchState::Done);
+}
+
+void VideoStitchQueue::Finish(const std::shared_ptr<Entry>& entry, VideoStitchState state) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		entry->job.state = state;
+		entry->finished = steady_clock::now();
+		running_.erase(std::remove(running_.begin(), running_.end(), entry), running_.end());
+		finished_.push_back(entry->job.id);
+		if (state == VideoStitchState::Done) {
+			++stats_.done;
+			// ETAs follow the recent jobs, the first one replaces the initial guess
+			const double mb = Megabytes(entry->job.input_bytes);
+			if (mb > 0) {
+				const double sample = SecondsBetween(entry->started, entry->finished) / mb;
+				seconds_per_mb_ = stats_.done == 1 ? sample : 0.7 * seconds_per_mb_ + 0.3 * sample;
+			}
+		}
+		else if (state == VideoStitchState::Failed) {
+			++stats_.failed;
+		}
+		else {
+			++stats_.cancelled;
+		}
+		while (finished_.size() > options_.max_finished) {
+			jobs_.erase(finished_.front());
+			finished_.erase(finished_.begin());
+		}
+	}
+	cv_.notify_all();
+	Notify(entry);
+}
+
+void VideoStitchQueue::Notify(const std::shared_ptr<Entry>& entry) {
+	std::lock_guard<std::mutex> listener_lock(listener_mutex_);
+	if (listeners_.empty()) {
+		return;
+	}
+	VideoStitchJob job;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto now = steady_clock::now();
+		double queue_eta = 0;
+		job = Snapshot(*entry, now, Schedule(now, queue_eta));
+	}
+	for (const auto& listener : listeners_) {
+		listener.second(job);
+	}
+}
+
+std::map<uint64_t, VideoStitchQueue::Estimate> VideoStitchQueue::Schedule(steady_clock::time_point now, double& queue_eta) const {
+	std::map<uint64_t, Estimate> schedule;
+	// seconds from now until each worker is free
+	std::vector<double> free_at;
+	for (const auto& entry : running_) {
+		const double elapsed = SecondsBetween(entry->started, now);
+		const int progress = entry->job.progress;
+		const double remaining = progress > 0 ? elapsed * (100 - progress) / progress
+			: std::max(Megabytes(entry->job.input_bytes) * seconds_per_mb_ - elapsed, 0.0);
+		free_at.push_back(remaining);
+		schedule[entry->job.id] = Estimate{ 0, remaining };
+	}
+	free_at.resize(std::max(free_at.size(), workers_.size()), 0.0);
+	size_t position = 0;
+	for (const auto& queued : queue_) {
+		auto worker = std::min_element(free_at.begin(), free_at.end());
+		*worker += Megabytes(queued.second->job.input_bytes) * seconds_per_mb_;
+		schedule[queued.second->job.id] = Estimate{ ++position, *worker };
+	}
+	queue_eta = free_at.empty() ? 0 : *std::max_element(free_at.begin(), free_at.end());
+	return schedule;
+}
+
+VideoStitchJob VideoStitchQueue::Snapshot(const Entry& entry, steady_clock::time_point now, const std::map<uint64_t, Estimate>& schedule) const {
+	VideoStitchJob job = entry.job;
+	const bool started = job.state != VideoStitchState::Queued && entry.started != steady_clock::time_point();
+	const bool finished = Finished(job.state);
+	job.queued_seconds = SecondsBetween(entry.submitted, started ? entry.started : (finished ? entry.finished : now));
+	job.run_seconds = started ? SecondsBetween(entry.started, finished ? entry.finished : now) : 0;
+	auto estimate = schedule.find(job.id);
+	if (!finished && estimate != schedule.end()) {
+		job.position = estimate->second.position;
+		job.eta_seconds = estimate->second.eta_seconds;
+	}
+	return job;
+}
+
+VideoStitchQueueStats VideoStitchQueue::StatsLocked(steady_clock::time_point now) const {
+	VideoStitchQueueStats stats = stats_;
+	stats.queued = queue_.size();
+	stats.running = running_.size();
+	stats.seconds_per_mb = seconds_per_mb_;
+	Schedule(now, stats.eta_seconds);
+	return stats;
+}
+
+bool VideoStitchQueue::Job(uint64_t id, VideoStitchJob& job) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = jobs_.find(id);
+	if (it == jobs_.end()) {
+		return false;
+	}
+	const auto now = steady_clock::now();
+	double queue_eta = 0;
+	job = Snapshot(*it->second, now, Schedule(now, queue_eta));
+	return true;
+}
+
+std::vector<VideoStitchJob> VideoStitchQueue::Jobs() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const auto now = steady_clock::now();
+	double queue_eta = 0;
+	const auto schedule = Schedule(now, queue_eta);
+	std::vector<VideoStitchJob> jobs;
+	for (const auto& entry : running_) {
+		jobs.push_back(Snapshot(*entry, now, schedule));
+	}
+	for (const auto& queued : queue_) {
+		jobs.push_back(Snapshot(*queued.second, now, schedule));
+	}
+	for (auto it = finished_.rbegin(); it != finished_.rend(); ++it) {
+		jobs.push_back(Snapshot(*jobs_.at(*it), now, schedule));
+	}
+	return jobs;
+}
+
+VideoStitchQueueStats VideoStitchQueue::Stats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return StatsLocked(steady_clock::now());
+}
+
+void VideoStitchQueue::WaitIdle() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [this]() { return queue_.empty() && running_.empty(); });
+}
+
+void VideoStitchQueue::Stop() {
+	std::vector<std::shared_ptr<Entry>> queued;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+		for (const auto& entry : queue_) {
+			entry.second->job.state = VideoStitchState::Cancelled;
+			queued.push_back(entry.second);
+		}
+		queue_.clear();
+	}
+	cv_.notify_all();
+	for (const auto& entry : queued) {
+		Finish(entry, VideoStitchState::Cancelled);
+	}
+	for (auto& worker : workers_) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+}
+
+void VideoStitchQueue::RegisterRoutes(crow::SimpleApp& app, const std::string& video_dir) {
+	AddListener([this](const VideoStitchJob& job) {
+		const auto streams = progress_streams_.equal_range(job.id);
+		if (watchers_.empty() && streams.first == streams.second) {
+			return;
+		}
+		crow::json::wvalue event = ToJson(job);
+		event["queue"] = ToJson(Stats());
+		const std::string message = event.dump();
+		for (auto watcher : watchers_) {
+			watcher->send_text(message);
+		}
+		// a progress stream ends with its job, or once its client is gone
+		for (auto it = streams.first; it != streams.second; ) {
+			if (!it->second->write(message + "\n") || job.eta_seconds < 0) {
+				it->second->close();
+				it = progress_streams_.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	});
+
+	// every change of every job, a new watcher first gets the whole queue
+	CROW_ROUTE(app, "/video/stitch/events").websocket()
+		.onopen([this](crow::websocket::connection& watcher) {
+		crow::json::wvalue snapshot;
+		std::vector<crow::json::wvalue> jobs;
+		for (const auto& job : Jobs()) {
+			jobs.push_back(ToJson(job));
+		}
+		snapshot["jobs"] = std::move(jobs);
+		snapshot["queue"] = ToJson(Stats());
+		std::lock_guard<std::mutex> lock(listener_mutex_);
+		watcher.send_text(snapshot.dump());
+		watchers_.push_back(&watcher);
+	})
+		.onclose([this](crow::websocket::connection& watcher, const std::string&) {
+		std::lock_guard<std::mutex> lock(listener_mutex_);
+		watchers_.erase(std::remove(watchers_.begin(), watchers_.end(), &watcher), watchers_.end());
+	});
+
+	// the changes of one job as they happen, a JSON line each, for clients without WebSockets
+	CROW_ROUTE(app, "/video/stitch/<uint>/progress")
+		([this](const crow::request&, crow::response& res, uint64_t id) {
+		{
+			std::lock_guard<std::mutex> lock(listener_mutex_);
+			VideoStitchJob job;
+			if (!Job(id, job)) {
+				res.code = 404;
+			}
+			else {
+				crow::json::wvalue event = ToJson(job);
+				event["queue"] = ToJson(Stats());
+				res.set_header("Content-Type", "application/x-ndjson");
+				auto stream = res.stream_chunked();
+				stream->write(event.dump() + "\n");
+				if (job.eta_seconds < 0) {
+					stream->close();
+				}
+				else {
+					progress_streams_.emplace(id, stream);
+				}
+			}
+		}
+		res.end();
+	});
+
+	// body: {"inputs": ["VID_xxx_00_001.insv", "VID_xxx_10_001.insv"], "name": "clip", "priority": 0},
+	// answered as soon as the job is queued
+	CROW_ROUTE(app, "/video/stitch").methods(crow::HTTPMethod::Post, crow::HTTPMethod::Get)
+		([this, video_dir](const crow::request& req) {
+		if (req.method == crow::HTTPMethod::Get) {
+			crow::json::wvalue body;
+			std::vector<crow::json::wvalue> jobs;
+			for (const auto& job : Jobs()) {
+				jobs.push_back(ToJson(job));
+			}
+			body["jobs"] = std::move(jobs);
+			body["queue"] = ToJson(Stats());
+			crow::response res(body.dump());
+			res.set_header("Content-Type", "application/json");
+			return res;
+		}
+		auto params = crow::json::load(req.body);
+		if (!params || !params.has("inputs") || !params.has("name") || params["inputs"].size() == 0) {
+			return crow::response(400, "Missing \"inputs\" or \"name\"");
+		}
+		// only files in video_dir, whatever path the client sends
+		std::vector<std::string> input_paths;
+		for (const auto& input : params["inputs"]) {
+			input_paths.push_back(video_dir + file_util::Basename(input.s()));
+			if (file_util::FileSize(input_paths.back()) < 0) {
+				return crow::response(404, "No " + file_util::Basename(input.s()) + " in the video directory");
+			}
+		}
+		const std::string output_path = video_dir + file_util::Basename(params["name"].s()) + ".mp4";
+		const int priority = params.has("priority") ? static_cast<int>(params["priority"].i()) : 0;
+		VideoStitchJob job;
+		const uint64_t id = Submit(input_paths, output_path, priority);
+		if (id == 0 || !Job(id, job)) {
+			return crow::response(503, "Stitch queue is full");
+		}
+		auto body = ToJson(job);
+		body["events"] = "/video/stitch/events";
+		crow::response res(202, body.dump());
+		res.set_header("Content-Type", "application/json");
+		return res;
+	});
+
+	CROW_ROUTE(app, "/video/stitch/<uint>").methods(crow::HTTPMethod::Get, crow::HTTPMethod::Delete)
+		([this](const crow::request& req, uint64_t id) {
+		if (req.method == crow::HTTPMethod::Delete && !Cancel(id)) {
+			VideoStitchJob job;
+			return crow::response(Job(id, job) ? 409 : 404);
+		}
+		VideoStitchJob job;
+		if (!Job(id, job)) {
+			return crow::response(404);
+		}
+		crow::response res(ToJson(job).dump());
+		res.set_header("Content-Type", "application/json");
+		return res;
+	});
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stitcher/common.h>
+#include "crow.h"
+
+/**
+ * \brief Everything VideoStitcher is configured with besides the input and output paths.
+ */
+struct VideoStitchParams {
+	STITCH_TYPE stitch_type = STITCH_TYPE::OPTFLOW;
+	int output_width = 3840;
+	int output_height = 1920;
+	int64_t output_bitrate = 0; // 0: that of the source
+	bool enable_flowstate = true;
+	bool enable_direction_lock = false;
+	bool enable_denoise = false;
+	bool enable_cuda = true;
+	bool enable_colorplus = false;
+	std::string colorplus_model_path;
+};
+
+/**
+ * \class VideoStitchRun
+ * \brief One video stitch. Start() returns right away and the callbacks come from the stitcher's own thread,
+ *        progress 100 means the output is complete. Callbacks after Cancel() are dropped.
+ */
+class VideoStitchRun {
+public:
+	typedef std::function<void(int progress)> ProgressCallback;
+	typedef std::function<void(int error, const std::string& info)> ErrorCallback;
+
+	virtual ~VideoStitchRun() {
+	}
+
+	virtual void Start(const std::vector<std::string>& input_paths, const std::string& output_path, const VideoStitchParams& params,
+		ProgressCallback on_progress, ErrorCallback on_error) = 0;
+	virtual bool Cancel() = 0;
+};
+
+typedef std::function<std::unique_ptr<VideoStitchRun>()> VideoStitchFactory;
+
+/**
+ * \brief runs on ins_media::VideoStitcher
+ */
+VideoStitchFactory SdkVideoStitchFactory();
+
+/**
+ * \brief no stitching: progress goes up in 1% steps over seconds_per_mb of the inputs (within +-jitter) and the
+ *        output is an empty file, for the benchmark and --simulate
+ */
+VideoStitchFactory SimulatedVideoStitchFactory(double seconds_per_mb, double jitter = 0.2);
+
+enum class VideoStitchState {
+	Queued,
+	Running,
+	Done,
+	Failed,
+	Cancelled,
+};
+
+const char* VideoStitchStateName(VideoStitchState state);
+
+struct VideoStitchJob {
+	uint64_t id = 0;
+	std::vector<std::string> input_paths;
+	std::string output_path;
+	int priority = 0;            // higher runs first, equal priorities in submission order
+	uint64_t input_bytes = 0;
+	VideoStitchState state = VideoStitchState::Queued;
+	int progress = 0;            // 0 ~ 100
+	int error = 0;
+	std::string error_info;
+	size_t position = 0;         // place in the queue, 1 runs next, 0 once it runs
+	double queued_seconds = 0;   // waiting until it started, or until now
+	double run_seconds = 0;
+	double eta_seconds = -1;     // until it is done, -1 once finished
+};
+
+struct VideoStitchQueueStats {
+	size_t queued = 0;
+	size_t running = 0;
+	uint64_t done = 0;
+	uint64_t failed = 0;
+	uint64_t cancelled = 0;
+	double eta_seconds = 0;      // until the queue is empty
+	double seconds_per_mb = 0;   // of the finished jobs, what the ETAs are based on
+};
+
+struct VideoStitchQueueOptions {
+	size_t workers = 1;                  // a VideoStitcher uses one GPU, more workers only help with more GPUs
+	size_t max_queued = 64;              // Submit fails beyond it
+	size_t max_finished = 256;           // finished jobs kept for GET and the events, the oldest are dropped
+	double initial_seconds_per_mb = 0.5; // ETA until the first job has finished
+	std::string part_suffix = ".part";   // the output is written next to output_path and renamed over it once done
+};
+
+/**
+ * \class VideoStitchQueue
+ * \brief Runs .insv stitches on a few worker threads of its own, highest priority first, so HTTP handlers only
+ *        queue a job and return. A job can be cancelled while queued or running. Every change of a job (queued,
+ *        started, each percent of progress, done, failed, cancelled) goes to the listeners, and the ETAs come
+ *        from the stitch time per input MB of the finished jobs.
+ */
+class VideoStitchQueue {
+public:
+	typedef std::function<void(const VideoStitchJob& job)> Listener;
+
+	VideoStitchQueue(VideoStitchFactory factory, const VideoStitchParams& params = VideoStitchParams(),
+		const VideoStitchQueueOptions& options = VideoStitchQueueOptions());
+	~VideoStitchQueue();
+
+	VideoStitchQueue(const VideoStitchQueue&) = delete;
+	VideoStitchQueue& operator=(const VideoStitchQueue&) = delete;
+
+	/**
+	 * \brief called for every change of every job, one at a time and in order, from the thread that made it:
+	 *        a worker, the stitcher's callback thread or the caller of Submit and Cancel. A listener must not
+	 *        add or remove listeners.
+	 */
+	size_t AddListener(Listener listener);
+	void RemoveListener(size_t id);
+
+	/**
+	 * \return id of the job, 0 if the queue is full or stopped
+	 */
+	uint64_t Submit(const std::vector<std::string>& input_paths, const std::string& output_path, int priority = 0);
+
+	/**
+	 * \brief a queued job is cancelled right away, a running one by its worker shortly after
+	 * \return false if the job is unknown or already finished
+	 */
+	bool Cancel(uint64_t id);
+
+	bool Job(uint64_t id, VideoStitchJob& job) const;
+
+	/**
+	 * \brief the running jobs, the queued ones in the order they will run, then the finished ones, newest first
+	 */
+	std::vector<VideoStitchJob> Jobs() const;
+
+	VideoStitchQueueStats Stats() const;
+
+	/**
+	 * \brief block until no job is queued or running
+	 */
+	void WaitIdle();
+
+	/**
+	 * \brief register POST /video/stitch, GET /video/stitch, GET and DELETE /video/stitch/<id>, the
+	 *        /video/stitch/events WebSocket and GET /video/stitch/<id>/progress, a chunked response with a JSON
+	 *        line per change of the job until it is finished; call before app.run_async()
+	 * \param video_dir where the inputs are looked up and the stitched videos are written, with trailing slash
+	 */
+	void RegisterRoutes(crow::SimpleApp& app, const std::string& video_dir);
+
+	/**
+	 * \brief cancel the queued and running jobs and join the workers
+	 */
+	void Stop();
+
+private:
+	struct Entry;
+	struct Estimate {
+		size_t position;
+		double eta_seconds;
+	};
+
+	void Run();
+	void Execute(const std::shared_ptr<Entry>& entry);
+	void Finish(const std::shared_ptr<Entry>& entry, VideoStitchState state);
+	void Notify(const std::shared_ptr<Entry>& entry);
+	/**
+	 * \brief positions and ETAs of the running and queued jobs, from handing them to the workers in queue order
+	 */
+	std::map<uint64_t, Estimate> Schedule(std::chrono::steady_clock::time_point now, double& queue_eta) const;
+	VideoStitchJob Snapshot(const Entry& entry, std::chrono::steady_clock::time_point now,
+		const std::map<uint64_t, Estimate>& schedule) const;
+	VideoStitchQueueStats StatsLocked(std::chrono::steady_clock::time_point now) const;
+
+	VideoStitchFactory factory_;
+	VideoStitchParams params_;
+	VideoStitchQueueOptions options_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::map<uint64_t, std::shared_ptr<Entry>> jobs_;
+	std::map<std::pair<int, uint64_t>, std::shared_ptr<Entry>> queue_; // by (-priority, id)
+	std::vector<std::shared_ptr<Entry>> running_;
+	std::vector<uint64_t> finished_; // oldest first
+	uint64_t next_id_;
+	bool stopping_;
+	VideoStitchQueueStats stats_;
+	double seconds_per_mb_;
+	std::vector<std::thread> workers_;
+
+	std::mutex listener_mutex_; // taken before mutex_, keeps the events in order
+	std::map<size_t, Listener> listeners_;
+	size_t next_listener_;
+	std::vector<crow::websocket::connection*> watchers_;
+	std::multimap<uint64_t, std::shared_ptr<crow::chunked_stream>> progress_streams_; // by job id
+};
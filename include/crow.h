@@ -9,11 +9,13 @@
 #include "crow/mustache.h"
 #include "crow/logging.h"
 #include "crow/task_timer.h"
+#include "crow/load_balancer.h"
 #include "crow/utility.h"
 #include "crow/common.h"
 #include "crow/http_request.h"
 #include "crow/websocket.h"
 #include "crow/parser.h"
+#include "crow/chunked_stream.h"
 #include "crow/http_response.h"
 #include "crow/multipart.h"
 #include "crow/routing.h"
@@ -182,7 +182,7 @@ namespace crow
         /// Set the response body size (in bytes) beyond which Crow automatically streams responses (Default is 1MiB)
 
         ///
-        /// Any streamed response is unaffected by Crow's timer, and therefore won't timeout before a response is fully sent.
+        /// A streamed response is written a slice at a time without holding up the other connections, and only times out when the client takes nothing for a whole timeout.
         self_t& stream_threshold(size_t threshold)
         {
             res_stream_threshold_ = threshold;
@@ -195,6 +195,33 @@ namespace crow
             return res_stream_threshold_;
         }
 
+        /// Set how many finished connections each worker thread keeps to reuse for new ones (Default is 128)
+
+        ///
+        /// Accepting a connection then doesn't allocate one, 0 turns this off.
+        self_t& connection_pool_size(size_t size)
+        {
+            connection_pool_size_ = size;
+            return *this;
+        }
+
+        /// Set how the worker thread for a new connection is picked (Default is crow::load_balancers::least_connections())
+
+        ///
+        /// Not used with reuse_port(), the kernel picks the worker then.
+        self_t& load_balancer(crow::load_balancer balancer)
+        {
+            load_balancer_ = std::move(balancer);
+            return *this;
+        }
+
+        /// Let every worker thread accept connections on its own SO_REUSEPORT socket rather than one thread accepting them all (Linux only)
+        self_t& reuse_port(bool reuse_port = true)
+        {
+            reuse_port_ = reuse_port;
+            return *this;
+        }
+
         self_t& register_blueprint(Blueprint& blueprint)
         {
             router_.register_blueprint(blueprint);
@@ -286,6 +313,9 @@ namespace crow
             {
                 ssl_server_ = std::move(std::unique_ptr<ssl_server_t>(new ssl_server_t(this, bindaddr_, port_, server_name_, &middlewares_, concurrency_, timeout_, &ssl_context_)));
                 ssl_server_->set_tick_function(tick_interval_, tick_function_);
+                ssl_server_->set_connection_pool_size(connection_pool_size_);
+                ssl_server_->set_load_balancer(load_balancer_);
+                ssl_server_->set_reuse_port(reuse_port_);
                 ssl_server_->signal_clear();
                 for (auto snum : signals_)
                 {
@@ -299,6 +329,9 @@ namespace crow
             {
                 server_ = std::move(std::unique_ptr<server_t>(new server_t(this, bindaddr_, port_, server_name_, &middlewares_, concurrency_, timeout_, nullptr)));
                 server_->set_tick_function(tick_interval_, tick_function_);
+                server_->set_connection_pool_size(connection_pool_size_);
+                server_->set_load_balancer(load_balancer_);
+                server_->set_reuse_port(reuse_port_);
                 server_->signal_clear();
                 for (auto snum : signals_)
                 {
@@ -465,6 +498,9 @@ namespace crow
         std::string server_name_ = std::string("Crow/") + VERSION;
         std::string bindaddr_ = "0.0.0.0";
         size_t res_stream_threshold_ = 1048576;
+        size_t connection_pool_size_ = 128;
+        crow::load_balancer load_balancer_ = load_balancers::least_connections();
+        bool reuse_port_ = false;
         Router router_;
 
 #ifdef CROW_ENABLE_COMPRESSION
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace crow
+{
+    template<typename Adaptor, typename Handler, typename... Middlewares>
+    class Connection;
+
+    /// The body of a response that is sent as it is produced, with chunked transfer encoding.
+
+    ///
+    /// Get one from response::stream_chunked(). Any thread can write to it, the connection sends what was written
+    /// on its own thread as soon as the socket takes it. Close it after the last chunk to complete the response.
+    class chunked_stream
+    {
+    public:
+        chunked_stream() = default;
+        chunked_stream(const chunked_stream&) = delete;
+        chunked_stream& operator=(const chunked_stream&) = delete;
+
+        /// Queue the next piece of the body, empty ones are skipped.
+
+        ///
+        /// \return false once the stream is closed or the client is gone, producing more is pointless then.
+        bool write(std::string data)
+        {
+            std::function<void()> wake;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (closed_ || detached_)
+                    return false;
+                if (data.empty())
+                    return true;
+                pending_bytes_ += data.size();
+                queue_.push_back(std::move(data));
+                wake.swap(wake_);
+            }
+            if (wake)
+                wake();
+            return true;
+        }
+
+        /// End the body after what has been written so far.
+        void close()
+        {
+            std::function<void()> wake;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (closed_)
+                    return;
+                closed_ = true;
+                wake.swap(wake_);
+            }
+            if (wake)
+                wake();
+        }
+
+        /// Whether writing still has any effect.
+        bool is_open()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return !closed_ && !detached_;
+        }
+
+        /// Bytes written but not yet taken by the connection, a producer faster than the client can wait on it.
+        size_t pending_bytes()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return pending_bytes_;
+        }
+
+    private:
+        template<typename Adaptor, typename Handler, typename... Middlewares>
+        friend class crow::Connection;
+
+        /// Move the queued pieces to chunks, or keep wake to call once there are some.
+
+        ///
+        /// \return true if the stream is closed, chunks then holds the last pieces of the body.
+        bool take(std::vector<std::string>& chunks, std::function<void()> wake)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunks.swap(queue_);
+            queue_.clear();
+            pending_bytes_ = 0;
+            if (chunks.empty() && !closed_)
+                wake_ = std::move(wake);
+            return closed_;
+        }
+
+        /// The connection is done with the stream, later writes are dropped.
+        void detach()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            detached_ = true;
+            attached_ = false;
+            wake_ = nullptr;
+            queue_.clear();
+            pending_bytes_ = 0;
+        }
+
+        std::mutex mutex_;
+        std::vector<std::string> queue_;
+        size_t pending_bytes_{0};
+        bool closed_{false};
+        bool detached_{false};
+        std::function<void()> wake_;
+
+        // only touched on the connection's thread, tells a wake up that was posted whether the connection still has the stream
+        bool attached_{true};
+    };
+} // namespace crow
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace crow
+{
+    namespace detail
+    {
+
+        /// A free list of finished connections of one io_service, so accepting a connection does not allocate one.
+
+        ///
+        /// The acceptor takes connections out and the io_service's thread puts them back once they are reset, the
+        /// two only share the lock for a push or a pop. At most `capacity` connections are kept, the rest are
+        /// deleted as before. A capacity of 0 turns pooling off.
+        template<typename Connection>
+        class connection_pool
+        {
+        public:
+            explicit connection_pool(size_t capacity):
+              capacity_(capacity)
+            {
+                free_.reserve(capacity_);
+            }
+
+            connection_pool(const connection_pool&) = delete;
+            connection_pool& operator=(const connection_pool&) = delete;
+
+            ~connection_pool()
+            {
+                clear();
+            }
+
+            /// A recycled connection, or nullptr if there is none and a new one has to be made.
+            Connection* acquire()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (free_.empty())
+                {
+                    ++misses_;
+                    return nullptr;
+                }
+                Connection* c = free_.back();
+                free_.pop_back();
+                ++hits_;
+                return c;
+            }
+
+            /// Keep a connection that was reset for reuse.
+
+            ///
+            /// \return false if the pool is full or closed, the caller deletes the connection then.
+            bool release(Connection* c)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (closed_ || free_.size() >= capacity_)
+                    return false;
+                free_.push_back(c);
+                return true;
+            }
+
+            /// Delete the pooled connections and stop taking new ones, call it from the io_service's thread before its objects go away.
+            void close()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    closed_ = true;
+                }
+                clear();
+            }
+
+            size_t size()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return free_.size();
+            }
+
+            size_t capacity() const { return capacity_; }
+
+            /// Accepts that got a recycled connection.
+            std::uint64_t hits() const { return hits_; }
+
+            /// Accepts that had to make a new connection.
+            std::uint64_t misses() const { return misses_; }
+
+        private:
+            void clear()
+            {
+                std::vector<Connection*> pooled;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    pooled.swap(free_);
+                }
+                for (auto c : pooled)
+                    delete c;
+            }
+
+            std::mutex mutex_;
+            std::vector<Connection*> free_;
+            size_t capacity_;
+            bool closed_{false};
+            std::atomic<std::uint64_t> hits_{0};
+            std::atomic<std::uint64_t> misses_{0};
+        };
+    } // namespace detail
+} // namespace crow
@@ -3,9 +3,19 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/array.hpp>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <type_traits>
 #include <vector>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#define CROW_USE_SENDFILE
+#endif
 
 #include "crow/http_parser_merged.h"
 #include "crow/common.h"
@@ -14,6 +24,8 @@
 #include "crow/logging.h"
 #include "crow/settings.h"
 #include "crow/task_timer.h"
+#include "crow/connection_pool.h"
+#include "crow/load_balancer.h"
 #include "crow/middleware_context.h"
 #include "crow/middleware.h"
 #include "crow/socket_adaptors.h"
@@ -44,7 +56,8 @@ namespace crow
           std::function<std::string()>& get_cached_date_str_f,
           detail::task_timer& task_timer,
           typename Adaptor::context* adaptor_ctx_,
-          std::atomic<unsigned int>& queue_length):
+          worker_load& load,
+          detail::connection_pool<Connection>* pool = nullptr):
           adaptor_(io_service, adaptor_ctx_),
           handler_(handler),
           parser_(this),
@@ -52,8 +65,10 @@ namespace crow
           middlewares_(middlewares),
           get_cached_date_str(get_cached_date_str_f),
           task_timer_(task_timer),
+          deadline_(&Connection::on_deadline, this),
           res_stream_threshold_(handler->stream_threshold()),
-          queue_length_(queue_length)
+          load_(load),
+          pool_(pool)
         {
 #ifdef CROW_ENABLE_DEBUG
             connectionCount++;
@@ -65,6 +80,7 @@ namespace crow
         {
             res.complete_request_handler_ = nullptr;
             cancel_deadline_timer();
+            close_static_file();
 #ifdef CROW_ENABLE_DEBUG
             connectionCount--;
             CROW_LOG_DEBUG << "Connection (" << this << ") freed, total: " << connectionCount;
@@ -242,16 +258,31 @@ namespace crow
                 res.set_header("location", location);
             }
 
+            if (res.is_chunked())
+            {
+                prepare_chunked();
+            }
+
             prepare_buffers();
 
             if (res.is_static_type())
             {
                 do_write_static();
             }
+            else if (chunked_)
+            {
+                do_write_chunked();
+            }
             else
             {
                 do_write_general();
             }
+
+            if (need_to_start_read_after_complete_)
+            {
+                need_to_start_read_after_complete_ = false;
+                continue_reading();
+            }
         }
 
     private:
@@ -335,7 +366,7 @@ namespace crow
                 buffers_.emplace_back(crlf.data(), crlf.size());
             }
 
-            if (!res.manual_length_header && !res.headers.count("content-length"))
+            if (!res.manual_length_header && !chunked_ && !res.headers.count("content-length"))
             {
                 content_length_ = std::to_string(res.body.size());
                 static std::string content_length_tag = "Content-Length: ";
@@ -371,36 +402,329 @@ namespace crow
         void do_write_static()
         {
             is_writing = true;
-            boost::asio::write(adaptor_.socket(), buffers_);
-
+            streaming_ = true;
+            stream_active_bytes_ = boost::asio::buffer_size(buffers_);
+            stream_offset_ = 0;
+            stream_remaining_ = 0;
             if (res.file_info.statResult == 0)
+                open_static_file();
+            load_.active_bytes += stream_active_bytes_;
+
+            // the headers, then the file a chunk at a time, the other connections of this thread run in between
+            boost::asio::async_write(
+              adaptor_.socket(), buffers_,
+              [this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+                  if (ec)
+                      finish_write_stream(ec);
+                  else
+                      write_static_file();
+              });
+        }
+
+        void open_static_file()
+        {
+#ifdef CROW_USE_SENDFILE
+            if (use_sendfile)
+                static_fd_ = ::open(res.file_info.path.c_str(), O_RDONLY | O_CLOEXEC);
+            else
+#endif
+                static_file_.open(res.file_info.path.c_str(), std::ios::in | std::ios::binary);
+            if (!static_file_open())
             {
-                std::ifstream is(res.file_info.path.c_str(), std::ios::in | std::ios::binary);
-                std::vector<boost::asio::const_buffer> buffers{1};
-                char buf[16384];
-                is.read(buf, sizeof(buf));
-                while (is.gcount() > 0)
+                // the headers promise the whole file, end the connection rather than leave the client waiting for it
+                CROW_LOG_ERROR << "Could not open " << res.file_info.path;
+                close_connection_ = true;
+                return;
+            }
+            stream_remaining_ = static_cast<uint64_t>(res.file_info.statbuf.st_size);
+            stream_active_bytes_ += stream_remaining_;
+        }
+
+        bool static_file_open()
+        {
+#ifdef CROW_USE_SENDFILE
+            if (use_sendfile)
+                return static_fd_ >= 0;
+#endif
+            return static_file_.is_open();
+        }
+
+        void close_static_file()
+        {
+#ifdef CROW_USE_SENDFILE
+            if (static_fd_ >= 0)
+            {
+                ::close(static_fd_);
+                static_fd_ = -1;
+            }
+#endif
+            if (static_file_.is_open())
+                static_file_.close();
+            static_file_.clear();
+        }
+
+        void write_static_file()
+        {
+            if (stream_remaining_ == 0)
+            {
+                finish_write_stream(boost::system::error_code());
+                return;
+            }
+            // a client is only timed out when it takes nothing for a whole timeout
+            start_deadline();
+#ifdef CROW_USE_SENDFILE
+            if (use_sendfile)
+            {
+                send_static_chunk();
+                return;
+            }
+#endif
+            read_static_chunk();
+        }
+
+#ifdef CROW_USE_SENDFILE
+        /// Let the kernel copy the next chunk from the file to the socket, as much as the socket takes right now.
+        void send_static_chunk()
+        {
+            auto& socket = adaptor_.raw_socket();
+            boost::system::error_code ec;
+            if (!socket.native_non_blocking())
+                socket.native_non_blocking(true, ec);
+            off_t offset = static_cast<off_t>(stream_offset_);
+            const ssize_t sent = ::sendfile(socket.native_handle(), static_fd_, &offset, static_cast<size_t>(std::min<uint64_t>(stream_remaining_, CROW_STREAM_CHUNK_SIZE)));
+            if (sent > 0)
+            {
+                stream_offset_ += static_cast<uint64_t>(sent);
+                stream_remaining_ -= static_cast<uint64_t>(sent);
+            }
+            else if (sent == 0)
+            {
+                // the file got shorter since it was stat'ed
+                finish_write_stream(boost::asio::error::eof);
+                return;
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                finish_write_stream(boost::system::error_code(errno, boost::system::system_category()));
+                return;
+            }
+            socket.async_wait(
+              tcp::socket::wait_write,
+              [this](const boost::system::error_code& ec) {
+                  if (ec)
+                      finish_write_stream(ec);
+                  else
+                      write_static_file();
+              });
+        }
+#endif
+
+        /// Read the next chunk into the connection's buffer and write it, for TLS and where there is no sendfile.
+        void read_static_chunk()
+        {
+            const size_t chunk = static_cast<size_t>(std::min<uint64_t>(stream_remaining_, CROW_STREAM_CHUNK_SIZE));
+            if (static_buffer_.size() < chunk)
+                static_buffer_.resize(chunk);
+            static_file_.read(static_buffer_.data(), chunk);
+            const std::streamsize read = static_file_.gcount();
+            if (read <= 0)
+            {
+                finish_write_stream(boost::asio::error::eof);
+                return;
+            }
+            stream_remaining_ -= static_cast<uint64_t>(read);
+            boost::asio::async_write(
+              adaptor_.socket(), boost::asio::buffer(static_buffer_.data(), static_cast<size_t>(read)),
+              [this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+                  if (ec)
+                      finish_write_stream(ec);
+                  else
+                      write_static_file();
+              });
+        }
+
+        /// Take the response's chunked stream and settle the headers for it.
+        void prepare_chunked()
+        {
+            chunked_ = std::move(res.chunked_);
+            res.manual_length_header = true;
+            if (res.skip_body)
+            {
+                // HEAD: the headers of a GET and no body, the producer writes into the void
+                res.headers.erase("content-length");
+                chunked_->detach();
+                chunked_.reset();
+                return;
+            }
+            chunked_framing_ = !req_.check_version(1, 0);
+            if (!chunked_framing_)
+            {
+                // HTTP/1.0 has no chunked encoding, the end of the connection is the end of the body
+                res.headers.erase("transfer-encoding");
+                close_connection_ = true;
+            }
+        }
+
+        void do_write_chunked()
+        {
+            is_writing = true;
+            streaming_ = true;
+            stream_offset_ = 0;
+            stream_remaining_ = 0;
+            // the body set before streaming is the first chunk, it goes out with the headers
+            chunked_chunks_.clear();
+            chunked_next_ = chunked_offset_ = 0;
+            if (!res.body.empty())
+                chunked_chunks_.push_back(std::move(res.body));
+            write_chunked();
+        }
+
+        /// Write the next slice of what the producer has written, or wait for it to write more.
+
+        ///
+        /// More is only taken from the stream once what was taken before is sent, so a producer can tell from
+        /// pending_bytes() how far ahead of the client it is.
+        void write_chunked()
+        {
+            bool last = false;
+            if (chunked_next_ == chunked_chunks_.size())
+            {
+                chunked_chunks_.clear();
+                chunked_next_ = 0;
+                std::shared_ptr<chunked_stream> stream = chunked_;
+                asio::io_service& io_service = adaptor_.get_io_service();
+                last = chunked_->take(chunked_chunks_, [this, stream, &io_service] {
+                    io_service.post([this, stream] {
+                        // the connection may be done with the stream, or even gone, by the time this runs
+                        if (stream->attached_ && chunked_waiting_)
+                        {
+                            chunked_waiting_ = false;
+                            write_chunked();
+                        }
+                    });
+                });
+                if (chunked_chunks_.empty() && buffers_.empty() && !last)
                 {
-                    buffers[0] = boost::asio::buffer(buf, is.gcount());
-                    do_write_sync(buffers);
-                    is.read(buf, sizeof(buf));
+                    chunked_waiting_ = true;
+                    return;
                 }
             }
-            is_writing = false;
-            if (close_connection_)
+
+            // whole chunks while they fit, a large one is split over several slices
+            static const std::string last_chunk = "0\r\n\r\n";
+            size_t budget = CROW_STREAM_CHUNK_SIZE;
+            chunked_sizes_.clear();
+            chunked_sizes_.reserve(chunked_chunks_.size() - chunked_next_);
+            while (chunked_next_ < chunked_chunks_.size() && budget > 0)
             {
-                adaptor_.shutdown_readwrite();
-                adaptor_.close();
-                CROW_LOG_DEBUG << this << " from write (static)";
-                check_destroy();
+                const std::string& chunk = chunked_chunks_[chunked_next_];
+                if (chunked_offset_ == 0 && chunked_framing_)
+                {
+                    char size[20];
+                    chunked_sizes_.emplace_back(size, snprintf(size, sizeof(size), "%zx\r\n", chunk.size()));
+                    buffers_.emplace_back(chunked_sizes_.back().data(), chunked_sizes_.back().size());
+                }
+                const size_t length = std::min(chunk.size() - chunked_offset_, budget);
+                buffers_.emplace_back(chunk.data() + chunked_offset_, length);
+                budget -= length;
+                chunked_offset_ += length;
+                if (chunked_offset_ < chunk.size())
+                    break;
+                if (chunked_framing_)
+                    buffers_.emplace_back(crlf.data(), crlf.size());
+                chunked_offset_ = 0;
+                chunked_next_++;
+            }
+            last = last && chunked_next_ == chunked_chunks_.size();
+            if (last && chunked_framing_)
+                buffers_.emplace_back(last_chunk.data(), last_chunk.size());
+            if (buffers_.empty())
+            {
+                finish_write_stream(boost::system::error_code());
+                return;
             }
 
+            start_deadline();
+            const uint64_t round_bytes = boost::asio::buffer_size(buffers_);
+            stream_active_bytes_ += round_bytes;
+            load_.active_bytes += round_bytes;
+            boost::asio::async_write(
+              adaptor_.socket(), buffers_,
+              [this, last, round_bytes](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+                  stream_active_bytes_ -= round_bytes;
+                  load_.active_bytes -= round_bytes;
+                  buffers_.clear();
+                  if (ec || last)
+                      finish_write_stream(ec);
+                  else
+                      write_chunked();
+              });
+        }
+
+        /// Clean up after a static file, a large or a chunked body was sent, or failed to.
+        void end_write_stream()
+        {
+            close_static_file();
+            if (chunked_)
+            {
+                chunked_->detach();
+                chunked_.reset();
+            }
+            chunked_waiting_ = false;
+            chunked_chunks_.clear();
+            chunked_next_ = chunked_offset_ = 0;
+            load_.active_bytes -= stream_active_bytes_;
+            stream_active_bytes_ = 0;
+            // don't hold on to a large body until the next response
+            if (res_body_copy_.capacity() > CROW_STREAM_CHUNK_SIZE)
+                std::string().swap(res_body_copy_);
+            else
+                res_body_copy_.clear();
+            is_writing = false;
+            streaming_ = false;
             res.end();
             res.clear();
             buffers_.clear();
             parser_.clear();
         }
 
+        void finish_write_stream(const boost::system::error_code& ec)
+        {
+            const bool complete = !ec && stream_remaining_ == 0;
+            const bool read_next = read_after_stream_;
+            read_after_stream_ = false;
+            end_write_stream();
+            // last, the connection may be recycled (or deleted) by it
+            if (!complete || close_connection_)
+            {
+                adaptor_.shutdown_readwrite();
+                adaptor_.close();
+                CROW_LOG_DEBUG << this << " from write (stream) " << ec.message();
+                check_destroy();
+            }
+            else if (read_next)
+            {
+                start_deadline();
+                do_read();
+            }
+        }
+
+        /// Read the next request, or leave it to finish_write_stream() while a response is being streamed.
+
+        ///
+        /// A pipelined request would otherwise be handled into the response and the buffers still being sent.
+        void continue_reading()
+        {
+            if (streaming_)
+            {
+                is_reading = false;
+                read_after_stream_ = true;
+                return;
+            }
+            start_deadline();
+            do_read();
+        }
+
         void do_write_general()
         {
             if (res.body.length() < res_stream_threshold_)
@@ -409,55 +733,50 @@ namespace crow
                 buffers_.emplace_back(res_body_copy_.data(), res_body_copy_.size());
 
                 do_write();
-
-                if (need_to_start_read_after_complete_)
-                {
-                    need_to_start_read_after_complete_ = false;
-                    start_deadline();
-                    do_read();
-                }
             }
             else
             {
+                // the headers, then the body a slice at a time, the other connections of this thread run in between
                 is_writing = true;
-                boost::asio::write(adaptor_.socket(), buffers_); // Write the response start / headers
-                if (res.body.length() > 0)
-                {
-                    std::string buf;
-                    std::vector<asio::const_buffer> buffers;
-
-                    while (res.body.length() > 16384)
-                    {
-                        //buf.reserve(16385);
-                        buf = res.body.substr(0, 16384);
-                        res.body = res.body.substr(16384);
-                        buffers.clear();
-                        buffers.push_back(boost::asio::buffer(buf));
-                        do_write_sync(buffers);
-                    }
-                    // Collect whatever is left (less than 16KB) and send it down the socket
-                    // buf.reserve(is.length());
-                    buf = res.body;
-                    res.body.clear();
-
-                    buffers.clear();
-                    buffers.push_back(boost::asio::buffer(buf));
-                    do_write_sync(buffers);
-                }
-                is_writing = false;
-                if (close_connection_)
-                {
-                    adaptor_.shutdown_readwrite();
-                    adaptor_.close();
-                    CROW_LOG_DEBUG << this << " from write (res_stream)";
-                    check_destroy();
-                }
+                streaming_ = true;
+                res_body_copy_.swap(res.body);
+                stream_offset_ = 0;
+                stream_remaining_ = res_body_copy_.size();
+                stream_active_bytes_ = boost::asio::buffer_size(buffers_) + stream_remaining_;
+                load_.active_bytes += stream_active_bytes_;
+                boost::asio::async_write(
+                  adaptor_.socket(), buffers_,
+                  [this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+                      if (ec)
+                          finish_write_stream(ec);
+                      else
+                          write_body();
+                  });
+            }
+        }
 
-                res.end();
-                res.clear();
-                buffers_.clear();
-                parser_.clear();
+        void write_body()
+        {
+            if (stream_remaining_ == 0)
+            {
+                finish_write_stream(boost::system::error_code());
+                return;
             }
+            // a client is only timed out when it takes nothing for a whole timeout
+            start_deadline();
+            const size_t slice = static_cast<size_t>(std::min<uint64_t>(stream_remaining_, CROW_STREAM_CHUNK_SIZE));
+            boost::asio::async_write(
+              adaptor_.socket(), boost::asio::buffer(res_body_copy_.data() + stream_offset_, slice),
+              [this, slice](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+                  if (ec)
+                  {
+                      finish_write_stream(ec);
+                      return;
+                  }
+                  stream_offset_ += slice;
+                  stream_remaining_ -= slice;
+                  write_body();
+              });
         }
 
         void do_read()
@@ -497,8 +816,7 @@ namespace crow
                   }
                   else if (!need_to_call_after_handlers_)
                   {
-                      start_deadline();
-                      do_read();
+                      continue_reading();
                   }
                   else
                   {
@@ -512,9 +830,12 @@ namespace crow
         {
             //auto self = this->shared_from_this();
             is_writing = true;
+            const uint64_t active_bytes = boost::asio::buffer_size(buffers_);
+            load_.active_bytes += active_bytes;
             boost::asio::async_write(
               adaptor_.socket(), buffers_,
-              [&](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+              [this, active_bytes](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+                  load_.active_bytes -= active_bytes;
                   is_writing = false;
                   res.clear();
                   res_body_copy_.clear();
@@ -537,54 +858,105 @@ namespace crow
               });
         }
 
-        inline void do_write_sync(std::vector<asio::const_buffer>& buffers)
+        void check_destroy()
         {
-
-            boost::asio::write(adaptor_.socket(), buffers, [&](std::error_code ec, std::size_t) {
-                if (!ec)
-                {
-                    return false;
-                }
-                else
+            CROW_LOG_DEBUG << this << " is_reading " << is_reading << " is_writing " << is_writing;
+            if (!is_reading && !is_writing)
+            {
+                load_.connections--;
+                if (pool_)
                 {
-                    CROW_LOG_ERROR << ec << " - happened while sending buffers";
-                    CROW_LOG_DEBUG << this << " from write (sync)(2)";
-                    check_destroy();
-                    return true;
+                    recycle();
+                    if (pool_->release(this))
+                    {
+                        CROW_LOG_DEBUG << this << " recycled (idle) (queue length: " << load_.connections << ')';
+                        return;
+                    }
                 }
-            });
+                CROW_LOG_DEBUG << this << " delete (idle) (queue length: " << load_.connections << ')';
+                delete this;
+            }
         }
 
-        void check_destroy()
+        /// Put the connection back in the state it was constructed in, keeping what it has allocated.
+        void recycle()
         {
-            CROW_LOG_DEBUG << this << " is_reading " << is_reading << " is_writing " << is_writing;
-            if (!is_reading && !is_writing)
+            cancel_deadline_timer();
+            adaptor_.reset();
+            http_parser_init(&parser_);
+            parser_.clear();
+            req_ = request();
+            res.clear();
+            res.complete_request_handler_ = nullptr;
+            res.is_alive_helper_ = nullptr;
+            res.skip_body = false;
+            res.manual_length_header = false;
+#ifdef CROW_ENABLE_COMPRESSION
+            res.compressed = true;
+#endif
+            close_static_file();
+            std::vector<char>().swap(static_buffer_);
+            if (chunked_)
             {
-                queue_length_--;
-                CROW_LOG_DEBUG << this << " delete (idle) (queue length: " << queue_length_ << ')';
-                delete this;
+                chunked_->detach();
+                chunked_.reset();
             }
+            chunked_waiting_ = false;
+            chunked_framing_ = true;
+            chunked_chunks_.clear();
+            chunked_sizes_.clear();
+            chunked_next_ = chunked_offset_ = 0;
+            stream_offset_ = stream_remaining_ = stream_active_bytes_ = 0;
+            buffers_.clear();
+            content_length_.clear();
+            date_str_.clear();
+            // a body can be any size, don't keep a large one around in the pool
+            if (res.body.capacity() > buffer_.size())
+                std::string().swap(res.body);
+            if (res_body_copy_.capacity() > buffer_.size())
+                std::string().swap(res_body_copy_);
+            else
+                res_body_copy_.clear();
+            close_connection_ = false;
+            is_reading = false;
+            is_writing = false;
+            need_to_call_after_handlers_ = false;
+            need_to_start_read_after_complete_ = false;
+            streaming_ = false;
+            read_after_stream_ = false;
+            add_keep_alive_ = false;
+            ctx_ = detail::context<Middlewares...>();
+            res_stream_threshold_ = handler_->stream_threshold();
         }
 
         void cancel_deadline_timer()
         {
-            CROW_LOG_DEBUG << this << " timer cancelled: " << &task_timer_ << ' ' << task_id_;
-            task_timer_.cancel(task_id_);
+            CROW_LOG_DEBUG << this << " timer cancelled: " << &task_timer_;
+            task_timer_.cancel(deadline_);
         }
 
         void start_deadline(/*int timeout = 5*/)
         {
-            cancel_deadline_timer();
+            // moves the embedded timer if it is already scheduled, nothing is allocated
+            task_timer_.schedule(deadline_);
+            CROW_LOG_DEBUG << this << " timer added: " << &task_timer_;
+        }
 
-            task_id_ = task_timer_.schedule([this] {
-                if (!adaptor_.is_open())
-                {
-                    return;
-                }
-                adaptor_.shutdown_readwrite();
-                adaptor_.close();
-            });
-            CROW_LOG_DEBUG << this << " timer added: " << &task_timer_ << ' ' << task_id_;
+        static void on_deadline(void* context)
+        {
+            auto self = static_cast<Connection*>(context);
+            if (!self->adaptor_.is_open())
+            {
+                return;
+            }
+            // waiting for the producer of a chunked response, not for the client
+            if (self->chunked_waiting_)
+            {
+                self->start_deadline();
+                return;
+            }
+            self->adaptor_.shutdown_readwrite();
+            self->adaptor_.close();
         }
 
     private:
@@ -606,8 +978,6 @@ namespace crow
         std::string date_str_;
         std::string res_body_copy_;
 
-        detail::task_timer::identifier_type task_id_;
-
         bool is_reading{};
         bool is_writing{};
         bool need_to_call_after_handlers_{};
@@ -619,10 +989,33 @@ namespace crow
 
         std::function<std::string()>& get_cached_date_str;
         detail::task_timer& task_timer_;
+        detail::task_timer::timer_node deadline_;
 
         size_t res_stream_threshold_;
 
-        std::atomic<unsigned int>& queue_length_;
+        worker_load& load_;
+        detail::connection_pool<Connection>* pool_;
+
+        // plain sockets send static files with sendfile, TLS has to encrypt every byte on the way
+        static constexpr bool use_sendfile = std::is_same<Adaptor, SocketAdaptor>::value;
+        std::ifstream static_file_;
+        std::vector<char> static_buffer_;
+#ifdef CROW_USE_SENDFILE
+        int static_fd_{-1};
+#endif
+        uint64_t stream_offset_{0};
+        uint64_t stream_remaining_{0};
+        uint64_t stream_active_bytes_{0};
+        bool streaming_{false};         // a static file, a large or a chunked body is being sent
+        bool read_after_stream_{false}; // the next request is read once it is sent
+
+        std::shared_ptr<chunked_stream> chunked_;
+        bool chunked_waiting_{false}; // for the producer, nothing is being written
+        bool chunked_framing_{true};  // false for HTTP/1.0
+        std::vector<std::string> chunked_chunks_; // taken from the stream, from chunked_next_ on not sent yet
+        size_t chunked_next_{0};
+        size_t chunked_offset_{0}; // bytes of chunked_chunks_[chunked_next_] that were sent
+        std::vector<std::string> chunked_sizes_;  // chunk size lines of the slice being written
     };
 
 } // namespace crow
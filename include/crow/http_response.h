@@ -1,4 +1,5 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <ios>
@@ -12,6 +13,7 @@
 #include "crow/logging.h"
 #include "crow/mime_types.h"
 #include "crow/returnable.h"
+#include "crow/chunked_stream.h"
 
 
 namespace crow
@@ -111,6 +113,7 @@ namespace crow
             headers = std::move(r.headers);
             completed_ = r.completed_;
             file_info = std::move(r.file_info);
+            chunked_ = std::move(r.chunked_);
             return *this;
         }
 
@@ -127,6 +130,7 @@ namespace crow
             headers.clear();
             completed_ = false;
             file_info = static_file_info{};
+            chunked_.reset();
         }
 
         /// Return a "Temporary Redirect" response.
@@ -206,6 +210,28 @@ namespace crow
             return is_alive_helper_ && is_alive_helper_();
         }
 
+        /// Send the body as it is produced rather than all at once, with chunked transfer encoding.
+
+        ///
+        /// Set the code and headers, then call end() as usual: they go out right away, followed by whatever is
+        /// written to the returned stream (after the body set so far). The response is complete once the stream
+        /// is closed. HTTP/1.0 clients get the body unframed and the connection closed after it.
+        std::shared_ptr<chunked_stream> stream_chunked()
+        {
+            chunked_ = std::make_shared<chunked_stream>();
+            set_header("Transfer-Encoding", "chunked");
+#ifdef CROW_ENABLE_COMPRESSION
+            compressed = false;
+#endif
+            return chunked_;
+        }
+
+        /// Check whether the body is sent with chunked transfer encoding.
+        bool is_chunked() const
+        {
+            return chunked_ != nullptr;
+        }
+
         /// Check whether the response has a static file defined.
         bool is_static_type()
         {
@@ -271,5 +297,6 @@ namespace crow
         std::function<void()> complete_request_handler_;
         std::function<bool()> is_alive_helper_;
         static_file_info file_info;
+        std::shared_ptr<chunked_stream> chunked_;
     };
 } // namespace crow
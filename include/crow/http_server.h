@@ -16,6 +16,8 @@
 #include "crow/http_connection.h"
 #include "crow/logging.h"
 #include "crow/task_timer.h"
+#include "crow/connection_pool.h"
+#include "crow/load_balancer.h"
 
 namespace crow
 {
@@ -25,9 +27,11 @@ namespace crow
     template<typename Handler, typename Adaptor = SocketAdaptor, typename... Middlewares>
     class Server
     {
+        using connection_t = Connection<Adaptor, Handler, Middlewares...>;
+
     public:
         Server(Handler* handler, std::string bindaddr, uint16_t port, std::string server_name = std::string("Crow/") + VERSION, std::tuple<Middlewares...>* middlewares = nullptr, uint16_t concurrency = 1, uint8_t timeout = 5, typename Adaptor::context* adaptor_ctx = nullptr):
-          acceptor_(io_service_, tcp::endpoint(boost::asio::ip::address::from_string(bindaddr), port)),
+          acceptor_(io_service_),
           signals_(io_service_),
           tick_timer_(io_service_),
           handler_(handler),
@@ -36,7 +40,7 @@ namespace crow
           server_name_(server_name),
           port_(port),
           bindaddr_(bindaddr),
-          task_queue_length_pool_(concurrency_ - 1),
+          worker_load_pool_(concurrency_ - 1),
           middlewares_(middlewares),
           adaptor_ctx_(adaptor_ctx)
         {}
@@ -47,6 +51,32 @@ namespace crow
             tick_function_ = f;
         }
 
+        /// Set how many finished connections each worker keeps for reuse, 0 allocates every connection anew. Call before run().
+        void set_connection_pool_size(size_t size)
+        {
+            connection_pool_size_ = size;
+        }
+
+        /// Set how the worker for a new connection is picked when one thread accepts them all. Call before run().
+        void set_load_balancer(load_balancer balancer)
+        {
+            load_balancer_ = std::move(balancer);
+        }
+
+        /// Let every worker accept its own connections on an SO_REUSEPORT socket, the kernel spreads them over the workers. Call before run().
+
+        ///
+        /// Only supported on Linux, elsewhere one thread keeps accepting and the load balancer is used.
+        void set_reuse_port(bool reuse_port)
+        {
+#if defined(__linux__) && defined(SO_REUSEPORT)
+            reuse_port_ = reuse_port;
+#else
+            if (reuse_port)
+                CROW_LOG_WARNING << "SO_REUSEPORT acceptors are only supported on Linux, accepting on one thread";
+#endif
+        }
+
         void on_tick()
         {
             tick_function_();
@@ -61,10 +91,25 @@ namespace crow
         void run()
         {
             uint16_t worker_thread_count = concurrency_ - 1;
+            // with SO_REUSEPORT the main acceptor only finds the port, the workers listen on it
+            open_acceptor(acceptor_, tcp::endpoint(boost::asio::ip::address::from_string(bindaddr_), port_), !reuse_port_);
+            port_ = acceptor_.local_endpoint().port();
+
             for (int i = 0; i < worker_thread_count; i++)
                 io_service_pool_.emplace_back(new boost::asio::io_service());
+            if (reuse_port_)
+            {
+                for (int i = 0; i < worker_thread_count; i++)
+                {
+                    acceptor_pool_.emplace_back(new tcp::acceptor(*io_service_pool_[i]));
+                    open_acceptor(*acceptor_pool_[i], acceptor_.local_endpoint(), true);
+                }
+                acceptor_.close();
+            }
             get_cached_date_str_pool_.resize(worker_thread_count);
             task_timer_pool_.resize(worker_thread_count);
+            for (int i = 0; i < worker_thread_count; i++)
+                connection_pool_pool_.emplace_back(connection_pool_size_ > 0 ? new detail::connection_pool<connection_t>(connection_pool_size_) : nullptr);
 
             std::vector<std::future<void>> v;
             std::atomic<int> init_count(0);
@@ -103,7 +148,10 @@ namespace crow
                         detail::task_timer task_timer(*io_service_pool_[i]);
                         task_timer.set_default_timeout(timeout_);
                         task_timer_pool_[i] = &task_timer;
-                        task_queue_length_pool_[i] = 0;
+                        worker_load_pool_[i].connections = 0;
+                        worker_load_pool_[i].active_bytes = 0;
+                        // the task timer only waits while it has timers, this keeps run() going until stop()
+                        asio::io_service::work keep_running(*io_service_pool_[i]);
 
                         init_count++;
                         while (1)
@@ -121,6 +169,9 @@ namespace crow
                                 CROW_LOG_ERROR << "Worker Crash: An uncaught exception occurred: " << e.what();
                             }
                         }
+                        // the pooled connections use this thread's task timer
+                        if (connection_pool_pool_[i])
+                            connection_pool_pool_[i]->close();
                     }));
 
             if (tick_function_ && tick_interval_.count() > 0)
@@ -134,11 +185,10 @@ namespace crow
                   });
             }
 
-            port_ = acceptor_.local_endpoint().port();
             handler_->port(port_);
 
 
-            CROW_LOG_INFO << server_name_ << " server is running at " << (handler_->ssl_used() ? "https://" : "http://") << bindaddr_ << ":" << acceptor_.local_endpoint().port() << " using " << concurrency_ << " threads";
+            CROW_LOG_INFO << server_name_ << " server is running at " << (handler_->ssl_used() ? "https://" : "http://") << bindaddr_ << ":" << port_ << " using " << concurrency_ << " threads" << (reuse_port_ ? " (SO_REUSEPORT)" : "");
             CROW_LOG_INFO << "Call `app.loglevel(crow::LogLevel::Warning)` to hide Info level logs.";
 
             signals_.async_wait(
@@ -149,7 +199,15 @@ namespace crow
             while (worker_thread_count != init_count)
                 std::this_thread::yield();
 
-            do_accept();
+            if (reuse_port_)
+            {
+                for (uint16_t i = 0; i < worker_thread_count; i++)
+                    io_service_pool_[i]->post([this, i] {
+                        do_accept_on_worker(i);
+                    });
+            }
+            else
+                do_accept();
 
             std::thread(
               [this] {
@@ -177,30 +235,58 @@ namespace crow
         }
 
     private:
+        void open_acceptor(tcp::acceptor& acceptor, const tcp::endpoint& endpoint, bool listen)
+        {
+            acceptor.open(endpoint.protocol());
+            acceptor.set_option(tcp::acceptor::reuse_address(true));
+#if defined(__linux__) && defined(SO_REUSEPORT)
+            if (reuse_port_)
+                acceptor.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+            acceptor.bind(endpoint);
+            if (listen)
+                acceptor.listen();
+        }
+
         uint16_t pick_io_service_idx()
         {
-            uint16_t min_queue_idx = 0;
+            return load_balancer_(worker_load_pool_);
+        }
+
+        /// A recycled or new connection on the given worker, counted in its load from now on.
+        connection_t* make_connection(uint16_t service_idx)
+        {
+            asio::io_service& is = *io_service_pool_[service_idx];
+            worker_load_pool_[service_idx].connections++;
+            CROW_LOG_DEBUG << &is << " {" << service_idx << "} queue length: " << worker_load_pool_[service_idx].connections;
 
-            // TODO improve load balancing
-            for (uint16_t i = 1; i < task_queue_length_pool_.size() && task_queue_length_pool_[min_queue_idx] > 0; i++)
-            // No need to check other io_services if the current one has no tasks
+            detail::connection_pool<connection_t>* pool = connection_pool_pool_[service_idx].get();
+            connection_t* p = pool ? pool->acquire() : nullptr;
+            if (!p)
             {
-                if (task_queue_length_pool_[i] < task_queue_length_pool_[min_queue_idx])
-                    min_queue_idx = i;
+                p = new connection_t(
+                  is, handler_, server_name_, middlewares_,
+                  get_cached_date_str_pool_[service_idx], *task_timer_pool_[service_idx], adaptor_ctx_, worker_load_pool_[service_idx], pool);
             }
-            return min_queue_idx;
+            return p;
+        }
+
+        /// Give back a connection whose accept failed.
+        void drop_connection(connection_t* p, uint16_t service_idx)
+        {
+            worker_load_pool_[service_idx].connections--;
+            CROW_LOG_DEBUG << io_service_pool_[service_idx].get() << " {" << service_idx << "} queue length: " << worker_load_pool_[service_idx].connections;
+            // it never started, it is as clean as a recycled one
+            detail::connection_pool<connection_t>* pool = connection_pool_pool_[service_idx].get();
+            if (!pool || !pool->release(p))
+                delete p;
         }
 
         void do_accept()
         {
             uint16_t service_idx = pick_io_service_idx();
             asio::io_service& is = *io_service_pool_[service_idx];
-            task_queue_length_pool_[service_idx]++;
-            CROW_LOG_DEBUG << &is << " {" << service_idx << "} queue length: " << task_queue_length_pool_[service_idx];
-
-            auto p = new Connection<Adaptor, Handler, Middlewares...>(
-              is, handler_, server_name_, middlewares_,
-              get_cached_date_str_pool_[service_idx], *task_timer_pool_[service_idx], adaptor_ctx_, task_queue_length_pool_[service_idx]);
+            connection_t* p = make_connection(service_idx);
 
             acceptor_.async_accept(
               p->socket(),
@@ -214,18 +300,39 @@ namespace crow
                   }
                   else
                   {
-                      task_queue_length_pool_[service_idx]--;
-                      CROW_LOG_DEBUG << &is << " {" << service_idx << "} queue length: " << task_queue_length_pool_[service_idx];
-                      delete p;
+                      drop_connection(p, service_idx);
                   }
                   do_accept();
               });
         }
 
+        /// Accept on the worker's own acceptor, the connection starts on the thread that accepted it.
+        void do_accept_on_worker(uint16_t service_idx)
+        {
+            connection_t* p = make_connection(service_idx);
+
+            acceptor_pool_[service_idx]->async_accept(
+              p->socket(),
+              [this, p, service_idx](boost::system::error_code ec) {
+                  if (!ec)
+                  {
+                      p->start();
+                  }
+                  else
+                  {
+                      drop_connection(p, service_idx);
+                  }
+                  do_accept_on_worker(service_idx);
+              });
+        }
+
     private:
         asio::io_service io_service_;
         std::vector<std::unique_ptr<asio::io_service>> io_service_pool_;
+        std::vector<std::unique_ptr<tcp::acceptor>> acceptor_pool_;
         std::vector<detail::task_timer*> task_timer_pool_;
+        std::vector<std::unique_ptr<detail::connection_pool<connection_t>>> connection_pool_pool_;
+        size_t connection_pool_size_{128};
         std::vector<std::function<std::string()>> get_cached_date_str_pool_;
         tcp::acceptor acceptor_;
         boost::asio::signal_set signals_;
@@ -237,7 +344,9 @@ namespace crow
         std::string server_name_;
         uint16_t port_;
         std::string bindaddr_;
-        std::vector<std::atomic<unsigned int>> task_queue_length_pool_;
+        std::vector<worker_load> worker_load_pool_;
+        load_balancer load_balancer_{load_balancers::least_connections()};
+        bool reuse_port_{false};
 
         std::chrono::milliseconds tick_interval_;
         std::function<void()> tick_function_;
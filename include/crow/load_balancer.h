@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace crow
+{
+    /// How busy a worker thread is, the server's load balancer picks a worker for every new connection by these.
+    struct worker_load
+    {
+        std::atomic<unsigned int> connections{0}; ///< Connections on the worker, including the one being accepted for it.
+        std::atomic<uint64_t> active_bytes{0};    ///< Response bytes the worker is writing right now.
+    };
+
+    /// Picks the index of the worker a new connection goes to. It is only called from the acceptor's thread.
+    using load_balancer = std::function<uint16_t(const std::vector<worker_load>&)>;
+
+    namespace load_balancers
+    {
+        /// The worker with the fewest connections, the scan stops at the first idle one. (Default)
+        inline load_balancer least_connections()
+        {
+            return [](const std::vector<worker_load>& workers) -> uint16_t {
+                uint16_t min_idx = 0;
+                // No need to check other workers if the current one has no connections
+                for (uint16_t i = 1; i < workers.size() && workers[min_idx].connections > 0; i++)
+                {
+                    if (workers[i].connections < workers[min_idx].connections)
+                        min_idx = i;
+                }
+                return min_idx;
+            };
+        }
+
+        /// The less busy of two random workers.
+
+        ///
+        /// Constant time however many workers there are, and the load stays almost as even as with a full scan.
+        inline load_balancer power_of_two_choices(unsigned seed = std::random_device{}())
+        {
+            std::minstd_rand random(seed);
+            return [random](const std::vector<worker_load>& workers) mutable -> uint16_t {
+                if (workers.size() < 2)
+                    return 0;
+                const uint16_t a = random() % workers.size();
+                uint16_t b = random() % (workers.size() - 1);
+                if (b >= a)
+                    b++;
+                return workers[b].connections < workers[a].connections ? b : a;
+            };
+        }
+
+        /// The worker writing the fewest response bytes, the fewest connections between equals.
+
+        ///
+        /// For servers that mix large downloads with small requests, a worker busy with a download gets no
+        /// new connections while an idle one is there, however few connections it has.
+        inline load_balancer least_active_bytes()
+        {
+            return [](const std::vector<worker_load>& workers) -> uint16_t {
+                uint16_t min_idx = 0;
+                uint64_t min_bytes = workers.empty() ? 0 : workers[0].active_bytes.load();
+                unsigned int min_connections = workers.empty() ? 0 : workers[0].connections.load();
+                for (uint16_t i = 1; i < workers.size(); i++)
+                {
+                    const uint64_t bytes = workers[i].active_bytes;
+                    const unsigned int connections = workers[i].connections;
+                    if (bytes < min_bytes || (bytes == min_bytes && connections < min_connections))
+                    {
+                        min_idx = i;
+                        min_bytes = bytes;
+                        min_connections = connections;
+                    }
+                }
+                return min_idx;
+            };
+        }
+    } // namespace load_balancers
+} // namespace crow
@@ -35,6 +35,11 @@
 #define CROW_STATIC_ENDPOINT "/static/<path>"
 #endif
 
+/* #define - the most bytes of a streamed response (a static file, a large body) a connection writes at once, before it lets the other connections of its thread go on */
+#ifndef CROW_STREAM_CHUNK_SIZE
+#define CROW_STREAM_CHUNK_SIZE (256 * 1024)
+#endif
+
 // compiler flags
 #if defined(_MSVC_LANG) && _MSVC_LANG >= 201402L
 #define CROW_CAN_USE_CPP14
@@ -79,6 +79,12 @@ namespace crow
             f(boost::system::error_code());
         }
 
+        /// Make a closed (or moved from) adaptor ready to accept another connection.
+        void reset()
+        {
+            close();
+        }
+
         tcp::socket socket_;
     };
 
@@ -88,7 +94,7 @@ namespace crow
         using context = boost::asio::ssl::context;
         using ssl_socket_t = boost::asio::ssl::stream<tcp::socket>;
         SSLAdaptor(boost::asio::io_service& io_service, context* ctx):
-          ssl_socket_(new ssl_socket_t(io_service, *ctx))
+          ssl_socket_(new ssl_socket_t(io_service, *ctx)), io_service_(&io_service), ctx_(ctx)
         {}
 
         boost::asio::ssl::stream<tcp::socket>& socket()
@@ -162,7 +168,19 @@ namespace crow
                                          });
         }
 
+        /// Make a closed (or moved from) adaptor ready to accept another connection.
+
+        ///
+        /// An SSL stream cannot be used again after its handshake, so a new one is made.
+        void reset()
+        {
+            close();
+            ssl_socket_.reset(new ssl_socket_t(*io_service_, *ctx_));
+        }
+
         std::unique_ptr<boost::asio::ssl::stream<tcp::socket>> ssl_socket_;
+        boost::asio::io_service* io_service_;
+        context* ctx_;
     };
 #endif
 } // namespace crow
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstdint>
 #include <functional>
-#include <map>
-#include <vector>
+#include <memory>
+#include <unordered_map>
 
 #include "crow/logging.h"
 
@@ -13,7 +16,15 @@ namespace crow
     namespace detail
     {
 
-        /// A class for scheduling functions to be called after a specific amount of ticks. A tick is equal to 1 second.
+        /// A class for scheduling functions to be called after a given time, on the thread of its io_service.
+
+        ///
+        /// Timers live in a hierarchical timing wheel: 4 levels of 64 slots, the first one `resolution` wide each
+        /// (100ms by default), every further level 64 times coarser. Scheduling and cancelling a timer is O(1) and
+        /// a tick only touches the slot that is due, however many timers are live. Timers further out than the
+        /// last level (about 19 days at 100ms) are clamped to it.
+        ///
+        /// The io_service's timer only runs while timers are scheduled and sleeps until the next slot that has any.
         class task_timer
         {
         public:
@@ -24,108 +35,320 @@ namespace crow
             using clock_type = std::chrono::steady_clock;
             using time_type = clock_type::time_point;
 
+            static constexpr unsigned slot_bits = 6;
+            static constexpr unsigned slots = 1u << slot_bits;
+            static constexpr unsigned levels = 4;
+            static constexpr std::uint64_t slot_mask = slots - 1;
+
         public:
-            task_timer(boost::asio::io_service& io_service):
-              io_service_(io_service), deadline_timer_(io_service_)
+            /// A timer that is embedded in the object it belongs to, scheduling and cancelling it allocates nothing.
+
+            ///
+            /// The callback gets `context` back. A node must be cancelled (or have fired) before it is destroyed.
+            struct timer_node
             {
-                deadline_timer_.expires_from_now(boost::posix_time::seconds(1));
-                deadline_timer_.async_wait(
-                  std::bind(&task_timer::tick_handler, this, std::placeholders::_1));
+                timer_node() = default;
+                timer_node(void (*fire_callback)(void*), void* fire_context):
+                  fire(fire_callback), context(fire_context)
+                {}
+                timer_node(const timer_node&) = delete;
+                timer_node& operator=(const timer_node&) = delete;
+
+                bool linked() const { return next != nullptr; }
+
+                void (*fire)(void*){nullptr};
+                void* context{nullptr};
+
+            private:
+                friend class task_timer;
+
+                void unlink()
+                {
+                    prev->next = next;
+                    next->prev = prev;
+                    prev = next = nullptr;
+                }
+
+                timer_node* prev{nullptr};
+                timer_node* next{nullptr};
+                std::uint64_t expiry{0}; // in ticks
+            };
+
+            task_timer(boost::asio::io_service& io_service, std::chrono::milliseconds resolution = std::chrono::milliseconds(100)):
+              io_service_(io_service), deadline_timer_(io_service_), resolution_(std::max(resolution, std::chrono::milliseconds(1))), start_(clock_type::now())
+            {
+                for (auto& level : wheel_)
+                {
+                    for (auto& slot : level)
+                        slot.prev = slot.next = &slot;
+                }
             }
 
-            ~task_timer() { deadline_timer_.cancel(); }
+            ~task_timer()
+            {
+                deadline_timer_.cancel();
+                // nodes that are still scheduled are left unlinked, cancelling them later does nothing
+                for (auto& level : wheel_)
+                {
+                    for (auto& slot : level)
+                    {
+                        while (slot.next != &slot)
+                            slot.next->unlink();
+                    }
+                }
+                owned_.clear();
+            }
+
+            /// Schedule an embedded timer after the default timeout, rescheduling it if it is already scheduled.
+            void schedule(timer_node& node)
+            {
+                schedule(node, std::chrono::seconds(default_timeout_));
+            }
+
+            /// Schedule an embedded timer after the given time, rescheduling it if it is already scheduled.
+
+            ///
+            /// It fires between `timeout` and `timeout` plus one resolution from now.
+            void schedule(timer_node& node, std::chrono::milliseconds timeout)
+            {
+                if (node.linked())
+                    node.unlink();
+                else
+                    ++live_;
+                // the wheel only catches up with the clock when it runs, count from the clock instead
+                const std::uint64_t now_tick = tick_of(clock_type::now());
+                if (live_ == 1 && now_tick > current_tick_)
+                    current_tick_ = now_tick;
+                const auto ticks = (timeout.count() + resolution_.count() - 1) / resolution_.count();
+                node.expiry = now_tick + static_cast<std::uint64_t>(std::max<std::int64_t>(ticks, 1));
+                insert(node);
+                // the wait in progress is early enough for any timer due no sooner than it
+                if (!armed_ || start_ + resolution_ * static_cast<std::int64_t>(node.expiry) < armed_due_)
+                    arm();
+            }
+
+            /// Cancel an embedded timer, nothing happens if it is not scheduled.
+            void cancel(timer_node& node)
+            {
+                if (!node.linked())
+                    return;
+                node.unlink();
+                --live_;
+            }
 
             void cancel(identifier_type id)
             {
-                tasks_.erase(id);
+                auto it = owned_.find(id);
+                if (it == owned_.end())
+                    return;
+                cancel(it->second->node);
+                owned_.erase(it);
                 CROW_LOG_DEBUG << "task_timer cancelled: " << this << ' ' << id;
             }
 
-            /// Schedule the given task to be executed after the default amount of ticks.
+            /// Schedule the given task to be executed after the default amount of seconds.
 
             ///
-            /// \return identifier_type Used to cancel the thread.
+            /// \return identifier_type Used to cancel the task.
             /// It is not bound to this task_timer instance and in some cases could lead to
             /// undefined behavior if used with other task_timer objects or after the task
             /// has been successfully executed.
             identifier_type schedule(const task_type& task)
             {
-                tasks_.insert(
-                  {++highest_id_,
-                   {clock_type::now() + std::chrono::seconds(get_default_timeout()),
-                    task}});
-                CROW_LOG_DEBUG << "task_timer scheduled: " << this << ' ' << highest_id_;
-                return highest_id_;
+                return schedule(task, default_timeout_);
             }
 
             /// Schedule the given task to be executed after the given time.
 
             ///
-            /// \param timeout The amount of ticks (seconds) to wait before execution.
+            /// \param timeout The amount of seconds to wait before execution.
             ///
-            /// \return identifier_type Used to cancel the thread.
+            /// \return identifier_type Used to cancel the task.
             /// It is not bound to this task_timer instance and in some cases could lead to
             /// undefined behavior if used with other task_timer objects or after the task
             /// has been successfully executed.
             identifier_type schedule(const task_type& task, std::uint8_t timeout)
             {
-                tasks_.insert({++highest_id_,
-                               {clock_type::now() + std::chrono::seconds(timeout), task}});
-                CROW_LOG_DEBUG << "task_timer scheduled: " << this << ' ' << highest_id_;
-                return highest_id_;
+                const identifier_type id = ++highest_id_;
+                std::unique_ptr<owned_task> owned(new owned_task(this, id, task));
+                schedule(owned->node, std::chrono::seconds(timeout));
+                owned_[id] = std::move(owned);
+                CROW_LOG_DEBUG << "task_timer scheduled: " << this << ' ' << id;
+                return id;
             }
 
             /// Set the default timeout for this task_timer instance. (Default: 5)
 
             ///
-            /// \param timeout The amount of ticks (seconds) to wait before execution.
+            /// \param timeout The amount of seconds to wait before execution.
             void set_default_timeout(std::uint8_t timeout) { default_timeout_ = timeout; }
 
             /// Get the default timeout. (Default: 5)
             std::uint8_t get_default_timeout() const { return default_timeout_; }
 
+            std::chrono::milliseconds get_resolution() const { return resolution_; }
+
+            /// Number of scheduled timers.
+            size_t size() const { return live_; }
+
+            /// Run every timer that is due at `now`, the io_service's timer calls it on its own.
+            void process(time_type now)
+            {
+                const std::uint64_t target = tick_of(now);
+                while (current_tick_ < target && live_ > 0)
+                {
+                    ++current_tick_;
+                    // a new lap of a level brings the next slot of the level above down
+                    for (unsigned level = 1; level < levels && ((current_tick_ >> (slot_bits * (level - 1))) & slot_mask) == 0; ++level)
+                        cascade(level, (current_tick_ >> (slot_bits * level)) & slot_mask);
+                    run_slot(wheel_[0][current_tick_ & slot_mask]);
+                }
+                if (live_ == 0 && current_tick_ < target)
+                    current_tick_ = target;
+            }
+
         private:
-            void process_tasks()
+            struct owned_task
             {
-                time_type current_time = clock_type::now();
-                std::vector<identifier_type> finished_tasks;
+                owned_task(task_timer* timer, identifier_type task_id, const task_type& f):
+                  node(&owned_task::fire_owned, this), owner(timer), id(task_id), task(f)
+                {}
 
-                for (const auto& task : tasks_)
+                static void fire_owned(void* context)
                 {
-                    if (task.second.first < current_time)
-                    {
-                        (task.second.second)();
-                        finished_tasks.push_back(task.first);
-                        CROW_LOG_DEBUG << "task_timer called: " << this << ' ' << task.first;
-                    }
+                    auto self = static_cast<owned_task*>(context);
+                    auto owner = self->owner;
+                    auto it = owner->owned_.find(self->id);
+                    // keep it alive while it runs, the task may cancel its own id
+                    std::unique_ptr<owned_task> keep = std::move(it->second);
+                    owner->owned_.erase(it);
+                    CROW_LOG_DEBUG << "task_timer called: " << owner << ' ' << keep->id;
+                    keep->task();
                 }
 
-                for (const auto& task : finished_tasks)
-                    tasks_.erase(task);
+                timer_node node;
+                task_timer* owner;
+                identifier_type id;
+                task_type task;
+            };
 
-                // If no task is currently scheduled, reset the issued ids back to 0.
-                if (tasks_.empty()) highest_id_ = 0;
+            std::uint64_t tick_of(time_type time) const
+            {
+                return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time - start_).count() / resolution_.count());
             }
 
-            void tick_handler(const boost::system::error_code& ec)
+            void insert(timer_node& node)
             {
-                if (ec) return;
+                std::uint64_t delta = node.expiry - current_tick_;
+                const std::uint64_t span = std::uint64_t(1) << (slot_bits * levels);
+                if (node.expiry < current_tick_)
+                    delta = 0, node.expiry = current_tick_;
+                else if (delta >= span)
+                    delta = span - 1, node.expiry = current_tick_ + delta;
+                unsigned level = 0;
+                while (level + 1 < levels && delta >= (std::uint64_t(1) << (slot_bits * (level + 1))))
+                    ++level;
+                timer_node& slot = wheel_[level][(node.expiry >> (slot_bits * level)) & slot_mask];
+                node.prev = slot.prev;
+                node.next = &slot;
+                slot.prev->next = &node;
+                slot.prev = &node;
+            }
+
+            void cascade(unsigned level, std::uint64_t index)
+            {
+                timer_node& slot = wheel_[level][index];
+                timer_node pending;
+                take(slot, pending);
+                while (pending.next != &pending)
+                {
+                    timer_node* node = pending.next;
+                    node->unlink();
+                    insert(*node);
+                }
+            }
+
+            void run_slot(timer_node& slot)
+            {
+                // callbacks may cancel or reschedule any timer, including the ones still pending here
+                timer_node pending;
+                take(slot, pending);
+                while (pending.next != &pending)
+                {
+                    timer_node* node = pending.next;
+                    node->unlink();
+                    --live_;
+                    node->fire(node->context);
+                }
+            }
 
-                process_tasks();
+            /// Move every node of slot to the list headed by pending.
+            static void take(timer_node& slot, timer_node& pending)
+            {
+                if (slot.next == &slot)
+                {
+                    pending.prev = pending.next = &pending;
+                    return;
+                }
+                pending.next = slot.next;
+                pending.prev = slot.prev;
+                pending.next->prev = &pending;
+                pending.prev->next = &pending;
+                slot.prev = slot.next = &slot;
+            }
+
+            /// Ticks until the next slot with timers, or the next lap of the first level if it is empty.
+            std::uint64_t ticks_to_next() const
+            {
+                for (std::uint64_t ahead = 1; ahead <= slots; ++ahead)
+                {
+                    const std::uint64_t tick = current_tick_ + ahead;
+                    const timer_node& slot = wheel_[0][tick & slot_mask];
+                    if (slot.next != &slot || (tick & slot_mask) == 0)
+                        return ahead;
+                }
+                return slots;
+            }
 
-                deadline_timer_.expires_from_now(boost::posix_time::seconds(1));
+            void arm()
+            {
+                if (live_ == 0)
+                    return;
+                const time_type due = start_ + resolution_ * static_cast<std::int64_t>(current_tick_ + ticks_to_next());
+                if (armed_ && armed_due_ <= due)
+                    return;
+                armed_ = true;
+                armed_due_ = due;
+                deadline_timer_.expires_from_now(boost::posix_time::microseconds(
+                  std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(due - clock_type::now()).count(), 0)));
                 deadline_timer_.async_wait(
                   std::bind(&task_timer::tick_handler, this, std::placeholders::_1));
             }
 
+            void tick_handler(const boost::system::error_code& ec)
+            {
+                // a timer that was moved earlier cancels the wait it replaces
+                if (ec) return;
+
+                armed_ = false;
+                process(clock_type::now());
+                arm();
+            }
+
         private:
             std::uint8_t default_timeout_{5};
             boost::asio::io_service& io_service_;
             boost::asio::deadline_timer deadline_timer_;
-            std::map<identifier_type, std::pair<time_type, task_type>> tasks_;
+            std::chrono::milliseconds resolution_;
+            time_type start_;
+            std::uint64_t current_tick_{0}; // the last tick that ran
+            size_t live_{0};
+            bool armed_{false};
+            time_type armed_due_;
+            std::array<std::array<timer_node, slots>, levels> wheel_;
 
-            // A continuosly increasing number to be issued to threads to identify them.
-            // If no tasks are scheduled, it will be reset to 0.
+            // tasks scheduled through std::function, they own their node
+            std::unordered_map<identifier_type, std::unique_ptr<owned_task>> owned_;
             identifier_type highest_id_{0};
         };
     } // namespace detail
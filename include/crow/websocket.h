@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <memory>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/array.hpp>
 #include "crow/socket_adaptors.h"
@@ -22,11 +24,15 @@ namespace crow
         struct connection
         {
             virtual void send_binary(const std::string& msg) = 0;
+            /// Send a binary message without copying it, the same buffer can be queued on many connections.
+            virtual void send_binary_shared(std::shared_ptr<const std::string> msg) = 0;
             virtual void send_text(const std::string& msg) = 0;
             virtual void send_ping(const std::string& msg) = 0;
             virtual void send_pong(const std::string& msg) = 0;
             virtual void close(const std::string& msg = "quit") = 0;
             virtual std::string get_remote_ip() = 0;
+            /// Bytes passed to send_* that have not been written to the socket yet, can be called from any thread.
+            virtual size_t queued_bytes() const = 0;
             virtual ~connection() {}
 
             void userdata(void* u) { userdata_ = u; }
@@ -125,12 +131,7 @@ namespace crow
             /// Usually invoked to check if the other point is still online.
             void send_ping(const std::string& msg) override
             {
-                dispatch([this, msg] {
-                    auto header = build_header(0x9, msg.size());
-                    write_buffers_.emplace_back(std::move(header));
-                    write_buffers_.emplace_back(msg);
-                    do_write();
-                });
+                send_data(0x9, msg);
             }
 
             /// Send a "Pong" message.
@@ -139,21 +140,28 @@ namespace crow
             /// Usually automatically invoked as a response to a "Ping" message.
             void send_pong(const std::string& msg) override
             {
-                dispatch([this, msg] {
-                    auto header = build_header(0xA, msg.size());
-                    write_buffers_.emplace_back(std::move(header));
-                    write_buffers_.emplace_back(msg);
-                    do_write();
-                });
+                send_data(0xA, msg);
             }
 
             /// Send a binary encoded message.
             void send_binary(const std::string& msg) override
             {
-                dispatch([this, msg] {
-                    auto header = build_header(2, msg.size());
+                send_data(2, msg);
+            }
+
+            /// Send a binary encoded message that is shared with other connections.
+
+            ///
+            /// Only the frame header is allocated per connection, the payload stays alive until every connection has written it.
+            void send_binary_shared(std::shared_ptr<const std::string> msg) override
+            {
+                std::string header = build_header(2, msg->size());
+                queued_bytes_ += header.size() + msg->size();
+                dispatch([this, header, msg]() mutable {
+                    if (destroying_)
+                        return;
                     write_buffers_.emplace_back(std::move(header));
-                    write_buffers_.emplace_back(msg);
+                    write_buffers_.emplace_back(std::move(msg));
                     do_write();
                 });
             }
@@ -161,12 +169,7 @@ namespace crow
             /// Send a plaintext message.
             void send_text(const std::string& msg) override
             {
-                dispatch([this, msg] {
-                    auto header = build_header(1, msg.size());
-                    write_buffers_.emplace_back(std::move(header));
-                    write_buffers_.emplace_back(msg);
-                    do_write();
-                });
+                send_data(1, msg);
             }
 
             /// Send a close signal.
@@ -175,17 +178,21 @@ namespace crow
             /// Sets a flag to destroy the object once the message is sent.
             void close(const std::string& msg) override
             {
-                dispatch([this, msg] {
+                std::string header = build_header(0x8, msg.size());
+                std::shared_ptr<const std::string> payload = std::make_shared<std::string>(msg);
+                queued_bytes_ += header.size() + msg.size();
+                dispatch([this, header, payload]() mutable {
+                    if (destroying_)
+                        return;
                     has_sent_close_ = true;
                     if (has_recv_close_ && !is_close_handler_called_)
                     {
                         is_close_handler_called_ = true;
                         if (close_handler_)
-                            close_handler_(*this, msg);
+                            close_handler_(*this, *payload);
                     }
-                    auto header = build_header(0x8, msg.size());
                     write_buffers_.emplace_back(std::move(header));
-                    write_buffers_.emplace_back(msg);
+                    write_buffers_.emplace_back(std::move(payload));
                     do_write();
                 });
             }
@@ -195,7 +202,46 @@ namespace crow
                 return adaptor_.remote_endpoint().address().to_string();
             }
 
+            size_t queued_bytes() const override
+            {
+                return queued_bytes_;
+            }
+
         protected:
+            /// A queued write, either owned by this connection or shared with others.
+            struct write_buffer
+            {
+                write_buffer(std::string&& data):
+                  owned(std::move(data))
+                {}
+                write_buffer(std::shared_ptr<const std::string>&& data):
+                  shared(std::move(data))
+                {}
+
+                const std::string& data() const
+                {
+                    return shared ? *shared : owned;
+                }
+
+                std::string owned;
+                std::shared_ptr<const std::string> shared;
+            };
+
+            /// Queue a message with its header, the message is copied once into a shared buffer.
+            void send_data(int opcode, const std::string& msg)
+            {
+                std::string header = build_header(opcode, msg.size());
+                std::shared_ptr<const std::string> payload = std::make_shared<std::string>(msg);
+                queued_bytes_ += header.size() + msg.size();
+                dispatch([this, header, payload]() mutable {
+                    if (destroying_)
+                        return;
+                    write_buffers_.emplace_back(std::move(header));
+                    write_buffers_.emplace_back(std::move(payload));
+                    do_write();
+                });
+            }
+
             /// Generate the websocket headers using an opcode and the message size (in bytes).
             std::string build_header(int opcode, size_t size)
             {
@@ -230,10 +276,11 @@ namespace crow
                                             "Upgrade: websocket\r\n"
                                             "Connection: Upgrade\r\n"
                                             "Sec-WebSocket-Accept: ";
-                write_buffers_.emplace_back(header);
+                queued_bytes_ += header.size() + hello.size() + 2 * crlf.size();
+                write_buffers_.emplace_back(std::string(header));
                 write_buffers_.emplace_back(std::move(hello));
-                write_buffers_.emplace_back(crlf);
-                write_buffers_.emplace_back(crlf);
+                write_buffers_.emplace_back(std::string(crlf));
+                write_buffers_.emplace_back(std::string(crlf));
                 do_write();
                 if (open_handler_)
                     open_handler_(*this);
@@ -572,14 +619,17 @@ namespace crow
                     sending_buffers_.swap(write_buffers_);
                     std::vector<boost::asio::const_buffer> buffers;
                     buffers.reserve(sending_buffers_.size());
+                    size_t sending_bytes = 0;
                     for (auto& s : sending_buffers_)
                     {
-                        buffers.emplace_back(boost::asio::buffer(s));
+                        buffers.emplace_back(boost::asio::buffer(s.data()));
+                        sending_bytes += s.data().size();
                     }
                     boost::asio::async_write(
                       adaptor_.socket(), buffers,
-                      [&](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
+                      [this, sending_bytes](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
                           sending_buffers_.clear();
+                          queued_bytes_ -= sending_bytes;
                           if (!ec && !close_connection_)
                           {
                               if (!write_buffers_.empty())
@@ -603,15 +653,21 @@ namespace crow
                 if (!is_close_handler_called_)
                     if (close_handler_)
                         close_handler_(*this, "uncleanly");
-                if (sending_buffers_.empty() && !is_reading)
-                    delete this;
+                if (sending_buffers_.empty() && !is_reading && !destroying_)
+                {
+                    // sends that other threads queued before the close handler returned still point at this,
+                    // they run first and are dropped
+                    destroying_ = true;
+                    post([this] { delete this; });
+                }
             }
 
         private:
             Adaptor adaptor_;
 
-            std::vector<std::string> sending_buffers_;
-            std::vector<std::string> write_buffers_;
+            std::vector<write_buffer> sending_buffers_;
+            std::vector<write_buffer> write_buffers_;
+            std::atomic<size_t> queued_bytes_{0};
 
             boost::array<char, 4096> buffer_;
             bool is_binary_;
@@ -630,6 +686,7 @@ namespace crow
             bool error_occured_{false};
             bool pong_received_{false};
             bool is_close_handler_called_{false};
+            bool destroying_{false};
 
             std::function<void(crow::websocket::connection&)> open_handler_;
             std::function<void(crow::websocket::connection&, const std::string&, bool)> message_handler_;